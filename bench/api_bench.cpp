@@ -0,0 +1,410 @@
+
+// Compares sqxx calls with the equivalent loops over the sqlite C API.
+//
+// Each benchmark reports a "capi" variant and one or more "sqxx" variants,
+// plus the overhead of each sqxx variant in percent of the C API time.
+//
+// Built a second time as api_bench_inline with SQXX_HEADER_ONLY, linked
+// against a library built the same way, where the sqxx variants are reported
+// with an "_inline" suffix.
+
+#include "sqxx.hpp"
+#include "bench.hpp"
+#include <sqlite3.h>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+namespace {
+
+// Keeps the compiler from optimizing away the values read in benchmarks
+volatile int64_t sink;
+
+#if defined(SQXX_HEADER_ONLY)
+const std::string variant_suffix = "_inline";
+#else
+const std::string variant_suffix = "";
+#endif
+
+// Number of rows in the scan table
+const int rows = 10000;
+const int blob_size = 16 * 1024;
+
+class api_bench {
+private:
+	std::string name;
+	uint64_t ops;
+	double capi_seconds;
+
+public:
+	api_bench(const std::string &name_arg, uint64_t ops_arg)
+		: name(name_arg), ops(ops_arg), capi_seconds(0) {
+	}
+
+	template<typename F>
+	void capi(F fun) {
+		bench::stopwatch sw;
+		fun();
+		capi_seconds = sw.seconds();
+		bench::report(name, "capi", ops, capi_seconds);
+	}
+
+	template<typename F>
+	void run(const std::string &variant, F fun) {
+		bench::stopwatch sw;
+		fun();
+		double seconds = sw.seconds();
+		bench::report(name, variant + variant_suffix, ops, seconds);
+		if (capi_seconds > 0)
+			bench::report_metric(name, variant + variant_suffix, "overhead_percent", (seconds / capi_seconds - 1) * 100);
+	}
+};
+
+sqlite3_stmt* raw_prepare(sqxx::connection &conn, const char *sql) {
+	sqlite3_stmt *stmt = nullptr;
+	sqlite3_prepare_v2(conn.raw(), sql, -1, &stmt, nullptr);
+	return stmt;
+}
+
+int addone(int i) {
+	return i + 1;
+}
+
+extern "C" void capi_addone(sqlite3_context *ctx, int, sqlite3_value **argv) {
+	sqlite3_result_int(ctx, sqlite3_value_int(argv[0]) + 1);
+}
+
+extern "C" void capi_sum_step(sqlite3_context *ctx, int, sqlite3_value **argv) {
+	int64_t *sum = static_cast<int64_t*>(sqlite3_aggregate_context(ctx, sizeof(int64_t)));
+	if (sum)
+		*sum += sqlite3_value_int(argv[0]);
+}
+
+extern "C" void capi_sum_final(sqlite3_context *ctx) {
+	int64_t *sum = static_cast<int64_t*>(sqlite3_aggregate_context(ctx, 0));
+	sqlite3_result_int64(ctx, (sum ? *sum : 0));
+}
+
+extern "C" int capi_progress(void*) {
+	sink = sink + 1;
+	return 0;
+}
+
+extern "C" void capi_update(void*, int, const char*, const char*, sqlite3_int64 rowid) {
+	sink = sink + rowid;
+}
+
+bool count_progress() {
+	sink = sink + 1;
+	return false;
+}
+
+void count_update(int, const char*, const char*, int64_t rowid) {
+	sink = sink + rowid;
+}
+
+void bench_prepare(sqxx::connection &conn, int n) {
+	const char *sql = "select v from items where id = ?";
+	api_bench b("prepare", n);
+	b.capi([&] {
+		for (int i = 0; i < n; ++i) {
+			sqlite3_finalize(raw_prepare(conn, sql));
+		}
+	});
+	b.run("sqxx", [&] {
+		for (int i = 0; i < n; ++i) {
+			conn.prepare(sql);
+		}
+	});
+}
+
+template<typename T, typename CapiBind>
+void bench_bind(sqxx::connection &conn, const char *name, T value, CapiBind capi_bind, int n) {
+	sqlite3_stmt *stmt = raw_prepare(conn, "select :v");
+	sqxx::statement st = conn.prepare("select :v");
+	api_bench b(name, n);
+	b.capi([&] {
+		for (int i = 0; i < n; ++i) {
+			capi_bind(stmt, 1, value);
+		}
+	});
+	b.run("sqxx", [&] {
+		for (int i = 0; i < n; ++i) {
+			st.bind(0, value);
+		}
+	});
+	b.run("sqxx_named", [&] {
+		for (int i = 0; i < n; ++i) {
+			st.bind(":v", value);
+		}
+	});
+	sqlite3_finalize(stmt);
+}
+
+void bench_binds(sqxx::connection &conn, int n) {
+	std::string text(32, 'x');
+	std::string blob_data(blob_size, 'b');
+	sqxx::blob blob_value(blob_data.data(), blob_data.size());
+	bench_bind(conn, "bind_int", 42, [](sqlite3_stmt *s, int i, int v) {
+		sqlite3_bind_int(s, i, v);
+	}, n);
+	bench_bind(conn, "bind_int64", int64_t(3000000000LL), [](sqlite3_stmt *s, int i, int64_t v) {
+		sqlite3_bind_int64(s, i, v);
+	}, n);
+	bench_bind(conn, "bind_double", 4.5, [](sqlite3_stmt *s, int i, double v) {
+		sqlite3_bind_double(s, i, v);
+	}, n);
+	bench_bind(conn, "bind_cstr", text.c_str(), [](sqlite3_stmt *s, int i, const char *v) {
+		sqlite3_bind_text(s, i, v, -1, SQLITE_TRANSIENT);
+	}, n);
+	bench_bind(conn, "bind_string", text, [](sqlite3_stmt *s, int i, const std::string &v) {
+		sqlite3_bind_text(s, i, v.data(), v.size(), SQLITE_TRANSIENT);
+	}, n);
+	bench_bind(conn, "bind_blob", blob_value, [](sqlite3_stmt *s, int i, const sqxx::blob &v) {
+		sqlite3_bind_blob(s, i, v.data, v.length, SQLITE_TRANSIENT);
+	}, n / 10);
+}
+
+void bench_step(sqxx::connection &conn, int n) {
+	const char *sql = "select id from items";
+	int scans = n / rows;
+	sqlite3_stmt *stmt = raw_prepare(conn, sql);
+	sqxx::statement st = conn.prepare(sql);
+	api_bench b("step", static_cast<uint64_t>(scans) * rows);
+	b.capi([&] {
+		for (int i = 0; i < scans; ++i) {
+			while (sqlite3_step(stmt) == SQLITE_ROW) {
+			}
+			sqlite3_reset(stmt);
+		}
+	});
+	b.run("sqxx", [&] {
+		for (int i = 0; i < scans; ++i) {
+			for (st.run(); !st.done(); st.next_row()) {
+			}
+			st.reset();
+		}
+	});
+	b.run("sqxx_try_step", [&] {
+		for (int i = 0; i < scans; ++i) {
+			while (st.try_step() == sqxx::ROW) {
+			}
+			st.reset();
+		}
+	});
+	b.run("sqxx_iterator", [&] {
+		for (int i = 0; i < scans; ++i) {
+			st.run();
+			for (auto r : st) {
+				sqxx::unused(r);
+			}
+			st.reset();
+		}
+	});
+	sqlite3_finalize(stmt);
+}
+
+// Reduce a value to a number for `sink`
+int64_t bench_value(int v) { return v; }
+int64_t bench_value(int64_t v) { return v; }
+int64_t bench_value(double v) { return static_cast<int64_t>(v); }
+int64_t bench_value(const char *v) { return v[0]; }
+int64_t bench_value(const std::string &v) { return v.size(); }
+int64_t bench_value(const sqxx::blob &v) { return v.length; }
+
+template<typename T, typename CapiVal>
+void bench_val(sqxx::connection &conn, const char *name, const char *sql, CapiVal capi_val, int n) {
+	sqlite3_stmt *stmt = raw_prepare(conn, sql);
+	sqlite3_step(stmt);
+	sqxx::statement st = conn.prepare(sql);
+	st.run();
+	api_bench b(name, n);
+	b.capi([&] {
+		for (int i = 0; i < n; ++i) {
+			sink = sink + capi_val(stmt, 0);
+		}
+	});
+	b.run("sqxx", [&] {
+		for (int i = 0; i < n; ++i) {
+			sink = sink + bench_value(st.val<T>(0));
+		}
+	});
+	b.run("sqxx_named", [&] {
+		for (int i = 0; i < n; ++i) {
+			sink = sink + bench_value(st.val<T>("c"));
+		}
+	});
+	sqlite3_finalize(stmt);
+}
+
+void bench_vals(sqxx::connection &conn, int n) {
+	bench_val<int>(conn, "val_int", "select 42 as c", [](sqlite3_stmt *s, int i) -> int64_t {
+		return sqlite3_column_int(s, i);
+	}, n);
+	bench_val<int64_t>(conn, "val_int64", "select 3000000000 as c", [](sqlite3_stmt *s, int i) -> int64_t {
+		return sqlite3_column_int64(s, i);
+	}, n);
+	bench_val<double>(conn, "val_double", "select 4.5 as c", [](sqlite3_stmt *s, int i) -> int64_t {
+		return static_cast<int64_t>(sqlite3_column_double(s, i));
+	}, n);
+	bench_val<const char*>(conn, "val_cstr", "select 'abcdefgh' as c", [](sqlite3_stmt *s, int i) -> int64_t {
+		return reinterpret_cast<const char*>(sqlite3_column_text(s, i))[0];
+	}, n);
+	bench_val<std::string>(conn, "val_string", "select 'abcdefgh' as c", [](sqlite3_stmt *s, int i) -> int64_t {
+		std::string v(reinterpret_cast<const char*>(sqlite3_column_text(s, i)), sqlite3_column_bytes(s, i));
+		return v.size();
+	}, n);
+	bench_val<sqxx::blob>(conn, "val_blob", "select zeroblob(16384) as c", [](sqlite3_stmt *s, int i) -> int64_t {
+		const void *data = sqlite3_column_blob(s, i);
+		return (data ? sqlite3_column_bytes(s, i) : 0);
+	}, n);
+}
+
+// Runs full scans calling the given SQL expression on each row
+void scan(sqxx::connection &conn, const std::string &expr, int scans) {
+	std::string sql = "select " + expr + " from items";
+	sqlite3_stmt *stmt = raw_prepare(conn, sql.c_str());
+	for (int i = 0; i < scans; ++i) {
+		while (sqlite3_step(stmt) == SQLITE_ROW) {
+			sink = sink + sqlite3_column_int64(stmt, 0);
+		}
+		sqlite3_reset(stmt);
+	}
+	sqlite3_finalize(stmt);
+}
+
+void bench_functions(sqxx::connection &conn, int n) {
+	int scans = std::max(1, n / rows);
+	sqlite3_create_function_v2(conn.raw(), "capi_addone", 1, SQLITE_UTF8, nullptr,
+			capi_addone, nullptr, nullptr, nullptr);
+	conn.create_function("callable_addone", [](int i) { return i + 1; });
+	conn.create_function<int (int), addone>("static_addone");
+
+	api_bench b("function", static_cast<uint64_t>(scans) * rows);
+	b.capi([&] { scan(conn, "capi_addone(v)", scans); });
+	b.run("sqxx_callable", [&] { scan(conn, "callable_addone(v)", scans); });
+	b.run("sqxx_static", [&] { scan(conn, "static_addone(v)", scans); });
+
+	sqlite3_create_function_v2(conn.raw(), "capi_sum", 1, SQLITE_UTF8, nullptr,
+			nullptr, capi_sum_step, capi_sum_final, nullptr);
+	conn.create_aggregate("sqxx_sum", int64_t(0), [](int64_t &sum, int v) { sum += v; });
+
+	api_bench a("aggregate", static_cast<uint64_t>(scans) * rows);
+	a.capi([&] { scan(conn, "capi_sum(v)", scans); });
+	a.run("sqxx", [&] { scan(conn, "sqxx_sum(v)", scans); });
+}
+
+// Updates all rows in one transaction, calling the update hook for each row
+void update_all(sqxx::connection &conn, int updates) {
+	sqlite3_exec(conn.raw(), "begin", nullptr, nullptr, nullptr);
+	sqlite3_stmt *stmt = raw_prepare(conn, "update items set v = v + 1");
+	for (int i = 0; i < updates; ++i) {
+		sqlite3_step(stmt);
+		sqlite3_reset(stmt);
+	}
+	sqlite3_finalize(stmt);
+	sqlite3_exec(conn.raw(), "rollback", nullptr, nullptr, nullptr);
+}
+
+void bench_hooks(sqxx::connection &conn, int n) {
+	// The progress handler is called every 4 VM instructions while scanning
+	int scans = std::max(1, n / rows);
+	auto scan_v = [&] { scan(conn, "v", scans); };
+
+	api_bench p("progress_hook", static_cast<uint64_t>(scans) * rows);
+	sqlite3_progress_handler(conn.raw(), 4, capi_progress, nullptr);
+	p.capi(scan_v);
+	conn.set_progress_handler(4, sqxx::connection::progress_handler_t(count_progress));
+	p.run("sqxx_function", scan_v);
+	conn.set_progress_handler(4, [] { sink = sink + 1; return false; });
+	p.run("sqxx_callable", scan_v);
+	conn.set_progress_handler<bool (), count_progress>(4);
+	p.run("sqxx_static", scan_v);
+	conn.set_progress_handler();
+
+	int updates = std::max(1, n / rows);
+	auto update_v = [&] { update_all(conn, updates); };
+
+	api_bench u("update_hook", static_cast<uint64_t>(updates) * rows);
+	sqlite3_update_hook(conn.raw(), capi_update, nullptr);
+	u.capi(update_v);
+	conn.set_update_handler(sqxx::connection::update_handler_t(count_update));
+	u.run("sqxx_function", update_v);
+	conn.set_update_handler([](int, const char*, const char*, int64_t rowid) { sink = sink + rowid; });
+	u.run("sqxx_callable", update_v);
+	conn.set_update_handler<void (int, const char*, const char*, int64_t), count_update>();
+	u.run("sqxx_static", update_v);
+	conn.set_update_handler();
+}
+
+void bench_blob_rows(sqxx::connection &conn, int n) {
+	// Writing and reading whole blob rows. sqxx has no public wrapper for
+	// incremental blob I/O (sqlite3_blob_open()), so values are streamed
+	// through statements.
+	conn.exec("create table blobs (id integer primary key, b blob)");
+	std::string data(blob_size, 'b');
+	int count = std::max(1, n / 100);
+
+	sqlite3_stmt *ins = raw_prepare(conn, "insert or replace into blobs (id, b) values (?, ?)");
+	sqlite3_stmt *sel = raw_prepare(conn, "select b from blobs where id = ?");
+	sqxx::statement sins = conn.prepare("insert or replace into blobs (id, b) values (?, ?)");
+	sqxx::statement ssel = conn.prepare("select b from blobs where id = ?");
+
+	api_bench b("blob_roundtrip", count);
+	b.capi([&] {
+		for (int i = 0; i < count; ++i) {
+			sqlite3_bind_int(ins, 1, i % 100);
+			sqlite3_bind_blob(ins, 2, data.data(), data.size(), SQLITE_STATIC);
+			sqlite3_step(ins);
+			sqlite3_reset(ins);
+			sqlite3_bind_int(sel, 1, i % 100);
+			sqlite3_step(sel);
+			sink = sink + sqlite3_column_bytes(sel, 0) + *static_cast<const char*>(sqlite3_column_blob(sel, 0));
+			sqlite3_reset(sel);
+		}
+	});
+	b.run("sqxx", [&] {
+		for (int i = 0; i < count; ++i) {
+			sins.bind(0, i % 100);
+			sins.bind(1, sqxx::blob(data.data(), data.size()), false);
+			sins.run();
+			sins.reset();
+			ssel.bind(0, i % 100);
+			ssel.run();
+			sqxx::blob v = ssel.val<sqxx::blob>(0);
+			sink = sink + v.length + *static_cast<const char*>(v.data);
+			ssel.reset();
+		}
+	});
+	sqlite3_finalize(ins);
+	sqlite3_finalize(sel);
+}
+
+} // anonymous namespace
+
+int main(int argc, char **argv) {
+	int n = (argc > 1 ? std::atoi(argv[1]) : 1000000);
+
+	sqxx::connection conn(":memory:");
+	conn.exec("create table items (id integer primary key, v integer)");
+	{
+		conn.exec("begin");
+		sqxx::statement st = conn.prepare("insert into items (v) values (?)");
+		for (int i = 0; i < rows; ++i) {
+			st.bind(0, i);
+			st.run();
+			st.reset();
+		}
+		conn.exec("commit");
+	}
+
+	bench_prepare(conn, n / 10);
+	bench_binds(conn, n);
+	bench_step(conn, n * 10);
+	bench_vals(conn, n);
+	bench_functions(conn, n);
+	bench_hooks(conn, n);
+	bench_blob_rows(conn, n);
+	return 0;
+}
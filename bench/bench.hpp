@@ -0,0 +1,159 @@
+
+// Shared helpers for the sqxx benchmarks
+
+#if !defined(SQXX_BENCH_HPP_INCLUDED)
+#define SQXX_BENCH_HPP_INCLUDED
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#if defined(__linux__)
+#include <linux/fiemap.h>
+#include <linux/fs.h>
+#endif
+
+namespace bench {
+
+/**
+ * Report a benchmark result.
+ *
+ * Results are written as one JSON object per line, so they can be collected
+ * and compared by scripts.
+ */
+inline void report(const std::string &benchmark, const std::string &variant,
+		uint64_t ops, double seconds) {
+	std::printf("{\"benchmark\": \"%s\", \"variant\": \"%s\", \"ops\": %llu, "
+			"\"seconds\": %.6f, \"ns_per_op\": %.1f}\n",
+			benchmark.c_str(), variant.c_str(), static_cast<unsigned long long>(ops),
+			seconds, (ops ? seconds * 1e9 / ops : 0.0));
+	std::fflush(stdout);
+}
+
+/**
+ * Report a measurement other than throughput, like memory use.
+ *
+ * Written in the same format as `report()`.
+ */
+inline void report_metric(const std::string &benchmark, const std::string &variant,
+		const std::string &metric, double value) {
+	std::printf("{\"benchmark\": \"%s\", \"variant\": \"%s\", \"metric\": \"%s\", "
+			"\"value\": %.0f}\n",
+			benchmark.c_str(), variant.c_str(), metric.c_str(), value);
+	std::fflush(stdout);
+}
+
+/** Measures elapsed wall clock time */
+class stopwatch {
+private:
+	std::chrono::steady_clock::time_point start;
+public:
+	stopwatch() : start(std::chrono::steady_clock::now()) {
+	}
+	void restart() {
+		start = std::chrono::steady_clock::now();
+	}
+	double seconds() const {
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+};
+
+/** A database file in a temporary location, removed again in the end */
+struct tmpdb {
+	std::string filename;
+	tmpdb() {
+		char name[] = "/tmp/sqxx_bench_XXXXXX";
+		int fd = mkstemp(name);
+		if (fd >= 0)
+			close(fd);
+		filename = name;
+	}
+	~tmpdb() {
+		for (const char *suffix : {"", "-wal", "-shm", "-journal"}) {
+			std::remove((filename + suffix).c_str());
+		}
+	}
+};
+
+/**
+ * Write back and evict cached pages of a file, so that the next reads
+ * come from the device.
+ */
+inline void drop_cache(const std::string &filename) {
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0)
+		return;
+	fdatasync(fd);
+	posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+	close(fd);
+}
+
+/** Resident set size of the current process in bytes */
+inline uint64_t rss_bytes() {
+	unsigned long long size = 0, resident = 0;
+	FILE *f = std::fopen("/proc/self/statm", "r");
+	if (!f)
+		return 0;
+	if (std::fscanf(f, "%llu %llu", &size, &resident) != 2)
+		resident = 0;
+	std::fclose(f);
+	return resident * sysconf(_SC_PAGESIZE);
+}
+
+/** Number of bytes of a file that are currently in the kernel page cache */
+inline uint64_t cached_bytes(const std::string &filename) {
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0)
+		return 0;
+	struct stat st;
+	uint64_t cached = 0;
+	if (fstat(fd, &st) == 0 && st.st_size > 0) {
+		void *map = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+		if (map != MAP_FAILED) {
+			size_t pagesize = sysconf(_SC_PAGESIZE);
+			std::vector<unsigned char> vec((st.st_size + pagesize - 1) / pagesize);
+			if (mincore(map, st.st_size, vec.data()) == 0) {
+				for (unsigned char v : vec) {
+					if (v & 1)
+						cached += pagesize;
+				}
+			}
+			munmap(map, st.st_size);
+		}
+	}
+	close(fd);
+	return cached;
+}
+
+/**
+ * Number of extents the file system uses to store a file, a measure for
+ * fragmentation. Returns 0 if it can't be determined.
+ */
+inline uint64_t file_extents(const std::string &filename) {
+	uint64_t extents = 0;
+#if defined(FS_IOC_FIEMAP)
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0)
+		return 0;
+	struct fiemap fm = {};
+	fm.fm_length = FIEMAP_MAX_OFFSET;
+	fm.fm_flags = FIEMAP_FLAG_SYNC;
+	// With fm_extent_count 0 only the number of extents is returned
+	if (ioctl(fd, FS_IOC_FIEMAP, &fm) == 0)
+		extents = fm.fm_mapped_extents;
+	close(fd);
+#endif
+	return extents;
+}
+
+} // namespace bench
+
+#endif // SQXX_BENCH_HPP_INCLUDED
@@ -0,0 +1,78 @@
+
+// Compares the O_DIRECT VFS with buffered I/O through sqlite's default VFS
+
+#include "sqxx.hpp"
+#include "vfs_direct.hpp"
+#include "bench.hpp"
+#include <cstdlib>
+#include <random>
+#include <sys/wait.h>
+
+namespace {
+
+// Loads a table, then reads it randomly and sequentially with a cold cache.
+// Both variants get the same sqlite page cache, so that the difference in
+// memory use is the data the kernel caches in addition.
+void bench_direct(const char *variant, const char *vfs, int rows) {
+	bench::tmpdb file;
+	{
+		sqxx::connection conn(file.filename, sqxx::OPEN_READWRITE|sqxx::OPEN_CREATE, vfs);
+		conn.exec("pragma cache_size = -65536");
+		conn.exec("create table items (id integer primary key, v blob)");
+		auto st = conn.prepare("insert into items (v) values (randomblob(400))");
+		bench::stopwatch sw;
+		conn.exec("begin");
+		for (int i = 0; i < rows; ++i) {
+			st.run();
+			st.reset();
+		}
+		conn.exec("commit");
+		bench::report("direct_load", variant, rows, sw.seconds());
+	}
+
+	bench::drop_cache(file.filename);
+	sqxx::connection conn(file.filename, sqxx::OPEN_READWRITE, vfs);
+	conn.exec("pragma cache_size = -65536");
+
+	std::mt19937 rng(42);
+	std::uniform_int_distribution<int> ids(1, rows);
+	auto st = conn.prepare("select length(v) from items where id = ?");
+	bench::stopwatch sw;
+	for (int i = 0; i < rows; ++i) {
+		st.bind(0, ids(rng));
+		st.run();
+		st.reset();
+	}
+	bench::report("direct_random_read", variant, rows, sw.seconds());
+
+	sw.restart();
+	conn.query("select sum(length(v)) from items");
+	bench::report("direct_scan", variant, rows, sw.seconds());
+
+	bench::report_metric("direct_memory", variant, "rss_bytes", bench::rss_bytes());
+	bench::report_metric("direct_memory", variant, "page_cache_bytes",
+			bench::cached_bytes(file.filename));
+}
+
+// Runs a variant in a child process, so that memory use isn't influenced by
+// previous variants
+void run_isolated(const char *variant, const char *vfs, int rows) {
+	pid_t pid = fork();
+	if (pid == 0) {
+		bench_direct(variant, vfs, rows);
+		std::exit(0);
+	}
+	if (pid > 0)
+		waitpid(pid, nullptr, 0);
+}
+
+} // anonymous namespace
+
+int main(int argc, char **argv) {
+	int rows = (argc > 1 ? std::atoi(argv[1]) : 100000);
+
+	sqxx::vfs_direct_register("sqxx-direct");
+
+	run_isolated("buffered", nullptr, rows);
+	run_isolated("direct", "sqxx-direct", rows);
+}
@@ -0,0 +1,62 @@
+
+// Compares growth policies for append-heavy workloads
+
+#include "sqxx.hpp"
+#include "bench.hpp"
+#include <cstdlib>
+
+namespace {
+
+// Appends rows in small transactions, which extends the file on most of
+// them. Two tables are filled in turns, so that their pages interleave.
+void bench_growth(const char *variant, const char *journal_mode, const sqxx::growth_policy &growth,
+		int rows) {
+	bench::tmpdb file;
+	std::string name = std::string(variant) + "_" + journal_mode;
+	{
+		sqxx::connection conn(file.filename, sqxx::OPEN_READWRITE|sqxx::OPEN_CREATE);
+		conn.exec(std::string("pragma journal_mode = ") + journal_mode);
+		conn.exec("pragma synchronous = normal");
+		conn.exec("create table events (id integer primary key, payload blob)");
+		conn.exec("create table audit (id integer primary key, payload blob)");
+		// Preallocation only works once the database has content
+		conn.set_growth_policy(growth);
+
+		const int batch = 10;
+		auto ev = conn.prepare("insert into events (payload) values (randomblob(1000))");
+		auto au = conn.prepare("insert into audit (payload) values (randomblob(200))");
+		bench::stopwatch sw;
+		for (int i = 0; i < rows; i += batch) {
+			conn.exec("begin");
+			for (int j = 0; j < batch; ++j) {
+				ev.run();
+				ev.reset();
+				au.run();
+				au.reset();
+			}
+			conn.exec("commit");
+		}
+		conn.exec("pragma wal_checkpoint(truncate)");
+		bench::report("growth_append", name, rows, sw.seconds());
+	}
+	bench::report_metric("growth_append", name, "file_extents", bench::file_extents(file.filename));
+}
+
+} // anonymous namespace
+
+int main(int argc, char **argv) {
+	int rows = (argc > 1 ? std::atoi(argv[1]) : 50000);
+
+	sqxx::growth_policy page_by_page;
+	sqxx::growth_policy chunked;
+	chunked.chunk_size = 4 * 1024 * 1024;
+	sqxx::growth_policy preallocated;
+	preallocated.chunk_size = 4 * 1024 * 1024;
+	preallocated.preallocate = 256 * 1024 * 1024;
+
+	for (const char *journal_mode : {"delete", "wal"}) {
+		bench_growth("default", journal_mode, page_by_page, rows);
+		bench_growth("chunk_4m", journal_mode, chunked, rows);
+		bench_growth("preallocate_256m", journal_mode, preallocated, rows);
+	}
+}
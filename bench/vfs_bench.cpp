@@ -0,0 +1,82 @@
+
+// Compares the io_uring and readahead VFSes with sqlite's default VFS
+
+#include "sqxx.hpp"
+#include "vfs_readahead.hpp"
+#include "vfs_uring.hpp"
+#include "bench.hpp"
+#include <cstdlib>
+#include <iostream>
+#include <random>
+
+namespace {
+
+// Inserts into an indexed table, which dirties many scattered pages, then
+// checkpoints them and finally scans the table and looks up random rows with
+// a cold cache.
+void bench_vfs(const char *variant, const char *vfs, int rows) {
+	bench::tmpdb file;
+	{
+		sqxx::connection conn(file.filename, sqxx::OPEN_READWRITE|sqxx::OPEN_CREATE, vfs);
+		conn.exec("pragma journal_mode = wal");
+		conn.exec("pragma synchronous = full");
+		conn.exec("pragma wal_autocheckpoint = 0");
+		conn.exec("create table items (id integer primary key, k blob, v blob)");
+		conn.exec("create index items_k on items (k)");
+
+		const int batch = 100;
+		auto st = conn.prepare("insert into items (k, v) values (randomblob(16), randomblob(400))");
+		bench::stopwatch sw;
+		for (int i = 0; i < rows; i += batch) {
+			conn.exec("begin");
+			for (int j = 0; j < batch; ++j) {
+				st.run();
+				st.reset();
+			}
+			conn.exec("commit");
+		}
+		bench::report("vfs_insert", variant, rows, sw.seconds());
+
+		sw.restart();
+		conn.exec("pragma wal_checkpoint(truncate)");
+		bench::report("vfs_checkpoint", variant, rows, sw.seconds());
+	}
+
+	bench::drop_cache(file.filename);
+	sqxx::connection conn(file.filename, sqxx::OPEN_READWRITE, vfs);
+	bench::stopwatch sw;
+	conn.query("select sum(length(v)) from items");
+	bench::report("vfs_cold_scan", variant, rows, sw.seconds());
+
+	bench::drop_cache(file.filename);
+	std::mt19937 rng(42);
+	std::uniform_int_distribution<int> ids(1, rows);
+	auto st = conn.prepare("select length(v) from items where id = ?");
+	const int lookups = rows / 10;
+	sw.restart();
+	for (int i = 0; i < lookups; ++i) {
+		st.bind(0, ids(rng));
+		st.run();
+		st.reset();
+	}
+	bench::report("vfs_cold_random", variant, lookups, sw.seconds());
+}
+
+} // anonymous namespace
+
+int main(int argc, char **argv) {
+	int rows = (argc > 1 ? std::atoi(argv[1]) : 20000);
+
+	if (!sqxx::vfs_uring_available())
+		std::cerr << "io_uring not available, sqxx-uring falls back to the default VFS" << std::endl;
+	sqxx::vfs_uring_register("sqxx-uring");
+	sqxx::vfs_uring_options ra;
+	ra.readahead = 1024 * 1024;
+	sqxx::vfs_uring_register("sqxx-uring-ra", false, ra);
+	sqxx::vfs_readahead_register("sqxx-readahead");
+
+	bench_vfs("default", nullptr, rows);
+	bench_vfs("uring", "sqxx-uring", rows);
+	bench_vfs("uring_readahead", "sqxx-uring-ra", rows);
+	bench_vfs("readahead", "sqxx-readahead", rows);
+}
@@ -0,0 +1,400 @@
+
+// Multi-threaded workloads over sqxx, modeled after YCSB and TPC-B.
+//
+// Without arguments a fixed set of configurations is run. A single
+// configuration can be selected with options, for example:
+//
+//     workload_bench --workload=ycsb --threads=8 --read-ratio=0.5 --distribution=zipfian
+//
+// Options:
+//
+//     --workload=ycsb|tpcb     YCSB: point reads and updates of single rows,
+//                              TPC-B: transactions updating several tables
+//     --threads=N              Number of threads, each with its own connection
+//     --seconds=S              Run time
+//     --records=N              Rows in the main table
+//     --read-ratio=R           Fraction of YCSB operations that are reads
+//     --distribution=uniform|zipfian
+//     --journal=MODE           Journal mode of file databases
+//     --sync=off|normal|full   Synchronous level
+//     --db=file|memory         File database or shared-cache in-memory database
+
+#include "sqxx.hpp"
+#include "profiler.hpp"
+#include "bench.hpp"
+#include <sqlite3.h>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct config {
+	std::string workload = "ycsb";
+	int threads = 4;
+	double seconds = 1.0;
+	int records = 10000;
+	double read_ratio = 0.95;
+	std::string distribution = "uniform";
+	std::string journal = "wal";
+	std::string sync = "normal";
+	bool memory = false;
+
+	std::string label() const {
+		std::string l = distribution + " t" + std::to_string(threads);
+		if (workload == "ycsb")
+			l = "r" + std::to_string(static_cast<int>(read_ratio * 100 + 0.5)) + " " + l;
+		if (memory)
+			return l + " memory";
+		return l + " " + journal + " " + sync;
+	}
+};
+
+// Zipfian distributed keys as in YCSB (Gray et al., "Quickly generating
+// billion-record synthetic databases"), scrambled so that the popular keys
+// are spread over the table.
+class key_generator {
+private:
+	std::mt19937_64 rng;
+	std::uniform_real_distribution<double> unit;
+	uint64_t n;
+	bool zipfian;
+	double theta, alpha, zetan, eta;
+
+	static double zeta(uint64_t n, double theta) {
+		double sum = 0;
+		for (uint64_t i = 1; i <= n; ++i) {
+			sum += 1 / std::pow(static_cast<double>(i), theta);
+		}
+		return sum;
+	}
+
+	static uint64_t scramble(uint64_t v) {
+		// FNV-1a over the bytes of v
+		uint64_t h = 14695981039346656037ULL;
+		for (int i = 0; i < 8; ++i) {
+			h ^= (v >> (i * 8)) & 0xff;
+			h *= 1099511628211ULL;
+		}
+		return h;
+	}
+
+public:
+	key_generator(uint64_t seed, uint64_t n_arg, bool zipfian_arg, double zetan_arg)
+		: rng(seed), unit(0.0, 1.0), n(n_arg), zipfian(zipfian_arg), theta(0.99),
+		  alpha(1 / (1 - theta)), zetan(zetan_arg) {
+		eta = (1 - std::pow(2.0 / n, 1 - theta)) / (1 - zeta(2, theta) / zetan);
+	}
+
+	static double zeta_for(uint64_t n) {
+		return zeta(n, 0.99);
+	}
+
+	double uniform() {
+		return unit(rng);
+	}
+
+	/** A key in [1, n] */
+	int64_t next() {
+		if (!zipfian)
+			return 1 + static_cast<int64_t>(uniform() * n) % n;
+		double u = uniform();
+		double uz = u * zetan;
+		uint64_t rank;
+		if (uz < 1)
+			rank = 0;
+		else if (uz < 1 + std::pow(0.5, theta))
+			rank = 1;
+		else
+			rank = static_cast<uint64_t>(n * std::pow(eta * u - eta + 1, alpha));
+		return 1 + static_cast<int64_t>(scramble(rank) % n);
+	}
+};
+
+bool is_busy(const sqxx::error &e) {
+	int primary = e.code & 0xff;
+	return (primary == SQLITE_BUSY || primary == SQLITE_LOCKED);
+}
+
+// SQLITE_BUSY was already retried for the busy timeout. SQLITE_LOCKED in
+// shared-cache mode isn't, so wait until the blocking connection finishes
+// its transaction instead of spinning. The transaction of the caller must
+// already be rolled back.
+void wait_before_retry(sqxx::connection &conn, const sqxx::error &e) {
+	if ((e.code & 0xff) != SQLITE_LOCKED)
+		return;
+#if defined(SQLITE_ENABLE_UNLOCK_NOTIFY)
+	if (conn.wait_for_unlock())
+		return;
+#else
+	sqxx::unused(&conn);
+#endif
+	std::this_thread::sleep_for(std::chrono::microseconds(100));
+}
+
+struct shared_state {
+	std::atomic<uint64_t> ops{0};
+	std::atomic<uint64_t> retries{0};
+	std::atomic<bool> stop{false};
+	sqxx::latency_histogram latency;
+};
+
+std::string database_name(const config &cfg, const bench::tmpdb &file) {
+	if (cfg.memory)
+		return "file:sqxx_workload_bench?mode=memory&cache=shared";
+	return file.filename;
+}
+
+void open_db(sqxx::connection &conn, const config &cfg, const std::string &name) {
+	int flags = sqxx::OPEN_READWRITE | sqxx::OPEN_CREATE;
+	if (cfg.memory)
+		flags |= sqxx::OPEN_URI | sqxx::OPEN_SHAREDCACHE;
+	conn.open(name, flags);
+	conn.busy_timeout(10000);
+	conn.exec("pragma synchronous = " + cfg.sync);
+}
+
+void populate(sqxx::connection &conn, const config &cfg) {
+	if (!cfg.memory)
+		conn.exec("pragma journal_mode = " + cfg.journal);
+	conn.exec("begin");
+	if (cfg.workload == "ycsb") {
+		conn.exec("create table usertable (key integer primary key, field blob)");
+		sqxx::statement st = conn.prepare("insert into usertable (key, field) values (?, randomblob(100))");
+		for (int i = 1; i <= cfg.records; ++i) {
+			st.bind(0, i);
+			st.run();
+			st.reset();
+		}
+	}
+	else {
+		int branches = std::max(1, cfg.records / 100000);
+		conn.exec("create table branches (bid integer primary key, bbalance integer, filler blob)");
+		conn.exec("create table tellers (tid integer primary key, bid integer, tbalance integer, filler blob)");
+		conn.exec("create table accounts (aid integer primary key, bid integer, abalance integer, filler blob)");
+		conn.exec("create table history (tid integer, bid integer, aid integer, delta integer, mtime integer, filler blob)");
+		sqxx::statement b = conn.prepare("insert into branches values (?, 0, zeroblob(88))");
+		for (int i = 1; i <= branches; ++i) {
+			b.bind(0, i);
+			b.run();
+			b.reset();
+		}
+		sqxx::statement t = conn.prepare("insert into tellers values (?, ?, 0, zeroblob(84))");
+		for (int i = 1; i <= branches * 10; ++i) {
+			t.bind(0, i);
+			t.bind(1, 1 + (i - 1) / 10);
+			t.run();
+			t.reset();
+		}
+		sqxx::statement a = conn.prepare("insert into accounts values (?, ?, 0, zeroblob(84))");
+		for (int i = 1; i <= cfg.records; ++i) {
+			a.bind(0, i);
+			a.bind(1, 1 + (i - 1) / 100000);
+			a.run();
+			a.reset();
+		}
+	}
+	conn.exec("commit");
+}
+
+void run_ycsb(sqxx::connection &conn, const config &cfg, key_generator &keys, shared_state &state) {
+	sqxx::statement read = conn.prepare("select field from usertable where key = ?");
+	sqxx::statement update = conn.prepare("update usertable set field = randomblob(100) where key = ?");
+	while (!state.stop.load(std::memory_order_relaxed)) {
+		bool is_read = (keys.uniform() < cfg.read_ratio);
+		int64_t key = keys.next();
+		sqxx::statement &st = (is_read ? read : update);
+		auto start = std::chrono::steady_clock::now();
+		try {
+			st.bind(0, key);
+			st.run();
+			st.reset();
+		}
+		catch (const sqxx::error &e) {
+			st.reset();
+			if (!is_busy(e))
+				throw;
+			state.retries.fetch_add(1, std::memory_order_relaxed);
+			wait_before_retry(conn, e);
+			continue;
+		}
+		state.latency.record(std::chrono::duration_cast<std::chrono::nanoseconds>(
+				std::chrono::steady_clock::now() - start).count());
+		state.ops.fetch_add(1, std::memory_order_relaxed);
+	}
+}
+
+void run_tpcb(sqxx::connection &conn, const config &cfg, key_generator &keys, shared_state &state) {
+	int branches = std::max(1, cfg.records / 100000);
+	sqxx::statement upd_account = conn.prepare("update accounts set abalance = abalance + ? where aid = ?");
+	sqxx::statement sel_account = conn.prepare("select abalance from accounts where aid = ?");
+	sqxx::statement upd_teller = conn.prepare("update tellers set tbalance = tbalance + ? where tid = ?");
+	sqxx::statement upd_branch = conn.prepare("update branches set bbalance = bbalance + ? where bid = ?");
+	sqxx::statement ins_history = conn.prepare("insert into history values (?, ?, ?, ?, strftime('%s','now'), zeroblob(22))");
+	std::vector<sqxx::statement*> all = {&upd_account, &sel_account, &upd_teller, &upd_branch, &ins_history};
+	while (!state.stop.load(std::memory_order_relaxed)) {
+		int64_t aid = keys.next();
+		int bid = 1 + static_cast<int>(keys.uniform() * branches) % branches;
+		int tid = (bid - 1) * 10 + 1 + static_cast<int>(keys.uniform() * 10) % 10;
+		int delta = static_cast<int>(keys.uniform() * 10000) - 5000;
+		auto start = std::chrono::steady_clock::now();
+		try {
+			conn.exec("begin immediate");
+			upd_account.bind(0, delta);
+			upd_account.bind(1, aid);
+			sel_account.bind(0, aid);
+			upd_teller.bind(0, delta);
+			upd_teller.bind(1, tid);
+			upd_branch.bind(0, delta);
+			upd_branch.bind(1, bid);
+			ins_history.bind(0, tid);
+			ins_history.bind(1, bid);
+			ins_history.bind(2, aid);
+			ins_history.bind(3, delta);
+			for (sqxx::statement *st : all) {
+				st->run();
+				st->reset();
+			}
+			conn.exec("commit");
+		}
+		catch (const sqxx::error &e) {
+			for (sqxx::statement *st : all) {
+				st->reset();
+			}
+			try {
+				conn.exec("rollback");
+			}
+			catch (const sqxx::error&) {
+				// No transaction was active
+			}
+			if (!is_busy(e))
+				throw;
+			state.retries.fetch_add(1, std::memory_order_relaxed);
+			wait_before_retry(conn, e);
+			continue;
+		}
+		state.latency.record(std::chrono::duration_cast<std::chrono::nanoseconds>(
+				std::chrono::steady_clock::now() - start).count());
+		state.ops.fetch_add(1, std::memory_order_relaxed);
+	}
+}
+
+void run(const config &cfg) {
+	bench::tmpdb file;
+	std::string name = database_name(cfg, file);
+	// Keeps a shared in-memory database alive while the workers run
+	sqxx::connection holder;
+	open_db(holder, cfg, name);
+	populate(holder, cfg);
+
+	shared_state state;
+	double zetan = (cfg.distribution == "zipfian" ? key_generator::zeta_for(cfg.records) : 1.0);
+	std::vector<std::thread> workers;
+	for (int i = 0; i < cfg.threads; ++i) {
+		workers.emplace_back([&, i] {
+			try {
+				sqxx::connection conn;
+				open_db(conn, cfg, name);
+				key_generator keys(1000 + i, cfg.records, cfg.distribution == "zipfian", zetan);
+				if (cfg.workload == "ycsb")
+					run_ycsb(conn, cfg, keys, state);
+				else
+					run_tpcb(conn, cfg, keys, state);
+			}
+			catch (const std::exception &e) {
+				std::cerr << "worker failed: " << e.what() << std::endl;
+			}
+		});
+	}
+	bench::stopwatch sw;
+	std::this_thread::sleep_for(std::chrono::duration<double>(cfg.seconds));
+	state.stop = true;
+	for (std::thread &t : workers) {
+		t.join();
+	}
+	double seconds = sw.seconds();
+
+	std::string label = cfg.label();
+	bench::report(cfg.workload, label, state.ops.load(), seconds);
+	bench::report_metric(cfg.workload, label, "p50_ns", state.latency.percentile(0.50));
+	bench::report_metric(cfg.workload, label, "p99_ns", state.latency.percentile(0.99));
+	bench::report_metric(cfg.workload, label, "p999_ns", state.latency.percentile(0.999));
+	bench::report_metric(cfg.workload, label, "busy_retries", state.retries.load());
+}
+
+bool parse_option(config &cfg, const std::string &arg) {
+	size_t eq = arg.find('=');
+	if (arg.compare(0, 2, "--") != 0 || eq == std::string::npos)
+		return false;
+	std::string key = arg.substr(2, eq - 2);
+	std::string value = arg.substr(eq + 1);
+	if (key == "workload")
+		cfg.workload = value;
+	else if (key == "threads")
+		cfg.threads = std::atoi(value.c_str());
+	else if (key == "seconds")
+		cfg.seconds = std::atof(value.c_str());
+	else if (key == "records")
+		cfg.records = std::atoi(value.c_str());
+	else if (key == "read-ratio")
+		cfg.read_ratio = std::atof(value.c_str());
+	else if (key == "distribution")
+		cfg.distribution = value;
+	else if (key == "journal")
+		cfg.journal = value;
+	else if (key == "sync")
+		cfg.sync = value;
+	else if (key == "db")
+		cfg.memory = (value == "memory");
+	else
+		return false;
+	return (cfg.workload == "ycsb" || cfg.workload == "tpcb") &&
+		(cfg.distribution == "uniform" || cfg.distribution == "zipfian") &&
+		cfg.threads > 0 && cfg.records > 0;
+}
+
+} // anonymous namespace
+
+int main(int argc, char **argv) {
+	if (argc > 1) {
+		config cfg;
+		for (int i = 1; i < argc; ++i) {
+			if (!parse_option(cfg, argv[i])) {
+				std::cerr << "invalid option: " << argv[i] << std::endl;
+				return 1;
+			}
+		}
+		run(cfg);
+		return 0;
+	}
+
+	config cfg;
+	for (int threads : {1, 4}) {
+		cfg.threads = threads;
+		run(cfg);
+	}
+	cfg.distribution = "zipfian";
+	run(cfg);
+	cfg.read_ratio = 0.5;
+	run(cfg);
+	cfg.memory = true;
+	run(cfg);
+
+	config tpcb;
+	tpcb.workload = "tpcb";
+	for (int threads : {1, 4}) {
+		tpcb.threads = threads;
+		run(tpcb);
+	}
+	tpcb.journal = "delete";
+	tpcb.sync = "full";
+	run(tpcb);
+	return 0;
+}
@@ -0,0 +1,186 @@
+
+#include "change_stream.hpp"
+#include "connection.hpp"
+#include <cstring>
+#include <thread>
+
+namespace sqxx {
+
+namespace {
+
+size_t round_up_pow2(size_t n) {
+	size_t p = 1;
+	while (p < n)
+		p <<= 1;
+	return p;
+}
+
+void atomic_max(std::atomic<size_t> &target, size_t value) {
+	size_t current = target.load(std::memory_order_relaxed);
+	while (value > current &&
+			!target.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+	}
+}
+
+} // anonymous namespace
+
+change_stream::change_stream(connection &conn_arg, const change_stream_options &opts_arg)
+	: conn(conn_arg), opts(opts_arg), head(0), tail(0), last_db(nullptr), last_table(nullptr),
+	  transaction(0), high_water(0), commits(0), rollbacks(0), published(0), discarded(0),
+	  dropped(0), full(0), consumed(0) {
+	size_t capacity = round_up_pow2(opts.capacity ? opts.capacity : 1);
+	ring.reset(new slot[capacity]);
+	mask = capacity - 1;
+	for (size_t i = 0; i < capacity; ++i) {
+		ring[i].seq.store(i, std::memory_order_relaxed);
+	}
+	pending.reserve(opts.transaction_capacity);
+
+	conn.set_update_handler([this](int op, const char *db, const char *table, int64_t rowid) {
+		record(op, db, table, rowid);
+	});
+	conn.set_commit_handler([this]() -> int {
+		commit();
+		return 0;
+	});
+	conn.set_rollback_handler([this] {
+		rollback();
+	});
+}
+
+change_stream::~change_stream() {
+	conn.set_update_handler();
+	conn.set_commit_handler();
+	conn.set_rollback_handler();
+}
+
+const char* change_stream::intern(const char *name, const char *&last) {
+	// Usually the same table as in the previous change
+	if (last && std::strcmp(last, name) == 0)
+		return last;
+	for (const std::string &s : names) {
+		if (s == name) {
+			last = s.c_str();
+			return last;
+		}
+	}
+	names.emplace_back(name);
+	last = names.back().c_str();
+	return last;
+}
+
+void change_stream::record(int op, const char *db, const char *table, int64_t rowid) {
+	change_event ev;
+	ev.op = op;
+	ev.db = intern(db, last_db);
+	ev.table = intern(table, last_table);
+	ev.rowid = rowid;
+	ev.transaction = 0;
+	pending.push_back(ev);
+}
+
+bool change_stream::push(const change_event &ev) {
+	size_t pos = head.load(std::memory_order_relaxed);
+	slot &s = ring[pos & mask];
+	if (s.seq.load(std::memory_order_acquire) != pos)
+		return false;
+	s.event = ev;
+	s.seq.store(pos + 1, std::memory_order_release);
+	head.store(pos + 1, std::memory_order_relaxed);
+	return true;
+}
+
+void change_stream::commit() {
+	++transaction;
+	bool was_full = false;
+	uint64_t n = 0;
+	for (change_event &ev : pending) {
+		ev.transaction = transaction;
+		if (!push(ev)) {
+			was_full = true;
+			if (!opts.block_when_full)
+				break;
+			do {
+				std::this_thread::yield();
+			} while (!push(ev));
+		}
+		++n;
+	}
+	atomic_max(high_water, size());
+	commits.fetch_add(1, std::memory_order_relaxed);
+	published.fetch_add(n, std::memory_order_relaxed);
+	if (was_full) {
+		full.fetch_add(1, std::memory_order_relaxed);
+		dropped.fetch_add(pending.size() - n, std::memory_order_relaxed);
+	}
+	pending.clear();
+}
+
+void change_stream::rollback() {
+	rollbacks.fetch_add(1, std::memory_order_relaxed);
+	discarded.fetch_add(pending.size(), std::memory_order_relaxed);
+	pending.clear();
+}
+
+bool change_stream::try_pop(change_event &ev) {
+	size_t pos = tail.load(std::memory_order_relaxed);
+	slot *s;
+	while (true) {
+		s = &ring[pos & mask];
+		size_t seq = s->seq.load(std::memory_order_acquire);
+		if (seq == pos + 1) {
+			if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				break;
+		}
+		else if (seq == pos) {
+			// Not yet published
+			return false;
+		}
+		else {
+			pos = tail.load(std::memory_order_relaxed);
+		}
+	}
+	ev = s->event;
+	s->seq.store(pos + mask + 1, std::memory_order_release);
+	consumed.fetch_add(1, std::memory_order_relaxed);
+	return true;
+}
+
+size_t change_stream::drain(change_event *out, size_t max) {
+	size_t n = 0;
+	while (n < max && try_pop(out[n]))
+		++n;
+	return n;
+}
+
+std::vector<change_event> change_stream::drain(size_t max) {
+	std::vector<change_event> events;
+	change_event ev;
+	while (events.size() < max && try_pop(ev))
+		events.push_back(ev);
+	return events;
+}
+
+size_t change_stream::size() const {
+	size_t t = tail.load(std::memory_order_relaxed);
+	size_t h = head.load(std::memory_order_relaxed);
+	return (h > t ? h - t : 0);
+}
+
+change_stream_stats change_stream::stats() const {
+	change_stream_stats st;
+	st.capacity = mask + 1;
+	st.size = size();
+	st.high_water = high_water.load(std::memory_order_relaxed);
+	st.commits = commits.load(std::memory_order_relaxed);
+	st.rollbacks = rollbacks.load(std::memory_order_relaxed);
+	st.published = published.load(std::memory_order_relaxed);
+	st.discarded = discarded.load(std::memory_order_relaxed);
+	st.dropped = dropped.load(std::memory_order_relaxed);
+	st.full = full.load(std::memory_order_relaxed);
+	st.consumed = consumed.load(std::memory_order_relaxed);
+	return st;
+}
+
+} // namespace sqxx
+
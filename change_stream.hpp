@@ -0,0 +1,164 @@
+
+#if !defined(SQXX_CHANGE_STREAM_HPP_INCLUDED)
+#define SQXX_CHANGE_STREAM_HPP_INCLUDED
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace sqxx {
+
+class connection;
+
+/** A changed row, as reported by the update hook */
+struct change_event {
+	/** `SQLITE_INSERT`, `SQLITE_UPDATE` or `SQLITE_DELETE` */
+	int op;
+	/** Database and table name, valid as long as the stream exists */
+	const char *db;
+	const char *table;
+	int64_t rowid;
+	/** Number of the committed transaction, starting at 1 */
+	uint64_t transaction;
+};
+
+struct change_stream_options {
+	/** Events the ring buffer can hold, rounded up to a power of two */
+	size_t capacity = 65536;
+	/** Events of the open transaction that fit without allocating */
+	size_t transaction_capacity = 4096;
+	/**
+	 * If a commit finds the ring buffer full, wait for consumers instead of
+	 * dropping the events that don't fit
+	 */
+	bool block_when_full = false;
+};
+
+/** Counters of a `change_stream` */
+struct change_stream_stats {
+	size_t capacity = 0;
+	/** Events waiting for consumers, and the most there ever were */
+	size_t size = 0;
+	size_t high_water = 0;
+	uint64_t commits = 0;
+	uint64_t rollbacks = 0;
+	/** Events published to the ring buffer by commits */
+	uint64_t published = 0;
+	/** Events discarded by rollbacks */
+	uint64_t discarded = 0;
+	/** Events lost because the ring buffer was full */
+	uint64_t dropped = 0;
+	/** Commits that found the ring buffer full */
+	uint64_t full = 0;
+	/** Events taken by consumers */
+	uint64_t consumed = 0;
+};
+
+/**
+ * Captures the rows changed by a connection into a ring buffer that other
+ * threads consume.
+ *
+ * The stream takes over the update, commit and rollback handlers of the
+ * connection. The update handler only appends to a preallocated buffer of
+ * the open transaction. The commit handler publishes these events to the
+ * ring buffer, the rollback handler discards them. Consumers take events
+ * without locking, from any number of threads:
+ *
+ *     sqxx::change_stream changes(conn);
+ *     // on consumer threads
+ *     sqxx::change_event batch[256];
+ *     size_t n = changes.drain(batch, 256);
+ *
+ * Writers are never slowed down by consumers, unless
+ * `change_stream_options::block_when_full` is set. Otherwise events that
+ * don't fit are dropped and counted in `change_stream_stats::dropped`.
+ *
+ * Like the update hook the stream doesn't see changes of tables without
+ * rowid or truncating deletes. Events are published when the commit hook
+ * runs, a commit that fails after that isn't reported as rolled back.
+ * Changes undone by `rollback to` a savepoint are still published.
+ *
+ * The stream must be destroyed before the connection.
+ */
+class change_stream {
+private:
+	struct slot {
+		std::atomic<size_t> seq;
+		change_event event;
+	};
+
+	connection &conn;
+	change_stream_options opts;
+	std::unique_ptr<slot[]> ring;
+	size_t mask;
+
+	// Producer and consumer positions on separate cache lines
+	alignas(64) std::atomic<size_t> head;
+	alignas(64) std::atomic<size_t> tail;
+
+	// Only used from the connection's hooks
+	alignas(64) std::vector<change_event> pending;
+	// Interned database and table names, never removed so that consumers can
+	// keep the pointers
+	std::deque<std::string> names;
+	const char *last_db;
+	const char *last_table;
+	uint64_t transaction;
+
+	std::atomic<size_t> high_water;
+	std::atomic<uint64_t> commits;
+	std::atomic<uint64_t> rollbacks;
+	std::atomic<uint64_t> published;
+	std::atomic<uint64_t> discarded;
+	std::atomic<uint64_t> dropped;
+	std::atomic<uint64_t> full;
+	std::atomic<uint64_t> consumed;
+
+	const char* intern(const char *name, const char *&last);
+	void record(int op, const char *db, const char *table, int64_t rowid);
+	void commit();
+	void rollback();
+	bool push(const change_event &ev);
+
+public:
+	/** Installs the update, commit and rollback handlers of `conn` */
+	explicit change_stream(connection &conn, const change_stream_options &opts = change_stream_options());
+	/** Removes the handlers */
+	~change_stream();
+
+	change_stream(const change_stream&) = delete;
+	change_stream& operator=(const change_stream&) = delete;
+
+	/** Take the oldest event, returns false if there is none */
+	bool try_pop(change_event &ev);
+
+	/** Take up to `max` events into `out`, returns their number */
+	size_t drain(change_event *out, size_t max);
+	std::vector<change_event> drain(size_t max);
+
+	/** Call `fun` with up to `max` events, returns their number */
+	template<typename Fun>
+	size_t consume(Fun fun, size_t max) {
+		change_event ev;
+		size_t n = 0;
+		while (n < max && try_pop(ev)) {
+			fun(ev);
+			++n;
+		}
+		return n;
+	}
+
+	/** Events waiting for consumers */
+	size_t size() const;
+
+	change_stream_stats stats() const;
+};
+
+} // namespace sqxx
+
+#endif // SQXX_CHANGE_STREAM_HPP_INCLUDED
+
@@ -0,0 +1,228 @@
+
+#include "change_watcher.hpp"
+#include <sqlite3.h>
+#include <cerrno>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#define SQXX_HAVE_INOTIFY 1
+#endif
+
+namespace sqxx {
+
+namespace {
+
+#if defined(SQXX_HAVE_INOTIFY)
+// Directory and file name of a database, false for in-memory databases and URIs
+bool split_filename(const std::string &filename, std::string &dir, std::string &base) {
+	if (filename.empty() || filename == ":memory:" || filename.compare(0, 5, "file:") == 0)
+		return false;
+	std::string::size_type slash = filename.rfind('/');
+	if (slash == std::string::npos) {
+		dir = ".";
+		base = filename;
+	}
+	else {
+		dir = (slash == 0 ? "/" : filename.substr(0, slash));
+		base = filename.substr(slash + 1);
+	}
+	return !base.empty();
+}
+#endif
+
+} // anonymous namespace
+
+change_watcher::change_watcher(const std::string &filename,
+		const change_watcher_options &opts_arg, int flags, const char *vfs)
+	: opts(opts_arg), data_version_stmt(nullptr), data_version(0), stopping(false), notify_fd(-1), recheck(false) {
+	wake_fds[0] = wake_fds[1] = -1;
+	conn.open(filename, flags, vfs);
+	if (sqlite3_prepare_v2(conn.raw(), "pragma data_version", -1, &data_version_stmt, nullptr) != SQLITE_OK)
+		throw recent_error(conn.raw());
+	try {
+		if (sqlite3_step(data_version_stmt) != SQLITE_ROW)
+			throw recent_error(conn.raw());
+		data_version = sqlite3_column_int64(data_version_stmt, 0);
+		sqlite3_reset(data_version_stmt);
+	}
+	catch (...) {
+		sqlite3_finalize(data_version_stmt);
+		throw;
+	}
+
+#if defined(SQXX_HAVE_INOTIFY)
+	std::string dir;
+	if (opts.use_inotify && split_filename(filename, dir, basename)) {
+		// Watch the directory, the WAL and journal files come and go
+		notify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (notify_fd != -1 &&
+				(inotify_add_watch(notify_fd, dir.c_str(), IN_MODIFY | IN_CLOSE_WRITE | IN_CREATE | IN_MOVED_TO) == -1 ||
+				 pipe2(wake_fds, O_CLOEXEC) == -1)) {
+			// Fall back to polling
+			close(notify_fd);
+			notify_fd = -1;
+		}
+	}
+#endif
+
+	worker = std::thread(&change_watcher::run, this);
+}
+
+change_watcher::~change_watcher() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	stop_requested.notify_all();
+#if defined(SQXX_HAVE_INOTIFY)
+	if (wake_fds[1] != -1) {
+		char c = 0;
+		while (::write(wake_fds[1], &c, 1) == -1 && errno == EINTR) {
+		}
+	}
+#endif
+	worker.join();
+#if defined(SQXX_HAVE_INOTIFY)
+	if (notify_fd != -1)
+		close(notify_fd);
+	if (wake_fds[0] != -1)
+		close(wake_fds[0]);
+	if (wake_fds[1] != -1)
+		close(wake_fds[1]);
+#endif
+	sqlite3_finalize(data_version_stmt);
+}
+
+void change_watcher::set_change_handler(const change_handler_t &fun) {
+	std::lock_guard<std::mutex> lock(mutex);
+	handler = fun;
+}
+
+void change_watcher::set_change_handler() {
+	std::lock_guard<std::mutex> lock(mutex);
+	handler = nullptr;
+}
+
+change_watcher_stats change_watcher::stats() const {
+	std::lock_guard<std::mutex> lock(mutex);
+	return st;
+}
+
+bool change_watcher::detect() {
+	std::lock_guard<std::mutex> lock(check_mutex);
+	int rv = sqlite3_step(data_version_stmt);
+	int64_t v = (rv == SQLITE_ROW ? sqlite3_column_int64(data_version_stmt, 0) : 0);
+	sqlite3_reset(data_version_stmt);
+
+	std::lock_guard<std::mutex> stats_lock(mutex);
+	if (rv != SQLITE_ROW) {
+		++st.failed;
+		throw static_error(rv);
+	}
+	++st.checks;
+	bool changed = (v != data_version);
+	data_version = v;
+	if (changed)
+		++st.changes;
+	return changed;
+}
+
+void change_watcher::notify_change() {
+	change_handler_t fun;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		fun = handler;
+	}
+	if (fun)
+		fun();
+}
+
+bool change_watcher::check() {
+	bool changed = detect();
+	if (changed)
+		notify_change();
+	return changed;
+}
+
+// Reads the pending inotify events, returns if one of them concerns the
+// database files
+bool change_watcher::read_events() {
+	bool relevant = false;
+#if defined(SQXX_HAVE_INOTIFY)
+	alignas(struct inotify_event) char buf[4096];
+	while (true) {
+		ssize_t n = ::read(notify_fd, buf, sizeof(buf));
+		if (n <= 0) {
+			if (n == -1 && errno == EINTR)
+				continue;
+			break;
+		}
+		for (char *p = buf; p < buf + n; ) {
+			const struct inotify_event *ev = reinterpret_cast<const struct inotify_event*>(p);
+			if (ev->len) {
+				std::string name(ev->name);
+				if (name == basename || name == basename + "-wal" || name == basename + "-journal")
+					relevant = true;
+			}
+			p += sizeof(struct inotify_event) + ev->len;
+		}
+	}
+#endif
+	return relevant;
+}
+
+// Waits until the next check is due, returns false if the watcher is stopped
+bool change_watcher::wait() {
+#if defined(SQXX_HAVE_INOTIFY)
+	if (notify_fd != -1) {
+		auto deadline = std::chrono::steady_clock::now() + (recheck ? opts.recheck_delay : opts.interval);
+		recheck = false;
+		while (true) {
+			auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+					deadline - std::chrono::steady_clock::now()).count();
+			struct pollfd fds[2] = {{wake_fds[0], POLLIN, 0}, {notify_fd, POLLIN, 0}};
+			int n = ::poll(fds, 2, (remaining > 0 ? static_cast<int>(remaining) : 0));
+			if (n == -1 && errno == EINTR)
+				continue;
+			if (n == -1 || fds[0].revents)
+				break;
+			if (n == 0)
+				return true;
+			if (read_events()) {
+				std::lock_guard<std::mutex> lock(mutex);
+				++st.events;
+				recheck = true;
+				return true;
+			}
+		}
+	}
+#endif
+	std::unique_lock<std::mutex> lock(mutex);
+	return !stop_requested.wait_for(lock, opts.interval, [this] { return stopping; });
+}
+
+void change_watcher::run() {
+	while (wait()) {
+		bool changed = false;
+		try {
+			changed = detect();
+		}
+		catch (const error&) {
+			// Counted as failed check, try again next time
+		}
+		if (changed) {
+			try {
+				notify_change();
+			}
+			catch (...) {
+				handle_callback_exception("change handler");
+			}
+		}
+	}
+}
+
+} // namespace sqxx
+
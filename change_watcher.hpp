@@ -0,0 +1,134 @@
+
+#if !defined(SQXX_CHANGE_WATCHER_HPP_INCLUDED)
+#define SQXX_CHANGE_WATCHER_HPP_INCLUDED
+
+#include "connection.hpp"
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// struct from <sqlite3.h>
+struct sqlite3_stmt;
+
+namespace sqxx {
+
+struct change_watcher_options {
+	/** Time between two checks of the database */
+	std::chrono::milliseconds interval = std::chrono::milliseconds(1000);
+	/**
+	 * On Linux, also check as soon as inotify reports a write to the
+	 * database, its WAL or its rollback journal. `interval` then only
+	 * matters for writes that inotify doesn't see, like the ones of other
+	 * hosts on network file systems.
+	 */
+	bool use_inotify = true;
+	/**
+	 * Delay of a second check after an inotify event. A writer updates the
+	 * WAL index only after writing the WAL, so the first check can come too
+	 * early to see the commit.
+	 */
+	std::chrono::milliseconds recheck_delay = std::chrono::milliseconds(10);
+};
+
+/** Counters of a `change_watcher` */
+struct change_watcher_stats {
+	/** Executions of `pragma data_version` */
+	uint64_t checks = 0;
+	/** Checks that found a change and called the handler */
+	uint64_t changes = 0;
+	/** Checks that failed, for example because the database was locked */
+	uint64_t failed = 0;
+	/** Checks started by inotify events */
+	uint64_t events = 0;
+};
+
+/**
+ * Detects changes that other connections or processes commit to a
+ * database, without querying its tables.
+ *
+ * The watcher opens its own connection to the database and repeatedly runs
+ * one prepared [`pragma data_version`](https://www.sqlite.org/pragma.html#pragma_data_version)
+ * statement on a background thread. The change handler is only called when
+ * the value differs from the previous one:
+ *
+ *     sqxx::change_watcher watcher("shared.db");
+ *     watcher.set_change_handler([&] { reload(); });
+ *
+ * Changes of several commits between two checks are reported once. Changes
+ * of the watcher's own connection aren't reported, but it only reads. The
+ * handler runs on the watcher's thread, or on the thread calling `check()`.
+ */
+class change_watcher {
+public:
+	typedef std::function<void ()> change_handler_t;
+
+private:
+	change_watcher_options opts;
+	connection conn;
+	sqlite3_stmt *data_version_stmt;
+	int64_t data_version;
+	// Serializes checks of the background thread and of `check()`
+	std::mutex check_mutex;
+
+	mutable std::mutex mutex;
+	std::condition_variable stop_requested;
+	bool stopping;
+	change_handler_t handler;
+	change_watcher_stats st;
+
+	// inotify descriptor and the pipe that wakes the thread, or -1
+	int notify_fd;
+	int wake_fds[2];
+	std::string basename;
+	bool recheck;
+
+	std::thread worker;
+
+	void run();
+	bool detect();
+	void notify_change();
+	bool wait();
+	bool read_events();
+
+public:
+	/**
+	 * Opens a connection to the database `filename` and starts the
+	 * background thread. `flags` and `vfs` are passed to
+	 * `connection::open()`, by default the database is opened read-only.
+	 */
+	explicit change_watcher(const std::string &filename,
+			const change_watcher_options &opts = change_watcher_options(),
+			int flags = OPEN_READONLY, const char *vfs = nullptr);
+	/** Stops the background thread */
+	~change_watcher();
+
+	change_watcher(const change_watcher&) = delete;
+	change_watcher& operator=(const change_watcher&) = delete;
+
+	const change_watcher_options& options() const { return opts; }
+
+	/** Called after a change was detected */
+	void set_change_handler(const change_handler_t &fun);
+	void set_change_handler();
+
+	/**
+	 * Check for a change right now and call the handler if there was one.
+	 * Returns if the database changed. Exceptions of the handler are passed
+	 * on.
+	 */
+	bool check();
+
+	/** If inotify is used to detect writes */
+	bool inotify() const { return notify_fd != -1; }
+
+	change_watcher_stats stats() const;
+};
+
+} // namespace sqxx
+
+#endif // SQXX_CHANGE_WATCHER_HPP_INCLUDED
+
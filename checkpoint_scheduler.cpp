@@ -0,0 +1,162 @@
+
+#include "checkpoint_scheduler.hpp"
+#include "statement.hpp"
+#include <sqlite3.h>
+#include <cstring>
+
+namespace sqxx {
+
+namespace {
+
+// Sizes of the WAL file header and of the header of each frame
+const int wal_header_size = 32;
+const int wal_frame_header_size = 24;
+
+// Autocheckpoint threshold sqlite uses by default
+const int default_autocheckpoint = 1000;
+
+uint64_t elapsed_ns(std::chrono::steady_clock::time_point start) {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now() - start).count();
+}
+
+} // anonymous namespace
+
+checkpoint_scheduler::checkpoint_scheduler(const std::string &filename,
+		const checkpoint_options &opts_arg, int flags, const char *vfs)
+	: opts(opts_arg), page_size(0), stopping(false), requested(false), running(false) {
+	conn.open(filename, flags, vfs);
+	conn.busy_timeout(static_cast<int>(opts.busy_timeout.count()));
+	// Checkpoints are only started by the scheduler
+	conn.wal_autocheckpoint(0);
+	// Reading the journal mode also opens the WAL of the connection, without
+	// that checkpoints do nothing
+	statement jm = conn.prepare("pragma journal_mode");
+	jm.run();
+	if (std::strcmp(jm.val<const char*>(0), "wal") != 0)
+		throw error(SQLITE_MISUSE, "checkpoint_scheduler needs a database in WAL mode");
+	statement ps = conn.prepare("pragma page_size");
+	ps.run();
+	page_size = ps.val<int>(0);
+	worker = std::thread(&checkpoint_scheduler::run, this);
+}
+
+checkpoint_scheduler::~checkpoint_scheduler() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	changed.notify_all();
+	worker.join();
+}
+
+void checkpoint_scheduler::attach(connection &writer) {
+	// Replaces the WAL hook that sqlite uses for autocheckpoints
+	writer.set_wal_handler([this](const char *dbname, int frames) {
+		if (std::strcmp(dbname, "main") == 0)
+			notify(frames);
+	});
+}
+
+void checkpoint_scheduler::detach(connection &writer) {
+	writer.wal_autocheckpoint(default_autocheckpoint);
+}
+
+void checkpoint_scheduler::set_wal_frames(int frames) {
+	st.wal_frames = frames;
+	st.wal_bytes = (frames > 0 ? wal_header_size + int64_t(frames) * (page_size + wal_frame_header_size) : 0);
+}
+
+void checkpoint_scheduler::notify(int frames) {
+	bool start = false;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		set_wal_frames(frames);
+		if (frames >= opts.passive_frames && !requested) {
+			requested = true;
+			start = true;
+		}
+	}
+	if (start)
+		changed.notify_all();
+}
+
+void checkpoint_scheduler::request() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		requested = true;
+	}
+	changed.notify_all();
+}
+
+void checkpoint_scheduler::flush() {
+	std::unique_lock<std::mutex> lock(mutex);
+	changed.wait(lock, [this] { return !requested && !running; });
+}
+
+checkpoint_stats checkpoint_scheduler::stats() const {
+	std::lock_guard<std::mutex> lock(mutex);
+	return st;
+}
+
+void checkpoint_scheduler::run() {
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true) {
+		changed.wait(lock, [this] { return stopping || requested; });
+		if (stopping)
+			break;
+		requested = false;
+		running = true;
+		int mode = SQLITE_CHECKPOINT_PASSIVE;
+#if SQLITE_VERSION_NUMBER >= 3008008
+		if (st.wal_frames >= opts.truncate_frames)
+			mode = SQLITE_CHECKPOINT_TRUNCATE;
+		else
+#endif
+		if (st.wal_frames >= opts.restart_frames)
+			mode = SQLITE_CHECKPOINT_RESTART;
+		lock.unlock();
+
+		auto start = std::chrono::steady_clock::now();
+		int rv = SQLITE_OK;
+		std::pair<int, int> frames(0, 0);
+		try {
+			frames = conn.wal_checkpoint("main", mode);
+		}
+		catch (const error &e) {
+			rv = e.code;
+		}
+		uint64_t ns = elapsed_ns(start);
+
+		lock.lock();
+		running = false;
+		st.last_duration_ns = ns;
+		st.total_duration_ns += ns;
+		if (ns > st.max_duration_ns)
+			st.max_duration_ns = ns;
+		if (rv == SQLITE_OK) {
+			if (mode == SQLITE_CHECKPOINT_PASSIVE) {
+				++st.passive;
+				set_wal_frames(frames.first);
+			}
+			else {
+				if (mode == SQLITE_CHECKPOINT_RESTART)
+					++st.restart;
+				else
+					++st.truncate;
+				// The next writer starts again at the beginning of the WAL
+				set_wal_frames(0);
+			}
+		}
+		else if (rv == SQLITE_BUSY || rv == SQLITE_LOCKED) {
+			++st.busy;
+		}
+		else {
+			++st.failed;
+		}
+		changed.notify_all();
+	}
+}
+
+} // namespace sqxx
+
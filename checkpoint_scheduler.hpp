@@ -0,0 +1,129 @@
+
+#if !defined(SQXX_CHECKPOINT_SCHEDULER_HPP_INCLUDED)
+#define SQXX_CHECKPOINT_SCHEDULER_HPP_INCLUDED
+
+#include "connection.hpp"
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace sqxx {
+
+struct checkpoint_options {
+	/** A passive checkpoint is started when the WAL has this many frames */
+	int passive_frames = 1000;
+	/**
+	 * From this many frames on a restart checkpoint is done, which waits
+	 * for readers so that the next writer starts at the beginning of the WAL
+	 */
+	int restart_frames = 10000;
+	/** From this many frames on the WAL file is truncated after the checkpoint */
+	int truncate_frames = 100000;
+	/** How long restart and truncate checkpoints wait for readers and writers */
+	std::chrono::milliseconds busy_timeout = std::chrono::milliseconds(1000);
+};
+
+/** Counters of a `checkpoint_scheduler` */
+struct checkpoint_stats {
+	/** Frames in the WAL, as of the most recent commit or checkpoint */
+	int wal_frames = 0;
+	/** Size of the WAL content in bytes, derived from `wal_frames` */
+	int64_t wal_bytes = 0;
+	/** Completed checkpoints by mode */
+	uint64_t passive = 0;
+	uint64_t restart = 0;
+	uint64_t truncate = 0;
+	/** Restart or truncate checkpoints that gave up waiting for other connections */
+	uint64_t busy = 0;
+	/** Checkpoints that failed with another error */
+	uint64_t failed = 0;
+	/** Durations of the checkpoints, in nanoseconds */
+	uint64_t last_duration_ns = 0;
+	uint64_t total_duration_ns = 0;
+	uint64_t max_duration_ns = 0;
+};
+
+/**
+ * Runs WAL checkpoints on a background thread instead of on committing
+ * writers.
+ *
+ * By default sqlite checkpoints inline in the commit that pushes the WAL over
+ * 1000 pages, adding the checkpoint's I/O to the latency of that commit.
+ * Connections attached to the scheduler have this autocheckpoint turned off.
+ * Their WAL hook only passes the current WAL size to the scheduler, which
+ * checkpoints on its own connection to the database:
+ *
+ *     sqxx::checkpoint_scheduler checkpoints("app.db");
+ *     checkpoints.attach(conn);
+ *
+ * Checkpoints are passive, so that they never block readers or writers.
+ * If readers keep the WAL from being reset and it grows past
+ * `checkpoint_options::restart_frames` or `truncate_frames`, the scheduler
+ * escalates to restart or truncate checkpoints, which wait up to
+ * `busy_timeout` for the other connections. Writers are blocked during such
+ * a checkpoint, so they should have a busy timeout or busy handler as well.
+ *
+ * The database has to be in WAL mode. The scheduler must outlive the
+ * connections attached to it, or they need to be detached before.
+ */
+class checkpoint_scheduler {
+private:
+	checkpoint_options opts;
+	connection conn;
+	int page_size;
+
+	mutable std::mutex mutex;
+	std::condition_variable changed;
+	bool stopping;
+	bool requested;
+	bool running;
+	checkpoint_stats st;
+
+	std::thread worker;
+
+	void run();
+	void set_wal_frames(int frames);
+
+public:
+	/**
+	 * Opens a connection to the database `filename` for checkpointing and
+	 * starts the background thread. `flags` and `vfs` are passed to
+	 * `connection::open()`.
+	 */
+	explicit checkpoint_scheduler(const std::string &filename,
+			const checkpoint_options &opts = checkpoint_options(),
+			int flags = 0, const char *vfs = nullptr);
+	/** Waits for a running checkpoint and stops the background thread */
+	~checkpoint_scheduler();
+
+	checkpoint_scheduler(const checkpoint_scheduler&) = delete;
+	checkpoint_scheduler& operator=(const checkpoint_scheduler&) = delete;
+
+	const checkpoint_options& options() const { return opts; }
+
+	/**
+	 * Turn off the autocheckpoint of `writer` and report its commits to the
+	 * scheduler. This uses the connection's WAL handler.
+	 */
+	void attach(connection &writer);
+	/** Remove the WAL handler and restore sqlite's default autocheckpoint */
+	void detach(connection &writer);
+
+	/** Report the WAL size after a commit. Usually called by attached connections. */
+	void notify(int frames);
+
+	/** Start a checkpoint regardless of the WAL size */
+	void request();
+	/** Wait until no checkpoint is requested or running */
+	void flush();
+
+	checkpoint_stats stats() const;
+};
+
+} // namespace sqxx
+
+#endif // SQXX_CHECKPOINT_SCHEDULER_HPP_INCLUDED
+
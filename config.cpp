@@ -34,8 +34,17 @@ void config_serialized() {
 		throw static_error(rv);
 }
 
-void config_malloc(mem_methods*);
-void config_getmalloc(mem_methods*);
+void config_malloc(const sqlite3_mem_methods *methods) {
+	int rv = sqlite3_config(SQLITE_CONFIG_MALLOC, methods);
+	if (rv != SQLITE_OK)
+		throw static_error(rv);
+}
+
+void config_getmalloc(sqlite3_mem_methods *methods) {
+	int rv = sqlite3_config(SQLITE_CONFIG_GETMALLOC, methods);
+	if (rv != SQLITE_OK)
+		throw static_error(rv);
+}
 
 void config_memstatus(bool enable) {
 	int rv = sqlite3_config(SQLITE_CONFIG_MEMSTATUS, enable);
@@ -61,8 +70,17 @@ void config_heap(void *buf, int bytes, int minalloc) {
 		throw static_error(rv);
 }
 
-void config_mutex(mutex_methods*);
-void config_getmutex(mutex_methods*);
+void config_mutex(const sqlite3_mutex_methods *methods) {
+	int rv = sqlite3_config(SQLITE_CONFIG_MUTEX, methods);
+	if (rv != SQLITE_OK)
+		throw static_error(rv);
+}
+
+void config_getmutex(sqlite3_mutex_methods *methods) {
+	int rv = sqlite3_config(SQLITE_CONFIG_GETMUTEX, methods);
+	if (rv != SQLITE_OK)
+		throw static_error(rv);
+}
 
 void config_lookaside(int sz, int n) {
 	int rv = sqlite3_config(SQLITE_CONFIG_LOOKASIDE, sz, n);
@@ -70,8 +88,17 @@ void config_lookaside(int sz, int n) {
 		throw static_error(rv);
 }
 
-void config_pcache2(pcache_methods2*);
-void config_getpcache2(pcache_methods2*);
+void config_pcache2(const sqlite3_pcache_methods2 *methods) {
+	int rv = sqlite3_config(SQLITE_CONFIG_PCACHE2, methods);
+	if (rv != SQLITE_OK)
+		throw static_error(rv);
+}
+
+void config_getpcache2(sqlite3_pcache_methods2 *methods) {
+	int rv = sqlite3_config(SQLITE_CONFIG_GETPCACHE2, methods);
+	if (rv != SQLITE_OK)
+		throw static_error(rv);
+}
 
 extern "C"
 void sqxx_call_config_log_handler(void *data, int err, const char *msg) {
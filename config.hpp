@@ -2,29 +2,52 @@
 #if !defined(SQXX_CONFIG_HPP_INCLUDED)
 #define SQXX_CONFIG_HPP_INCLUDED
 
+#include <cstdint>
 #include <functional>
 
-struct mem_malloc;
-struct mem_methods;
-struct mutex_methods;
-struct pcache_methods2;
+struct sqlite3_mem_methods;
+struct sqlite3_mutex_methods;
+struct sqlite3_pcache_methods2;
 
 namespace sqxx {
 
+// Global configuration, wraps [`sqlite3_config()`](http://www.sqlite.org/c3ref/config.html).
+//
+// These functions can only be used while sqlite isn't initialized, see
+// `shutdown()` and `initialize()` in global.hpp.
+
 void config_singlethread();
 void config_multithread();
 void config_serialized();
-void config_malloc(mem_methods*);
-void config_getmalloc(mem_methods*);
+/**
+ * Install a memory allocator (SQLITE_CONFIG_MALLOC).
+ *
+ * sqlite copies `*methods`. See also `config_malloc_pool()` in malloc_pool.hpp.
+ */
+void config_malloc(const sqlite3_mem_methods *methods);
+/** Retrieve the current memory allocator (SQLITE_CONFIG_GETMALLOC) */
+void config_getmalloc(sqlite3_mem_methods *methods);
 void config_memstatus(bool enable);
 void config_scratch(void *buf, int sz, int n);
 void config_pagecache(void *buf, int sz, int n);
 void config_heap(void *buf, int bytes, int minalloc);
-void config_mutex(mutex_methods*);
-void config_getmutex(mutex_methods*);
+/**
+ * Install a mutex implementation (SQLITE_CONFIG_MUTEX).
+ *
+ * sqlite copies `*methods`. See also `config_spin_mutex()` in spin_mutex.hpp.
+ */
+void config_mutex(const sqlite3_mutex_methods *methods);
+/** Retrieve the current mutex implementation (SQLITE_CONFIG_GETMUTEX) */
+void config_getmutex(sqlite3_mutex_methods *methods);
 void config_lookaside(int sz, int n);
-void config_pcache2(pcache_methods2*);
-void config_getpcache2(pcache_methods2*);
+/**
+ * Install a page cache implementation (SQLITE_CONFIG_PCACHE2).
+ *
+ * sqlite copies `*methods`. See also `config_shared_pcache()` in pcache.hpp.
+ */
+void config_pcache2(const sqlite3_pcache_methods2 *methods);
+/** Retrieve the current page cache implementation (SQLITE_CONFIG_GETPCACHE2) */
+void config_getpcache2(sqlite3_pcache_methods2 *methods);
 typedef std::function<void (int err, const char *msg)> log_handler_t;
 void config_log(const log_handler_t &fun);
 void config_log();
@@ -4,8 +4,18 @@
 #include "connection.hpp"
 #include "sqxx.hpp"
 #include "error.hpp"
+#include "profiler.hpp"
+#include "slow_query_log.hpp"
 #include <sqlite3.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
 #include <cstring>
+#include <mutex>
+#include <new>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 namespace sqxx {
 
@@ -22,18 +32,99 @@ struct collation_data_t {
 
 namespace detail {
 
+// A running statement observed for a profiler
+struct profile_run {
+	static const int counter_count = 4;
+	static const int counter_ops[counter_count];
+	// Statement counters when the run started, in the order of `counter_ops`
+	int start[counter_count];
+	uint64_t rows = 0;
+	profiler::entry *entry = nullptr;
+};
+
+const int profile_run::counter_ops[counter_count] = {
+	SQLITE_STMTSTATUS_VM_STEP, SQLITE_STMTSTATUS_FULLSCAN_STEP,
+	SQLITE_STMTSTATUS_SORT, SQLITE_STMTSTATUS_AUTOINDEX,
+};
+
+// User data of a hook, destroyed when the hook is replaced or removed
+class hook_data {
+private:
+	void *data;
+	sqxx_appdata_destroy_type *destroy;
+
+public:
+	hook_data() : data(nullptr), destroy(nullptr) {
+	}
+	hook_data(void *data_arg, sqxx_appdata_destroy_type *destroy_arg)
+		: data(data_arg), destroy(destroy_arg) {
+	}
+	~hook_data() {
+		reset();
+	}
+
+	hook_data(hook_data &&other) noexcept : data(other.data), destroy(other.destroy) {
+		other.data = nullptr;
+		other.destroy = nullptr;
+	}
+	hook_data& operator=(hook_data &&other) noexcept {
+		if (this != &other) {
+			reset();
+			data = other.data;
+			destroy = other.destroy;
+			other.data = nullptr;
+			other.destroy = nullptr;
+		}
+		return *this;
+	}
+
+	void reset() {
+		if (destroy)
+			destroy(data);
+		data = nullptr;
+		destroy = nullptr;
+	}
+};
+
 class connection_callback_table {
 public:
-	std::unique_ptr<connection::commit_handler_t> commit_handler;
-	std::unique_ptr<connection::rollback_handler_t> rollback_handler;
-	std::unique_ptr<connection::update_handler_t> update_handler;
+	hook_data commit_handler;
+	hook_data rollback_handler;
+	hook_data update_handler;
+	std::unique_ptr<connection::preupdate_handler_t> preupdate_handler;
+	// Number of `session`s using the preupdate hook
+	int sessions = 0;
 	std::unique_ptr<connection::trace_handler_t> trace_handler;
 	std::unique_ptr<connection::profile_handler_t> profile_handler;
+#if SQLITE_VERSION_NUMBER >= 3014000
+	profiler *prof = nullptr;
+	slow_query_log *slow_log = nullptr;
+	std::unordered_map<sqlite3_stmt*, profile_run> profile_runs;
+	// Profiler entries of the handles of `statement` objects, null until
+	// the statement runs
+	std::unordered_map<sqlite3_stmt*, profiler::entry*> profiled;
+#endif
 	std::unique_ptr<connection::authorize_handler_t> authorize_handler;
-	std::unique_ptr<connection::busy_handler_t> busy_handler;
-	std::unique_ptr<connection::progress_handler_t> progress_handler;
-	std::unique_ptr<connection::wal_handler_t> wal_handler;
+	hook_data busy_handler;
+	hook_data progress_handler;
+	hook_data wal_handler;
 	std::unique_ptr<collation_data_t> collation_data;
+	std::unique_ptr<connection::unlock_handler_t> unlock_handler;
+	sqxx::unlock_stats unlock;
+};
+
+// Context of the authorizer that collects the tables a statement reads from
+struct read_tables_context {
+	std::vector<std::string> &tables;
+	// Registered authorize handler to consult as well
+	connection::authorize_handler_t *authorize;
+};
+
+// State of a thread blocked in `connection::wait_for_unlock()`
+struct unlock_wait {
+	std::mutex mutex;
+	std::condition_variable cond;
+	bool fired = false;
 };
 
 void create_function_register(sqlite3 *handle, const char *name, int argc,
@@ -76,12 +167,12 @@ void create_collation_register(sqlite3 *handle, const char *name, void *data,
 connection::connection() : handle(nullptr) {
 }
 
-connection::connection(const char *filename, int flags) : handle(nullptr) {
-	open(filename, flags);
+connection::connection(const char *filename, int flags, const char *vfs) : handle(nullptr) {
+	open(filename, flags, vfs);
 }
 
-connection:: connection(const std::string &filename, int flags) : handle(nullptr) {
-	open(filename, flags);
+connection:: connection(const std::string &filename, int flags, const char *vfs) : handle(nullptr) {
+	open(filename, flags, vfs);
 }
 
 connection::~connection() noexcept {
@@ -213,11 +304,11 @@ int connection::total_changes() const {
 	return sqlite3_total_changes(handle);
 }
 
-void connection::open(const char *filename, int flags) {
+void connection::open(const char *filename, int flags, const char *vfs) {
 	int rv;
 	if (!flags)
 		flags = OPEN_READWRITE;
-	rv = sqlite3_open_v2(filename, &handle, flags, nullptr);
+	rv = sqlite3_open_v2(filename, &handle, flags, vfs);
 	if (rv != SQLITE_OK) {
 		if (handle)
 			close();
@@ -225,8 +316,24 @@ void connection::open(const char *filename, int flags) {
 	}
 }
 
-void connection::open(const std::string &filename, int flags) {
-	open(filename.c_str(), flags);
+void connection::open(const std::string &filename, int flags, const char *vfs) {
+	open(filename.c_str(), flags, vfs);
+}
+
+void connection::open(const char *filename, int flags, const char *vfs, const growth_policy &growth) {
+	open(filename, flags, vfs);
+	try {
+		set_growth_policy(growth);
+	}
+	catch (...) {
+		close();
+		throw;
+	}
+}
+
+void connection::open(const std::string &filename, int flags, const char *vfs,
+		const growth_policy &growth) {
+	open(filename.c_str(), flags, vfs, growth);
 }
 
 void connection::close_sync() {
@@ -423,6 +530,43 @@ int connection::limit_worker_threads(int value) {
 }
 #endif
 
+void connection::file_control(const char *dbname, int op, void *arg) {
+	int rv = sqlite3_file_control(handle, dbname, op, arg);
+	if (rv != SQLITE_OK)
+		throw static_error(rv);
+}
+
+void connection::file_control(const std::string &dbname, int op, void *arg) {
+	file_control(dbname.c_str(), op, arg);
+}
+
+void connection::file_control_chunk_size(int bytes, const char *dbname) {
+	file_control(dbname, SQLITE_FCNTL_CHUNK_SIZE, &bytes);
+}
+
+void connection::file_control_size_hint(int64_t bytes, const char *dbname) {
+	sqlite3_int64 hint = bytes;
+	file_control(dbname, SQLITE_FCNTL_SIZE_HINT, &hint);
+}
+
+bool connection::file_control_persist_wal(int mode, const char *dbname) {
+	file_control(dbname, SQLITE_FCNTL_PERSIST_WAL, &mode);
+	return mode;
+}
+
+void connection::set_growth_policy(const growth_policy &growth, const char *dbname) {
+	if (growth.chunk_size > 0)
+		file_control_chunk_size(growth.chunk_size, dbname);
+	if (growth.preallocate > 0) {
+		// Extending an empty file would make it look like a corrupt database
+		sqlite3_int64 size = 0;
+		sqlite3_file *file = nullptr;
+		file_control(dbname, SQLITE_FCNTL_FILE_POINTER, &file);
+		if (file && file->pMethods && file->pMethods->xFileSize(file, &size) == SQLITE_OK && size > 0)
+			file_control_size_hint(growth.preallocate, dbname);
+	}
+}
+
 void connection::release_memory() {
 	sqlite3_db_release_memory(handle);
 }
@@ -436,24 +580,17 @@ int connection::changes() const {
 	return sqlite3_changes(handle);
 }
 
-extern "C"
-int sqxx_call_commit_handler(void *data) {
-	connection::commit_handler_t *fn = reinterpret_cast<connection::commit_handler_t*>(data);
-	try {
-		return (*fn)();
-	}
-	catch (...) {
-		handle_callback_exception("commit handler");
-		return 1;
-	}
+void connection::register_commit_hook(sqxx_commit_hook_type *fun, void *data, sqxx_appdata_destroy_type *destroy) {
+	detail::hook_data hook(data, destroy);
+	setup_callbacks();
+	sqlite3_commit_hook(handle, fun, data);
+	callbacks->commit_handler = std::move(hook);
 }
 
 void connection::set_commit_handler(const commit_handler_t &fun) {
 	if (fun) {
-		std::unique_ptr<commit_handler_t> cb(new commit_handler_t(fun));
-		sqlite3_commit_hook(handle, sqxx_call_commit_handler, cb.get());
-		setup_callbacks();
-		callbacks->commit_handler = std::move(cb);
+		register_commit_hook(detail::commit_hook_call<commit_handler_t>,
+				new commit_handler_t(fun), detail::appdata_destroy_object<commit_handler_t>);
 	}
 	else {
 		set_commit_handler();
@@ -466,23 +603,17 @@ void connection::set_commit_handler() {
 		callbacks->commit_handler.reset();
 }
 
-extern "C"
-void sqxx_call_rollback_handler(void *data) {
-	connection::rollback_handler_t *fn = reinterpret_cast<connection::rollback_handler_t*>(data);
-	try {
-		(*fn)();
-	}
-	catch (...) {
-		handle_callback_exception("rollback handler");
-	}
+void connection::register_rollback_hook(sqxx_rollback_hook_type *fun, void *data, sqxx_appdata_destroy_type *destroy) {
+	detail::hook_data hook(data, destroy);
+	setup_callbacks();
+	sqlite3_rollback_hook(handle, fun, data);
+	callbacks->rollback_handler = std::move(hook);
 }
 
 void connection::set_rollback_handler(const rollback_handler_t &fun) {
 	if (fun) {
-		std::unique_ptr<rollback_handler_t> cb(new rollback_handler_t(fun));
-		sqlite3_rollback_hook(handle, sqxx_call_rollback_handler, cb.get());
-		setup_callbacks();
-		callbacks->rollback_handler = std::move(cb);
+		register_rollback_hook(detail::rollback_hook_call<rollback_handler_t>,
+				new rollback_handler_t(fun), detail::appdata_destroy_object<rollback_handler_t>);
 	}
 	else {
 		set_rollback_handler();
@@ -496,35 +627,385 @@ void connection::set_rollback_handler() {
 }
 
 
+void connection::register_update_hook(sqxx_update_hook_type *fun, void *data, sqxx_appdata_destroy_type *destroy) {
+	detail::hook_data hook(data, destroy);
+	setup_callbacks();
+	sqlite3_update_hook(handle, fun, data);
+	callbacks->update_handler = std::move(hook);
+}
+
+void connection::set_update_handler(const update_handler_t &fun) {
+	if (fun) {
+		register_update_hook(detail::update_hook_call<update_handler_t>,
+				new update_handler_t(fun), detail::appdata_destroy_object<update_handler_t>);
+	}
+	else {
+		set_update_handler();
+	}
+}
+
+void connection::set_update_handler() {
+	sqlite3_update_hook(handle, nullptr, nullptr);
+	if (callbacks)
+		callbacks->update_handler.reset();
+}
+
+
+#if defined(SQLITE_ENABLE_PREUPDATE_HOOK)
+int preupdate::count() const {
+	return sqlite3_preupdate_count(handle);
+}
+
+int preupdate::depth() const {
+	return sqlite3_preupdate_depth(handle);
+}
+
+value preupdate::old_value(int col) const {
+	sqlite3_value *v = nullptr;
+	int rv = sqlite3_preupdate_old(handle, col, &v);
+	if (rv != SQLITE_OK)
+		throw static_error(rv);
+	return value(v);
+}
+
+value preupdate::new_value(int col) const {
+	sqlite3_value *v = nullptr;
+	int rv = sqlite3_preupdate_new(handle, col, &v);
+	if (rv != SQLITE_OK)
+		throw static_error(rv);
+	return value(v);
+}
+
+int preupdate::blobwrite() const {
+#if SQLITE_VERSION_NUMBER >= 3036000
+	return sqlite3_preupdate_blobwrite(handle);
+#else
+	throw error(SQLITE_MISUSE, "sqlite3_preupdate_blobwrite() not supported");
+#endif
+}
+
 extern "C"
-void sqxx_call_update_handler(void *data, int op, char const *database_name, const char *table_name, sqlite3_int64 rowid) {
-	connection::update_handler_t *fn = reinterpret_cast<connection::update_handler_t*>(data);
+void sqxx_call_preupdate_handler(void *data, sqlite3 *handle, int op, char const *database_name,
+		const char *table_name, sqlite3_int64 old_rowid, sqlite3_int64 new_rowid) {
+	connection::preupdate_handler_t *fn = reinterpret_cast<connection::preupdate_handler_t*>(data);
 	try {
-		(*fn)(op, database_name, table_name, rowid);
+		(*fn)(preupdate(handle, op, database_name, table_name, old_rowid, new_rowid));
 	}
 	catch (...) {
-		handle_callback_exception("update handler");
+		handle_callback_exception("preupdate handler");
 	}
 }
 
-void connection::set_update_handler(const update_handler_t &fun) {
+void connection::set_preupdate_handler(const preupdate_handler_t &fun) {
 	if (fun) {
-		std::unique_ptr<update_handler_t> cb(new update_handler_t(fun));
-		sqlite3_update_hook(handle, sqxx_call_update_handler, cb.get());
+		if (callbacks && callbacks->sessions)
+			throw error(SQLITE_MISUSE, "cannot set a preupdate handler while a session uses the preupdate hook");
+		std::unique_ptr<preupdate_handler_t> cb(new preupdate_handler_t(fun));
+		sqlite3_preupdate_hook(handle, sqxx_call_preupdate_handler, cb.get());
 		setup_callbacks();
-		callbacks->update_handler = std::move(cb);
+		callbacks->preupdate_handler = std::move(cb);
 	}
 	else {
-		set_update_handler();
+		set_preupdate_handler();
 	}
 }
 
-void connection::set_update_handler() {
-	sqlite3_update_hook(handle, nullptr, nullptr);
+void connection::set_preupdate_handler() {
+	// With sessions no handler can be set, and the hook belongs to them
+	if (callbacks && callbacks->sessions)
+		return;
+	sqlite3_preupdate_hook(handle, nullptr, nullptr);
 	if (callbacks)
-		callbacks->update_handler.reset();
+		callbacks->preupdate_handler.reset();
+}
+#else
+int preupdate::count() const {
+	throw error(SQLITE_MISUSE, "sqlite3_preupdate_hook() not enabled");
+}
+
+int preupdate::depth() const {
+	throw error(SQLITE_MISUSE, "sqlite3_preupdate_hook() not enabled");
+}
+
+value preupdate::old_value(int) const {
+	throw error(SQLITE_MISUSE, "sqlite3_preupdate_hook() not enabled");
+}
+
+value preupdate::new_value(int) const {
+	throw error(SQLITE_MISUSE, "sqlite3_preupdate_hook() not enabled");
+}
+
+int preupdate::blobwrite() const {
+	throw error(SQLITE_MISUSE, "sqlite3_preupdate_hook() not enabled");
+}
+
+void connection::set_preupdate_handler(const preupdate_handler_t &) {
+	throw error(SQLITE_MISUSE, "sqlite3_preupdate_hook() not enabled");
+}
+
+void connection::set_preupdate_handler() {
+}
+#endif
+
+void connection::attach_session() {
+	if (callbacks && callbacks->preupdate_handler)
+		throw error(SQLITE_MISUSE, "cannot create a session while a preupdate handler is set");
+	setup_callbacks();
+	++callbacks->sessions;
+}
+
+void connection::detach_session() noexcept {
+	--callbacks->sessions;
+}
+
+#if SQLITE_VERSION_NUMBER >= 3014000
+
+// Trace handler, profile handler, profiler and slow query log share one
+// sqlite3_trace_v2() callback, which gets the callback table as context.
+
+namespace detail {
+namespace {
+
+void run_counters(sqlite3_stmt *stmt, int *out) {
+	for (int i = 0; i < profile_run::counter_count; ++i) {
+		out[i] = sqlite3_stmt_status(stmt, profile_run::counter_ops[i], 0);
+	}
 }
 
+// Handles not owned by a `statement` object might be finalized and their
+// address reused without the connection noticing, those aren't cached
+profiler::entry* profiler_entry(connection_callback_table *cbs, sqlite3_stmt *stmt) {
+	auto it = cbs->profiled.find(stmt);
+	if (it == cbs->profiled.end())
+		return nullptr;
+	if (!it->second) {
+		const char *sql = sqlite3_sql(stmt);
+		if (sql)
+			it->second = cbs->prof->lookup(sql);
+	}
+	return it->second;
+}
+
+void capture_slow_query(connection_callback_table *cbs, sqlite3_stmt *stmt,
+		uint64_t nsec, const profile_run *run) {
+	slow_query_log &log = *cbs->slow_log;
+	if (nsec < static_cast<uint64_t>(log.options().threshold.count()) || !log.admit())
+		return;
+	slow_query q;
+	char *expanded = sqlite3_expanded_sql(stmt);
+	q.sql = (expanded ? expanded : sqlite3_sql(stmt));
+	sqlite3_free(expanded);
+	q.duration_ns = nsec;
+	int now[profile_run::counter_count];
+	run_counters(stmt, now);
+	int *deltas[] = {&q.vm_steps, &q.fullscan_steps, &q.sorts, &q.autoindexes};
+	for (int i = 0; i < profile_run::counter_count; ++i) {
+		*deltas[i] = now[i] - (run ? run->start[i] : 0);
+	}
+	const char *database = sqlite3_db_filename(sqlite3_db_handle(stmt), "main");
+	if (database)
+		q.database = database;
+	// The connection is still running the statement, the log determines the
+	// plan on its own thread
+	log.submit(std::move(q), (log.options().explain ? sqlite3_sql(stmt) : ""));
+}
+
+} // anonymous namespace
+} // namespace detail
+
+extern "C"
+int sqxx_call_trace_v2(unsigned type, void *data, void *p, void *x) {
+	detail::connection_callback_table *cbs = reinterpret_cast<detail::connection_callback_table*>(data);
+	sqlite3_stmt *stmt = reinterpret_cast<sqlite3_stmt*>(p);
+	switch (type) {
+	case SQLITE_TRACE_STMT:
+		if (cbs->prof || cbs->slow_log) {
+			// Triggers report their own STMT events, only the first one starts a run
+			auto inserted = cbs->profile_runs.emplace(stmt, detail::profile_run());
+			if (inserted.second) {
+				detail::profile_run &run = inserted.first->second;
+				detail::run_counters(stmt, run.start);
+				if (cbs->prof) {
+					try {
+						run.entry = detail::profiler_entry(cbs, stmt);
+					}
+					catch (...) {
+						handle_callback_exception("profiler");
+					}
+				}
+			}
+		}
+		if (cbs->trace_handler) {
+			const char *text = reinterpret_cast<const char*>(x);
+			try {
+				if (text[0] == '-' && text[1] == '-') {
+					// Trigger comment
+					(*cbs->trace_handler)(text);
+				}
+				else {
+					char *expanded = sqlite3_expanded_sql(stmt);
+					std::unique_ptr<char, void (*)(void*)> guard(expanded, sqlite3_free);
+					(*cbs->trace_handler)(expanded ? expanded : text);
+				}
+			}
+			catch (...) {
+				handle_callback_exception("trace handler");
+			}
+		}
+		break;
+	case SQLITE_TRACE_PROFILE: {
+		uint64_t nsec = static_cast<uint64_t>(*reinterpret_cast<sqlite3_int64*>(x));
+		auto it = cbs->profile_runs.find(stmt);
+		const detail::profile_run *run = (it != cbs->profile_runs.end() ? &it->second : nullptr);
+		if (cbs->prof) {
+			uint64_t vm_steps = sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_VM_STEP, 0) - (run ? run->start[0] : 0);
+			try {
+				if (run && run->entry)
+					cbs->prof->record(run->entry, nsec, run->rows, vm_steps);
+				else
+					cbs->prof->record(sqlite3_sql(stmt), nsec, (run ? run->rows : 0), vm_steps);
+			}
+			catch (...) {
+				handle_callback_exception("profiler");
+			}
+		}
+		if (cbs->slow_log) {
+			try {
+				detail::capture_slow_query(cbs, stmt, nsec, run);
+			}
+			catch (...) {
+				handle_callback_exception("slow query log");
+			}
+		}
+		if (run)
+			cbs->profile_runs.erase(it);
+		if (cbs->profile_handler) {
+			try {
+				(*cbs->profile_handler)(sqlite3_sql(stmt), nsec);
+			}
+			catch (...) {
+				handle_callback_exception("profile handler");
+			}
+		}
+		break;
+	}
+	case SQLITE_TRACE_ROW:
+		if (cbs->prof) {
+			auto it = cbs->profile_runs.find(stmt);
+			if (it != cbs->profile_runs.end())
+				++it->second.rows;
+		}
+		break;
+	}
+	return 0;
+}
+
+void connection::update_trace() {
+	unsigned mask = 0;
+	if (callbacks) {
+		if (callbacks->trace_handler)
+			mask |= SQLITE_TRACE_STMT;
+		if (callbacks->profile_handler)
+			mask |= SQLITE_TRACE_PROFILE;
+		if (callbacks->prof)
+			mask |= SQLITE_TRACE_STMT | SQLITE_TRACE_PROFILE | SQLITE_TRACE_ROW;
+		if (callbacks->slow_log)
+			mask |= SQLITE_TRACE_STMT | SQLITE_TRACE_PROFILE;
+		if (!callbacks->prof && !callbacks->slow_log)
+			callbacks->profile_runs.clear();
+	}
+	int rv = sqlite3_trace_v2(handle, mask, (mask ? sqxx_call_trace_v2 : nullptr), callbacks.get());
+	if (rv != SQLITE_OK)
+		throw static_error(rv);
+}
+
+void connection::set_trace_handler(const trace_handler_t &fun) {
+	if (fun) {
+		std::unique_ptr<trace_handler_t> cb(new trace_handler_t(fun));
+		setup_callbacks();
+		callbacks->trace_handler = std::move(cb);
+		update_trace();
+	}
+	else {
+		set_trace_handler();
+	}
+}
+
+void connection::set_trace_handler() {
+	if (callbacks)
+		callbacks->trace_handler.reset();
+	update_trace();
+}
+
+void connection::set_profile_handler(const profile_handler_t &fun) {
+	if (fun) {
+		std::unique_ptr<profile_handler_t> cb(new profile_handler_t(fun));
+		setup_callbacks();
+		callbacks->profile_handler = std::move(cb);
+		update_trace();
+	}
+	else {
+		set_profile_handler();
+	}
+}
+
+void connection::set_profile_handler() {
+	if (callbacks)
+		callbacks->profile_handler.reset();
+	update_trace();
+}
+
+void connection::set_profiler(profiler &prof) {
+	setup_callbacks();
+	if (callbacks->prof != &prof) {
+		// Entries of the previous profiler, also of runs in progress
+		for (auto &p : callbacks->profiled) {
+			p.second = nullptr;
+		}
+		for (auto &r : callbacks->profile_runs) {
+			r.second.entry = nullptr;
+		}
+	}
+	callbacks->prof = &prof;
+	update_trace();
+}
+
+void connection::set_profiler() {
+	if (callbacks)
+		callbacks->prof = nullptr;
+	update_trace();
+}
+
+void connection::statement_created(sqlite3_stmt *stmt) noexcept {
+	if (!callbacks || !callbacks->prof)
+		return;
+	try {
+		callbacks->profiled.emplace(stmt, nullptr);
+	}
+	catch (const std::bad_alloc&) {
+		// The statement is profiled by its SQL text instead
+	}
+}
+
+void connection::statement_finalized(sqlite3_stmt *stmt) noexcept {
+	if (callbacks)
+		callbacks->profiled.erase(stmt);
+}
+
+void connection::set_slow_query_log(slow_query_log &log) {
+	setup_callbacks();
+	callbacks->slow_log = &log;
+	update_trace();
+}
+
+void connection::set_slow_query_log() {
+	if (callbacks)
+		callbacks->slow_log = nullptr;
+	update_trace();
+}
+
+#else
+
 extern "C"
 void sqxx_call_trace_handler(void *data, const char* sql) {
 	connection::trace_handler_t *fn = reinterpret_cast<connection::trace_handler_t*>(data);
@@ -583,6 +1064,27 @@ void connection::set_profile_handler() {
 		callbacks->profile_handler.reset();
 }
 
+void connection::set_profiler(profiler &) {
+	throw error(SQLITE_MISUSE, "profiling needs sqlite3_trace_v2()");
+}
+
+void connection::set_profiler() {
+}
+
+void connection::statement_created(sqlite3_stmt *) noexcept {
+}
+
+void connection::statement_finalized(sqlite3_stmt *) noexcept {
+}
+
+void connection::set_slow_query_log(slow_query_log &) {
+	throw error(SQLITE_MISUSE, "slow query log needs sqlite3_trace_v2()");
+}
+
+void connection::set_slow_query_log() {
+}
+#endif
+
 extern "C"
 int sqxx_call_authorize_handler(void *data, int action, const char* d1, const char *d2, const char *d3, const char *d4) {
 	connection::authorize_handler_t *fn = reinterpret_cast<connection::authorize_handler_t*>(data);
@@ -614,23 +1116,85 @@ void connection::set_authorize_handler() {
 }
 
 extern "C"
-int sqxx_call_busy_handler(void *data, int count) {
-	connection::busy_handler_t *fn = reinterpret_cast<connection::busy_handler_t*>(data);
+int sqxx_call_collect_read_tables(void *data, int action, const char *table, const char *d2, const char *d3, const char *d4) {
+	detail::read_tables_context *ctx = reinterpret_cast<detail::read_tables_context*>(data);
 	try {
-		return (*fn)(count);
+		std::vector<std::string> &tables = ctx->tables;
+		if (action == SQLITE_READ && table && std::find(tables.begin(), tables.end(), table) == tables.end())
+			tables.push_back(table);
 	}
 	catch (...) {
-		handle_callback_exception("busy handler");
-		return 0;
+		handle_callback_exception("read tables authorizer");
+		return SQLITE_DENY;
+	}
+	if (ctx->authorize)
+		return sqxx_call_authorize_handler(ctx->authorize, action, table, d2, d3, d4);
+	return SQLITE_OK;
+}
+
+namespace detail {
+namespace {
+
+// Compiles `sql` with a temporary authorizer that collects the tables it
+// reads from. With `authorize` the authorize handler is consulted as well.
+int prepare_read_tables(sqlite3 *handle, connection_callback_table *cbs, const char *sql,
+		std::vector<std::string> &tables, bool authorize, sqlite3_stmt **stmt) {
+	connection::authorize_handler_t *handler = (cbs ? cbs->authorize_handler.get() : nullptr);
+	read_tables_context ctx{tables, (authorize ? handler : nullptr)};
+	sqlite3_set_authorizer(handle, sqxx_call_collect_read_tables, &ctx);
+	int rv = sqlite3_prepare_v2(handle, sql, -1, stmt, nullptr);
+	std::string msg = (rv == SQLITE_OK ? "" : sqlite3_errmsg(handle));
+
+	if (handler)
+		sqlite3_set_authorizer(handle, sqxx_call_authorize_handler, handler);
+	else
+		sqlite3_set_authorizer(handle, nullptr, nullptr);
+
+	if (rv != SQLITE_OK) {
+		sqlite3_finalize(*stmt);
+		throw error(rv, msg);
 	}
+	return rv;
+}
+
+} // anonymous namespace
+} // namespace detail
+
+std::vector<std::string> connection::read_tables(const char *sql) {
+	std::vector<std::string> tables;
+	sqlite3_stmt *stmt = nullptr;
+	detail::prepare_read_tables(handle, callbacks.get(), sql, tables, false, &stmt);
+	sqlite3_finalize(stmt);
+	return tables;
+}
+
+statement connection::prepare(const char *sql, std::vector<std::string> &tables) {
+	sqlite3_stmt *stmt = nullptr;
+	detail::prepare_read_tables(handle, callbacks.get(), sql, tables, true, &stmt);
+	return statement(*this, stmt);
+}
+
+statement connection::prepare(const std::string &sql, std::vector<std::string> &tables) {
+	return prepare(sql.c_str(), tables);
+}
+
+std::vector<std::string> connection::read_tables(const std::string &sql) {
+	return read_tables(sql.c_str());
+}
+
+void connection::register_busy_hook(sqxx_busy_hook_type *fun, void *data, sqxx_appdata_destroy_type *destroy) {
+	detail::hook_data hook(data, destroy);
+	setup_callbacks();
+	int rv = sqlite3_busy_handler(handle, fun, data);
+	if (rv != SQLITE_OK)
+		throw static_error(rv);
+	callbacks->busy_handler = std::move(hook);
 }
 
 void connection::set_busy_handler(const busy_handler_t &fun) {
 	if (fun) {
-		std::unique_ptr<busy_handler_t> cb(new busy_handler_t(fun));
-		sqlite3_busy_handler(handle, sqxx_call_busy_handler, cb.get());
-		setup_callbacks();
-		callbacks->busy_handler = std::move(cb);
+		register_busy_hook(detail::busy_hook_call<busy_handler_t>,
+				new busy_handler_t(fun), detail::appdata_destroy_object<busy_handler_t>);
 	}
 	else {
 		set_busy_handler();
@@ -652,24 +1216,232 @@ void connection::busy_timeout(int ms) {
 }
 
 
+// Typed pragmas
+
+namespace detail {
+namespace {
+
+const char* const journal_mode_names[] = {"delete", "truncate", "persist", "memory", "wal", "off"};
+const char* const locking_mode_names[] = {"normal", "exclusive"};
+
+template<size_t N>
+int name_index(const char* const (&names)[N], const std::string &name) {
+	for (size_t i = 0; i < N; ++i) {
+		if (name == names[i])
+			return static_cast<int>(i);
+	}
+	throw error(SQLITE_ERROR, "unexpected pragma value: " + name);
+}
+
+} // anonymous namespace
+
+// First column of the first result row of a pragma, as text
+std::string pragma(sqlite3 *db, const std::string &sql) {
+	sqlite3_stmt *stmt = nullptr;
+	int rv = sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr);
+	if (rv != SQLITE_OK) {
+		sqlite3_finalize(stmt);
+		throw recent_error(db);
+	}
+	std::string result;
+	rv = sqlite3_step(stmt);
+	if (rv == SQLITE_ROW) {
+		const unsigned char *text = sqlite3_column_text(stmt, 0);
+		if (text)
+			result = reinterpret_cast<const char*>(text);
+	}
+	else if (rv != SQLITE_DONE) {
+		sqlite3_finalize(stmt);
+		throw recent_error(db);
+	}
+	sqlite3_finalize(stmt);
+	return result;
+}
+
+} // namespace detail
+
+journal_mode_t connection::journal_mode() {
+	return static_cast<journal_mode_t>(detail::name_index(detail::journal_mode_names,
+			detail::pragma(handle, "pragma journal_mode")));
+}
+
+void connection::journal_mode(journal_mode_t mode) {
+	const char *name = detail::journal_mode_names[mode];
+	std::string result = detail::pragma(handle, std::string("pragma journal_mode = ") + name);
+	if (result != name)
+		throw error(SQLITE_ERROR, std::string("cannot change journal_mode to ") + name + ", it stays " + result);
+}
+
+synchronous_t connection::synchronous() {
+	return static_cast<synchronous_t>(std::stoi(detail::pragma(handle, "pragma synchronous")));
+}
+
+void connection::synchronous(synchronous_t mode) {
+	detail::pragma(handle, "pragma synchronous = " + std::to_string(mode));
+}
+
+int64_t connection::cache_size() {
+	return std::stoll(detail::pragma(handle, "pragma cache_size"));
+}
+
+void connection::cache_size(int64_t size) {
+	detail::pragma(handle, "pragma cache_size = " + std::to_string(size));
+}
+
+int64_t connection::mmap_size() {
+	std::string result = detail::pragma(handle, "pragma mmap_size");
+	// No result if memory mapping is disabled at compile time
+	return (result.empty() ? 0 : std::stoll(result));
+}
+
+int64_t connection::mmap_size(int64_t bytes) {
+	std::string result = detail::pragma(handle, "pragma mmap_size = " + std::to_string(bytes));
+	return (result.empty() ? 0 : std::stoll(result));
+}
+
+temp_store_t connection::temp_store() {
+	return static_cast<temp_store_t>(std::stoi(detail::pragma(handle, "pragma temp_store")));
+}
+
+void connection::temp_store(temp_store_t store) {
+	detail::pragma(handle, "pragma temp_store = " + std::to_string(store));
+}
+
+int connection::page_size() {
+	return std::stoi(detail::pragma(handle, "pragma page_size"));
+}
+
+void connection::page_size(int bytes) {
+	detail::pragma(handle, "pragma page_size = " + std::to_string(bytes));
+}
+
+locking_mode_t connection::locking_mode() {
+	return static_cast<locking_mode_t>(detail::name_index(detail::locking_mode_names,
+			detail::pragma(handle, "pragma locking_mode")));
+}
+
+void connection::locking_mode(locking_mode_t mode) {
+	const char *name = detail::locking_mode_names[mode];
+	std::string result = detail::pragma(handle, std::string("pragma locking_mode = ") + name);
+	if (result != name)
+		throw error(SQLITE_ERROR, std::string("cannot change locking_mode to ") + name + ", it stays " + result);
+}
+
+int connection::wal_autocheckpoint() {
+	return std::stoi(detail::pragma(handle, "pragma wal_autocheckpoint"));
+}
+
+int connection::busy_timeout() {
+	return std::stoi(detail::pragma(handle, "pragma busy_timeout"));
+}
+
+
+#if defined(SQLITE_ENABLE_UNLOCK_NOTIFY)
 extern "C"
-int sqxx_call_progress_handler(void *data) {
-	connection::progress_handler_t *fn = reinterpret_cast<connection::progress_handler_t*>(data);
-	try {
-		return (*fn)();
+void sqxx_call_unlock_handler(void **args, int nargs) {
+	for (int i = 0; i < nargs; ++i) {
+		connection::unlock_handler_t *fn = reinterpret_cast<connection::unlock_handler_t*>(args[i]);
+		try {
+			(*fn)();
+		}
+		catch (...) {
+			handle_callback_exception("unlock handler");
+		}
 	}
-	catch (...) {
-		handle_callback_exception("progress handler");
-		return 0;
+}
+
+void connection::set_unlock_handler(const unlock_handler_t &fun) {
+	if (fun) {
+		std::unique_ptr<unlock_handler_t> cb(new unlock_handler_t(fun));
+		int rv = sqlite3_unlock_notify(handle, sqxx_call_unlock_handler, cb.get());
+		if (rv != SQLITE_OK)
+			throw static_error(rv);
+		setup_callbacks();
+		callbacks->unlock_handler = std::move(cb);
+	}
+	else {
+		set_unlock_handler();
+	}
+}
+
+void connection::set_unlock_handler() {
+	sqlite3_unlock_notify(handle, nullptr, nullptr);
+	if (callbacks)
+		callbacks->unlock_handler.reset();
+}
+
+extern "C"
+void sqxx_call_unlock_wait(void **args, int nargs) {
+	for (int i = 0; i < nargs; ++i) {
+		detail::unlock_wait *w = reinterpret_cast<detail::unlock_wait*>(args[i]);
+		// Notify while holding the lock, the waiter destroys `w` as soon as
+		// it sees `fired`.
+		std::lock_guard<std::mutex> lock(w->mutex);
+		w->fired = true;
+		w->cond.notify_one();
 	}
 }
 
+bool connection::wait_for_unlock() {
+	setup_callbacks();
+	sqxx::unlock_stats &stats = callbacks->unlock;
+
+	detail::unlock_wait w;
+	auto start = std::chrono::steady_clock::now();
+	int rv = sqlite3_unlock_notify(handle, sqxx_call_unlock_wait, &w);
+	if (rv != SQLITE_OK) {
+		++stats.deadlocks;
+		return false;
+	}
+	// Only one notification can be registered, this replaced the user's
+	callbacks->unlock_handler.reset();
+	{
+		std::unique_lock<std::mutex> lock(w.mutex);
+		w.cond.wait(lock, [&w] { return w.fired; });
+	}
+	uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now() - start).count();
+
+	++stats.waits;
+	stats.wait_ns += ns;
+	if (ns > stats.max_wait_ns)
+		stats.max_wait_ns = ns;
+	return true;
+}
+
+#else
+
+void connection::set_unlock_handler(const unlock_handler_t &) {
+	throw error(SQLITE_MISUSE, "sqlite3_unlock_notify() not supported");
+}
+
+void connection::set_unlock_handler() {
+}
+
+bool connection::wait_for_unlock() {
+	throw error(SQLITE_MISUSE, "sqlite3_unlock_notify() not supported");
+}
+
+#endif
+
+sqxx::unlock_stats connection::unlock_stats() const {
+	if (callbacks)
+		return callbacks->unlock;
+	return sqxx::unlock_stats();
+}
+
+
+void connection::register_progress_hook(int vinst, sqxx_progress_hook_type *fun, void *data, sqxx_appdata_destroy_type *destroy) {
+	detail::hook_data hook(data, destroy);
+	setup_callbacks();
+	sqlite3_progress_handler(handle, vinst, fun, data);
+	callbacks->progress_handler = std::move(hook);
+}
+
 void connection::set_progress_handler(int vinst, const progress_handler_t &fun) {
 	if (fun) {
-		std::unique_ptr<progress_handler_t> cb(new progress_handler_t(fun));
-		sqlite3_progress_handler(handle, vinst, sqxx_call_progress_handler, cb.get());
-		setup_callbacks();
-		callbacks->progress_handler = std::move(cb);
+		register_progress_hook(vinst, detail::progress_hook_call<progress_handler_t>,
+				new progress_handler_t(fun), detail::appdata_destroy_object<progress_handler_t>);
 	}
 	else {
 		set_progress_handler();
@@ -683,29 +1455,17 @@ void connection::set_progress_handler() {
 }
 
 
-extern "C"
-int sqxx_call_wal_handler(void *data, sqlite3* conn, const char *dbname, int pages) {
-	// We registered on a certain connection, and thats the connection we
-	// expect to get back here. So `conn` seems to be pretty useless here.
-	unused(conn);
-	connection::wal_handler_t *fn = reinterpret_cast<connection::wal_handler_t*>(data);
-	try {
-		(*fn)(dbname, pages);
-		return SQLITE_OK;
-	}
-	catch (...) {
-		// TODO: Better exception handling?
-		handle_callback_exception("wal handler");
-		return SQLITE_ERROR;
-	}
+void connection::register_wal_hook(sqxx_wal_hook_type *fun, void *data, sqxx_appdata_destroy_type *destroy) {
+	detail::hook_data hook(data, destroy);
+	setup_callbacks();
+	sqlite3_wal_hook(handle, fun, data);
+	callbacks->wal_handler = std::move(hook);
 }
 
 void connection::set_wal_handler(const wal_handler_t &fun) {
 	if (fun) {
-		std::unique_ptr<wal_handler_t> cb(new wal_handler_t(fun));
-		sqlite3_wal_hook(handle, sqxx_call_wal_handler, cb.get());
-		setup_callbacks();
-		callbacks->wal_handler = std::move(cb);
+		register_wal_hook(detail::wal_hook_call<wal_handler_t>,
+				new wal_handler_t(fun), detail::appdata_destroy_object<wal_handler_t>);
 	}
 	else {
 		set_wal_handler();
@@ -758,6 +1518,19 @@ std::pair<int, int> connection::wal_checkpoint_restart(const std::string &dbname
 	return wal_checkpoint_restart(dbname.c_str());
 }
 
+std::pair<int, int> connection::wal_checkpoint_truncate(const char *dbname) {
+#if SQLITE_VERSION_NUMBER >= 3008008
+	return wal_checkpoint(dbname, SQLITE_CHECKPOINT_TRUNCATE);
+#else
+	unused(dbname);
+	throw error(SQLITE_MISUSE, "checkpoint truncate needs sqlite3 >= v3.8.8");
+#endif
+}
+
+std::pair<int, int> connection::wal_checkpoint_truncate(const std::string &dbname) {
+	return wal_checkpoint_truncate(dbname.c_str());
+}
+
 extern "C"
 void sqxx_call_collation_handler(void *data, sqlite3* /*conn*/, int textrep, const char *name) {
 	// We registered on a certain connection, and thats the connection we
@@ -8,8 +8,22 @@
 #include "error.hpp"
 #include <memory>
 #include <functional>
+#include <string>
+#include <type_traits>
+#include <vector>
 
 struct sqlite3;
+struct sqlite3_stmt;
+
+// Function types with C calling convention for callbacks
+// https://stackoverflow.com/a/5590050/
+extern "C" typedef void sqxx_appdata_destroy_type(void*);
+extern "C" typedef int sqxx_commit_hook_type(void*);
+extern "C" typedef void sqxx_rollback_hook_type(void*);
+extern "C" typedef void sqxx_update_hook_type(void*, int, const char*, const char*, long long);
+extern "C" typedef int sqxx_busy_hook_type(void*, int);
+extern "C" typedef int sqxx_progress_hook_type(void*);
+extern "C" typedef int sqxx_wal_hook_type(void*, sqlite3*, const char*, int);
 
 namespace sqxx {
 
@@ -36,16 +50,64 @@ enum open_flags {
 	 //OPEN_WAL =              0x00080000,  /* VFS only */
 };
 
+/** Values of `pragma journal_mode`, see `connection::journal_mode()` */
+enum journal_mode_t {
+	JOURNAL_DELETE,
+	JOURNAL_TRUNCATE,
+	JOURNAL_PERSIST,
+	JOURNAL_MEMORY,
+	JOURNAL_WAL,
+	JOURNAL_OFF,
+};
+
+/** Values of `pragma synchronous`, see `connection::synchronous()` */
+enum synchronous_t {
+	SYNC_OFF =    0,
+	SYNC_NORMAL = 1,
+	SYNC_FULL =   2,
+	SYNC_EXTRA =  3,
+};
+
+/** Values of `pragma temp_store`, see `connection::temp_store()` */
+enum temp_store_t {
+	TEMP_STORE_DEFAULT = 0,
+	TEMP_STORE_FILE =    1,
+	TEMP_STORE_MEMORY =  2,
+};
+
+/** Values of `pragma locking_mode`, see `connection::locking_mode()` */
+enum locking_mode_t {
+	LOCKING_NORMAL,
+	LOCKING_EXCLUSIVE,
+};
+
 class recent_error : public error {
 public:
 	recent_error(sqlite3 *handle);
 };
 
 class statement;
+class profiler;
+class slow_query_log;
+class value;
 
 namespace detail {
 	// Helpers for user defined callbacks/sql functions
 	class connection_callback_table;
+
+	template<typename T>
+	struct is_std_function : std::false_type {};
+	template<typename Signature>
+	struct is_std_function<std::function<Signature>> : std::true_type {};
+
+	// Callable objects that are registered as hooks without wrapping them in
+	// a `std::function`. Function pointers, `nullptr` and `std::function`s
+	// use the overloads taking a `std::function`.
+	template<typename Callable>
+	using if_hook_object_t = std::enable_if_t<
+			std::is_class<std::decay_t<Callable>>::value &&
+			!is_std_function<std::decay_t<Callable>>::value,
+			void>;
 }
 
 /** Metadata for a table column */
@@ -57,6 +119,99 @@ struct column_metadata {
 	bool autoinc;
 };
 
+/**
+ * How database files grow, see `connection::set_growth_policy()`.
+ */
+struct growth_policy {
+	/**
+	 * Files are extended in multiples of this size (in bytes). `0` keeps
+	 * sqlite's default of growing page by page.
+	 */
+	int chunk_size = 0;
+	/**
+	 * Size (in bytes) the main database file is extended to right away,
+	 * rounded up to whole chunks. Ignored for empty databases, including
+	 * newly created ones.
+	 */
+	int64_t preallocate = 0;
+};
+
+/** Contention on shared-cache locks, see `connection::unlock_stats()` */
+struct unlock_stats {
+	/** Number of times the connection waited for another connection's lock */
+	uint64_t waits = 0;
+	/** Waits that were not started because they would have deadlocked */
+	uint64_t deadlocks = 0;
+	/** Total time spent waiting, in nanoseconds */
+	uint64_t wait_ns = 0;
+	/** Longest single wait, in nanoseconds */
+	uint64_t max_wait_ns = 0;
+};
+
+/**
+ * A row about to be changed, passed to the preupdate handler of a
+ * connection.
+ *
+ * The values point directly into sqlite's copy of the row and are only
+ * valid during the handler call.
+ */
+class preupdate {
+private:
+	sqlite3 *handle;
+
+public:
+	/** `SQLITE_INSERT`, `SQLITE_UPDATE` or `SQLITE_DELETE` */
+	int op;
+	const char *database;
+	const char *table;
+	/** Rowid before and after the change, undefined for inserts resp. deletes */
+	int64_t old_rowid;
+	int64_t new_rowid;
+
+	preupdate(sqlite3 *handle_arg, int op_arg, const char *database_arg, const char *table_arg,
+			int64_t old_rowid_arg, int64_t new_rowid_arg)
+		: handle(handle_arg), op(op_arg), database(database_arg), table(table_arg),
+		  old_rowid(old_rowid_arg), new_rowid(new_rowid_arg) {
+	}
+
+	/**
+	 * Number of columns of the row.
+	 *
+	 * Wraps [`sqlite3_preupdate_count()`](http://www.sqlite.org/c3ref/preupdate_blobwrite.html)
+	 */
+	int count() const;
+
+	/**
+	 * 0 for changes of top-level statements, 1 for changes by their
+	 * triggers, and so on.
+	 *
+	 * Wraps [`sqlite3_preupdate_depth()`](http://www.sqlite.org/c3ref/preupdate_blobwrite.html)
+	 */
+	int depth() const;
+
+	/**
+	 * Column of the row before an update or delete.
+	 *
+	 * Wraps [`sqlite3_preupdate_old()`](http://www.sqlite.org/c3ref/preupdate_blobwrite.html)
+	 */
+	value old_value(int col) const;
+
+	/**
+	 * Column of the row after an insert or update.
+	 *
+	 * Wraps [`sqlite3_preupdate_new()`](http://www.sqlite.org/c3ref/preupdate_blobwrite.html)
+	 */
+	value new_value(int col) const;
+
+	/**
+	 * Column written by incremental blob I/O, -1 if the change wasn't done
+	 * with a blob handle. Only available from sqlite 3.36.
+	 *
+	 * Wraps [`sqlite3_preupdate_blobwrite()`](http://www.sqlite.org/c3ref/preupdate_blobwrite.html)
+	 */
+	int blobwrite() const;
+};
+
 /** A database connection */
 class connection {
 private:
@@ -67,11 +222,34 @@ private:
 
 	// On-demand initialization of callback table
 	void setup_callbacks();
+	// Install the trace callback needed by the current handlers
+	void update_trace();
+
+	// Install a hook function. `data` is owned by the connection from now
+	// on and released with `destroy`, if that isn't null.
+	void register_commit_hook(sqxx_commit_hook_type *fun, void *data, sqxx_appdata_destroy_type *destroy);
+	void register_rollback_hook(sqxx_rollback_hook_type *fun, void *data, sqxx_appdata_destroy_type *destroy);
+	void register_update_hook(sqxx_update_hook_type *fun, void *data, sqxx_appdata_destroy_type *destroy);
+	void register_busy_hook(sqxx_busy_hook_type *fun, void *data, sqxx_appdata_destroy_type *destroy);
+	void register_progress_hook(int n, sqxx_progress_hook_type *fun, void *data, sqxx_appdata_destroy_type *destroy);
+	void register_wal_hook(sqxx_wal_hook_type *fun, void *data, sqxx_appdata_destroy_type *destroy);
+
+	// A `session` installs its own preupdate hook, which can't be combined
+	// with a preupdate handler
+	friend class session;
+	void attach_session();
+	void detach_session() noexcept;
+
+	// Statement objects report their handles, so that a profiler's entry can
+	// be cached per handle until the statement is finalized
+	friend class statement;
+	void statement_created(sqlite3_stmt *stmt) noexcept;
+	void statement_finalized(sqlite3_stmt *stmt) noexcept;
 
 public:
 	connection();
-	explicit connection(const char *filename, int flags = 0);
-	explicit connection(const std::string &filename, int flags = 0);
+	explicit connection(const char *filename, int flags = 0, const char *vfs = nullptr);
+	explicit connection(const std::string &filename, int flags = 0, const char *vfs = nullptr);
 	~connection() noexcept;
 
 	// Don't copy, move
@@ -165,10 +343,30 @@ public:
 	/**
 	 * Open a new database connection.
 	 *
+	 * `vfs` is the name of the virtual file system that should be used,
+	 * `nullptr` for the default VFS.
+	 *
 	 * Wraps [`sqlite3_open_v2()`](http://www.sqlite.org/c3ref/open.html)
 	 */
-	void open(const char *filename, int flags = 0);
-	void open(const std::string &filename, int flags = 0);
+	void open(const char *filename, int flags = 0, const char *vfs = nullptr);
+	void open(const std::string &filename, int flags = 0, const char *vfs = nullptr);
+
+	/**
+	 * Open a new database connection and apply a growth policy to the
+	 * main database.
+	 *
+	 * For example to grow a database in steps of 64 MiB:
+	 *
+	 *     sqxx::growth_policy growth;
+	 *     growth.chunk_size = 64 * 1024 * 1024;
+	 *     conn.open("log.db", sqxx::OPEN_READWRITE|sqxx::OPEN_CREATE, nullptr, growth);
+	 *
+	 * The `preallocate` size of the policy is ignored if the database is
+	 * still empty, which is always the case for newly created files, see
+	 * `set_growth_policy()`.
+	 */
+	void open(const char *filename, int flags, const char *vfs, const growth_policy &growth);
+	void open(const std::string &filename, int flags, const char *vfs, const growth_policy &growth);
 
 	/**
 	 * Close the database connection (might delay closure and finish it async).
@@ -217,6 +415,23 @@ public:
 	 */
 	statement prepare(const char *sql);
 	statement prepare(const std::string &sql);
+	/**
+	 * Like `prepare()`, and also stores the names of the tables the
+	 * statement reads from in `tables`, like `read_tables()`, without
+	 * compiling the statement twice.
+	 */
+	statement prepare(const char *sql, std::vector<std::string> &tables);
+	statement prepare(const std::string &sql, std::vector<std::string> &tables);
+
+	/**
+	 * Names of the tables a sql statement reads from, including the tables
+	 * behind views.
+	 *
+	 * Compiles the statement with a temporary authorizer that collects the
+	 * tables. A registered authorize handler is restored afterwards.
+	 */
+	std::vector<std::string> read_tables(const char *sql);
+	std::vector<std::string> read_tables(const std::string &sql);
 
 	/** Runs a sql query.
 	 *
@@ -298,12 +513,123 @@ public:
 	/// only implemented for sqlite3 >= 3.8.7
 	int limit_worker_threads(int value=-1);
 
+	/**
+	 * Low-level control of the file of database `dbname`.
+	 *
+	 * Throws if the VFS doesn't understand `op`.
+	 *
+	 * Wraps [`sqlite3_file_control()`](http://www.sqlite.org/c3ref/file_control.html)
+	 */
+	void file_control(const char *dbname, int op, void *arg);
+	void file_control(const std::string &dbname, int op, void *arg);
+
+	/**
+	 * Extend and truncate the database file in multiples of `bytes`
+	 * (SQLITE_FCNTL_CHUNK_SIZE).
+	 */
+	void file_control_chunk_size(int bytes, const char *dbname = "main");
+	/**
+	 * Tell the VFS that the database file will grow to `bytes`, so that it
+	 * can preallocate the space (SQLITE_FCNTL_SIZE_HINT). The builtin unix VFS
+	 * only preallocates if a chunk size is set.
+	 */
+	void file_control_size_hint(int64_t bytes, const char *dbname = "main");
+	/**
+	 * Keep the write-ahead log after the last connection closes
+	 * (SQLITE_FCNTL_PERSIST_WAL).
+	 *
+	 * `mode` is `0` or `1` to change the setting, `-1` to only query it.
+	 * Returns the current setting.
+	 */
+	bool file_control_persist_wal(int mode = -1, const char *dbname = "main");
+
+	/**
+	 * Apply a growth policy to database `dbname`.
+	 *
+	 * Growing in large chunks avoids fragmentation of the file and the cost
+	 * of extending it on many writes of append-heavy workloads.
+	 *
+	 * `growth.preallocate` is ignored without notice if the database file is
+	 * still empty, since sqlite would take a file that is extended before
+	 * its first page is written for a corrupt database. The chunk size is
+	 * applied in any case. For a new database, call this again once the
+	 * first transaction has committed to preallocate the file.
+	 */
+	void set_growth_policy(const growth_policy &growth, const char *dbname = "main");
+
 	/**
 	 * Sets a busy timeout.
 	 *
 	 * Wraps [`sqlite3_busy_timeout()`](http://www.sqlite.org/c3ref/busy_timeout.html)
 	 */
 	void busy_timeout(int ms);
+	/** The busy timeout in milliseconds, `0` if there is none */
+	int busy_timeout();
+
+	/**
+	 * Typed access to the pragmas used to tune a connection. The getters
+	 * query the current value, the setters check that the new value took
+	 * effect where sqlite reports it, and throw otherwise. They apply to the
+	 * main database.
+	 *
+	 * See also `tuning` (tuning.hpp) to change several of these at once.
+	 */
+
+	/**
+	 * [`pragma journal_mode`](http://www.sqlite.org/pragma.html#pragma_journal_mode)
+	 *
+	 * Throws if the mode can't be changed, for example to `JOURNAL_WAL` for
+	 * an in-memory database or while a transaction is active.
+	 */
+	journal_mode_t journal_mode();
+	void journal_mode(journal_mode_t mode);
+
+	/** [`pragma synchronous`](http://www.sqlite.org/pragma.html#pragma_synchronous) */
+	synchronous_t synchronous();
+	void synchronous(synchronous_t mode);
+
+	/**
+	 * [`pragma cache_size`](http://www.sqlite.org/pragma.html#pragma_cache_size)
+	 *
+	 * Positive values are pages, negative values KiB.
+	 */
+	int64_t cache_size();
+	void cache_size(int64_t size);
+
+	/**
+	 * [`pragma mmap_size`](http://www.sqlite.org/pragma.html#pragma_mmap_size)
+	 *
+	 * The setter returns the size that is actually used, which is limited by
+	 * `SQLITE_MAX_MMAP_SIZE`.
+	 */
+	int64_t mmap_size();
+	int64_t mmap_size(int64_t bytes);
+
+	/** [`pragma temp_store`](http://www.sqlite.org/pragma.html#pragma_temp_store) */
+	temp_store_t temp_store();
+	void temp_store(temp_store_t store);
+
+	/**
+	 * [`pragma page_size`](http://www.sqlite.org/pragma.html#pragma_page_size)
+	 *
+	 * A new page size only takes effect when the database is created or by
+	 * a `vacuum`.
+	 */
+	int page_size();
+	void page_size(int bytes);
+
+	/**
+	 * [`pragma locking_mode`](http://www.sqlite.org/pragma.html#pragma_locking_mode)
+	 *
+	 * After switching back to `LOCKING_NORMAL`, the exclusive lock is only
+	 * released with the next access to the database.
+	 */
+	locking_mode_t locking_mode();
+	void locking_mode(locking_mode_t mode);
+
+	/** [`pragma wal_autocheckpoint`](http://www.sqlite.org/pragma.html#pragma_wal_autocheckpoint) */
+	int wal_autocheckpoint();
+
 	/**
 	 * Try to free memory that is no longer used by the database connection.
 	 *
@@ -327,6 +653,28 @@ public:
 	void set_commit_handler(const commit_handler_t &fun);
 	void set_commit_handler();
 
+	/**
+	 * Register a callable object or a function known at compile time as
+	 * commit handler.
+	 *
+	 * Unlike with `commit_handler_t` the hook calls it directly, without
+	 * the indirection of `std::function`, so that it can be inlined. A copy
+	 * of the callable object is stored by the connection. The same overloads
+	 * exist for the other frequently called hooks (rollback, update, busy,
+	 * progress, WAL):
+	 *
+	 * ```
+	 * int on_commit() { return 0; }
+	 *
+	 * conn.set_commit_handler([&] { ++commits; return 0; });
+	 * conn.set_commit_handler<int (), on_commit>();
+	 * ```
+	 */
+	template<typename Callable>
+	detail::if_hook_object_t<Callable> set_commit_handler(Callable &&fun);
+	template<typename Function, Function *Fun>
+	void set_commit_handler();
+
 	/**
 	 * Register/clear a rollback notification callback.
 	 *
@@ -335,6 +683,10 @@ public:
 	typedef std::function<void ()> rollback_handler_t;
 	void set_rollback_handler(const rollback_handler_t &fun);
 	void set_rollback_handler();
+	template<typename Callable>
+	detail::if_hook_object_t<Callable> set_rollback_handler(Callable &&fun);
+	template<typename Function, Function *Fun>
+	void set_rollback_handler();
 
 	/**
 	 * Register a data change notification callback.
@@ -344,25 +696,84 @@ public:
 	typedef std::function<void (int, const char*, const char *, int64_t)> update_handler_t;
 	void set_update_handler(const update_handler_t &fun);
 	void set_update_handler();
+	template<typename Callable>
+	detail::if_hook_object_t<Callable> set_update_handler(Callable &&fun);
+	template<typename Function, Function *Fun>
+	void set_update_handler();
+
+	/**
+	 * Register a callback that is called before each change of a row, with
+	 * access to the old and new column values.
+	 *
+	 * Unlike the update handler it is also called for tables without rowid
+	 * (with undefined rowids).
+	 *
+	 * Wraps [`sqlite3_preupdate_hook()`](http://www.sqlite.org/c3ref/preupdate_blobwrite.html),
+	 * which is only available if sqlite was compiled with
+	 * `SQLITE_ENABLE_PREUPDATE_HOOK`. sqxx needs to be compiled with the same
+	 * define, otherwise these functions throw.
+	 *
+	 * The session extension uses the same hook, so a preupdate handler can't
+	 * be set while a `session` of the connection exists, and no `session`
+	 * can be created while a handler is set. Both throw an error with code
+	 * `SQLITE_MISUSE`. Sessions created directly with the C API aren't
+	 * detected.
+	 */
+	typedef std::function<void (const preupdate&)> preupdate_handler_t;
+	void set_preupdate_handler(const preupdate_handler_t &fun);
+	void set_preupdate_handler();
 
 	/**
-	 * Register a trace callback function
+	 * Register a trace callback function, called with the expanded SQL text
+	 * of each statement when it starts running.
 	 *
-	 * Wraps [`sqlite3_trace()`](http://www.sqlite.org/c3ref/profile.html)
+	 * Wraps [`sqlite3_trace_v2()`](http://www.sqlite.org/c3ref/trace_v2.html)
+	 * with `SQLITE_TRACE_STMT`, or
+	 * [`sqlite3_trace()`](http://www.sqlite.org/c3ref/profile.html) for
+	 * sqlite versions before 3.14.
 	 */
 	typedef std::function<void (const char*)> trace_handler_t;
 	void set_trace_handler(const trace_handler_t &fun);
 	void set_trace_handler();
 
 	/**
-	 * Register a profiling callback function
+	 * Register a profiling callback function, called with the SQL text and
+	 * the run time in nanoseconds of each statement when it finishes.
 	 *
-	 * Wraps [`sqlite3_profile()`](http://www.sqlite.org/c3ref/profile.html)
+	 * Wraps [`sqlite3_trace_v2()`](http://www.sqlite.org/c3ref/trace_v2.html)
+	 * with `SQLITE_TRACE_PROFILE`, or
+	 * [`sqlite3_profile()`](http://www.sqlite.org/c3ref/profile.html) for
+	 * sqlite versions before 3.14.
 	 */
 	typedef std::function<void (const char*, uint64_t)> profile_handler_t;
 	void set_profile_handler(const profile_handler_t &fun);
 	void set_profile_handler();
 
+	/**
+	 * Record latency, returned rows and VM steps of every statement in
+	 * `prof`, see `profiler`. Works together with trace and profile handlers.
+	 *
+	 * The profiler's entry of a `statement` prepared while a profiler is set
+	 * is looked up on its first execution and kept until the statement is
+	 * destroyed. Executions of other statements, like those run by `exec()`,
+	 * are looked up by their SQL text each time.
+	 *
+	 * Needs [`sqlite3_trace_v2()`](http://www.sqlite.org/c3ref/trace_v2.html)
+	 * (sqlite 3.14).
+	 */
+	void set_profiler(profiler &prof);
+	void set_profiler();
+
+	/**
+	 * Log statements that run longer than the threshold of `log`, together
+	 * with their counters and query plan, see `slow_query_log`.
+	 *
+	 * Needs [`sqlite3_trace_v2()`](http://www.sqlite.org/c3ref/trace_v2.html)
+	 * (sqlite 3.14).
+	 */
+	void set_slow_query_log(slow_query_log &log);
+	void set_slow_query_log();
+
 	/**
 	 * Register a compile-time authorizer callback function
 	 *
@@ -380,6 +791,10 @@ public:
 	typedef std::function<bool (int)> busy_handler_t;
 	void set_busy_handler(const busy_handler_t &busy);
 	void set_busy_handler();
+	template<typename Callable>
+	detail::if_hook_object_t<Callable> set_busy_handler(Callable &&fun);
+	template<typename Function, Function *Fun>
+	void set_busy_handler();
 
 	/**
 	 * Registers a query progress callback
@@ -389,6 +804,10 @@ public:
 	typedef std::function<bool ()> progress_handler_t;
 	void set_progress_handler(int n, const progress_handler_t &fun);
 	void set_progress_handler();
+	template<typename Callable>
+	detail::if_hook_object_t<Callable> set_progress_handler(int n, Callable &&fun);
+	template<typename Function, Function *Fun>
+	void set_progress_handler(int n);
 
 	/**
 	 * Registers a write-ahead log hook
@@ -398,6 +817,10 @@ public:
 	typedef std::function<void (/*connection&,*/ const char*, int)> wal_handler_t;
 	void set_wal_handler(const wal_handler_t &fun);
 	void set_wal_handler();
+	template<typename Callable>
+	detail::if_hook_object_t<Callable> set_wal_handler(Callable &&fun);
+	template<typename Function, Function *Fun>
+	void set_wal_handler();
 
 	/**
 	 * Configure an auto-checkpoint
@@ -420,6 +843,10 @@ public:
 	std::pair<int, int> wal_checkpoint_restart(const char *dbname);
 	std::pair<int, int> wal_checkpoint_restart(const std::string &dbname);
 
+	/** For sqlite3 >= v3.8.8 */
+	std::pair<int, int> wal_checkpoint_truncate(const char *dbname);
+	std::pair<int, int> wal_checkpoint_truncate(const std::string &dbname);
+
 	/**
 	 * Wraps [`sqlite3_collation_needed()`](http://www.sqlite.org/c3ref/collation_needed.html)
 	 */
@@ -427,10 +854,46 @@ public:
 	void set_collation_handler(const collation_handler_t &fun);
 	void set_collation_handler();
 
-	// TODO:
-	//typedef std::function<void ()> unlock_handler_t;
-	//void set_unlock_handler(const unlock_handler_t &fun);
-	//void set_unlock_handler();
+	/**
+	 * Registers a callback that is invoked once the connection that blocked
+	 * the last statement of this connection with `SQLITE_LOCKED` in
+	 * shared-cache mode finishes its transaction.
+	 *
+	 * The callback is invoked only once, from the thread of the blocking
+	 * connection. If no connection is blocking, it is invoked immediately.
+	 * Throws an error with code `SQLITE_LOCKED` if waiting for the blocking
+	 * connection would deadlock.
+	 *
+	 * Only one callback can be registered per connection, this replaces any
+	 * previous one, including the one used by `wait_for_unlock()`.
+	 *
+	 * Wraps [`sqlite3_unlock_notify()`](http://www.sqlite.org/c3ref/unlock_notify.html),
+	 * which is only available if sqlite was compiled with
+	 * `SQLITE_ENABLE_UNLOCK_NOTIFY`. sqxx needs to be compiled with the same
+	 * define, otherwise setting a handler throws an error with code
+	 * `SQLITE_MISUSE`.
+	 */
+	typedef std::function<void ()> unlock_handler_t;
+	void set_unlock_handler(const unlock_handler_t &fun);
+	void set_unlock_handler();
+
+	/**
+	 * Blocks until the connection that made the last statement of this
+	 * connection fail with `SQLITE_LOCKED` in shared-cache mode finishes its
+	 * transaction.
+	 *
+	 * Waits on a condition variable signaled by an unlock notification.
+	 * Returns `false` without waiting if waiting would deadlock, in that case
+	 * the current transaction should be rolled back.
+	 *
+	 * Usually used through `statement::step_blocking()`. Like
+	 * `set_unlock_handler()` it needs `SQLITE_ENABLE_UNLOCK_NOTIFY` and
+	 * throws an error with code `SQLITE_MISUSE` otherwise.
+	 */
+	bool wait_for_unlock();
+
+	/** Statistics of the waits done by `wait_for_unlock()` */
+	sqxx::unlock_stats unlock_stats() const;
 
 public:
 	/**
@@ -574,6 +1037,7 @@ public:
 #include "connection_create_function.impl.hpp"
 #include "connection_create_aggregate.impl.hpp"
 #include "connection_create_collation.impl.hpp"
+#include "connection_hooks.impl.hpp"
 
 #endif // SQXX_CONNECTION_HPP_INCLUDED
 
@@ -6,10 +6,6 @@
 #include "context.hpp"
 #include "value.hpp"
 
-// Function types with C calling convention for callbacks
-// https://stackoverflow.com/a/5590050/
-extern "C" typedef void sqxx_appdata_destroy_type(void*);
-
 extern "C" void* sqlite3_user_data(sqlite3_context*);
 
 namespace sqxx {
@@ -0,0 +1,274 @@
+
+#if !defined(SQXX_CONNECTION_HOOKS_IMPL_HPP_INCLUDED)
+#define SQXX_CONNECTION_HOOKS_IMPL_HPP_INCLUDED
+
+namespace sqxx {
+namespace detail {
+
+// Hooks calling a callable object stored as sqlite user data
+
+template<typename Callable>
+sqxx_commit_hook_type commit_hook_call;
+
+template<typename Callable>
+int commit_hook_call(void *data) {
+	Callable *callable = reinterpret_cast<Callable*>(data);
+	try {
+		return (*callable)();
+	}
+	catch (...) {
+		handle_callback_exception("commit handler");
+		return 1;
+	}
+}
+
+template<typename Callable>
+sqxx_rollback_hook_type rollback_hook_call;
+
+template<typename Callable>
+void rollback_hook_call(void *data) {
+	Callable *callable = reinterpret_cast<Callable*>(data);
+	try {
+		(*callable)();
+	}
+	catch (...) {
+		handle_callback_exception("rollback handler");
+	}
+}
+
+template<typename Callable>
+sqxx_update_hook_type update_hook_call;
+
+template<typename Callable>
+void update_hook_call(void *data, int op, const char *database_name, const char *table_name, long long rowid) {
+	Callable *callable = reinterpret_cast<Callable*>(data);
+	try {
+		(*callable)(op, database_name, table_name, rowid);
+	}
+	catch (...) {
+		handle_callback_exception("update handler");
+	}
+}
+
+template<typename Callable>
+sqxx_busy_hook_type busy_hook_call;
+
+template<typename Callable>
+int busy_hook_call(void *data, int count) {
+	Callable *callable = reinterpret_cast<Callable*>(data);
+	try {
+		return (*callable)(count);
+	}
+	catch (...) {
+		handle_callback_exception("busy handler");
+		return 0;
+	}
+}
+
+template<typename Callable>
+sqxx_progress_hook_type progress_hook_call;
+
+template<typename Callable>
+int progress_hook_call(void *data) {
+	Callable *callable = reinterpret_cast<Callable*>(data);
+	try {
+		return (*callable)();
+	}
+	catch (...) {
+		handle_callback_exception("progress handler");
+		return 0;
+	}
+}
+
+template<typename Callable>
+sqxx_wal_hook_type wal_hook_call;
+
+template<typename Callable>
+int wal_hook_call(void *data, sqlite3* /*conn*/, const char *dbname, int pages) {
+	Callable *callable = reinterpret_cast<Callable*>(data);
+	try {
+		(*callable)(dbname, pages);
+		return OK;
+	}
+	catch (...) {
+		handle_callback_exception("wal handler");
+		return ERROR;
+	}
+}
+
+
+// Hooks calling a function specified as template parameter
+
+template<typename Function, Function *Fun>
+sqxx_commit_hook_type commit_hook_static;
+
+template<typename Function, Function *Fun>
+int commit_hook_static(void* /*data*/) {
+	try {
+		return Fun();
+	}
+	catch (...) {
+		handle_callback_exception("commit handler");
+		return 1;
+	}
+}
+
+template<typename Function, Function *Fun>
+sqxx_rollback_hook_type rollback_hook_static;
+
+template<typename Function, Function *Fun>
+void rollback_hook_static(void* /*data*/) {
+	try {
+		Fun();
+	}
+	catch (...) {
+		handle_callback_exception("rollback handler");
+	}
+}
+
+template<typename Function, Function *Fun>
+sqxx_update_hook_type update_hook_static;
+
+template<typename Function, Function *Fun>
+void update_hook_static(void* /*data*/, int op, const char *database_name, const char *table_name, long long rowid) {
+	try {
+		Fun(op, database_name, table_name, rowid);
+	}
+	catch (...) {
+		handle_callback_exception("update handler");
+	}
+}
+
+template<typename Function, Function *Fun>
+sqxx_busy_hook_type busy_hook_static;
+
+template<typename Function, Function *Fun>
+int busy_hook_static(void* /*data*/, int count) {
+	try {
+		return Fun(count);
+	}
+	catch (...) {
+		handle_callback_exception("busy handler");
+		return 0;
+	}
+}
+
+template<typename Function, Function *Fun>
+sqxx_progress_hook_type progress_hook_static;
+
+template<typename Function, Function *Fun>
+int progress_hook_static(void* /*data*/) {
+	try {
+		return Fun();
+	}
+	catch (...) {
+		handle_callback_exception("progress handler");
+		return 0;
+	}
+}
+
+template<typename Function, Function *Fun>
+sqxx_wal_hook_type wal_hook_static;
+
+template<typename Function, Function *Fun>
+int wal_hook_static(void* /*data*/, sqlite3* /*conn*/, const char *dbname, int pages) {
+	try {
+		Fun(dbname, pages);
+		return OK;
+	}
+	catch (...) {
+		handle_callback_exception("wal handler");
+		return ERROR;
+	}
+}
+
+} // namespace detail
+
+
+// The connection stores a copy of the callable as sqlite user data, and
+// deletes it when the hook is replaced or removed.
+
+template<typename Callable>
+detail::if_hook_object_t<Callable> connection::set_commit_handler(Callable &&fun) {
+	typedef std::decay_t<Callable> CallableType;
+	register_commit_hook(detail::commit_hook_call<CallableType>,
+			new CallableType(std::forward<Callable>(fun)),
+			detail::appdata_destroy_object<CallableType>);
+}
+
+template<typename Callable>
+detail::if_hook_object_t<Callable> connection::set_rollback_handler(Callable &&fun) {
+	typedef std::decay_t<Callable> CallableType;
+	register_rollback_hook(detail::rollback_hook_call<CallableType>,
+			new CallableType(std::forward<Callable>(fun)),
+			detail::appdata_destroy_object<CallableType>);
+}
+
+template<typename Callable>
+detail::if_hook_object_t<Callable> connection::set_update_handler(Callable &&fun) {
+	typedef std::decay_t<Callable> CallableType;
+	register_update_hook(detail::update_hook_call<CallableType>,
+			new CallableType(std::forward<Callable>(fun)),
+			detail::appdata_destroy_object<CallableType>);
+}
+
+template<typename Callable>
+detail::if_hook_object_t<Callable> connection::set_busy_handler(Callable &&fun) {
+	typedef std::decay_t<Callable> CallableType;
+	register_busy_hook(detail::busy_hook_call<CallableType>,
+			new CallableType(std::forward<Callable>(fun)),
+			detail::appdata_destroy_object<CallableType>);
+}
+
+template<typename Callable>
+detail::if_hook_object_t<Callable> connection::set_progress_handler(int n, Callable &&fun) {
+	typedef std::decay_t<Callable> CallableType;
+	register_progress_hook(n, detail::progress_hook_call<CallableType>,
+			new CallableType(std::forward<Callable>(fun)),
+			detail::appdata_destroy_object<CallableType>);
+}
+
+template<typename Callable>
+detail::if_hook_object_t<Callable> connection::set_wal_handler(Callable &&fun) {
+	typedef std::decay_t<Callable> CallableType;
+	register_wal_hook(detail::wal_hook_call<CallableType>,
+			new CallableType(std::forward<Callable>(fun)),
+			detail::appdata_destroy_object<CallableType>);
+}
+
+// Functions specified as template parameter don't need any user data
+
+template<typename Function, Function *Fun>
+void connection::set_commit_handler() {
+	register_commit_hook(detail::commit_hook_static<Function, Fun>, nullptr, nullptr);
+}
+
+template<typename Function, Function *Fun>
+void connection::set_rollback_handler() {
+	register_rollback_hook(detail::rollback_hook_static<Function, Fun>, nullptr, nullptr);
+}
+
+template<typename Function, Function *Fun>
+void connection::set_update_handler() {
+	register_update_hook(detail::update_hook_static<Function, Fun>, nullptr, nullptr);
+}
+
+template<typename Function, Function *Fun>
+void connection::set_busy_handler() {
+	register_busy_hook(detail::busy_hook_static<Function, Fun>, nullptr, nullptr);
+}
+
+template<typename Function, Function *Fun>
+void connection::set_progress_handler(int n) {
+	register_progress_hook(n, detail::progress_hook_static<Function, Fun>, nullptr, nullptr);
+}
+
+template<typename Function, Function *Fun>
+void connection::set_wal_handler() {
+	register_wal_hook(detail::wal_hook_static<Function, Fun>, nullptr, nullptr);
+}
+
+} // namespace sqxx
+
+#endif // SQXX_CONNECTION_HOOKS_IMPL_HPP_INCLUDED
+
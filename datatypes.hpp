@@ -7,6 +7,20 @@
 #include <utility>
 #include <string>
 
+/**
+ * Linkage of the wrappers that are called for each row, column or value,
+ * like `statement::val<T>()` or `statement::try_step()`.
+ *
+ * With `SQXX_HEADER_ONLY` defined they are defined inline in the headers, so
+ * that the compiler can inline them into the caller's loops. Otherwise they
+ * are compiled into the library.
+ */
+#if defined(SQXX_HEADER_ONLY)
+#define SQXX_INLINE inline
+#else
+#define SQXX_INLINE
+#endif
+
 namespace sqxx {
 
 struct blob {
@@ -9,6 +9,49 @@
 
 namespace sqxx {
 
+/**
+ * Primary sqlite result codes, as returned by the non-throwing `try_*`
+ * functions. The values are the same as the ones of the `SQLITE_*` constants.
+ */
+enum result_code {
+	 OK =          0,
+	 ERROR =       1,
+	 INTERNAL =    2,
+	 PERM =        3,
+	 ABORT =       4,
+	 BUSY =        5,
+	 LOCKED =      6,
+	 NOMEM =       7,
+	 READONLY =    8,
+	 INTERRUPT =   9,
+	 IOERR =      10,
+	 CORRUPT =    11,
+	 NOTFOUND =   12,
+	 FULL =       13,
+	 CANTOPEN =   14,
+	 PROTOCOL =   15,
+	 EMPTY =      16,
+	 SCHEMA =     17,
+	 TOOBIG =     18,
+	 CONSTRAINT = 19,
+	 MISMATCH =   20,
+	 MISUSE =     21,
+	 NOLFS =      22,
+	 AUTH =       23,
+	 FORMAT =     24,
+	 RANGE =      25,
+	 NOTADB =     26,
+	 NOTICE =     27,
+	 WARNING =    28,
+	 ROW =       100,
+	 DONE =      101,
+};
+
+/** Primary result code of a possibly extended result code */
+inline int primary_code(int code) {
+	return code & 0xff;
+}
+
 // TODO: Check what of this is really used
 
 /** An error thrown if some sqlite API function returns an error */
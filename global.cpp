@@ -5,6 +5,18 @@
 
 namespace sqxx {
 
+void initialize() {
+	int rv = sqlite3_initialize();
+	if (rv != SQLITE_OK)
+		throw static_error(rv);
+}
+
+void shutdown() {
+	int rv = sqlite3_shutdown();
+	if (rv != SQLITE_OK)
+		throw static_error(rv);
+}
+
 int release_memory(int amount) {
    return sqlite3_release_memory(amount);
 }
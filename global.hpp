@@ -8,6 +8,27 @@
 
 namespace sqxx {
 
+/**
+ * Initialize the sqlite library.
+ *
+ * sqxx initializes sqlite automatically on startup. This is only needed
+ * after `shutdown()`, for example to change global configuration with the
+ * `config_*()` functions, which only work while the library isn't
+ * initialized.
+ *
+ * Wraps [`sqlite3_initialize()`](http://www.sqlite.org/c3ref/initialize.html)
+ */
+void initialize();
+
+/**
+ * Deinitialize the sqlite library.
+ *
+ * All database connections must be closed before.
+ *
+ * Wraps [`sqlite3_shutdown()`](http://www.sqlite.org/c3ref/initialize.html)
+ */
+void shutdown();
+
 /**
  * Attempt to free heap memory
  *
@@ -0,0 +1,161 @@
+
+#include "huge_buffer.hpp"
+#include "config.hpp"
+#include "connection.hpp"
+#include "error.hpp"
+#include <sqlite3.h>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <utility>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#if defined(MAP_ANONYMOUS)
+#define SQXX_HAVE_MMAP 1
+#endif
+#endif
+
+namespace sqxx {
+
+namespace {
+
+#if defined(SQXX_HAVE_MMAP) && defined(MAP_HUGETLB)
+
+const size_t default_huge_page_size = 2 * 1024 * 1024;
+
+// Size of explicit huge pages as configured by the kernel
+size_t huge_page_size() {
+	static size_t size = [] {
+		size_t kb = 0;
+		if (std::FILE *f = std::fopen("/proc/meminfo", "r")) {
+			char line[128];
+			while (std::fgets(line, sizeof(line), f)) {
+				if (std::sscanf(line, "Hugepagesize: %zu kB", &kb) == 1)
+					break;
+			}
+			std::fclose(f);
+		}
+		return (kb ? kb * 1024 : default_huge_page_size);
+	}();
+	return size;
+}
+
+#endif
+
+inline size_t round_up(size_t n, size_t to) {
+	return (n + to - 1) / to * to;
+}
+
+} // anonymous namespace
+
+#if defined(SQXX_HAVE_MMAP)
+
+huge_buffer::huge_buffer(size_t size, bool huge_pages)
+	: ptr(nullptr), len(0), kind(backing::none) {
+#if !defined(MAP_HUGETLB) && !defined(MADV_HUGEPAGE)
+	unused(huge_pages);
+#endif
+	void *p = MAP_FAILED;
+#if defined(MAP_HUGETLB)
+	if (huge_pages) {
+		size_t rounded = round_up(size, huge_page_size());
+		p = mmap(nullptr, rounded, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB, -1, 0);
+		if (p != MAP_FAILED) {
+			len = rounded;
+			kind = backing::hugetlb;
+		}
+	}
+#endif
+	if (p == MAP_FAILED) {
+		p = mmap(nullptr, size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+		if (p == MAP_FAILED)
+			throw std::bad_alloc();
+		len = size;
+		kind = backing::normal;
+#if defined(MADV_HUGEPAGE)
+		if (huge_pages && madvise(p, size, MADV_HUGEPAGE) == 0)
+			kind = backing::transparent;
+#endif
+	}
+	ptr = p;
+}
+
+huge_buffer::~huge_buffer() {
+	if (ptr)
+		munmap(ptr, len);
+}
+
+#else // SQXX_HAVE_MMAP
+
+// Without mmap() the memory comes from the heap, in normal pages
+huge_buffer::huge_buffer(size_t size, bool /*huge_pages*/)
+	: ptr(nullptr), len(0), kind(backing::none) {
+	void *p = std::calloc(size ? size : 1, 1);
+	if (!p)
+		throw std::bad_alloc();
+	ptr = p;
+	len = size;
+	kind = backing::normal;
+}
+
+huge_buffer::~huge_buffer() {
+	std::free(ptr);
+}
+
+#endif // SQXX_HAVE_MMAP
+
+huge_buffer::huge_buffer(huge_buffer &&other) noexcept
+	: ptr(other.ptr), len(other.len), kind(other.kind) {
+	other.ptr = nullptr;
+	other.len = 0;
+	other.kind = backing::none;
+}
+
+huge_buffer& huge_buffer::operator=(huge_buffer &&other) noexcept {
+	std::swap(ptr, other.ptr);
+	std::swap(len, other.len);
+	std::swap(kind, other.kind);
+	return *this;
+}
+
+huge_buffer config_pagecache_huge(int page_size, int pages, int connections) {
+#if SQLITE_VERSION_NUMBER >= 3008008
+	int slot_size = page_size + config_pcache_hdrsz();
+#else
+	// Generous estimate of the header size of older versions
+	int slot_size = page_size + 256;
+#endif
+	int count = pages * connections;
+	huge_buffer buffer(static_cast<size_t>(slot_size) * count);
+	config_pagecache(buffer.data(), slot_size, count);
+	return buffer;
+}
+
+lookaside_arena::lookaside_arena(int connections, int slot_size_arg, int slots_arg)
+	: slot_size(slot_size_arg / 8 * 8), slots(slots_arg) {
+	if (connections <= 0 || slot_size <= 0 || slots <= 0)
+		throw error(SQLITE_MISUSE, "invalid lookaside arena size");
+	// Parts start on cache lines
+	size_t part_size = round_up(static_cast<size_t>(slot_size) * slots, 64);
+	buffer = huge_buffer(part_size * connections);
+	for (int i = connections - 1; i >= 0; --i) {
+		free_parts.push_back(i);
+	}
+}
+
+int lookaside_arena::config(connection &conn) {
+	if (free_parts.empty())
+		throw error(SQLITE_FULL, "lookaside arena exhausted");
+	int part = free_parts.back();
+	size_t part_size = round_up(static_cast<size_t>(slot_size) * slots, 64);
+	conn.config_lookaside(static_cast<char*>(buffer.data()) + part * part_size, slot_size, slots);
+	free_parts.pop_back();
+	return part;
+}
+
+void lookaside_arena::release(int part) {
+	free_parts.push_back(part);
+}
+
+} // namespace sqxx
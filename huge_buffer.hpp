@@ -0,0 +1,135 @@
+
+#if !defined(SQXX_HUGE_BUFFER_HPP_INCLUDED)
+#define SQXX_HUGE_BUFFER_HPP_INCLUDED
+
+#include <cstddef>
+#include <vector>
+
+namespace sqxx {
+
+class connection;
+
+/**
+ * A memory region reserved with `mmap()`, preferably backed by huge pages.
+ *
+ * Large buffers that sqlite accesses all over, like page cache memory, cause
+ * many TLB misses with normal pages. This tries, in order:
+ *
+ * - explicit huge pages (`MAP_HUGETLB`), which need to be reserved by the
+ *   administrator, for example in `/proc/sys/vm/nr_hugepages`
+ * - transparent huge pages (`madvise(MADV_HUGEPAGE)`)
+ * - normal pages
+ *
+ * Each step is skipped if the system doesn't support it. Without `mmap()`
+ * the memory is allocated from the heap.
+ *
+ * The memory is zero-initialized and released by the destructor.
+ */
+class huge_buffer {
+public:
+	enum class backing {
+		/** No memory reserved */
+		none,
+		/** Explicit huge pages */
+		hugetlb,
+		/** Normal pages the kernel was asked to back with huge pages */
+		transparent,
+		/** Normal pages */
+		normal,
+	};
+
+private:
+	void *ptr;
+	size_t len;
+	backing kind;
+
+public:
+	huge_buffer() : ptr(nullptr), len(0), kind(backing::none) {
+	}
+
+	/**
+	 * Reserve at least `size` bytes. With `huge_pages` false only normal
+	 * pages are used.
+	 *
+	 * Throws `std::bad_alloc` if no memory can be reserved at all.
+	 */
+	explicit huge_buffer(size_t size, bool huge_pages = true);
+	~huge_buffer();
+
+	huge_buffer(const huge_buffer&) = delete;
+	huge_buffer& operator=(const huge_buffer&) = delete;
+	huge_buffer(huge_buffer &&other) noexcept;
+	huge_buffer& operator=(huge_buffer &&other) noexcept;
+
+	void* data() const { return ptr; }
+	/** Size of the region, which might be rounded up to whole huge pages */
+	size_t size() const { return len; }
+	backing kind_of_pages() const { return kind; }
+};
+
+/**
+ * Reserve page cache memory for `connections` connections with
+ * `pages` pages of `page_size` bytes each and install it with
+ * `config_pagecache()` (SQLITE_CONFIG_PAGECACHE).
+ *
+ * The slot size includes the per-page header of sqlite's default page cache,
+ * which is the only one that uses this memory. Pages that don't fit are
+ * allocated from the heap by sqlite.
+ *
+ * Must be called while sqlite isn't initialized. The returned buffer needs
+ * to be kept until sqlite is shut down again:
+ *
+ *     sqxx::shutdown();
+ *     sqxx::huge_buffer pagecache = sqxx::config_pagecache_huge(4096, 2000, 16);
+ *     sqxx::initialize();
+ */
+huge_buffer config_pagecache_huge(int page_size, int pages, int connections);
+
+/**
+ * Lookaside memory for several connections in one huge page backed region.
+ *
+ * Each connection gets its own part of the region with `config()`, which
+ * uses `connection::config_lookaside()`:
+ *
+ *     sqxx::lookaside_arena lookaside(16);
+ *     sqxx::connection conn("data.db");
+ *     int part = lookaside.config(conn);
+ *     ...
+ *     conn.close();
+ *     lookaside.release(part);
+ *
+ * The arena needs to outlive the connections using it.
+ */
+class lookaside_arena {
+private:
+	huge_buffer buffer;
+	int slot_size;
+	int slots;
+	std::vector<int> free_parts;
+
+public:
+	/**
+	 * Reserve lookaside memory for `connections` connections with `slots`
+	 * slots of `slot_size` bytes each (sqlite's defaults are 1200 and 100).
+	 */
+	explicit lookaside_arena(int connections, int slot_size = 1200, int slots = 100);
+
+	/**
+	 * Configure a connection to use an unused part of the arena. Must be
+	 * called before the connection allocated any lookaside memory, usually
+	 * right after opening it.
+	 *
+	 * Returns the part used, to be passed to `release()` when the
+	 * connection is closed. Throws if all parts are in use.
+	 */
+	int config(connection &conn);
+
+	/** Make a part available again after its connection was closed */
+	void release(int part);
+
+	const huge_buffer& memory() const { return buffer; }
+};
+
+} // namespace sqxx
+
+#endif // SQXX_HUGE_BUFFER_HPP_INCLUDED
@@ -0,0 +1,379 @@
+
+#include "malloc_pool.hpp"
+#include "config.hpp"
+#include <sqlite3.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+
+namespace sqxx {
+namespace detail {
+namespace {
+
+const size_t class_sizes[] = {
+	16, 32, 48, 64, 80, 96, 112, 128,
+	160, 192, 224, 256, 320, 384, 448, 512,
+	640, 768, 896, 1024, 1280, 1536, 1792, 2048,
+	2560, 3072, 3584, 4096, 5120, 6144, 7168, 8192,
+	10240, 12288, 14336, 16384, 20480, 24576, 28672, 32768,
+	40960, 49152, 57344, 65536,
+};
+const int class_count = sizeof(class_sizes) / sizeof(class_sizes[0]);
+const size_t max_class_size = class_sizes[class_count - 1];
+
+// Every block starts with a header that records its size class, or the
+// requested size for large blocks. It keeps the returned memory 8 byte
+// aligned, as sqlite requires.
+const size_t header_size = 8;
+const uint64_t large_tag = 0xff;
+
+// Idle blocks a thread keeps per class, and the amount moved to or from the
+// shared freelist at once
+const size_t cache_bytes = 256 * 1024;
+const size_t min_arena_size = 1024 * 1024;
+
+int class_of(size_t n) {
+	if (n <= 128)
+		return static_cast<int>((n + 15) / 16) - 1 + (n == 0);
+	return static_cast<int>(std::lower_bound(class_sizes, class_sizes + class_count, n) - class_sizes);
+}
+
+unsigned cache_limit(int c) {
+	return static_cast<unsigned>(std::max<size_t>(8, std::min<size_t>(128, cache_bytes / class_sizes[c])));
+}
+
+struct free_block {
+	free_block *next;
+};
+
+// Counters that are only written by the owning thread, so updating them
+// needs no atomic read-modify-write.
+inline void bump(std::atomic<uint64_t> &counter) {
+	counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+struct class_counters {
+	std::atomic<uint64_t> allocations{0};
+	std::atomic<uint64_t> cache_hits{0};
+	std::atomic<uint64_t> frees{0};
+};
+
+struct central_class {
+	std::mutex mutex;
+	free_block *free = nullptr;
+	char *carve = nullptr;
+	char *carve_end = nullptr;
+	std::atomic<uint64_t> transfers{0};
+	std::atomic<uint64_t> arena_bytes{0};
+};
+
+class thread_cache;
+
+struct pool_state {
+	central_class classes[class_count];
+	std::atomic<uint64_t> large_allocations{0};
+	std::atomic<uint64_t> large_frees{0};
+
+	// Live thread caches and counters of exited threads, for statistics
+	std::mutex registry_mutex;
+	std::vector<thread_cache*> threads;
+	uint64_t retired[class_count][3] = {};
+};
+
+// Never destroyed, threads might still free memory during static
+// destruction.
+pool_state& state() {
+	static pool_state *s = new pool_state;
+	return *s;
+}
+
+// Takes up to `want` blocks of class `c` from the shared freelist or a new
+// arena. Returns the number of blocks prepended to `*list`.
+unsigned central_take(int c, free_block **list, unsigned want) {
+	central_class &cc = state().classes[c];
+	size_t block_size = header_size + class_sizes[c];
+	unsigned got = 0;
+	std::lock_guard<std::mutex> lock(cc.mutex);
+	while (got < want) {
+		free_block *b;
+		if (cc.free) {
+			b = cc.free;
+			cc.free = b->next;
+		}
+		else {
+			if (cc.carve + block_size > cc.carve_end) {
+				size_t arena_size = std::max(min_arena_size, 16 * block_size);
+				char *arena = static_cast<char*>(std::malloc(arena_size));
+				if (!arena)
+					break;
+				cc.carve = arena;
+				cc.carve_end = arena + arena_size;
+				cc.arena_bytes.fetch_add(arena_size, std::memory_order_relaxed);
+			}
+			b = reinterpret_cast<free_block*>(cc.carve);
+			cc.carve += block_size;
+		}
+		b->next = *list;
+		*list = b;
+		++got;
+	}
+	cc.transfers.fetch_add(got, std::memory_order_relaxed);
+	return got;
+}
+
+// Returns a list of `n` blocks of class `c` to the shared freelist
+void central_put(int c, free_block *first, free_block *last, unsigned n) {
+	central_class &cc = state().classes[c];
+	std::lock_guard<std::mutex> lock(cc.mutex);
+	last->next = cc.free;
+	cc.free = first;
+	cc.transfers.fetch_add(n, std::memory_order_relaxed);
+}
+
+class thread_cache {
+public:
+	free_block *free[class_count] = {};
+	unsigned count[class_count] = {};
+	class_counters counters[class_count];
+
+	thread_cache();
+	~thread_cache();
+
+	void* alloc(int c);
+	void release(int c, free_block *b);
+	// Moves `n` blocks of class `c` to the shared freelist
+	void flush(int c, unsigned n);
+};
+
+thread_local thread_cache *current_cache = nullptr;
+thread_local bool cache_exited = false;
+
+thread_cache::thread_cache() {
+	pool_state &s = state();
+	std::lock_guard<std::mutex> lock(s.registry_mutex);
+	s.threads.push_back(this);
+}
+
+thread_cache::~thread_cache() {
+	current_cache = nullptr;
+	cache_exited = true;
+	for (int c = 0; c < class_count; ++c) {
+		flush(c, count[c]);
+	}
+	pool_state &s = state();
+	std::lock_guard<std::mutex> lock(s.registry_mutex);
+	for (int c = 0; c < class_count; ++c) {
+		s.retired[c][0] += counters[c].allocations.load(std::memory_order_relaxed);
+		s.retired[c][1] += counters[c].cache_hits.load(std::memory_order_relaxed);
+		s.retired[c][2] += counters[c].frees.load(std::memory_order_relaxed);
+	}
+	s.threads.erase(std::find(s.threads.begin(), s.threads.end(), this));
+}
+
+void* thread_cache::alloc(int c) {
+	bump(counters[c].allocations);
+	if (free[c]) {
+		bump(counters[c].cache_hits);
+	}
+	else {
+		count[c] += central_take(c, &free[c], cache_limit(c) / 2);
+		if (!free[c])
+			return nullptr;
+	}
+	free_block *b = free[c];
+	free[c] = b->next;
+	--count[c];
+	return b;
+}
+
+void thread_cache::release(int c, free_block *b) {
+	bump(counters[c].frees);
+	b->next = free[c];
+	free[c] = b;
+	if (++count[c] > cache_limit(c))
+		flush(c, cache_limit(c) / 2);
+}
+
+void thread_cache::flush(int c, unsigned n) {
+	if (n == 0)
+		return;
+	free_block *first = free[c];
+	free_block *last = first;
+	for (unsigned i = 1; i < n; ++i) {
+		last = last->next;
+	}
+	free[c] = last->next;
+	count[c] -= n;
+	central_put(c, first, last, n);
+}
+
+// The calling thread's cache, or nullptr if the thread is already exiting
+thread_cache* get_cache() {
+	if (current_cache)
+		return current_cache;
+	if (cache_exited)
+		return nullptr;
+	static thread_local thread_cache cache;
+	current_cache = &cache;
+	return current_cache;
+}
+
+inline uint64_t& header_of(void *p) {
+	return *reinterpret_cast<uint64_t*>(static_cast<char*>(p) - header_size);
+}
+
+inline size_t block_size_of(void *p) {
+	uint64_t h = header_of(p);
+	if ((h & 0xff) == large_tag)
+		return h >> 8;
+	return class_sizes[h];
+}
+
+} // anonymous namespace
+} // namespace detail
+} // namespace sqxx
+
+using namespace sqxx::detail;
+
+extern "C"
+void* sqxx_pool_malloc(int n) {
+	size_t size = n;
+	if (size > max_class_size) {
+		char *b = static_cast<char*>(std::malloc(header_size + size));
+		if (!b)
+			return nullptr;
+		*reinterpret_cast<uint64_t*>(b) = (static_cast<uint64_t>(size) << 8) | large_tag;
+		state().large_allocations.fetch_add(1, std::memory_order_relaxed);
+		return b + header_size;
+	}
+
+	int c = class_of(size);
+	void *b;
+	thread_cache *cache = get_cache();
+	if (cache) {
+		b = cache->alloc(c);
+	}
+	else {
+		free_block *list = nullptr;
+		central_take(c, &list, 1);
+		b = list;
+	}
+	if (!b)
+		return nullptr;
+	*static_cast<uint64_t*>(b) = c;
+	return static_cast<char*>(b) + header_size;
+}
+
+extern "C"
+void sqxx_pool_free(void *p) {
+	if (!p)
+		return;
+	uint64_t h = header_of(p);
+	void *b = static_cast<char*>(p) - header_size;
+	if ((h & 0xff) == large_tag) {
+		state().large_frees.fetch_add(1, std::memory_order_relaxed);
+		std::free(b);
+		return;
+	}
+
+	int c = static_cast<int>(h);
+	free_block *fb = static_cast<free_block*>(b);
+	thread_cache *cache = get_cache();
+	if (cache) {
+		cache->release(c, fb);
+	}
+	else {
+		central_put(c, fb, fb, 1);
+	}
+}
+
+extern "C"
+int sqxx_pool_size(void *p) {
+	if (!p)
+		return 0;
+	return static_cast<int>(block_size_of(p));
+}
+
+extern "C"
+void* sqxx_pool_realloc(void *p, int n) {
+	size_t size = n;
+	size_t old = block_size_of(p);
+	// Keep the block if it fits and wouldn't waste more than half of it
+	if (size <= old && size >= old / 2)
+		return p;
+	void *np = sqxx_pool_malloc(n);
+	if (!np)
+		return nullptr;
+	std::memcpy(np, p, std::min(size, old));
+	sqxx_pool_free(p);
+	return np;
+}
+
+extern "C"
+int sqxx_pool_roundup(int n) {
+	size_t size = n;
+	if (size > max_class_size)
+		return static_cast<int>((size + 7) & ~size_t(7));
+	return static_cast<int>(class_sizes[class_of(size)]);
+}
+
+extern "C"
+int sqxx_pool_init(void*) {
+	return SQLITE_OK;
+}
+
+extern "C"
+void sqxx_pool_shutdown(void*) {
+}
+
+namespace sqxx {
+
+namespace {
+	const sqlite3_mem_methods pool_methods = {
+		sqxx_pool_malloc,
+		sqxx_pool_free,
+		sqxx_pool_realloc,
+		sqxx_pool_size,
+		sqxx_pool_roundup,
+		sqxx_pool_init,
+		sqxx_pool_shutdown,
+		nullptr,
+	};
+}
+
+const sqlite3_mem_methods* malloc_pool_methods() {
+	return &pool_methods;
+}
+
+void config_malloc_pool() {
+	config_malloc(&pool_methods);
+}
+
+malloc_pool_statistics malloc_pool_stats() {
+	pool_state &s = state();
+	malloc_pool_statistics result;
+	result.classes.resize(class_count);
+
+	std::lock_guard<std::mutex> lock(s.registry_mutex);
+	for (int c = 0; c < class_count; ++c) {
+		malloc_pool_class_stats &cs = result.classes[c];
+		cs.size = class_sizes[c];
+		cs.allocations = s.retired[c][0];
+		cs.cache_hits = s.retired[c][1];
+		cs.frees = s.retired[c][2];
+		for (thread_cache *t : s.threads) {
+			cs.allocations += t->counters[c].allocations.load(std::memory_order_relaxed);
+			cs.cache_hits += t->counters[c].cache_hits.load(std::memory_order_relaxed);
+			cs.frees += t->counters[c].frees.load(std::memory_order_relaxed);
+		}
+		cs.transfers = s.classes[c].transfers.load(std::memory_order_relaxed);
+		cs.arena_bytes = s.classes[c].arena_bytes.load(std::memory_order_relaxed);
+	}
+	result.large_allocations = s.large_allocations.load(std::memory_order_relaxed);
+	result.large_frees = s.large_frees.load(std::memory_order_relaxed);
+	return result;
+}
+
+} // namespace sqxx
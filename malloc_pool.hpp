@@ -0,0 +1,73 @@
+
+#if !defined(SQXX_MALLOC_POOL_HPP_INCLUDED)
+#define SQXX_MALLOC_POOL_HPP_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct sqlite3_mem_methods;
+
+namespace sqxx {
+
+/** Statistics for one size class of the pool allocator */
+struct malloc_pool_class_stats {
+	/** Largest request served by this class, in bytes */
+	size_t size;
+	/** Number of allocations */
+	uint64_t allocations;
+	/** Number of allocations served from a thread's own cache without locking */
+	uint64_t cache_hits;
+	/** Number of frees */
+	uint64_t frees;
+	/** Number of blocks moved between thread caches and the shared freelist */
+	uint64_t transfers;
+	/** Bytes taken from the system for this class */
+	uint64_t arena_bytes;
+};
+
+/** Statistics of the pool allocator, see `malloc_pool_stats()` */
+struct malloc_pool_statistics {
+	std::vector<malloc_pool_class_stats> classes;
+	/** Allocations too large for any size class, passed on to `malloc()` */
+	uint64_t large_allocations;
+	uint64_t large_frees;
+};
+
+/**
+ * The memory allocator methods of the built-in pool allocator.
+ *
+ * Small allocations are served from size classes. Each thread keeps a cache
+ * of free blocks per class, so most allocations and frees don't need any
+ * locking. Thread caches exchange blocks in batches with a shared freelist
+ * per class, which is refilled by carving up large arenas. Allocations
+ * larger than the biggest class go to `malloc()`.
+ *
+ * Memory of the size classes is never returned to the system, it is reused
+ * for later allocations of the same class.
+ */
+const sqlite3_mem_methods* malloc_pool_methods();
+
+/**
+ * Install the pool allocator for sqlite (SQLITE_CONFIG_MALLOC).
+ *
+ * Like all `config_*()` functions this must be called while sqlite isn't
+ * initialized:
+ *
+ *     sqxx::shutdown();
+ *     sqxx::config_malloc_pool();
+ *     sqxx::initialize();
+ */
+void config_malloc_pool();
+
+/**
+ * Statistics of the pool allocator.
+ *
+ * Counters of threads that are still running are read while they might
+ * change, so they are only approximately consistent.
+ */
+malloc_pool_statistics malloc_pool_stats();
+
+} // namespace sqxx
+
+#endif // SQXX_MALLOC_POOL_HPP_INCLUDED
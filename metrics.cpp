@@ -0,0 +1,328 @@
+
+#include "metrics.hpp"
+#include "checkpoint_scheduler.hpp"
+#include "connection.hpp"
+#include "error.hpp"
+#include "global.hpp"
+#include "profiler.hpp"
+#include "query_cache.hpp"
+#include <sqlite3.h>
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+namespace sqxx {
+
+namespace {
+
+struct connection_counter {
+	int op;
+	// Some counters only report their value as highwater mark
+	bool highwater;
+	const char *name;
+	const char *help;
+};
+
+// Cumulative counters, exported as totals and rates
+const connection_counter cumulative_counters[] = {
+	{SQLITE_DBSTATUS_CACHE_HIT, false, "cache_hits", "Page cache hits"},
+	{SQLITE_DBSTATUS_CACHE_MISS, false, "cache_misses", "Page cache misses"},
+	{SQLITE_DBSTATUS_CACHE_WRITE, false, "cache_writes", "Pages written to disk"},
+	{SQLITE_DBSTATUS_LOOKASIDE_HIT, true, "lookaside_hits", "Allocations served from lookaside memory"},
+	{SQLITE_DBSTATUS_LOOKASIDE_MISS_SIZE, true, "lookaside_misses_size", "Allocations too large for lookaside memory"},
+	{SQLITE_DBSTATUS_LOOKASIDE_MISS_FULL, true, "lookaside_misses_full", "Allocations missed because lookaside memory was full"},
+};
+const size_t cumulative_count = sizeof(cumulative_counters) / sizeof(cumulative_counters[0]);
+enum { cache_hit, cache_miss, cache_write, lookaside_hit, lookaside_miss_size, lookaside_miss_full };
+
+const connection_counter gauge_counters[] = {
+	{SQLITE_DBSTATUS_LOOKASIDE_USED, false, "lookaside_used_slots", "Lookaside slots in use"},
+	{SQLITE_DBSTATUS_CACHE_USED, false, "cache_used_bytes", "Heap memory used by the page cache"},
+	{SQLITE_DBSTATUS_SCHEMA_USED, false, "schema_used_bytes", "Heap memory used by schemas"},
+	{SQLITE_DBSTATUS_STMT_USED, false, "stmt_used_bytes", "Heap memory used by prepared statements"},
+};
+
+struct global_counter {
+	int op;
+	bool highwater;
+	const char *name;
+	const char *help;
+};
+
+const global_counter global_counters[] = {
+	{SQLITE_STATUS_MEMORY_USED, false, "memory_used_bytes", "Memory allocated by sqlite"},
+	{SQLITE_STATUS_MEMORY_USED, true, "memory_used_highwater_bytes", "Highest memory allocated by sqlite"},
+	{SQLITE_STATUS_MALLOC_COUNT, false, "malloc_count", "Outstanding allocations"},
+	{SQLITE_STATUS_MALLOC_SIZE, true, "malloc_size_highwater_bytes", "Largest allocation requested"},
+	{SQLITE_STATUS_PAGECACHE_USED, false, "pagecache_used_pages", "Pages used from SQLITE_CONFIG_PAGECACHE memory"},
+	{SQLITE_STATUS_PAGECACHE_OVERFLOW, false, "pagecache_overflow_bytes", "Page cache memory allocated from the heap"},
+	{SQLITE_STATUS_PAGECACHE_SIZE, true, "pagecache_size_highwater_bytes", "Largest page cache allocation requested"},
+};
+
+// Longer SQL texts are cut in labels
+const size_t max_sql_label = 200;
+
+std::string label_value(const std::string &value) {
+	std::string result;
+	for (char c : value) {
+		switch (c) {
+		case '\\': result += "\\\\"; break;
+		case '"': result += "\\\""; break;
+		case '\n': result += "\\n"; break;
+		default: result += c; break;
+		}
+	}
+	return result;
+}
+
+std::string labels(const char *key, const std::string &value) {
+	return std::string("{") + key + "=\"" + label_value(value) + "\"}";
+}
+
+double ratio(double part, double whole) {
+	return (whole > 0 ? part / whole : 0.0);
+}
+
+} // anonymous namespace
+
+metrics::metrics() : stopping(false) {
+}
+
+metrics::~metrics() {
+	stop();
+}
+
+void metrics::add(connection &conn, const std::string &name) {
+	std::lock_guard<std::mutex> lock(mutex);
+	connections.push_back(connection_source{&conn, name, false, std::chrono::steady_clock::time_point(), {}});
+}
+
+void metrics::remove(connection &conn) {
+	std::lock_guard<std::mutex> lock(mutex);
+	connections.erase(std::remove_if(connections.begin(), connections.end(),
+			[&](const connection_source &s) { return s.conn == &conn; }),
+			connections.end());
+}
+
+void metrics::add(const profiler &prof, const std::string &name) {
+	std::lock_guard<std::mutex> lock(mutex);
+	profilers.emplace_back(&prof, name);
+}
+
+void metrics::remove(const profiler &prof) {
+	std::lock_guard<std::mutex> lock(mutex);
+	profilers.erase(std::remove_if(profilers.begin(), profilers.end(),
+			[&](const std::pair<const profiler*, std::string> &p) { return p.first == &prof; }),
+			profilers.end());
+}
+
+void metrics::add(const checkpoint_scheduler &sched, const std::string &name) {
+	std::lock_guard<std::mutex> lock(mutex);
+	checkpointers.emplace_back(&sched, name);
+}
+
+void metrics::remove(const checkpoint_scheduler &sched) {
+	std::lock_guard<std::mutex> lock(mutex);
+	checkpointers.erase(std::remove_if(checkpointers.begin(), checkpointers.end(),
+			[&](const std::pair<const checkpoint_scheduler*, std::string> &p) { return p.first == &sched; }),
+			checkpointers.end());
+}
+
+void metrics::add(const query_cache &cache, const std::string &name) {
+	std::lock_guard<std::mutex> lock(mutex);
+	caches.emplace_back(&cache, name);
+}
+
+void metrics::remove(const query_cache &cache) {
+	std::lock_guard<std::mutex> lock(mutex);
+	caches.erase(std::remove_if(caches.begin(), caches.end(),
+			[&](const std::pair<const query_cache*, std::string> &p) { return p.first == &cache; }),
+			caches.end());
+}
+
+void metrics::set(const std::string &name, const char *type, const char *help,
+		const std::string &labels, double value) {
+	family &f = families["sqlite_" + name];
+	f.type = type;
+	f.help = help;
+	f.values.emplace_back(labels, value);
+}
+
+void metrics::sample() {
+	std::lock_guard<std::mutex> lock(mutex);
+	sample_locked();
+}
+
+void metrics::sample_locked() {
+	families.clear();
+
+	for (const global_counter &g : global_counters) {
+		counter c = status(g.op);
+		set(g.name, "gauge", g.help, "", static_cast<double>(g.highwater ? c.highwater : c.current));
+	}
+
+	auto now = std::chrono::steady_clock::now();
+	for (connection_source &src : connections) {
+		std::string l = labels("connection", src.name);
+		std::vector<int64_t> current;
+		for (const connection_counter &cc : cumulative_counters) {
+			counter c = src.conn->status(cc.op);
+			current.push_back(cc.highwater ? c.highwater : c.current);
+		}
+		// Ratios and rates cover the time since the previous sample
+		std::vector<int64_t> delta = current;
+		double seconds = 0;
+		if (src.sampled) {
+			for (size_t i = 0; i < cumulative_count; ++i) {
+				delta[i] -= src.previous[i];
+			}
+			seconds = std::chrono::duration<double>(now - src.when).count();
+		}
+		for (size_t i = 0; i < cumulative_count; ++i) {
+			const connection_counter &cc = cumulative_counters[i];
+			set(std::string("connection_") + cc.name + "_total", "counter", cc.help, l,
+					static_cast<double>(current[i]));
+			if (seconds > 0) {
+				set(std::string("connection_") + cc.name + "_per_second", "gauge", cc.help, l,
+						delta[i] / seconds);
+			}
+		}
+		set("connection_cache_hit_ratio", "gauge", "Fraction of page lookups served by the page cache", l,
+				ratio(delta[cache_hit], delta[cache_hit] + delta[cache_miss]));
+		set("connection_lookaside_miss_ratio", "gauge", "Fraction of allocations not served from lookaside memory", l,
+				ratio(delta[lookaside_miss_size] + delta[lookaside_miss_full],
+					delta[lookaside_hit] + delta[lookaside_miss_size] + delta[lookaside_miss_full]));
+		for (const connection_counter &cc : gauge_counters) {
+			counter c = src.conn->status(cc.op);
+			set(std::string("connection_") + cc.name, "gauge", cc.help, l, static_cast<double>(c.current));
+		}
+		src.previous = std::move(current);
+		src.when = now;
+		src.sampled = true;
+	}
+
+	for (auto &p : profilers) {
+		for (const statement_profile &s : p.first->snapshot()) {
+			std::string sql = s.sql.substr(0, max_sql_label);
+			std::string l = "{profiler=\"" + label_value(p.second) + "\",sql=\"" + label_value(sql) + "\"";
+			set("statement_executions_total", "counter", "Executions of the statement", l + "}",
+					static_cast<double>(s.count));
+			set("statement_seconds_total", "counter", "Time spent running the statement", l + "}",
+					s.total_ns / 1e9);
+			set("statement_rows_total", "counter", "Rows returned by the statement", l + "}",
+					static_cast<double>(s.rows));
+			set("statement_vm_steps_total", "counter", "Virtual machine steps of the statement", l + "}",
+					static_cast<double>(s.vm_steps));
+			const char *help = "Latency quantiles of the statement";
+			set("statement_latency_seconds", "summary", help, l + ",quantile=\"0.5\"}", s.p50_ns / 1e9);
+			set("statement_latency_seconds", "summary", help, l + ",quantile=\"0.9\"}", s.p90_ns / 1e9);
+			set("statement_latency_seconds", "summary", help, l + ",quantile=\"0.99\"}", s.p99_ns / 1e9);
+			set("statement_latency_seconds", "summary", help, "_sum" + l + "}", s.total_ns / 1e9);
+			set("statement_latency_seconds", "summary", help, "_count" + l + "}", static_cast<double>(s.count));
+		}
+	}
+
+	for (auto &c : checkpointers) {
+		checkpoint_stats cs = c.first->stats();
+		std::string l = "{checkpointer=\"" + label_value(c.second) + "\"";
+		set("wal_frames", "gauge", "Frames in the write-ahead log", l + "}",
+				static_cast<double>(cs.wal_frames));
+		set("wal_bytes", "gauge", "Size of the write-ahead log content", l + "}",
+				static_cast<double>(cs.wal_bytes));
+		const char *help = "Completed checkpoints";
+		set("checkpoints_total", "counter", help, l + ",mode=\"passive\"}", static_cast<double>(cs.passive));
+		set("checkpoints_total", "counter", help, l + ",mode=\"restart\"}", static_cast<double>(cs.restart));
+		set("checkpoints_total", "counter", help, l + ",mode=\"truncate\"}", static_cast<double>(cs.truncate));
+		set("checkpoints_busy_total", "counter", "Checkpoints that gave up waiting for other connections", l + "}",
+				static_cast<double>(cs.busy));
+		set("checkpoints_failed_total", "counter", "Checkpoints that failed", l + "}",
+				static_cast<double>(cs.failed));
+		set("checkpoint_seconds_total", "counter", "Time spent checkpointing", l + "}",
+				cs.total_duration_ns / 1e9);
+		set("checkpoint_last_seconds", "gauge", "Duration of the most recent checkpoint", l + "}",
+				cs.last_duration_ns / 1e9);
+		set("checkpoint_max_seconds", "gauge", "Duration of the longest checkpoint", l + "}",
+				cs.max_duration_ns / 1e9);
+	}
+
+	for (auto &c : caches) {
+		query_cache_stats qs = c.first->stats();
+		std::string l = labels("cache", c.second);
+		set("query_cache_hits_total", "counter", "Queries answered from the cache", l,
+				static_cast<double>(qs.hits));
+		set("query_cache_misses_total", "counter", "Queries that had to be run", l,
+				static_cast<double>(qs.misses));
+		set("query_cache_invalidations_total", "counter", "Results dropped because of changed tables", l,
+				static_cast<double>(qs.invalidations));
+		set("query_cache_evictions_total", "counter", "Results dropped to stay within the memory limit", l,
+				static_cast<double>(qs.evictions));
+		set("query_cache_entries", "gauge", "Cached results", l, static_cast<double>(qs.entries));
+		set("query_cache_bytes", "gauge", "Memory used by cached results", l, static_cast<double>(qs.bytes));
+		set("query_cache_hit_ratio", "gauge", "Fraction of queries answered from the cache", l, qs.hit_ratio());
+	}
+}
+
+std::string metrics::render() const {
+	std::lock_guard<std::mutex> lock(mutex);
+	std::ostringstream out;
+	out.precision(15);
+	for (auto &kv : families) {
+		const family &f = kv.second;
+		out << "# HELP " << kv.first << " " << f.help << "\n";
+		out << "# TYPE " << kv.first << " " << f.type << "\n";
+		for (auto &v : f.values) {
+			out << kv.first << v.first << " " << v.second << "\n";
+		}
+	}
+	return out.str();
+}
+
+void metrics::write(const std::string &filename) const {
+	std::string tmpname = filename + ".tmp";
+	{
+		std::ofstream out(tmpname.c_str(), std::ios::out | std::ios::trunc);
+		out << render();
+		out.close();
+		if (!out)
+			throw error(SQLITE_IOERR, "cannot write " + tmpname);
+	}
+	if (std::rename(tmpname.c_str(), filename.c_str()) != 0) {
+		std::remove(tmpname.c_str());
+		throw error(SQLITE_IOERR, "cannot replace " + filename);
+	}
+}
+
+void metrics::start(std::chrono::milliseconds interval, const std::string &filename) {
+	stop();
+	stopping = false;
+	worker = std::thread([this, interval, filename] {
+		std::unique_lock<std::mutex> lock(mutex);
+		while (!stop_requested.wait_for(lock, interval, [this] { return stopping; })) {
+			sample_locked();
+			if (!filename.empty()) {
+				lock.unlock();
+				try {
+					write(filename);
+				}
+				catch (...) {
+					// Try again next time
+				}
+				lock.lock();
+			}
+		}
+	});
+}
+
+void metrics::stop() {
+	if (!worker.joinable())
+		return;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	stop_requested.notify_all();
+	worker.join();
+}
+
+} // namespace sqxx
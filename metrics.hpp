@@ -0,0 +1,131 @@
+
+#if !defined(SQXX_METRICS_HPP_INCLUDED)
+#define SQXX_METRICS_HPP_INCLUDED
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace sqxx {
+
+class checkpoint_scheduler;
+class connection;
+class profiler;
+class query_cache;
+
+/**
+ * Collects sqlite's status counters and renders them in the
+ * [Prometheus text format](https://prometheus.io/docs/instrumenting/exposition_formats/).
+ *
+ * Connections and profilers are registered under a name, which becomes
+ * the `connection` or `profiler` label of their metrics. Each `sample()`
+ * reads:
+ *
+ * - the global counters of `status()` (memory, page cache)
+ * - the counters of `connection::status()` of all registered connections,
+ *   together with cache and lookaside hit ratios and per-second rates since
+ *   the previous sample
+ * - the statement statistics of all registered profilers
+ * - WAL size and checkpoint durations of all registered checkpoint schedulers
+ * - hits, misses and size of all registered query caches
+ *
+ * `start()` samples on a background thread and optionally writes the result
+ * to a file each time, for example for the textfile collector of the node
+ * exporter:
+ *
+ *     sqxx::metrics m;
+ *     m.add(conn, "main");
+ *     m.start(std::chrono::seconds(15), "/var/lib/node_exporter/sqxx.prom");
+ *
+ * Connections that are sampled from the background thread must be opened
+ * in serialized threading mode (the default). Registered objects have to be
+ * removed before they are destroyed.
+ */
+class metrics {
+private:
+	struct connection_source {
+		connection *conn;
+		std::string name;
+		// Cumulative counters at the previous sample, to compute rates
+		bool sampled;
+		std::chrono::steady_clock::time_point when;
+		std::vector<int64_t> previous;
+	};
+	struct family {
+		std::string help;
+		std::string type;
+		// Labels in Prometheus syntax, like `{connection="main"}`, and value.
+		// Summaries prefix the labels of their `_sum` and `_count` samples
+		// with that suffix.
+		std::vector<std::pair<std::string, double>> values;
+	};
+
+	mutable std::mutex mutex;
+	std::vector<connection_source> connections;
+	std::vector<std::pair<const profiler*, std::string>> profilers;
+	std::vector<std::pair<const checkpoint_scheduler*, std::string>> checkpointers;
+	std::vector<std::pair<const query_cache*, std::string>> caches;
+	std::map<std::string, family> families;
+
+	// Background sampling
+	std::thread worker;
+	std::condition_variable stop_requested;
+	bool stopping;
+
+	void set(const std::string &name, const char *type, const char *help,
+			const std::string &labels, double value);
+	void sample_locked();
+
+public:
+	metrics();
+	~metrics();
+
+	metrics(const metrics&) = delete;
+	metrics& operator=(const metrics&) = delete;
+
+	/** Register a connection, `name` is used as its `connection` label */
+	void add(connection &conn, const std::string &name);
+	void remove(connection &conn);
+
+	/** Export the statement statistics of a profiler, `name` is used as its `profiler` label */
+	void add(const profiler &prof, const std::string &name);
+	void remove(const profiler &prof);
+
+	/** Export the WAL and checkpoint statistics of a scheduler, `name` is used as its `checkpointer` label */
+	void add(const checkpoint_scheduler &sched, const std::string &name);
+	void remove(const checkpoint_scheduler &sched);
+
+	/** Export the statistics of a query cache, `name` is used as its `cache` label */
+	void add(const query_cache &cache, const std::string &name);
+	void remove(const query_cache &cache);
+
+	/** Read all counters */
+	void sample();
+
+	/** The values of the most recent sample in Prometheus text format */
+	std::string render() const;
+
+	/**
+	 * Write `render()` to `filename`. The file is replaced atomically, so
+	 * readers never see partial content.
+	 */
+	void write(const std::string &filename) const;
+
+	/**
+	 * Call `sample()` every `interval` on a background thread, and `write()`
+	 * afterwards if `filename` is not empty.
+	 */
+	void start(std::chrono::milliseconds interval, const std::string &filename = std::string());
+	/** Stop the background thread */
+	void stop();
+};
+
+} // namespace sqxx
+
+#endif // SQXX_METRICS_HPP_INCLUDED
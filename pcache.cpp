@@ -0,0 +1,494 @@
+
+#include "pcache.hpp"
+#include "config.hpp"
+#include "huge_buffer.hpp"
+#include <sqlite3.h>
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <unordered_map>
+#include <vector>
+
+namespace sqxx {
+namespace detail {
+namespace {
+
+struct pc_instance;
+
+enum page_queue : uint8_t {
+	queue_none,
+	// Unpinned pages used only once, evicted first
+	queue_a1,
+	// Unpinned pages used repeatedly
+	queue_am,
+};
+
+struct pc_page;
+
+struct page_links {
+	pc_page *prev;
+	pc_page *next;
+};
+
+// Header of a cached page. It lives in the same slot as the page buffer
+// and the extra memory requested by sqlite.
+struct pc_page {
+	sqlite3_pcache_page base;
+	pc_instance *owner;
+	unsigned key;
+	// Position in the queue of all caches and in the one of the owner
+	page_links shared;
+	page_links own;
+	page_queue queue;
+	bool reused;
+};
+
+// Unpinned pages in order of their last use, oldest first. A page can be
+// in one list for each of its `page_links`.
+template<page_links pc_page::*Links>
+struct page_list {
+	pc_page *head = nullptr;
+	pc_page *tail = nullptr;
+	size_t count = 0;
+
+	void push(pc_page *p) {
+		(p->*Links).prev = tail;
+		(p->*Links).next = nullptr;
+		if (tail)
+			(tail->*Links).next = p;
+		else
+			head = p;
+		tail = p;
+		++count;
+	}
+
+	void remove(pc_page *p) {
+		page_links &l = p->*Links;
+		if (l.prev)
+			(l.prev->*Links).next = l.next;
+		else
+			head = l.next;
+		if (l.next)
+			(l.next->*Links).prev = l.prev;
+		else
+			tail = l.prev;
+		--count;
+	}
+};
+
+typedef page_list<&pc_page::shared> shared_page_list;
+typedef page_list<&pc_page::own> own_page_list;
+
+// Page to evict from a pair of 2Q queues. Pages used only once go first, as
+// long as they are more than a quarter of the unpinned pages.
+template<typename List>
+pc_page* victim_in(const List &a1, const List &am) {
+	if (a1.head && (a1.count * 4 > a1.count + am.count || !am.head))
+		return a1.head;
+	return am.head;
+}
+
+struct pc_instance {
+	uint64_t id;
+	int page_size;
+	int extra_size;
+	size_t slot_size;
+	bool purgeable;
+	unsigned max_pages = 100;
+	std::unordered_map<unsigned, pc_page*> pages;
+	// The unpinned pages of this cache
+	own_page_list a1;
+	own_page_list am;
+	uint64_t hits = 0;
+	uint64_t misses = 0;
+	uint64_t evictions = 0;
+};
+
+// Free slots of one size, carved from slabs
+struct slot_class {
+	void *free = nullptr;
+	char *carve = nullptr;
+	char *carve_end = nullptr;
+};
+
+struct pc_state {
+	pcache_options opts;
+	std::mutex mutex;
+	std::map<size_t, slot_class> slots;
+	std::vector<huge_buffer> slabs;
+	size_t reserved = 0;
+	size_t used = 0;
+	bool got_huge = false;
+	shared_page_list a1;
+	shared_page_list am;
+	std::vector<pc_instance*> instances;
+	uint64_t next_id = 1;
+
+	void* map_slab(size_t size);
+	void* alloc_slot(size_t slot_size);
+	void free_slot(size_t slot_size, void *slot);
+	void release_slabs();
+
+	pc_page* alloc_page(pc_instance *inst);
+	void discard(pc_page *p);
+	void evict(pc_page *p);
+	void pin(pc_page *p);
+	void unpin(pc_page *p);
+	pc_page* victim();
+	pc_page* victim_of(pc_instance *inst);
+};
+
+// Never destroyed, sqlite3_shutdown() might still call into the cache
+// during static destruction.
+pc_state *shared_state = nullptr;
+
+inline size_t round_up(size_t n, size_t to) {
+	return (n + to - 1) / to * to;
+}
+
+void* pc_state::map_slab(size_t size) {
+	try {
+		huge_buffer slab(size, opts.huge_pages);
+		if (slab.kind_of_pages() != huge_buffer::backing::normal)
+			got_huge = true;
+		reserved += slab.size();
+		slabs.push_back(std::move(slab));
+		return slabs.back().data();
+	}
+	catch (const std::bad_alloc&) {
+		return nullptr;
+	}
+}
+
+void* pc_state::alloc_slot(size_t slot_size) {
+	slot_class &sc = slots[slot_size];
+	if (sc.free) {
+		void *slot = sc.free;
+		sc.free = *static_cast<void**>(slot);
+		return slot;
+	}
+	if (sc.carve + slot_size > sc.carve_end) {
+		size_t size = std::max(opts.slab_size, slot_size);
+		char *slab = static_cast<char*>(map_slab(size));
+		if (!slab)
+			return nullptr;
+		sc.carve = slab;
+		sc.carve_end = slab + size;
+	}
+	void *slot = sc.carve;
+	sc.carve += slot_size;
+	return slot;
+}
+
+void pc_state::free_slot(size_t slot_size, void *slot) {
+	slot_class &sc = slots[slot_size];
+	*static_cast<void**>(slot) = sc.free;
+	sc.free = slot;
+}
+
+void pc_state::release_slabs() {
+	slabs.clear();
+	slots.clear();
+	reserved = 0;
+	used = 0;
+}
+
+pc_page* pc_state::alloc_page(pc_instance *inst) {
+	char *slot = static_cast<char*>(alloc_slot(inst->slot_size));
+	if (!slot)
+		return nullptr;
+	size_t extra = round_up(inst->extra_size, 8);
+	pc_page *p = reinterpret_cast<pc_page*>(slot + inst->page_size + extra);
+	p->base.pBuf = slot;
+	p->base.pExtra = slot + inst->page_size;
+	std::memset(p->base.pExtra, 0, inst->extra_size);
+	p->owner = inst;
+	p->queue = queue_none;
+	p->reused = false;
+	if (inst->purgeable)
+		used += inst->slot_size;
+	return p;
+}
+
+void pc_state::discard(pc_page *p) {
+	pc_instance *inst = p->owner;
+	if (p->queue != queue_none)
+		pin(p);
+	inst->pages.erase(p->key);
+	if (inst->purgeable)
+		used -= inst->slot_size;
+	free_slot(inst->slot_size, p->base.pBuf);
+}
+
+void pc_state::evict(pc_page *p) {
+	++p->owner->evictions;
+	discard(p);
+}
+
+void pc_state::pin(pc_page *p) {
+	if (p->queue == queue_a1) {
+		a1.remove(p);
+		p->owner->a1.remove(p);
+	}
+	else if (p->queue == queue_am) {
+		am.remove(p);
+		p->owner->am.remove(p);
+	}
+	p->queue = queue_none;
+}
+
+void pc_state::unpin(pc_page *p) {
+	if (p->reused) {
+		p->queue = queue_am;
+		am.push(p);
+		p->owner->am.push(p);
+	}
+	else {
+		p->queue = queue_a1;
+		a1.push(p);
+		p->owner->a1.push(p);
+	}
+}
+
+// Page to evict for the shared budget
+pc_page* pc_state::victim() {
+	return victim_in(a1, am);
+}
+
+// Page to evict if a cache exceeds its own size limit
+pc_page* pc_state::victim_of(pc_instance *inst) {
+	return victim_in(inst->a1, inst->am);
+}
+
+inline pc_instance* instance_of(sqlite3_pcache *p) {
+	return reinterpret_cast<pc_instance*>(p);
+}
+
+inline pc_page* page_of(sqlite3_pcache_page *pg) {
+	return reinterpret_cast<pc_page*>(pg);
+}
+
+} // anonymous namespace
+} // namespace detail
+} // namespace sqxx
+
+using sqxx::detail::shared_state;
+using sqxx::detail::instance_of;
+using sqxx::detail::page_of;
+using sqxx::detail::pc_instance;
+using sqxx::detail::pc_page;
+
+extern "C"
+int sqxx_pcache_init(void*) {
+	return SQLITE_OK;
+}
+
+extern "C"
+void sqxx_pcache_shutdown(void*) {
+	std::lock_guard<std::mutex> lock(shared_state->mutex);
+	shared_state->release_slabs();
+}
+
+extern "C"
+sqlite3_pcache* sqxx_pcache_create(int page_size, int extra_size, int purgeable) {
+	std::unique_ptr<pc_instance> inst(new pc_instance);
+	inst->page_size = page_size;
+	inst->extra_size = extra_size;
+	inst->slot_size = sqxx::detail::round_up(page_size + sqxx::detail::round_up(extra_size, 8)
+			+ sizeof(pc_page), 16);
+	inst->purgeable = purgeable;
+
+	std::lock_guard<std::mutex> lock(shared_state->mutex);
+	inst->id = shared_state->next_id++;
+	shared_state->instances.push_back(inst.get());
+	return reinterpret_cast<sqlite3_pcache*>(inst.release());
+}
+
+extern "C"
+void sqxx_pcache_cachesize(sqlite3_pcache *p, int max_pages) {
+	pc_instance *inst = instance_of(p);
+	std::lock_guard<std::mutex> lock(shared_state->mutex);
+	inst->max_pages = max_pages;
+	while (inst->purgeable && inst->pages.size() > inst->max_pages) {
+		pc_page *v = shared_state->victim_of(inst);
+		if (!v)
+			break;
+		shared_state->evict(v);
+	}
+}
+
+extern "C"
+int sqxx_pcache_pagecount(sqlite3_pcache *p) {
+	pc_instance *inst = instance_of(p);
+	std::lock_guard<std::mutex> lock(shared_state->mutex);
+	return static_cast<int>(inst->pages.size());
+}
+
+extern "C"
+sqlite3_pcache_page* sqxx_pcache_fetch(sqlite3_pcache *p, unsigned key, int create) {
+	pc_instance *inst = instance_of(p);
+	sqxx::detail::pc_state &s = *shared_state;
+	std::lock_guard<std::mutex> lock(s.mutex);
+
+	auto it = inst->pages.find(key);
+	if (it != inst->pages.end()) {
+		pc_page *pg = it->second;
+		if (pg->queue != sqxx::detail::queue_none) {
+			s.pin(pg);
+			pg->reused = true;
+		}
+		++inst->hits;
+		return &pg->base;
+	}
+	if (create == 0)
+		return nullptr;
+
+	// Make room. With `create == 1` sqlite prefers to get nothing over
+	// exceeding the limits, with `create == 2` it really needs the page.
+	while (inst->purgeable) {
+		bool over_own = (inst->pages.size() >= inst->max_pages);
+		bool over_budget = (s.opts.budget && s.used + inst->slot_size > s.opts.budget);
+		if (!over_own && !over_budget)
+			break;
+		pc_page *v = (over_own ? s.victim_of(inst) : s.victim());
+		if (!v) {
+			if (create == 1)
+				return nullptr;
+			break;
+		}
+		s.evict(v);
+	}
+
+	pc_page *pg = s.alloc_page(inst);
+	if (!pg)
+		return nullptr;
+	pg->key = key;
+	inst->pages.emplace(key, pg);
+	++inst->misses;
+	return &pg->base;
+}
+
+extern "C"
+void sqxx_pcache_unpin(sqlite3_pcache *p, sqlite3_pcache_page *page, int discard) {
+	pc_instance *inst = instance_of(p);
+	pc_page *pg = page_of(page);
+	std::lock_guard<std::mutex> lock(shared_state->mutex);
+	if (discard)
+		shared_state->discard(pg);
+	else if (inst->purgeable)
+		shared_state->unpin(pg);
+}
+
+extern "C"
+void sqxx_pcache_rekey(sqlite3_pcache *p, sqlite3_pcache_page *page, unsigned oldkey, unsigned newkey) {
+	pc_instance *inst = instance_of(p);
+	pc_page *pg = page_of(page);
+	std::lock_guard<std::mutex> lock(shared_state->mutex);
+	inst->pages.erase(oldkey);
+	auto it = inst->pages.find(newkey);
+	if (it != inst->pages.end())
+		shared_state->discard(it->second);
+	pg->key = newkey;
+	inst->pages.emplace(newkey, pg);
+}
+
+extern "C"
+void sqxx_pcache_truncate(sqlite3_pcache *p, unsigned limit) {
+	pc_instance *inst = instance_of(p);
+	std::lock_guard<std::mutex> lock(shared_state->mutex);
+	std::vector<pc_page*> drop;
+	for (auto &e : inst->pages) {
+		if (e.first >= limit)
+			drop.push_back(e.second);
+	}
+	for (pc_page *pg : drop) {
+		shared_state->discard(pg);
+	}
+}
+
+extern "C"
+void sqxx_pcache_destroy(sqlite3_pcache *p) {
+	pc_instance *inst = instance_of(p);
+	{
+		std::lock_guard<std::mutex> lock(shared_state->mutex);
+		while (!inst->pages.empty()) {
+			shared_state->discard(inst->pages.begin()->second);
+		}
+		auto &v = shared_state->instances;
+		v.erase(std::find(v.begin(), v.end(), inst));
+	}
+	delete inst;
+}
+
+extern "C"
+void sqxx_pcache_shrink(sqlite3_pcache *p) {
+	pc_instance *inst = instance_of(p);
+	std::lock_guard<std::mutex> lock(shared_state->mutex);
+	std::vector<pc_page*> drop;
+	for (auto &e : inst->pages) {
+		if (e.second->queue != sqxx::detail::queue_none)
+			drop.push_back(e.second);
+	}
+	for (pc_page *pg : drop) {
+		shared_state->discard(pg);
+	}
+}
+
+namespace sqxx {
+
+namespace {
+	const sqlite3_pcache_methods2 shared_pcache_methods = {
+		1,
+		nullptr,
+		sqxx_pcache_init,
+		sqxx_pcache_shutdown,
+		sqxx_pcache_create,
+		sqxx_pcache_cachesize,
+		sqxx_pcache_pagecount,
+		sqxx_pcache_fetch,
+		sqxx_pcache_unpin,
+		sqxx_pcache_rekey,
+		sqxx_pcache_truncate,
+		sqxx_pcache_destroy,
+		sqxx_pcache_shrink,
+	};
+}
+
+void config_shared_pcache(const pcache_options &opts) {
+	if (!shared_state)
+		shared_state = new detail::pc_state;
+	// sqlite isn't initialized after this succeeds, so no cache uses the state
+	config_pcache2(&shared_pcache_methods);
+	shared_state->opts = opts;
+	shared_state->got_huge = false;
+}
+
+pcache_statistics shared_pcache_stats() {
+	pcache_statistics result = pcache_statistics();
+	if (!shared_state)
+		return result;
+
+	std::lock_guard<std::mutex> lock(shared_state->mutex);
+	for (pc_instance *inst : shared_state->instances) {
+		pcache_instance_stats is;
+		is.id = inst->id;
+		is.page_size = inst->page_size;
+		is.purgeable = inst->purgeable;
+		is.pages = static_cast<unsigned>(inst->pages.size());
+		is.max_pages = inst->max_pages;
+		is.hits = inst->hits;
+		is.misses = inst->misses;
+		is.evictions = inst->evictions;
+		result.instances.push_back(is);
+	}
+	result.budget = shared_state->opts.budget;
+	result.used = shared_state->used;
+	result.reserved = shared_state->reserved;
+	result.huge_pages = shared_state->got_huge;
+	return result;
+}
+
+} // namespace sqxx
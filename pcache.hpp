@@ -0,0 +1,94 @@
+
+#if !defined(SQXX_PCACHE_HPP_INCLUDED)
+#define SQXX_PCACHE_HPP_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace sqxx {
+
+/** Parameters for `config_shared_pcache()` */
+struct pcache_options {
+	/**
+	 * Memory (in bytes) all page caches together may use for pages that
+	 * sqlite could evict, `0` for no common limit. Each cache is also
+	 * limited by its own `pragma cache_size`, set that high to let the
+	 * budget decide.
+	 */
+	size_t budget = 0;
+	/** Back page memory by huge pages if possible */
+	bool huge_pages = false;
+	/** Size of the memory regions pages are allocated from */
+	size_t slab_size = 2 * 1024 * 1024;
+};
+
+/** Statistics of one page cache (usually one per database of a connection) */
+struct pcache_instance_stats {
+	/** Identifies the cache as long as it exists */
+	uint64_t id;
+	int page_size;
+	/** Caches of temporary and in-memory databases can't evict pages */
+	bool purgeable;
+	/** Number of pages currently held */
+	unsigned pages;
+	/** Page limit from `pragma cache_size` */
+	unsigned max_pages;
+	uint64_t hits;
+	uint64_t misses;
+	/** Pages of this cache that were dropped to make room */
+	uint64_t evictions;
+
+	double hit_ratio() const {
+		return (hits + misses ? static_cast<double>(hits) / (hits + misses) : 0.0);
+	}
+};
+
+/** Statistics of the shared page cache, see `shared_pcache_stats()` */
+struct pcache_statistics {
+	std::vector<pcache_instance_stats> instances;
+	size_t budget;
+	/** Memory used by pages of purgeable caches */
+	size_t used;
+	/** Memory reserved from the system for pages */
+	size_t reserved;
+	/** If huge pages were requested, whether the system provided them */
+	bool huge_pages;
+};
+
+/**
+ * Install a page cache shared by all database connections
+ * (SQLITE_CONFIG_PCACHE2).
+ *
+ * Each database of each connection still gets its own cache instance,
+ * since sqlite doesn't allow several connections to use the same page
+ * buffers. But all instances draw from one memory `budget`, so that the
+ * total memory used for caching is capped and pages of busy connections
+ * can replace idle pages of others.
+ *
+ * Pages that aren't in use are replaced with a 2Q policy: pages used once,
+ * like those read by a table scan, are evicted before pages that were
+ * used repeatedly. This keeps the hot pages of all connections cached
+ * through large scans.
+ *
+ * Page memory is taken from slabs of `slab_size` bytes. With `huge_pages`,
+ * slabs are requested with `MAP_HUGETLB`, falling back to transparent huge
+ * pages and then normal pages.
+ *
+ * Like all `config_*()` functions this must be called while sqlite isn't
+ * initialized:
+ *
+ *     sqxx::pcache_options opts;
+ *     opts.budget = 512 * 1024 * 1024;
+ *     sqxx::shutdown();
+ *     sqxx::config_shared_pcache(opts);
+ *     sqxx::initialize();
+ */
+void config_shared_pcache(const pcache_options &opts = pcache_options());
+
+/** Statistics of the page cache installed with `config_shared_pcache()` */
+pcache_statistics shared_pcache_stats();
+
+} // namespace sqxx
+
+#endif // SQXX_PCACHE_HPP_INCLUDED
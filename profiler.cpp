@@ -0,0 +1,323 @@
+
+#include "profiler.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <functional>
+
+namespace sqxx {
+
+// ---------------------------------------------------------------------------
+// latency_histogram
+
+// Values below `sub_buckets` get a bucket each. Above that, the bucket is
+// given by the position of the highest set bit and the following four bits.
+
+int latency_histogram::bucket_of(uint64_t ns) {
+	if (ns < static_cast<uint64_t>(sub_buckets))
+		return static_cast<int>(ns);
+	int exponent = 63 - __builtin_clzll(ns);
+	if (exponent >= max_exponent)
+		return bucket_count - 1;
+	int sub = static_cast<int>((ns >> (exponent - 4)) & (sub_buckets - 1));
+	return (exponent - 3) * sub_buckets + sub;
+}
+
+uint64_t latency_histogram::bucket_upper(int bucket) {
+	if (bucket < sub_buckets)
+		return static_cast<uint64_t>(bucket);
+	int exponent = bucket / sub_buckets + 3;
+	uint64_t sub = static_cast<uint64_t>(bucket % sub_buckets);
+	uint64_t width = uint64_t(1) << (exponent - 4);
+	return (sub_buckets + sub) * width + width - 1;
+}
+
+latency_histogram::latency_histogram() {
+	reset();
+}
+
+void latency_histogram::record(uint64_t ns) {
+	buckets[bucket_of(ns)].fetch_add(1, std::memory_order_relaxed);
+}
+
+void latency_histogram::reset() {
+	for (auto &b : buckets) {
+		b.store(0, std::memory_order_relaxed);
+	}
+}
+
+uint64_t latency_histogram::count() const {
+	uint64_t n = 0;
+	for (auto &b : buckets) {
+		n += b.load(std::memory_order_relaxed);
+	}
+	return n;
+}
+
+uint64_t latency_histogram::percentile(double q) const {
+	uint64_t counts[bucket_count];
+	uint64_t total = 0;
+	for (int i = 0; i < bucket_count; ++i) {
+		counts[i] = buckets[i].load(std::memory_order_relaxed);
+		total += counts[i];
+	}
+	if (total == 0)
+		return 0;
+	q = std::min(std::max(q, 0.0), 1.0);
+	uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(q * total)));
+	uint64_t seen = 0;
+	for (int i = 0; i < bucket_count; ++i) {
+		seen += counts[i];
+		if (seen >= rank)
+			return bucket_upper(i);
+	}
+	return bucket_upper(bucket_count - 1);
+}
+
+
+// ---------------------------------------------------------------------------
+// profiler
+
+namespace {
+	// Raw SQL texts remembered per shard before the cache is cleared, bounds
+	// memory for applications that inline values into their statements
+	const size_t max_raw_per_shard = 4096;
+
+	void atomic_max(std::atomic<uint64_t> &target, uint64_t value) {
+		uint64_t current = target.load(std::memory_order_relaxed);
+		while (current < value &&
+				!target.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+		}
+	}
+
+	bool is_ident_char(char c) {
+		return (std::isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '$' ||
+				(static_cast<unsigned char>(c) & 0x80));
+	}
+
+	// Skip a quoted section starting at `p`, where quotes are escaped by doubling
+	const char* skip_quoted(const char *p, char close) {
+		++p;
+		while (*p) {
+			if (*p == close) {
+				if (p[1] != close)
+					return p + 1;
+				++p;
+			}
+			++p;
+		}
+		return p;
+	}
+}
+
+struct profiler::entry {
+	std::string sql;
+	latency_histogram histogram;
+	std::atomic<uint64_t> count{0};
+	std::atomic<uint64_t> total_ns{0};
+	std::atomic<uint64_t> max_ns{0};
+	std::atomic<uint64_t> rows{0};
+	std::atomic<uint64_t> vm_steps{0};
+
+	explicit entry(const std::string &sql_arg) : sql(sql_arg) {
+	}
+
+	statement_profile profile() const {
+		statement_profile p;
+		p.sql = sql;
+		p.count = count.load(std::memory_order_relaxed);
+		p.total_ns = total_ns.load(std::memory_order_relaxed);
+		p.max_ns = max_ns.load(std::memory_order_relaxed);
+		// Bucket bounds can be above the largest value actually seen
+		p.p50_ns = std::min(histogram.percentile(0.50), p.max_ns);
+		p.p90_ns = std::min(histogram.percentile(0.90), p.max_ns);
+		p.p99_ns = std::min(histogram.percentile(0.99), p.max_ns);
+		p.rows = rows.load(std::memory_order_relaxed);
+		p.vm_steps = vm_steps.load(std::memory_order_relaxed);
+		return p;
+	}
+};
+
+profiler::profiler() {
+}
+
+profiler::~profiler() {
+}
+
+profiler::entry* profiler::lookup(const char *sql) {
+	std::string raw(sql);
+	shard &s = shards[std::hash<std::string>()(raw) % shard_count];
+	std::lock_guard<std::mutex> shard_lock(s.mutex);
+	auto it = s.by_raw.find(raw);
+	if (it != s.by_raw.end())
+		return it->second;
+
+	std::string normalized = normalize(sql);
+	entry *e;
+	{
+		std::lock_guard<std::mutex> lock(entries_mutex);
+		std::unique_ptr<entry> &slot = entries[normalized];
+		if (!slot)
+			slot.reset(new entry(normalized));
+		e = slot.get();
+	}
+	if (s.by_raw.size() >= max_raw_per_shard)
+		s.by_raw.clear();
+	s.by_raw.emplace(std::move(raw), e);
+	return e;
+}
+
+void profiler::record(const char *sql, uint64_t ns, uint64_t rows, uint64_t vm_steps) {
+	if (sql)
+		record(lookup(sql), ns, rows, vm_steps);
+}
+
+void profiler::record(entry *e, uint64_t ns, uint64_t rows, uint64_t vm_steps) {
+	e->histogram.record(ns);
+	e->count.fetch_add(1, std::memory_order_relaxed);
+	e->total_ns.fetch_add(ns, std::memory_order_relaxed);
+	atomic_max(e->max_ns, ns);
+	e->rows.fetch_add(rows, std::memory_order_relaxed);
+	e->vm_steps.fetch_add(vm_steps, std::memory_order_relaxed);
+}
+
+std::vector<statement_profile> profiler::snapshot() const {
+	std::vector<statement_profile> result;
+	std::lock_guard<std::mutex> lock(entries_mutex);
+	result.reserve(entries.size());
+	for (auto &kv : entries) {
+		statement_profile p = kv.second->profile();
+		if (p.count)
+			result.push_back(std::move(p));
+	}
+	return result;
+}
+
+std::vector<statement_profile> profiler::top_by_total(size_t n) const {
+	std::vector<statement_profile> all = snapshot();
+	n = std::min(n, all.size());
+	std::partial_sort(all.begin(), all.begin() + n, all.end(),
+			[](const statement_profile &a, const statement_profile &b) {
+				return a.total_ns > b.total_ns;
+			});
+	all.resize(n);
+	return all;
+}
+
+std::vector<statement_profile> profiler::top_by_p99(size_t n) const {
+	std::vector<statement_profile> all = snapshot();
+	n = std::min(n, all.size());
+	std::partial_sort(all.begin(), all.begin() + n, all.end(),
+			[](const statement_profile &a, const statement_profile &b) {
+				return a.p99_ns > b.p99_ns;
+			});
+	all.resize(n);
+	return all;
+}
+
+void profiler::reset() {
+	// Entries stay around since the raw SQL caches point to them
+	std::lock_guard<std::mutex> lock(entries_mutex);
+	for (auto &kv : entries) {
+		entry &e = *kv.second;
+		e.histogram.reset();
+		e.count.store(0, std::memory_order_relaxed);
+		e.total_ns.store(0, std::memory_order_relaxed);
+		e.max_ns.store(0, std::memory_order_relaxed);
+		e.rows.store(0, std::memory_order_relaxed);
+		e.vm_steps.store(0, std::memory_order_relaxed);
+	}
+}
+
+std::string profiler::normalize(const char *sql) {
+	std::string result;
+	bool space = false;
+	const char *p = sql;
+	while (*p) {
+		char c = *p;
+		const char *next;
+		bool literal = false;
+		bool prev_ident = (!result.empty() && !space && is_ident_char(result.back()));
+
+		if (std::isspace(static_cast<unsigned char>(c))) {
+			space = true;
+			++p;
+			continue;
+		}
+		else if (c == '-' && p[1] == '-') {
+			next = p;
+			while (*next && *next != '\n')
+				++next;
+			space = true;
+			p = next;
+			continue;
+		}
+		else if (c == '/' && p[1] == '*') {
+			next = p + 2;
+			while (*next && !(next[0] == '*' && next[1] == '/'))
+				++next;
+			space = true;
+			p = (*next ? next + 2 : next);
+			continue;
+		}
+		else if (c == '\'') {
+			next = skip_quoted(p, '\'');
+			literal = true;
+		}
+		else if ((c == 'x' || c == 'X') && p[1] == '\'' && !prev_ident) {
+			next = skip_quoted(p + 1, '\'');
+			literal = true;
+		}
+		else if (c == '"' || c == '`') {
+			next = skip_quoted(p, c);
+		}
+		else if (c == '[') {
+			next = p + 1;
+			while (*next && *next != ']')
+				++next;
+			if (*next)
+				++next;
+		}
+		else if ((std::isdigit(static_cast<unsigned char>(c)) ||
+					(c == '.' && std::isdigit(static_cast<unsigned char>(p[1])))) && !prev_ident) {
+			next = p;
+			if (c == '0' && (p[1] == 'x' || p[1] == 'X')) {
+				next += 2;
+				while (std::isxdigit(static_cast<unsigned char>(*next)))
+					++next;
+			}
+			else {
+				while (std::isdigit(static_cast<unsigned char>(*next)) || *next == '.')
+					++next;
+				if ((*next == 'e' || *next == 'E') &&
+						(std::isdigit(static_cast<unsigned char>(next[1])) ||
+						 ((next[1] == '+' || next[1] == '-') && std::isdigit(static_cast<unsigned char>(next[2]))))) {
+					next += 2;
+					while (std::isdigit(static_cast<unsigned char>(*next)))
+						++next;
+				}
+			}
+			literal = true;
+		}
+		else if (is_ident_char(c)) {
+			next = p;
+			while (*next && is_ident_char(*next))
+				++next;
+		}
+		else {
+			next = p + 1;
+		}
+
+		if (space && !result.empty())
+			result += ' ';
+		space = false;
+		if (literal)
+			result += '?';
+		else
+			result.append(p, next);
+		p = next;
+	}
+	return result;
+}
+
+} // namespace sqxx
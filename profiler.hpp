@@ -0,0 +1,154 @@
+
+#if !defined(SQXX_PROFILER_HPP_INCLUDED)
+#define SQXX_PROFILER_HPP_INCLUDED
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace sqxx {
+
+/**
+ * A latency histogram with logarithmic buckets, like HdrHistogram.
+ *
+ * Each power of two is split into 16 linear buckets, so percentiles are
+ * exact to about 6%. Recording is lock-free and can happen from several
+ * threads at once.
+ */
+class latency_histogram {
+public:
+	/** Values up to 2^`max_exponent` nanoseconds (about 5 hours) are distinguished */
+	static const int max_exponent = 44;
+	static const int sub_buckets = 16;
+	static const int bucket_count = (max_exponent - 3) * sub_buckets;
+
+private:
+	std::atomic<uint64_t> buckets[bucket_count];
+
+	static int bucket_of(uint64_t ns);
+	static uint64_t bucket_upper(int bucket);
+
+public:
+	latency_histogram();
+
+	void record(uint64_t ns);
+	void reset();
+
+	/** Number of recorded values */
+	uint64_t count() const;
+
+	/**
+	 * Value below which the fraction `q` (0.0 to 1.0) of the recorded
+	 * values lie. Returns the upper bound of the bucket, 0 if nothing was
+	 * recorded.
+	 */
+	uint64_t percentile(double q) const;
+};
+
+/** Aggregated executions of one statement, see `profiler` */
+struct statement_profile {
+	/** Normalized SQL text */
+	std::string sql;
+	uint64_t count;
+	uint64_t total_ns;
+	uint64_t max_ns;
+	uint64_t p50_ns;
+	uint64_t p90_ns;
+	uint64_t p99_ns;
+	/** Rows returned by all executions */
+	uint64_t rows;
+	/** Virtual machine steps of all executions */
+	uint64_t vm_steps;
+
+	double mean_ns() const {
+		return (count ? static_cast<double>(total_ns) / count : 0.0);
+	}
+};
+
+/**
+ * Collects execution statistics of the statements of one or more
+ * connections.
+ *
+ * Attach it with `connection::set_profiler()`. Executions are grouped by
+ * their SQL text, with literals replaced by `?` and whitespace collapsed
+ * (see `normalize()`), so that statements that only differ in inlined
+ * values end up together. For each group the profiler keeps a latency
+ * histogram and counts executions, returned rows and VM steps. A connection
+ * looks up the group of each `statement` object once and keeps it by
+ * statement handle until the statement is destroyed. Recording an execution
+ * then only needs a hash lookup of the handle and atomic updates.
+ *
+ *     sqxx::profiler prof;
+ *     conn.set_profiler(prof);
+ *     ...
+ *     for (auto &s : prof.top_by_total(10))
+ *         std::cout << s.total_ns << " " << s.p99_ns << " " << s.sql << std::endl;
+ *
+ * The profiler must outlive the connections it is attached to.
+ */
+class profiler {
+public:
+	/** Statistics of one normalized statement, see `lookup()` */
+	struct entry;
+
+private:
+	static const int shard_count = 16;
+	struct shard {
+		std::mutex mutex;
+		// Raw SQL text to entry, raw texts are cached to avoid normalizing
+		// on every execution
+		std::unordered_map<std::string, entry*> by_raw;
+	};
+
+	shard shards[shard_count];
+	mutable std::mutex entries_mutex;
+	std::unordered_map<std::string, std::unique_ptr<entry>> entries;
+
+public:
+	profiler();
+	~profiler();
+
+	profiler(const profiler&) = delete;
+	profiler& operator=(const profiler&) = delete;
+
+	/**
+	 * The entry that executions of `sql` are recorded in. It stays valid
+	 * as long as the profiler exists, so callers can look it up once per
+	 * prepared statement.
+	 */
+	entry* lookup(const char *sql);
+
+	/**
+	 * Record one execution of a statement. Usually called by the connection.
+	 *
+	 * Recording in an entry only updates atomic counters, recording by SQL
+	 * text first needs a `lookup()`.
+	 */
+	void record(entry *e, uint64_t ns, uint64_t rows, uint64_t vm_steps);
+	void record(const char *sql, uint64_t ns, uint64_t rows, uint64_t vm_steps);
+
+	/** Statistics of all statements seen so far */
+	std::vector<statement_profile> snapshot() const;
+	/** The `n` statements with the highest total execution time */
+	std::vector<statement_profile> top_by_total(size_t n) const;
+	/** The `n` statements with the highest 99th percentile latency */
+	std::vector<statement_profile> top_by_p99(size_t n) const;
+
+	/** Clear all statistics */
+	void reset();
+
+	/**
+	 * Replace numeric, string and blob literals with `?` and collapse
+	 * whitespace.
+	 */
+	static std::string normalize(const char *sql);
+};
+
+} // namespace sqxx
+
+#endif // SQXX_PROFILER_HPP_INCLUDED
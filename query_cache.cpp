@@ -0,0 +1,281 @@
+
+#include "query_cache.hpp"
+#include "connection.hpp"
+#include "error.hpp"
+#include "statement.hpp"
+#include <sqlite3.h>
+#include <cstring>
+#include <iterator>
+
+namespace sqxx {
+
+namespace {
+
+sqlite3_stmt* prepare_pragma(sqlite3 *db, const char *sql) {
+	sqlite3_stmt *stmt = nullptr;
+	if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+		sqlite3_finalize(stmt);
+		throw recent_error(db);
+	}
+	return stmt;
+}
+
+int64_t pragma_value(sqlite3_stmt *stmt) {
+	int64_t v = 0;
+	if (sqlite3_step(stmt) == SQLITE_ROW)
+		v = sqlite3_column_int64(stmt, 0);
+	sqlite3_reset(stmt);
+	return v;
+}
+
+template<typename T>
+void append_raw(std::string &key, const T &value) {
+	key.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+// SQL text and parameters, in a form that can't be ambiguous
+std::string cache_key(const std::string &sql, const std::vector<cache_param> &params) {
+	std::string key = sql;
+	key += '\0';
+	for (const cache_param &p : params) {
+		key += static_cast<char>(p.type);
+		switch (p.type) {
+		case datatype::INTEGER:
+			append_raw(key, p.i);
+			break;
+		case datatype::FLOAT:
+			append_raw(key, p.d);
+			break;
+		case datatype::TEXT:
+		case datatype::BLOB:
+			append_raw(key, static_cast<uint64_t>(p.s.size()));
+			key += p.s;
+			break;
+		case datatype::NULLVALUE:
+			break;
+		}
+	}
+	return key;
+}
+
+} // anonymous namespace
+
+query_cache::query_cache(connection &conn_arg, const query_cache_options &opts_arg)
+	: conn(conn_arg), opts(opts_arg), data_version_stmt(nullptr), schema_version_stmt(nullptr),
+	  data_version(0), schema_version(0), total_changes(0),
+	  reported_changes(0), checked_reported_changes(0) {
+	data_version_stmt = prepare_pragma(conn.raw(), "pragma data_version");
+	try {
+		schema_version_stmt = prepare_pragma(conn.raw(), "pragma schema_version");
+	}
+	catch (...) {
+		sqlite3_finalize(data_version_stmt);
+		throw;
+	}
+	data_version = pragma_value(data_version_stmt);
+	schema_version = pragma_value(schema_version_stmt);
+	total_changes = conn.total_changes();
+	conn.set_update_handler([this](int, const char*, const char *table, int64_t) {
+		table_changed(table);
+	});
+}
+
+query_cache::~query_cache() {
+	conn.set_update_handler();
+	sqlite3_finalize(data_version_stmt);
+	sqlite3_finalize(schema_version_stmt);
+}
+
+void query_cache::check_changes() {
+	int64_t dv = pragma_value(data_version_stmt);
+	int64_t sv = pragma_value(schema_version_stmt);
+	int tc = conn.total_changes();
+
+	std::lock_guard<std::mutex> lock(mutex);
+	// Changes of this connection that didn't pass the update handler.
+	// Changes made by triggers are reported but not counted, so this can
+	// only miss unreported changes in statements that also ran triggers.
+	bool unreported = (static_cast<uint64_t>(tc - total_changes) > reported_changes - checked_reported_changes);
+	if (dv != data_version || sv != schema_version || unreported) {
+		st.invalidations += index.size();
+		clear_locked();
+	}
+	data_version = dv;
+	schema_version = sv;
+	total_changes = tc;
+	checked_reported_changes = reported_changes;
+}
+
+void query_cache::table_changed(const char *table) {
+	std::lock_guard<std::mutex> lock(mutex);
+	++reported_changes;
+	invalidate_locked(table);
+}
+
+void query_cache::invalidate(const std::string &table) {
+	std::lock_guard<std::mutex> lock(mutex);
+	invalidate_locked(table);
+}
+
+void query_cache::invalidate_locked(const std::string &table) {
+	auto tk = table_keys.find(table);
+	if (tk == table_keys.end())
+		return;
+	std::vector<std::string> keys(tk->second.begin(), tk->second.end());
+	for (const std::string &key : keys) {
+		auto it = index.find(key);
+		if (it != index.end()) {
+			erase(it->second);
+			++st.invalidations;
+		}
+	}
+}
+
+void query_cache::erase(entry_iterator it) {
+	for (const std::string &table : it->tables) {
+		auto tk = table_keys.find(table);
+		if (tk != table_keys.end()) {
+			tk->second.erase(it->key);
+			if (tk->second.empty())
+				table_keys.erase(tk);
+		}
+	}
+	st.bytes -= it->bytes;
+	index.erase(it->key);
+	lru.erase(it);
+	st.entries = index.size();
+}
+
+void query_cache::clear() {
+	std::lock_guard<std::mutex> lock(mutex);
+	clear_locked();
+}
+
+void query_cache::clear_locked() {
+	lru.clear();
+	index.clear();
+	table_keys.clear();
+	st.bytes = 0;
+	st.entries = 0;
+}
+
+query_cache_stats query_cache::stats() const {
+	std::lock_guard<std::mutex> lock(mutex);
+	return st;
+}
+
+std::shared_ptr<cached_rows> query_cache::execute(const std::string &sql,
+		const std::vector<cache_param> &params, std::vector<std::string> &tables) {
+	statement stmt = conn.prepare(sql, tables);
+	if (!stmt.readonly())
+		throw error(SQLITE_MISUSE, "query_cache only runs read-only statements");
+
+	for (size_t i = 0; i < params.size(); ++i) {
+		const cache_param &p = params[i];
+		int idx = static_cast<int>(i);
+		switch (p.type) {
+		case datatype::INTEGER:
+			stmt.bind<int64_t>(idx, p.i);
+			break;
+		case datatype::FLOAT:
+			stmt.bind<double>(idx, p.d);
+			break;
+		case datatype::TEXT:
+			stmt.bind<std::string>(idx, p.s, false);
+			break;
+		case datatype::BLOB:
+			stmt.bind<blob>(idx, blob(p.s.data(), p.s.size()), false);
+			break;
+		case datatype::NULLVALUE:
+			stmt.bind(idx);
+			break;
+		}
+	}
+
+	std::shared_ptr<cached_rows> rows = std::make_shared<cached_rows>();
+	sqlite3_stmt *h = stmt.raw();
+	rows->ncols = stmt.col_count();
+	for (int c = 0; c < rows->ncols; ++c) {
+		rows->names.push_back(sqlite3_column_name(h, c));
+	}
+	for (stmt.run(); !stmt.done(); stmt.next_row()) {
+		for (int c = 0; c < rows->ncols; ++c) {
+			cached_rows::cell cell;
+			cell.length = 0;
+			switch (sqlite3_column_type(h, c)) {
+			case SQLITE_INTEGER:
+				cell.type = datatype::INTEGER;
+				cell.i = sqlite3_column_int64(h, c);
+				break;
+			case SQLITE_FLOAT:
+				cell.type = datatype::FLOAT;
+				cell.d = sqlite3_column_double(h, c);
+				break;
+			case SQLITE_TEXT:
+			case SQLITE_BLOB: {
+				bool text = (sqlite3_column_type(h, c) == SQLITE_TEXT);
+				// Correct order to call functions according to http://www.sqlite.org/c3ref/column_blob.html
+				const void *data = (text ? sqlite3_column_text(h, c) : sqlite3_column_blob(h, c));
+				int bytes = sqlite3_column_bytes(h, c);
+				cell.type = (text ? datatype::TEXT : datatype::BLOB);
+				cell.length = bytes;
+				cell.offset = rows->arena.size();
+				rows->arena.append(static_cast<const char*>(data), bytes);
+				rows->arena += '\0';
+				break;
+			}
+			default:
+				cell.type = datatype::NULLVALUE;
+				cell.i = 0;
+				break;
+			}
+			rows->cells.push_back(cell);
+		}
+	}
+	rows->cells.shrink_to_fit();
+	rows->arena.shrink_to_fit();
+	return rows;
+}
+
+std::shared_ptr<const cached_rows> query_cache::query_params(const std::string &sql,
+		const std::vector<cache_param> &params) {
+	check_changes();
+
+	std::string key = cache_key(sql, params);
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		auto it = index.find(key);
+		if (it != index.end()) {
+			++st.hits;
+			lru.splice(lru.begin(), lru, it->second);
+			return it->second->rows;
+		}
+		++st.misses;
+	}
+
+	std::vector<std::string> tables;
+	std::shared_ptr<cached_rows> rows = execute(sql, params, tables);
+	size_t bytes = sizeof(entry) + key.size() + rows->memory();
+
+	std::lock_guard<std::mutex> lock(mutex);
+	// Within a transaction the rows might include changes that are rolled back
+	if (!conn.autocommit() || bytes > opts.max_entry_bytes || bytes > opts.max_bytes) {
+		++st.uncached;
+		return rows;
+	}
+	while (st.bytes + bytes > opts.max_bytes && !lru.empty()) {
+		erase(std::prev(lru.end()));
+		++st.evictions;
+	}
+	lru.push_front(entry{key, rows, tables, bytes});
+	index[key] = lru.begin();
+	for (const std::string &table : tables) {
+		table_keys[table].insert(key);
+	}
+	st.bytes += bytes;
+	st.entries = index.size();
+	return rows;
+}
+
+} // namespace sqxx
+
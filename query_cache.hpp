@@ -0,0 +1,289 @@
+
+#if !defined(SQXX_QUERY_CACHE_HPP_INCLUDED)
+#define SQXX_QUERY_CACHE_HPP_INCLUDED
+
+#include "datatypes.hpp"
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// struct from <sqlite3.h>
+struct sqlite3_stmt;
+
+namespace sqxx {
+
+class connection;
+
+/** A bound parameter of a cached query */
+struct cache_param {
+	datatype type;
+	int64_t i;
+	double d;
+	std::string s;
+};
+
+namespace detail {
+	inline cache_param make_cache_param(int v) { return {datatype::INTEGER, v, 0, std::string()}; }
+	inline cache_param make_cache_param(int64_t v) { return {datatype::INTEGER, v, 0, std::string()}; }
+	inline cache_param make_cache_param(double v) { return {datatype::FLOAT, 0, v, std::string()}; }
+	inline cache_param make_cache_param(const std::string &v) { return {datatype::TEXT, 0, 0, v}; }
+	inline cache_param make_cache_param(const char *v) {
+		if (!v)
+			return {datatype::NULLVALUE, 0, 0, std::string()};
+		return {datatype::TEXT, 0, 0, v};
+	}
+	inline cache_param make_cache_param(const blob &v) {
+		return {datatype::BLOB, 0, 0, std::string(static_cast<const char*>(v.data), v.length)};
+	}
+	inline cache_param make_cache_param(std::nullptr_t) { return {datatype::NULLVALUE, 0, 0, std::string()}; }
+}
+
+/**
+ * The result rows of a query, as stored by a `query_cache`.
+ *
+ * Numbers are stored directly, text and blobs in one shared buffer. The
+ * accessors convert between integers and floats, and parse text as numbers.
+ * `val<const char*>()` returns a null pointer for numbers.
+ */
+class cached_rows {
+private:
+	struct cell {
+		datatype type;
+		uint32_t length;
+		union {
+			int64_t i;
+			double d;
+			// Position of text and blobs in `arena`
+			uint64_t offset;
+		};
+	};
+
+	int ncols;
+	std::vector<std::string> names;
+	std::vector<cell> cells;
+	// Contents of text and blob cells, each followed by a NUL byte
+	std::string arena;
+
+	const cell& at(int row, int col) const { return cells[static_cast<size_t>(row) * ncols + col]; }
+	const char* data(const cell &c) const { return arena.data() + c.offset; }
+
+	friend class query_cache;
+
+public:
+	cached_rows() : ncols(0) {
+	}
+
+	int row_count() const { return (ncols ? static_cast<int>(cells.size() / ncols) : 0); }
+	int col_count() const { return ncols; }
+	const std::string& col_name(int col) const { return names[col]; }
+
+	datatype type(int row, int col) const { return at(row, col).type; }
+	bool null(int row, int col) const { return (at(row, col).type == datatype::NULLVALUE); }
+
+	template<typename T>
+	if_sqxx_db_type<T, T>
+	val(int row, int col) const;
+
+	/** Approximate memory used by the rows, in bytes */
+	size_t memory() const {
+		size_t n = sizeof(*this) + cells.capacity() * sizeof(cell) + arena.capacity();
+		for (const std::string &name : names)
+			n += sizeof(name) + name.capacity();
+		return n;
+	}
+};
+
+template<>
+inline int64_t cached_rows::val<int64_t>(int row, int col) const {
+	const cell &c = at(row, col);
+	switch (c.type) {
+	case datatype::INTEGER: return c.i;
+	case datatype::FLOAT: return static_cast<int64_t>(c.d);
+	case datatype::TEXT: return std::strtoll(data(c), nullptr, 10);
+	default: return 0;
+	}
+}
+
+template<>
+inline int cached_rows::val<int>(int row, int col) const {
+	return static_cast<int>(val<int64_t>(row, col));
+}
+
+template<>
+inline double cached_rows::val<double>(int row, int col) const {
+	const cell &c = at(row, col);
+	switch (c.type) {
+	case datatype::INTEGER: return static_cast<double>(c.i);
+	case datatype::FLOAT: return c.d;
+	case datatype::TEXT: return std::strtod(data(c), nullptr);
+	default: return 0.0;
+	}
+}
+
+template<>
+inline const char* cached_rows::val<const char*>(int row, int col) const {
+	const cell &c = at(row, col);
+	if (c.type == datatype::TEXT || c.type == datatype::BLOB)
+		return data(c);
+	return nullptr;
+}
+
+template<>
+inline std::string cached_rows::val<std::string>(int row, int col) const {
+	const cell &c = at(row, col);
+	char buf[32];
+	switch (c.type) {
+	case datatype::TEXT:
+	case datatype::BLOB:
+		return std::string(data(c), c.length);
+	case datatype::INTEGER:
+		return std::to_string(c.i);
+	case datatype::FLOAT:
+		std::snprintf(buf, sizeof(buf), "%.15g", c.d);
+		return buf;
+	default:
+		return std::string();
+	}
+}
+
+template<>
+inline blob cached_rows::val<blob>(int row, int col) const {
+	const cell &c = at(row, col);
+	if (c.type == datatype::TEXT || c.type == datatype::BLOB)
+		return blob(data(c), c.length);
+	return blob(nullptr, 0);
+}
+
+struct query_cache_options {
+	/** Memory for all cached results, least recently used ones are evicted */
+	size_t max_bytes = 16 * 1024 * 1024;
+	/** Larger results are not cached */
+	size_t max_entry_bytes = 1024 * 1024;
+};
+
+/** Counters of a `query_cache` */
+struct query_cache_stats {
+	uint64_t hits = 0;
+	uint64_t misses = 0;
+	/** Results dropped because a table they read from changed */
+	uint64_t invalidations = 0;
+	/** Results dropped to stay within `max_bytes` */
+	uint64_t evictions = 0;
+	/** Results not cached because of their size or an open transaction */
+	uint64_t uncached = 0;
+	size_t entries = 0;
+	size_t bytes = 0;
+
+	double hit_ratio() const {
+		return (hits + misses ? static_cast<double>(hits) / (hits + misses) : 0.0);
+	}
+};
+
+/**
+ * Caches the results of read-only queries, keyed by the SQL text and the
+ * bound parameters.
+ *
+ * Meant for identical queries that run many times between writes, like the
+ * ones of dashboards:
+ *
+ *     sqxx::query_cache cache(conn);
+ *     auto rows = cache.query("select count(*) from orders where state = ?", "open");
+ *     int open = rows->val<int>(0, 0);
+ *
+ * A cached result is dropped when
+ *
+ * - the connection writes to one of the tables the query reads from. For this
+ *   the cache uses the connection's update handler.
+ * - another connection writes to the database, detected by
+ *   `pragma data_version`. This drops all results.
+ * - the schema changes, or the connection changed rows without calling the
+ *   update handler (tables without rowid, truncating deletes). This also
+ *   drops all results.
+ *
+ * Results aren't cached within explicit transactions, since they might see
+ * changes that are rolled back later.
+ *
+ * The cache must be used from the connection's thread, only `stats()` can be
+ * called from other threads. Since it takes over the update handler, there
+ * can only be one cache per connection, and it must be destroyed before the
+ * connection.
+ */
+class query_cache {
+private:
+	struct entry {
+		std::string key;
+		std::shared_ptr<const cached_rows> rows;
+		std::vector<std::string> tables;
+		size_t bytes;
+	};
+	typedef std::list<entry>::iterator entry_iterator;
+
+	connection &conn;
+	query_cache_options opts;
+	sqlite3_stmt *data_version_stmt;
+	sqlite3_stmt *schema_version_stmt;
+
+	mutable std::mutex mutex;
+	// Most recently used first
+	std::list<entry> lru;
+	std::unordered_map<std::string, entry_iterator> index;
+	std::unordered_map<std::string, std::unordered_set<std::string>> table_keys;
+	query_cache_stats st;
+
+	// State at the previous lookup, to detect changes
+	int64_t data_version;
+	int64_t schema_version;
+	int total_changes;
+	uint64_t reported_changes;
+	uint64_t checked_reported_changes;
+
+	void check_changes();
+	void table_changed(const char *table);
+	void invalidate_locked(const std::string &table);
+	void erase(entry_iterator it);
+	void clear_locked();
+	std::shared_ptr<cached_rows> execute(const std::string &sql, const std::vector<cache_param> &params,
+			std::vector<std::string> &tables);
+
+public:
+	/** Installs the update handler of `conn` */
+	explicit query_cache(connection &conn, const query_cache_options &opts = query_cache_options());
+	/** Removes the update handler */
+	~query_cache();
+
+	query_cache(const query_cache&) = delete;
+	query_cache& operator=(const query_cache&) = delete;
+
+	/**
+	 * Result of `sql` with the given parameters bound by index, from the
+	 * cache if possible. Parameters can be of the types supported by
+	 * `statement::bind()` or `nullptr`.
+	 *
+	 * Throws an error with code `SQLITE_MISUSE` if the statement isn't
+	 * read-only.
+	 */
+	template<typename... Args>
+	std::shared_ptr<const cached_rows> query(const std::string &sql, const Args&... params) {
+		return query_params(sql, {detail::make_cache_param(params)...});
+	}
+	std::shared_ptr<const cached_rows> query_params(const std::string &sql, const std::vector<cache_param> &params);
+
+	/** Drop the cached results that read from `table` */
+	void invalidate(const std::string &table);
+	/** Drop all cached results */
+	void clear();
+
+	query_cache_stats stats() const;
+};
+
+} // namespace sqxx
+
+#endif // SQXX_QUERY_CACHE_HPP_INCLUDED
+
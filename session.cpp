@@ -0,0 +1,426 @@
+
+#include "session.hpp"
+#include <sqlite3.h>
+#include <cstring>
+#include <exception>
+
+#if defined(SQLITE_ENABLE_SESSION) && defined(SQLITE_ENABLE_PREUPDATE_HOOK) && SQLITE_VERSION_NUMBER >= 3013000
+#define SQXX_HAVE_SESSION 1
+#endif
+
+namespace sqxx {
+
+changeset::changeset(const void *data, int size) : buf(nullptr), len(0) {
+	if (size > 0) {
+		buf = sqlite3_malloc(size);
+		if (!buf)
+			throw static_error(SQLITE_NOMEM);
+		std::memcpy(buf, data, size);
+		len = size;
+	}
+}
+
+changeset::~changeset() {
+	sqlite3_free(buf);
+}
+
+changeset::changeset(changeset &&other) noexcept : buf(other.buf), len(other.len) {
+	other.buf = nullptr;
+	other.len = 0;
+}
+
+changeset& changeset::operator=(changeset &&other) noexcept {
+	if (this != &other) {
+		sqlite3_free(buf);
+		buf = other.buf;
+		len = other.len;
+		other.buf = nullptr;
+		other.len = 0;
+	}
+	return *this;
+}
+
+changeset changeset::adopt(void *data, int size) {
+	changeset cs;
+	cs.buf = data;
+	cs.len = size;
+	return cs;
+}
+
+#if defined(SQXX_HAVE_SESSION)
+
+namespace {
+
+// C++ functions of a streaming call and the exception one of them threw
+struct stream_context {
+	const changeset_output_t *out;
+	const changeset_input_t *in;
+	std::exception_ptr ex;
+
+	explicit stream_context(const changeset_output_t *out_arg, const changeset_input_t *in_arg = nullptr)
+		: out(out_arg), in(in_arg) {
+	}
+
+	void check(int rv) {
+		if (ex)
+			std::rethrow_exception(ex);
+		if (rv != SQLITE_OK)
+			throw static_error(rv);
+	}
+};
+
+struct apply_context {
+	const conflict_handler_t &on_conflict;
+	const changeset_filter_t &filter;
+	std::exception_ptr ex;
+
+	apply_context(const conflict_handler_t &on_conflict_arg, const changeset_filter_t &filter_arg)
+		: on_conflict(on_conflict_arg), filter(filter_arg) {
+	}
+};
+
+} // anonymous namespace
+
+extern "C"
+int sqxx_call_changeset_output(void *data, const void *buf, int n) {
+	stream_context *ctx = reinterpret_cast<stream_context*>(data);
+	try {
+		(*ctx->out)(buf, n);
+		return SQLITE_OK;
+	}
+	catch (...) {
+		ctx->ex = std::current_exception();
+		return SQLITE_IOERR;
+	}
+}
+
+extern "C"
+int sqxx_call_changeset_input(void *data, void *buf, int *n) {
+	stream_context *ctx = reinterpret_cast<stream_context*>(data);
+	try {
+		*n = (*ctx->in)(buf, *n);
+		return SQLITE_OK;
+	}
+	catch (...) {
+		ctx->ex = std::current_exception();
+		return SQLITE_IOERR;
+	}
+}
+
+extern "C"
+int sqxx_call_changeset_filter(void *data, const char *table) {
+	apply_context *ctx = reinterpret_cast<apply_context*>(data);
+	try {
+		return ctx->filter(table);
+	}
+	catch (...) {
+		// Can't abort from here, skip the table and throw afterwards
+		if (!ctx->ex)
+			ctx->ex = std::current_exception();
+		return 0;
+	}
+}
+
+extern "C"
+int sqxx_call_changeset_conflict(void *data, int type, sqlite3_changeset_iter *iter) {
+	apply_context *ctx = reinterpret_cast<apply_context*>(data);
+	if (ctx->ex || !ctx->on_conflict)
+		return SQLITE_CHANGESET_ABORT;
+	try {
+		return ctx->on_conflict(changeset_conflict(iter, static_cast<conflict_type>(type)));
+	}
+	catch (...) {
+		ctx->ex = std::current_exception();
+		return SQLITE_CHANGESET_ABORT;
+	}
+}
+
+changeset changeset::invert() const {
+	void *out = nullptr;
+	int n = 0;
+	int rv = sqlite3changeset_invert(len, buf, &n, &out);
+	if (rv != SQLITE_OK)
+		throw static_error(rv);
+	return adopt(out, n);
+}
+
+session::session(connection &conn_arg, const char *db) : conn(conn_arg), handle(nullptr) {
+	conn.attach_session();
+	int rv = sqlite3session_create(conn.raw(), db, &handle);
+	if (rv != SQLITE_OK) {
+		conn.detach_session();
+		throw static_error(rv);
+	}
+}
+
+session::~session() {
+	sqlite3session_delete(handle);
+	conn.detach_session();
+}
+
+void session::attach(const char *table) {
+	int rv = sqlite3session_attach(handle, table);
+	if (rv != SQLITE_OK)
+		throw static_error(rv);
+}
+
+void session::attach(const std::string &table) {
+	attach(table.c_str());
+}
+
+void session::attach() {
+	attach(nullptr);
+}
+
+bool session::enable(bool on) {
+	return sqlite3session_enable(handle, on);
+}
+
+bool session::enabled() const {
+	return sqlite3session_enable(handle, -1);
+}
+
+bool session::indirect(bool on) {
+	return sqlite3session_indirect(handle, on);
+}
+
+bool session::empty() const {
+	return sqlite3session_isempty(handle);
+}
+
+changeset session::changes() {
+	void *out = nullptr;
+	int n = 0;
+	int rv = sqlite3session_changeset(handle, &n, &out);
+	if (rv != SQLITE_OK)
+		throw static_error(rv);
+	return changeset::adopt(out, n);
+}
+
+void session::changes(const changeset_output_t &out) {
+	stream_context ctx(&out);
+	ctx.check(sqlite3session_changeset_strm(handle, sqxx_call_changeset_output, &ctx));
+}
+
+changeset session::patches() {
+	void *out = nullptr;
+	int n = 0;
+	int rv = sqlite3session_patchset(handle, &n, &out);
+	if (rv != SQLITE_OK)
+		throw static_error(rv);
+	return changeset::adopt(out, n);
+}
+
+void session::patches(const changeset_output_t &out) {
+	stream_context ctx(&out);
+	ctx.check(sqlite3session_patchset_strm(handle, sqxx_call_changeset_output, &ctx));
+}
+
+changegroup::changegroup() : handle(nullptr) {
+	int rv = sqlite3changegroup_new(&handle);
+	if (rv != SQLITE_OK)
+		throw static_error(rv);
+}
+
+changegroup::~changegroup() {
+	sqlite3changegroup_delete(handle);
+}
+
+void changegroup::add(const changeset &cs) {
+	int rv = sqlite3changegroup_add(handle, cs.size(), const_cast<void*>(cs.data()));
+	if (rv != SQLITE_OK)
+		throw static_error(rv);
+}
+
+void changegroup::add(const changeset_input_t &in) {
+	stream_context ctx(nullptr, &in);
+	ctx.check(sqlite3changegroup_add_strm(handle, sqxx_call_changeset_input, &ctx));
+}
+
+changeset changegroup::output() {
+	void *out = nullptr;
+	int n = 0;
+	int rv = sqlite3changegroup_output(handle, &n, &out);
+	if (rv != SQLITE_OK)
+		throw static_error(rv);
+	return changeset::adopt(out, n);
+}
+
+void changegroup::output(const changeset_output_t &out) {
+	stream_context ctx(&out);
+	ctx.check(sqlite3changegroup_output_strm(handle, sqxx_call_changeset_output, &ctx));
+}
+
+const char* changeset_conflict::table() const {
+	const char *name = nullptr;
+	int ncols, op, indirect;
+	sqlite3changeset_op(iter, &name, &ncols, &op, &indirect);
+	return name;
+}
+
+int changeset_conflict::op() const {
+	const char *name;
+	int ncols, op = 0, indirect;
+	sqlite3changeset_op(iter, &name, &ncols, &op, &indirect);
+	return op;
+}
+
+int changeset_conflict::column_count() const {
+	const char *name;
+	int ncols = 0, op, indirect;
+	sqlite3changeset_op(iter, &name, &ncols, &op, &indirect);
+	return ncols;
+}
+
+bool changeset_conflict::indirect() const {
+	const char *name;
+	int ncols, op, indirect = 0;
+	sqlite3changeset_op(iter, &name, &ncols, &op, &indirect);
+	return indirect;
+}
+
+bool changeset_conflict::has_old_value(int col) const {
+	sqlite3_value *v = nullptr;
+	return (sqlite3changeset_old(iter, col, &v) == SQLITE_OK && v);
+}
+
+value changeset_conflict::old_value(int col) const {
+	sqlite3_value *v = nullptr;
+	int rv = sqlite3changeset_old(iter, col, &v);
+	if (rv != SQLITE_OK)
+		throw static_error(rv);
+	if (!v)
+		throw error(SQLITE_RANGE, "column is not part of the change");
+	return value(v);
+}
+
+bool changeset_conflict::has_new_value(int col) const {
+	sqlite3_value *v = nullptr;
+	return (sqlite3changeset_new(iter, col, &v) == SQLITE_OK && v);
+}
+
+value changeset_conflict::new_value(int col) const {
+	sqlite3_value *v = nullptr;
+	int rv = sqlite3changeset_new(iter, col, &v);
+	if (rv != SQLITE_OK)
+		throw static_error(rv);
+	if (!v)
+		throw error(SQLITE_RANGE, "column is not part of the change");
+	return value(v);
+}
+
+value changeset_conflict::conflict_value(int col) const {
+	sqlite3_value *v = nullptr;
+	int rv = sqlite3changeset_conflict(iter, col, &v);
+	if (rv != SQLITE_OK)
+		throw static_error(rv);
+	return value(v);
+}
+
+int changeset_conflict::foreign_key_conflicts() const {
+	int n = 0;
+	int rv = sqlite3changeset_fk_conflicts(iter, &n);
+	if (rv != SQLITE_OK)
+		throw static_error(rv);
+	return n;
+}
+
+namespace {
+
+// sqlite only rolls back if the changeset is aborted. An exception of the
+// filter doesn't abort it, so changes are applied within a savepoint that
+// is rolled back if a handler threw.
+template<typename Apply>
+int apply_in_savepoint(connection &conn, const apply_context &ctx, Apply apply) {
+	conn.exec("savepoint sqxx_apply_changeset");
+	int rv = apply();
+	if (ctx.ex || rv != SQLITE_OK)
+		conn.exec("rollback to sqxx_apply_changeset");
+	conn.exec("release sqxx_apply_changeset");
+	return rv;
+}
+
+} // anonymous namespace
+
+void apply_changeset(connection &conn, const changeset &cs,
+		const conflict_handler_t &on_conflict, const changeset_filter_t &filter) {
+	apply_context ctx(on_conflict, filter);
+	int rv = apply_in_savepoint(conn, ctx, [&] {
+		return sqlite3changeset_apply(conn.raw(), cs.size(), const_cast<void*>(cs.data()),
+				(filter ? sqxx_call_changeset_filter : nullptr), sqxx_call_changeset_conflict, &ctx);
+	});
+	if (ctx.ex)
+		std::rethrow_exception(ctx.ex);
+	if (rv != SQLITE_OK)
+		throw static_error(rv);
+}
+
+void apply_changeset(connection &conn, const changeset_input_t &in,
+		const conflict_handler_t &on_conflict, const changeset_filter_t &filter) {
+	stream_context input(nullptr, &in);
+	apply_context ctx(on_conflict, filter);
+	int rv = apply_in_savepoint(conn, ctx, [&] {
+		return sqlite3changeset_apply_strm(conn.raw(), sqxx_call_changeset_input, &input,
+				(filter ? sqxx_call_changeset_filter : nullptr), sqxx_call_changeset_conflict, &ctx);
+	});
+	if (ctx.ex)
+		std::rethrow_exception(ctx.ex);
+	input.check(rv);
+}
+
+#else // SQXX_HAVE_SESSION
+
+namespace {
+
+[[noreturn]] void session_not_enabled() {
+	throw error(SQLITE_MISUSE, "sqlite session extension not enabled");
+}
+
+} // anonymous namespace
+
+changeset changeset::invert() const { session_not_enabled(); }
+
+session::session(connection &conn_arg, const char*) : conn(conn_arg), handle(nullptr) { session_not_enabled(); }
+session::~session() {}
+void session::attach(const char*) { session_not_enabled(); }
+void session::attach(const std::string&) { session_not_enabled(); }
+void session::attach() { session_not_enabled(); }
+bool session::enable(bool) { session_not_enabled(); }
+bool session::enabled() const { session_not_enabled(); }
+bool session::indirect(bool) { session_not_enabled(); }
+bool session::empty() const { session_not_enabled(); }
+changeset session::changes() { session_not_enabled(); }
+void session::changes(const changeset_output_t&) { session_not_enabled(); }
+changeset session::patches() { session_not_enabled(); }
+void session::patches(const changeset_output_t&) { session_not_enabled(); }
+
+changegroup::changegroup() : handle(nullptr) { session_not_enabled(); }
+changegroup::~changegroup() {}
+void changegroup::add(const changeset&) { session_not_enabled(); }
+void changegroup::add(const changeset_input_t&) { session_not_enabled(); }
+changeset changegroup::output() { session_not_enabled(); }
+void changegroup::output(const changeset_output_t&) { session_not_enabled(); }
+
+const char* changeset_conflict::table() const { session_not_enabled(); }
+int changeset_conflict::op() const { session_not_enabled(); }
+int changeset_conflict::column_count() const { session_not_enabled(); }
+bool changeset_conflict::indirect() const { session_not_enabled(); }
+bool changeset_conflict::has_old_value(int) const { session_not_enabled(); }
+value changeset_conflict::old_value(int) const { session_not_enabled(); }
+bool changeset_conflict::has_new_value(int) const { session_not_enabled(); }
+value changeset_conflict::new_value(int) const { session_not_enabled(); }
+value changeset_conflict::conflict_value(int) const { session_not_enabled(); }
+int changeset_conflict::foreign_key_conflicts() const { session_not_enabled(); }
+
+void apply_changeset(connection&, const changeset&, const conflict_handler_t&, const changeset_filter_t&) {
+	session_not_enabled();
+}
+
+void apply_changeset(connection&, const changeset_input_t&, const conflict_handler_t&, const changeset_filter_t&) {
+	session_not_enabled();
+}
+
+#endif // SQXX_HAVE_SESSION
+
+} // namespace sqxx
+
@@ -0,0 +1,301 @@
+
+#if !defined(SQXX_SESSION_HPP_INCLUDED)
+#define SQXX_SESSION_HPP_INCLUDED
+
+#include "connection.hpp"
+#include "value.hpp"
+#include <functional>
+
+// structs from <sqlite3.h>
+struct sqlite3_session;
+struct sqlite3_changegroup;
+struct sqlite3_changeset_iter;
+
+namespace sqxx {
+
+/**
+ * Writes a part of a streamed changeset, for example to a file or socket.
+ * Exceptions are passed on to the caller of the streaming function.
+ */
+typedef std::function<void (const void *data, int size)> changeset_output_t;
+
+/**
+ * Reads up to `size` bytes of a streamed changeset into `data`, returns
+ * the number of bytes read, 0 at the end.
+ */
+typedef std::function<int (void *data, int size)> changeset_input_t;
+
+/**
+ * A changeset or patchset in memory.
+ *
+ * The buffer is allocated with `sqlite3_malloc()`.
+ */
+class changeset {
+private:
+	void *buf;
+	int len;
+
+public:
+	changeset() : buf(nullptr), len(0) {
+	}
+	/** Copy of the changeset in `data` */
+	changeset(const void *data, int size);
+	~changeset();
+
+	changeset(changeset &&other) noexcept;
+	changeset& operator=(changeset &&other) noexcept;
+	changeset(const changeset&) = delete;
+	changeset& operator=(const changeset&) = delete;
+
+	/** Take over a buffer allocated by sqlite */
+	static changeset adopt(void *data, int size);
+
+	const void* data() const { return buf; }
+	int size() const { return len; }
+	bool empty() const { return len == 0; }
+
+	/**
+	 * A changeset that reverts this one.
+	 *
+	 * Wraps [`sqlite3changeset_invert()`](http://www.sqlite.org/session/sqlite3changeset_invert.html)
+	 */
+	changeset invert() const;
+};
+
+/**
+ * Records the changes to tables of a database, to apply them to another
+ * database later.
+ *
+ * Wraps [`sqlite3_session`](http://www.sqlite.org/session/session.html) and
+ * associated functions:
+ *
+ *     sqxx::session s(conn);
+ *     s.attach();
+ *     conn.exec("insert into items values (1, 'a')");
+ *     sqxx::changeset cs = s.changes();
+ *     sqxx::apply_changeset(other, cs, [](const sqxx::changeset_conflict&) {
+ *         return sqxx::CHANGESET_REPLACE;
+ *     });
+ *
+ * Only changes to tables with a primary key are recorded.
+ *
+ * The session extension is only available if sqlite was compiled with
+ * `SQLITE_ENABLE_SESSION` and `SQLITE_ENABLE_PREUPDATE_HOOK`. sqxx needs to
+ * be compiled with the same defines, otherwise the constructors of
+ * `session` and `changegroup` and `apply_changeset()` throw.
+ */
+class session {
+private:
+	connection &conn;
+	sqlite3_session *handle;
+
+public:
+	/**
+	 * Throws an error with code `SQLITE_MISUSE` if `conn` has a preupdate
+	 * handler, see `connection::set_preupdate_handler()`.
+	 *
+	 * Wraps [`sqlite3session_create()`](http://www.sqlite.org/session/sqlite3session_create.html)
+	 */
+	explicit session(connection &conn, const char *db = "main");
+	/** Wraps [`sqlite3session_delete()`](http://www.sqlite.org/session/sqlite3session_delete.html) */
+	~session();
+
+	session(const session&) = delete;
+	session& operator=(const session&) = delete;
+
+	/**
+	 * Record changes to `table`, or to all tables.
+	 *
+	 * Wraps [`sqlite3session_attach()`](http://www.sqlite.org/session/sqlite3session_attach.html)
+	 */
+	void attach(const char *table);
+	void attach(const std::string &table);
+	void attach();
+
+	/**
+	 * Pause or resume recording, returns if the session is recording now.
+	 *
+	 * Wraps [`sqlite3session_enable()`](http://www.sqlite.org/session/sqlite3session_enable.html)
+	 */
+	bool enable(bool on);
+	bool enabled() const;
+
+	/**
+	 * Mark following changes as indirect.
+	 *
+	 * Wraps [`sqlite3session_indirect()`](http://www.sqlite.org/session/sqlite3session_indirect.html)
+	 */
+	bool indirect(bool on);
+
+	/**
+	 * If no changes were recorded.
+	 *
+	 * Wraps [`sqlite3session_isempty()`](http://www.sqlite.org/session/sqlite3session_isempty.html)
+	 */
+	bool empty() const;
+
+	/**
+	 * The recorded changes as changeset.
+	 *
+	 * Wraps [`sqlite3session_changeset()`](http://www.sqlite.org/session/sqlite3session_changeset.html)
+	 * and [`sqlite3session_changeset_strm()`](http://www.sqlite.org/session/sqlite3session_changeset_strm.html)
+	 */
+	changeset changes();
+	void changes(const changeset_output_t &out);
+
+	/**
+	 * The recorded changes as patchset, which omits the old values of
+	 * updated and deleted rows.
+	 *
+	 * Wraps [`sqlite3session_patchset()`](http://www.sqlite.org/session/sqlite3session_patchset.html)
+	 * and [`sqlite3session_patchset_strm()`](http://www.sqlite.org/session/sqlite3session_changeset_strm.html)
+	 */
+	changeset patches();
+	void patches(const changeset_output_t &out);
+
+	/** Raw access to the underlying `sqlite3_session*` handle */
+	sqlite3_session* raw() const { return handle; }
+};
+
+/**
+ * Combines several changesets into one.
+ *
+ * Wraps [`sqlite3_changegroup`](http://www.sqlite.org/session/changegroup.html)
+ * and associated functions.
+ */
+class changegroup {
+private:
+	sqlite3_changegroup *handle;
+
+public:
+	/** Wraps [`sqlite3changegroup_new()`](http://www.sqlite.org/session/sqlite3changegroup_new.html) */
+	changegroup();
+	/** Wraps [`sqlite3changegroup_delete()`](http://www.sqlite.org/session/sqlite3changegroup_delete.html) */
+	~changegroup();
+
+	changegroup(const changegroup&) = delete;
+	changegroup& operator=(const changegroup&) = delete;
+
+	/**
+	 * Wraps [`sqlite3changegroup_add()`](http://www.sqlite.org/session/sqlite3changegroup_add.html)
+	 * and [`sqlite3changegroup_add_strm()`](http://www.sqlite.org/session/sqlite3changegroup_add_strm.html)
+	 */
+	void add(const changeset &cs);
+	void add(const changeset_input_t &in);
+
+	/**
+	 * Wraps [`sqlite3changegroup_output()`](http://www.sqlite.org/session/sqlite3changegroup_output.html)
+	 * and [`sqlite3changegroup_output_strm()`](http://www.sqlite.org/session/sqlite3changegroup_add_strm.html)
+	 */
+	changeset output();
+	void output(const changeset_output_t &out);
+
+	/** Raw access to the underlying `sqlite3_changegroup*` handle */
+	sqlite3_changegroup* raw() const { return handle; }
+};
+
+/** Kinds of conflicts when applying a changeset, see `changeset_conflict` */
+enum conflict_type {
+	/** The row to update or delete has other values than expected */
+	CHANGESET_DATA =        1,
+	/** The row to update or delete doesn't exist */
+	CHANGESET_NOTFOUND =    2,
+	/** A row to insert already exists */
+	CHANGESET_CONFLICT =    3,
+	/** A change violates a constraint */
+	CHANGESET_CONSTRAINT =  4,
+	/** Foreign keys are violated at the end, no row is available */
+	CHANGESET_FOREIGN_KEY = 5,
+};
+
+/** What to do about a conflict, returned by a `conflict_handler_t` */
+enum conflict_action {
+	/** Skip the change */
+	CHANGESET_OMIT =    0,
+	/** Apply the change anyway (only for `CHANGESET_DATA` and `CHANGESET_CONFLICT`) */
+	CHANGESET_REPLACE = 1,
+	/** Roll back all changes of the changeset */
+	CHANGESET_ABORT =   2,
+};
+
+/**
+ * A change that conflicts with the target database.
+ *
+ * The values are only valid during the conflict handler call.
+ */
+class changeset_conflict {
+private:
+	sqlite3_changeset_iter *iter;
+
+public:
+	conflict_type type;
+
+	changeset_conflict(sqlite3_changeset_iter *iter_arg, conflict_type type_arg)
+		: iter(iter_arg), type(type_arg) {
+	}
+
+	/**
+	 * The table of the change.
+	 *
+	 * Wraps [`sqlite3changeset_op()`](http://www.sqlite.org/session/sqlite3changeset_op.html)
+	 */
+	const char* table() const;
+	/** `SQLITE_INSERT`, `SQLITE_UPDATE` or `SQLITE_DELETE` */
+	int op() const;
+	int column_count() const;
+	bool indirect() const;
+
+	/**
+	 * Values of the row before and after the change. For updates only the
+	 * primary key and the changed columns are part of the change.
+	 *
+	 * Wrap [`sqlite3changeset_old()`](http://www.sqlite.org/session/sqlite3changeset_old.html)
+	 * and [`sqlite3changeset_new()`](http://www.sqlite.org/session/sqlite3changeset_new.html)
+	 */
+	bool has_old_value(int col) const;
+	value old_value(int col) const;
+	bool has_new_value(int col) const;
+	value new_value(int col) const;
+
+	/**
+	 * Value of the conflicting row in the database, for `CHANGESET_DATA`
+	 * and `CHANGESET_CONFLICT`.
+	 *
+	 * Wraps [`sqlite3changeset_conflict()`](http://www.sqlite.org/session/sqlite3changeset_conflict.html)
+	 */
+	value conflict_value(int col) const;
+
+	/**
+	 * Number of foreign key violations, for `CHANGESET_FOREIGN_KEY`.
+	 *
+	 * Wraps [`sqlite3changeset_fk_conflicts()`](http://www.sqlite.org/session/sqlite3changeset_fk_conflicts.html)
+	 */
+	int foreign_key_conflicts() const;
+};
+
+typedef std::function<conflict_action (const changeset_conflict&)> conflict_handler_t;
+/** Returns if changes to a table should be applied */
+typedef std::function<bool (const char *table)> changeset_filter_t;
+
+/**
+ * Apply a changeset or patchset to the database of `conn`.
+ *
+ * `on_conflict` decides about each conflicting change, without handler the
+ * changeset is aborted at the first conflict. All changes are applied in
+ * one transaction, if the changeset is aborted or a handler throws, none of
+ * them remain.
+ *
+ * Wraps [`sqlite3changeset_apply()`](http://www.sqlite.org/session/sqlite3changeset_apply.html)
+ * and [`sqlite3changeset_apply_strm()`](http://www.sqlite.org/session/sqlite3changeset_apply_strm.html)
+ */
+void apply_changeset(connection &conn, const changeset &cs,
+		const conflict_handler_t &on_conflict = conflict_handler_t(),
+		const changeset_filter_t &filter = changeset_filter_t());
+void apply_changeset(connection &conn, const changeset_input_t &in,
+		const conflict_handler_t &on_conflict = conflict_handler_t(),
+		const changeset_filter_t &filter = changeset_filter_t());
+
+} // namespace sqxx
+
+#endif // SQXX_SESSION_HPP_INCLUDED
+
@@ -0,0 +1,195 @@
+
+#include "slow_query_log.hpp"
+#include <sqlite3.h>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <ostream>
+#include <sstream>
+#include <unordered_map>
+#include <utility>
+
+namespace sqxx {
+
+namespace {
+
+// How long the explaining connection waits for a lock to read the schema
+const int explain_busy_timeout_ms = 100;
+
+typedef std::unique_ptr<sqlite3, int (*)(sqlite3*)> explain_connection;
+
+// Detail lines of EXPLAIN QUERY PLAN, indented by nesting level
+std::vector<std::string> explain_plan(sqlite3 *db, const std::string &sql) {
+	std::vector<std::string> plan;
+	std::string eqp = "EXPLAIN QUERY PLAN " + sql;
+	sqlite3_stmt *stmt = nullptr;
+	if (sqlite3_prepare_v2(db, eqp.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
+		sqlite3_finalize(stmt);
+		return plan;
+	}
+	std::unordered_map<int, size_t> depth;
+	while (sqlite3_step(stmt) == SQLITE_ROW) {
+		int id = sqlite3_column_int(stmt, 0);
+		auto parent = depth.find(sqlite3_column_int(stmt, 1));
+		size_t d = (parent == depth.end() ? 0 : parent->second + 1);
+		depth[id] = d;
+		const char *detail = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 3));
+		plan.push_back(std::string(2 * d, ' ') + (detail ? detail : ""));
+	}
+	sqlite3_finalize(stmt);
+	return plan;
+}
+
+// Read-only connection to `database`, opened on first use. Null if the
+// database can't be opened.
+sqlite3* explainer_for(std::map<std::string, explain_connection> &explainers, const std::string &database) {
+	auto it = explainers.find(database);
+	if (it == explainers.end()) {
+		sqlite3 *db = nullptr;
+		int rv = sqlite3_open_v2(database.c_str(), &db, SQLITE_OPEN_READONLY, nullptr);
+		if (rv != SQLITE_OK) {
+			sqlite3_close_v2(db);
+			db = nullptr;
+		}
+		else {
+			sqlite3_busy_timeout(db, explain_busy_timeout_ms);
+		}
+		it = explainers.emplace(database, explain_connection(db, sqlite3_close_v2)).first;
+	}
+	return it->second.get();
+}
+
+} // anonymous namespace
+
+// ---------------------------------------------------------------------------
+// slow_query
+
+bool slow_query::full_scan() const {
+	return (fullscan_steps > 0);
+}
+
+bool slow_query::automatic_index() const {
+	if (autoindexes > 0)
+		return true;
+	for (const std::string &line : plan) {
+		if (line.find("AUTOMATIC") != std::string::npos)
+			return true;
+	}
+	return false;
+}
+
+std::string slow_query::format() const {
+	std::ostringstream out;
+	out << "slow query: " << std::fixed << std::setprecision(3)
+		<< (duration_ns / 1e6) << " ms";
+	if (full_scan())
+		out << " [FULL SCAN]";
+	if (automatic_index())
+		out << " [AUTOMATIC INDEX]";
+	out << "\n  " << sql << "\n"
+		<< "  fullscan_steps=" << fullscan_steps << " sorts=" << sorts
+		<< " autoindexes=" << autoindexes << " vm_steps=" << vm_steps << "\n";
+	for (const std::string &line : plan) {
+		out << "  plan: " << line << "\n";
+	}
+	return out.str();
+}
+
+
+// ---------------------------------------------------------------------------
+// slow_query_log
+
+slow_query_log::slow_query_log(const sink_t &sink_arg, const slow_query_options &opts_arg)
+	: sink(sink_arg), opts(opts_arg), stopping(false), busy(false),
+	  logged_count(0), dropped_count(0),
+	  window_start(std::chrono::steady_clock::now()), window_count(0) {
+	worker = std::thread(&slow_query_log::run, this);
+}
+
+slow_query_log::~slow_query_log() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	queue_changed.notify_all();
+	worker.join();
+}
+
+slow_query_log::sink_t slow_query_log::write_to(std::ostream &out) {
+	return [&out](const slow_query &q) {
+		out << q.format() << std::flush;
+	};
+}
+
+void slow_query_log::run() {
+	// Statements can't be explained on their own connection while it runs
+	// them, so the plan is taken from connections owned by this thread
+	std::map<std::string, explain_connection> explainers;
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true) {
+		queue_changed.wait(lock, [this] { return stopping || !queue.empty(); });
+		if (queue.empty())
+			break;
+		queued next = std::move(queue.front());
+		queue.pop_front();
+		busy = true;
+		lock.unlock();
+		try {
+			slow_query &q = next.query;
+			if (opts.explain && !q.database.empty() && !next.plan_sql.empty()) {
+				sqlite3 *db = explainer_for(explainers, q.database);
+				if (db)
+					q.plan = explain_plan(db, next.plan_sql);
+			}
+			sink(q);
+		}
+		catch (...) {
+			// Nobody to report to, the record is lost
+		}
+		lock.lock();
+		busy = false;
+		++logged_count;
+		queue_changed.notify_all();
+	}
+}
+
+bool slow_query_log::admit() {
+	auto now = std::chrono::steady_clock::now();
+	std::lock_guard<std::mutex> lock(mutex);
+	if (now - window_start >= std::chrono::seconds(1)) {
+		window_start = now;
+		window_count = 0;
+	}
+	if (window_count >= opts.max_per_second) {
+		++dropped_count;
+		return false;
+	}
+	++window_count;
+	return true;
+}
+
+void slow_query_log::submit(slow_query &&query, const std::string &plan_sql) {
+	queued q{std::move(query), plan_sql};
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		queue.push_back(std::move(q));
+	}
+	queue_changed.notify_all();
+}
+
+void slow_query_log::flush() {
+	std::unique_lock<std::mutex> lock(mutex);
+	queue_changed.wait(lock, [this] { return queue.empty() && !busy; });
+}
+
+uint64_t slow_query_log::logged() const {
+	std::lock_guard<std::mutex> lock(mutex);
+	return logged_count;
+}
+
+uint64_t slow_query_log::dropped() const {
+	std::lock_guard<std::mutex> lock(mutex);
+	return dropped_count;
+}
+
+} // namespace sqxx
@@ -0,0 +1,137 @@
+
+#if !defined(SQXX_SLOW_QUERY_LOG_HPP_INCLUDED)
+#define SQXX_SLOW_QUERY_LOG_HPP_INCLUDED
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <iosfwd>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace sqxx {
+
+/** A statement that ran longer than the threshold of a `slow_query_log` */
+struct slow_query {
+	/** SQL text with the bound parameters filled in */
+	std::string sql;
+	uint64_t duration_ns;
+	/** Counters of the execution, see `statement::status()` */
+	int fullscan_steps;
+	int sorts;
+	int autoindexes;
+	int vm_steps;
+	/** File name of the connection's main database, empty for in-memory databases */
+	std::string database;
+	/**
+	 * Detail column of `EXPLAIN QUERY PLAN`, indented by nesting level. Empty
+	 * if the plan couldn't be determined.
+	 */
+	std::vector<std::string> plan;
+
+	/** The statement stepped through a table or index from start to end */
+	bool full_scan() const;
+	/** Sqlite created a temporary index for the statement */
+	bool automatic_index() const;
+
+	/** Multi-line description that points out full scans and automatic indexes */
+	std::string format() const;
+};
+
+struct slow_query_options {
+	/** Statements taking at least this long are logged */
+	std::chrono::nanoseconds threshold = std::chrono::milliseconds(100);
+	/** At most this many statements are logged per second, the others are dropped */
+	unsigned max_per_second = 10;
+	/**
+	 * Capture the output of `EXPLAIN QUERY PLAN`. The plan is determined on
+	 * the log's thread with a separate read-only connection to the database
+	 * file, so it isn't available for in-memory databases.
+	 */
+	bool explain = true;
+};
+
+/**
+ * Logs statements that run longer than a threshold.
+ *
+ * Attach it to connections with `connection::set_slow_query_log()`. For each
+ * slow statement it captures the expanded SQL, the statement's counters for
+ * full scan steps, sorts, automatic indexes and VM steps, and the query
+ * plan. The query plan and the sink run on a background thread, so that
+ * neither slows down the connection:
+ *
+ *     sqxx::slow_query_log slow(sqxx::slow_query_log::write_to(std::cerr));
+ *     conn.set_slow_query_log(slow);
+ *
+ * The log must outlive the connections it is attached to.
+ */
+class slow_query_log {
+public:
+	typedef std::function<void (const slow_query&)> sink_t;
+
+private:
+	sink_t sink;
+	slow_query_options opts;
+
+	mutable std::mutex mutex;
+	std::condition_variable queue_changed;
+	struct queued {
+		slow_query query;
+		// Unexpanded SQL to explain
+		std::string plan_sql;
+	};
+	std::deque<queued> queue;
+	bool stopping;
+	bool busy;
+	uint64_t logged_count;
+	uint64_t dropped_count;
+	// Rate limiting
+	std::chrono::steady_clock::time_point window_start;
+	unsigned window_count;
+
+	std::thread worker;
+
+	void run();
+
+public:
+	explicit slow_query_log(const sink_t &sink, const slow_query_options &opts = slow_query_options());
+	/** Waits until all queued records were passed to the sink */
+	~slow_query_log();
+
+	slow_query_log(const slow_query_log&) = delete;
+	slow_query_log& operator=(const slow_query_log&) = delete;
+
+	/** A sink that writes `slow_query::format()` to `out` */
+	static sink_t write_to(std::ostream &out);
+
+	const slow_query_options& options() const { return opts; }
+
+	/**
+	 * Reserve a place for a record. Returns false if the rate limit was
+	 * reached. Usually called by the connection.
+	 */
+	bool admit();
+	/**
+	 * Queue a record admitted before. Usually called by the connection.
+	 *
+	 * If `options().explain` is set, the plan of `plan_sql` is added to the
+	 * record before it is passed to the sink.
+	 */
+	void submit(slow_query &&query, const std::string &plan_sql = std::string());
+
+	/** Wait until all queued records were passed to the sink */
+	void flush();
+
+	/** Number of records passed to the sink */
+	uint64_t logged() const;
+	/** Number of slow statements dropped because of the rate limit */
+	uint64_t dropped() const;
+};
+
+} // namespace sqxx
+
+#endif // SQXX_SLOW_QUERY_LOG_HPP_INCLUDED
@@ -0,0 +1,259 @@
+
+#include "spin_mutex.hpp"
+#include "config.hpp"
+#include "datatypes.hpp"
+#include <sqlite3.h>
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <thread>
+
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+namespace sqxx {
+namespace detail {
+namespace {
+
+// Classes 0 and 1 are sqlite's dynamic mutex types, the others are the
+// static mutexes in the order of their SQLITE_MUTEX_STATIC_* values.
+const char *const class_names[] = {
+	"fast", "recursive", "main", "mem", "open", "prng", "lru", "pmem",
+	"app1", "app2", "app3", "vfs1", "vfs2", "vfs3",
+};
+const int class_count = sizeof(class_names) / sizeof(class_names[0]);
+
+struct alignas(64) class_counters {
+	std::atomic<uint64_t> acquisitions{0};
+	std::atomic<uint64_t> contended{0};
+	std::atomic<uint64_t> wait_ns{0};
+};
+
+class_counters counters[class_count];
+unsigned spin_limit = 100;
+
+// Identifies the calling thread, cheaper to get than std::this_thread::get_id()
+inline uintptr_t self() {
+	static thread_local char tag;
+	return reinterpret_cast<uintptr_t>(&tag);
+}
+
+inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+	_mm_pause();
+#endif
+}
+
+struct spin_mutex {
+	// 0: unlocked, 1: locked, 2: locked and there might be sleeping waiters
+	std::atomic<int> state{0};
+	std::atomic<uintptr_t> owner{0};
+	int depth = 0;
+	int cls;
+
+	spin_mutex(int cls_arg) : cls(cls_arg) {
+	}
+
+	bool recursive() const {
+		// Static mutexes are never entered recursively by sqlite
+		return cls == SQLITE_MUTEX_RECURSIVE;
+	}
+
+	bool try_lock() {
+		int expected = 0;
+		return state.compare_exchange_strong(expected, 1, std::memory_order_acquire);
+	}
+
+	void lock_contended();
+	void unlock();
+};
+
+void futex_wait(std::atomic<int> &word, int value) {
+#if defined(__linux__)
+	syscall(SYS_futex, reinterpret_cast<int*>(&word), FUTEX_WAIT_PRIVATE, value, nullptr, nullptr, 0);
+#else
+	unused(word);
+	unused(value);
+	std::this_thread::yield();
+#endif
+}
+
+void futex_wake(std::atomic<int> &word) {
+#if defined(__linux__)
+	syscall(SYS_futex, reinterpret_cast<int*>(&word), FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+#else
+	unused(word);
+#endif
+}
+
+void spin_mutex::lock_contended() {
+	auto start = std::chrono::steady_clock::now();
+	bool locked = false;
+	for (unsigned i = 0; i < spin_limit && !locked; ++i) {
+		cpu_relax();
+		locked = (state.load(std::memory_order_relaxed) == 0 && try_lock());
+	}
+	if (!locked) {
+		// Mark the mutex as having waiters, then sleep until it is released
+		while (state.exchange(2, std::memory_order_acquire) != 0) {
+			futex_wait(state, 2);
+		}
+	}
+	class_counters &c = counters[cls];
+	c.contended.fetch_add(1, std::memory_order_relaxed);
+	c.wait_ns.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now() - start).count(), std::memory_order_relaxed);
+}
+
+void spin_mutex::unlock() {
+	if (state.exchange(0, std::memory_order_release) == 2)
+		futex_wake(state);
+}
+
+spin_mutex static_mutexes[class_count - 2] = {
+	{2}, {3}, {4}, {5}, {6}, {7}, {8}, {9}, {10}, {11}, {12}, {13},
+};
+
+inline spin_mutex* mutex_of(sqlite3_mutex *m) {
+	return reinterpret_cast<spin_mutex*>(m);
+}
+
+} // anonymous namespace
+} // namespace detail
+} // namespace sqxx
+
+using sqxx::detail::spin_mutex;
+using sqxx::detail::mutex_of;
+
+extern "C"
+int sqxx_spin_mutex_init() {
+	return SQLITE_OK;
+}
+
+extern "C"
+int sqxx_spin_mutex_end() {
+	return SQLITE_OK;
+}
+
+extern "C"
+sqlite3_mutex* sqxx_spin_mutex_alloc(int type) {
+	if (type == SQLITE_MUTEX_FAST || type == SQLITE_MUTEX_RECURSIVE)
+		return reinterpret_cast<sqlite3_mutex*>(new (std::nothrow) spin_mutex(type));
+	if (type < 2 || type >= sqxx::detail::class_count)
+		return nullptr;
+	return reinterpret_cast<sqlite3_mutex*>(&sqxx::detail::static_mutexes[type - 2]);
+}
+
+extern "C"
+void sqxx_spin_mutex_free(sqlite3_mutex *m) {
+	spin_mutex *sm = mutex_of(m);
+	if (sm->cls == SQLITE_MUTEX_FAST || sm->cls == SQLITE_MUTEX_RECURSIVE)
+		delete sm;
+}
+
+extern "C"
+void sqxx_spin_mutex_enter(sqlite3_mutex *m) {
+	spin_mutex *sm = mutex_of(m);
+	uintptr_t me = sqxx::detail::self();
+	sqxx::detail::counters[sm->cls].acquisitions.fetch_add(1, std::memory_order_relaxed);
+	if (sm->recursive() && sm->owner.load(std::memory_order_relaxed) == me) {
+		++sm->depth;
+		return;
+	}
+	if (!sm->try_lock())
+		sm->lock_contended();
+	sm->owner.store(me, std::memory_order_relaxed);
+	sm->depth = 1;
+}
+
+extern "C"
+int sqxx_spin_mutex_try(sqlite3_mutex *m) {
+	spin_mutex *sm = mutex_of(m);
+	uintptr_t me = sqxx::detail::self();
+	if (sm->recursive() && sm->owner.load(std::memory_order_relaxed) == me) {
+		++sm->depth;
+	}
+	else {
+		if (!sm->try_lock())
+			return SQLITE_BUSY;
+		sm->owner.store(me, std::memory_order_relaxed);
+		sm->depth = 1;
+	}
+	sqxx::detail::counters[sm->cls].acquisitions.fetch_add(1, std::memory_order_relaxed);
+	return SQLITE_OK;
+}
+
+extern "C"
+void sqxx_spin_mutex_leave(sqlite3_mutex *m) {
+	spin_mutex *sm = mutex_of(m);
+	if (--sm->depth > 0)
+		return;
+	sm->owner.store(0, std::memory_order_relaxed);
+	sm->unlock();
+}
+
+extern "C"
+int sqxx_spin_mutex_held(sqlite3_mutex *m) {
+	return (!m || mutex_of(m)->owner.load(std::memory_order_relaxed) == sqxx::detail::self());
+}
+
+extern "C"
+int sqxx_spin_mutex_notheld(sqlite3_mutex *m) {
+	return (!m || mutex_of(m)->owner.load(std::memory_order_relaxed) != sqxx::detail::self());
+}
+
+namespace sqxx {
+
+namespace {
+	const sqlite3_mutex_methods spin_methods = {
+		sqxx_spin_mutex_init,
+		sqxx_spin_mutex_end,
+		sqxx_spin_mutex_alloc,
+		sqxx_spin_mutex_free,
+		sqxx_spin_mutex_enter,
+		sqxx_spin_mutex_try,
+		sqxx_spin_mutex_leave,
+		sqxx_spin_mutex_held,
+		sqxx_spin_mutex_notheld,
+	};
+}
+
+const sqlite3_mutex_methods* spin_mutex_methods() {
+	return &spin_methods;
+}
+
+void config_spin_mutex(unsigned spin) {
+	config_mutex(&spin_methods);
+	detail::spin_limit = spin;
+}
+
+std::vector<mutex_class_stats> spin_mutex_stats() {
+	std::vector<mutex_class_stats> result;
+	for (int i = 0; i < detail::class_count; ++i) {
+		const detail::class_counters &c = detail::counters[i];
+		mutex_class_stats s;
+		s.name = detail::class_names[i];
+		s.acquisitions = c.acquisitions.load(std::memory_order_relaxed);
+		s.contended = c.contended.load(std::memory_order_relaxed);
+		s.wait_ns = c.wait_ns.load(std::memory_order_relaxed);
+		result.push_back(s);
+	}
+	return result;
+}
+
+void spin_mutex_reset_stats() {
+	for (auto &c : detail::counters) {
+		c.acquisitions.store(0, std::memory_order_relaxed);
+		c.contended.store(0, std::memory_order_relaxed);
+		c.wait_ns.store(0, std::memory_order_relaxed);
+	}
+}
+
+} // namespace sqxx
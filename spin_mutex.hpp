@@ -0,0 +1,56 @@
+
+#if !defined(SQXX_SPIN_MUTEX_HPP_INCLUDED)
+#define SQXX_SPIN_MUTEX_HPP_INCLUDED
+
+#include <cstdint>
+#include <vector>
+
+struct sqlite3_mutex_methods;
+
+namespace sqxx {
+
+/** Lock statistics for one class of sqlite mutexes */
+struct mutex_class_stats {
+	/**
+	 * The mutex type: "fast" and "recursive" for the mutexes sqlite allocates
+	 * per connection and per shared cache, otherwise the name of a static
+	 * mutex like "main", "mem", "open", "prng", "lru", "pmem", "app1" or
+	 * "vfs1".
+	 */
+	const char *name;
+	uint64_t acquisitions;
+	/** Acquisitions that found the mutex locked by another thread */
+	uint64_t contended;
+	/** Total time spent waiting in contended acquisitions */
+	uint64_t wait_ns;
+};
+
+/**
+ * The mutex methods of the built-in spin-then-futex mutex.
+ *
+ * A mutex is taken with a single atomic operation if it is free. Otherwise
+ * the thread spins for a short while, since sqlite holds most mutexes only
+ * for a few instructions, and then sleeps on a futex (on Linux, elsewhere it
+ * yields). Lock statistics are collected per mutex class.
+ */
+const sqlite3_mutex_methods* spin_mutex_methods();
+
+/**
+ * Install the spin-then-futex mutex for sqlite (SQLITE_CONFIG_MUTEX).
+ *
+ * `spin` is the number of attempts to take a locked mutex before
+ * sleeping. Only has an effect if sqlite is compiled thread safe. Like
+ * all `config_*()` functions this must be called while sqlite isn't
+ * initialized.
+ */
+void config_spin_mutex(unsigned spin = 100);
+
+/** Lock statistics of the spin-then-futex mutex, per mutex class */
+std::vector<mutex_class_stats> spin_mutex_stats();
+
+/** Reset the lock statistics */
+void spin_mutex_reset_stats();
+
+} // namespace sqxx
+
+#endif // SQXX_SPIN_MUTEX_HPP_INCLUDED
@@ -8,14 +8,21 @@
 #include <sqlite3.h>
 #include <cstring>
 
+#if !defined(SQXX_HEADER_ONLY)
+#include "statement.inline.hpp"
+#endif
+
 namespace sqxx {
 
 statement::statement(connection &conn_arg, sqlite3_stmt *handle_arg)
 		: handle(handle_arg), conn(conn_arg), completed(true) {
+	if (handle)
+		conn.statement_created(handle);
 }
 
 statement::~statement() {
 	if (handle) {
+		conn.statement_finalized(handle);
 		sqlite3_finalize(handle);
 	}
 }
@@ -46,6 +53,46 @@ int statement::status_vm_step(bool reset) {
 }
 #endif
 
+#if defined(SQLITE_ENABLE_STMT_SCANSTATUS)
+std::vector<scan_stat> statement::scan_stats() const {
+	std::vector<scan_stat> result;
+	for (int idx = 0; ; ++idx) {
+		scan_stat st;
+		sqlite3_int64 loops, visited;
+		double est;
+		const char *name, *explain;
+		int select_id;
+		if (sqlite3_stmt_scanstatus(handle, idx, SQLITE_SCANSTAT_NLOOP, &loops))
+			break;
+		sqlite3_stmt_scanstatus(handle, idx, SQLITE_SCANSTAT_NVISIT, &visited);
+		sqlite3_stmt_scanstatus(handle, idx, SQLITE_SCANSTAT_EST, &est);
+		sqlite3_stmt_scanstatus(handle, idx, SQLITE_SCANSTAT_NAME, &name);
+		sqlite3_stmt_scanstatus(handle, idx, SQLITE_SCANSTAT_EXPLAIN, &explain);
+		sqlite3_stmt_scanstatus(handle, idx, SQLITE_SCANSTAT_SELECTID, &select_id);
+		st.loops = loops;
+		st.rows_visited = visited;
+		st.estimated_rows = est;
+		st.name = (name ? name : "");
+		st.explain = (explain ? explain : "");
+		st.select_id = select_id;
+		result.push_back(st);
+	}
+	return result;
+}
+
+void statement::scan_stats_reset() {
+	sqlite3_stmt_scanstatus_reset(handle);
+}
+#else
+std::vector<scan_stat> statement::scan_stats() const {
+	throw error(SQLITE_MISUSE, "sqlite3_stmt_scanstatus() not enabled");
+}
+
+void statement::scan_stats_reset() {
+	throw error(SQLITE_MISUSE, "sqlite3_stmt_scanstatus() not enabled");
+}
+#endif
+
 bool statement::readonly() const {
 	return sqlite3_stmt_readonly(handle);
 }
@@ -81,87 +128,10 @@ parameter statement::param(const std::string &name) {
 	return param(name.c_str());
 }
 
-void statement::bind(int idx) {
-	int rv = sqlite3_bind_null(handle, idx+1);
-	if (rv != SQLITE_OK)
-		throw static_error(rv);
-}
-
-template<>
-void statement::bind<int>(int idx, int value) {
-	int rv = sqlite3_bind_int(handle, idx+1, value);
-	if (rv != SQLITE_OK)
-		throw static_error(rv);
-}
-
-template<>
-void statement::bind<int64_t>(int idx, int64_t value) {
-	int rv = sqlite3_bind_int64(handle, idx+1, value);
-	if (rv != SQLITE_OK)
-		throw static_error(rv);
-}
-
-template<>
-void statement::bind<double>(int idx, double value) {
-	int rv = sqlite3_bind_double(handle, idx+1, value);
-	if (rv != SQLITE_OK)
-		throw static_error(rv);
-}
-
-template<>
-void statement::bind<const char*>(int idx, const char *value, bool copy) {
-	if (value) {
-		int rv =
-#if SQLITE_VERSION_NUMBER >= 3008007
-			sqlite3_bind_text64(handle, idx+1, value, std::strlen(value), (copy ? SQLITE_TRANSIENT : SQLITE_STATIC), SQLITE_UTF8);
-#else
-			sqlite3_bind_text(handle, idx+1, value, -1, (copy ? SQLITE_TRANSIENT : SQLITE_STATIC));
-#endif
-		if (rv != SQLITE_OK)
-			throw static_error(rv);
-	}
-	else {
-		bind(idx);
-	}
-}
-
-template<>
-void statement::bind<std::string>(int idx, const std::string &value, bool copy) {
-	int rv =
-#if SQLITE_VERSION_NUMBER >= 3008007
-		sqlite3_bind_text64(handle, idx+1, value.c_str(), value.length(), (copy ? SQLITE_TRANSIENT : SQLITE_STATIC), SQLITE_UTF8);
-#else
-		sqlite3_bind_text(handle, idx+1, value.c_str(), value.length(), (copy ? SQLITE_TRANSIENT : SQLITE_STATIC));
-#endif
-	if (rv != SQLITE_OK)
-		throw static_error(rv);
-}
-
-template<>
-void statement::bind<blob>(int idx, const blob &value, bool copy) {
-	if (value.data) {
-		int rv = 
-#if SQLITE_VERSION_NUMBER >= 3008007
-			sqlite3_bind_blob64(handle, idx+1, value.data, value.length, (copy ? SQLITE_TRANSIENT : SQLITE_STATIC));
-#else
-			sqlite3_bind_blob(handle, idx+1, value.data, value.length, (copy ? SQLITE_TRANSIENT : SQLITE_STATIC));
-#endif
-		if (rv != SQLITE_OK)
-			throw static_error(rv);
-	}
-	else {
-		int rv =
-#if SQLITE_VERSION_NUMBER >= 3008011
-			sqlite3_bind_zeroblob64(handle, idx+1, value.length);
-#else
-			sqlite3_bind_zeroblob(handle, idx+1, value.length);
-#endif
-		if (rv != SQLITE_OK)
-			throw static_error(rv);
-	}
+int statement::try_bind(int idx) {
+	return sqlite3_bind_null(handle, idx+1);
 }
 
-
 int statement::col_count() const {
 	return sqlite3_column_count(handle);
 }
@@ -192,58 +162,23 @@ column statement::col(const std::string &name) const {
 	return col(name.c_str());
 }
 
-template<>
-int statement::val<int>(int idx) const {
-	return sqlite3_column_int(handle, idx);
-}
-
-template<>
-int64_t statement::val<int64_t>(int idx) const {
-	return sqlite3_column_int64(handle, idx);
-}
-
-template<>
-double statement::val<double>(int idx) const {
-	return sqlite3_column_double(handle, idx);
-}
-
-template<>
-const char* statement::val<const char*>(int idx) const {
-	const unsigned char *text = sqlite3_column_text(handle, idx);
-	return reinterpret_cast<const char*>(text);
-}
-
-template<>
-std::string statement::val<std::string>(int idx) const {
-	// Correct order to call functions according to http://www.sqlite.org/c3ref/column_blob.html
-	const unsigned char* text = sqlite3_column_text(handle, idx);
-	int bytes = sqlite3_column_bytes(handle, idx);
-	return std::string(reinterpret_cast<const char*>(text), bytes);
-}
-
-template<>
-blob statement::val<blob>(int idx) const {
-	// Correct order to call functions according to http://www.sqlite.org/c3ref/column_blob.html
-	const void *data = sqlite3_column_blob(handle, idx);
-	int bytes = sqlite3_column_bytes(handle, idx);
-	return blob(data, bytes);
-}
-
-
-void statement::step() {
+#if defined(SQLITE_ENABLE_UNLOCK_NOTIFY)
+void statement::step_blocking() {
 	int rv;
-
-	rv = sqlite3_step(handle);
-	if (rv == SQLITE_ROW) {
-		completed = false;
+	while (primary_code(rv = try_step()) == SQLITE_LOCKED &&
+			sqlite3_extended_errcode(conn.raw()) == SQLITE_LOCKED_SHAREDCACHE) {
+		if (!conn.wait_for_unlock())
+			break;
+		try_reset();
 	}
-	else if (rv == SQLITE_DONE) {
-		completed = true;
-	}
-	else {
+	if (rv != SQLITE_ROW && rv != SQLITE_DONE)
 		throw static_error(rv);
-	}
 }
+#else
+void statement::step_blocking() {
+	throw error(SQLITE_MISUSE, "sqlite3_unlock_notify() not supported");
+}
+#endif
 
 void statement::run() {
 	// TODO: Check that statement was not yet run(), maybe reset() if it was
@@ -259,25 +194,17 @@ void statement::next_row() {
 	step();
 }
 
-void statement::reset() {
-	int rv;
-
-	rv = sqlite3_reset(handle);
-	if (rv != SQLITE_OK) {
-		// last step() gave error. Does this mean reset() is also invalid?
-		// TODO
-	}
+int statement::try_reset() {
+	int rv = sqlite3_reset(handle);
 
 	col_index_table.clear();
 	col_index_table_built = false;
-}
 
-void statement::clear_bindings() {
-	int rv;
+	return rv;
+}
 
-	rv = sqlite3_clear_bindings(handle);
-	if (rv != SQLITE_OK)
-		throw static_error(rv);
+int statement::try_clear_bindings() {
+	return sqlite3_clear_bindings(handle);
 }
 
 statement::row_iterator::row_iterator(statement *s_arg) : s(s_arg), rowidx(0) {
@@ -6,7 +6,10 @@
 
 #include "datatypes.hpp"
 #include "connection.hpp"
+#include "error.hpp"
 #include <map>
+#include <string>
+#include <vector>
 
 // struct from <sqlite3.h>
 struct sqlite3_stmt;
@@ -17,6 +20,27 @@ class connection;
 class parameter;
 class column;
 
+/** Cost of one loop of a statement, see `statement::scan_stats()` */
+struct scan_stat {
+	/** Number of times the loop was run */
+	int64_t loops;
+	/** Rows visited by all runs of the loop */
+	int64_t rows_visited;
+	/** Planner's estimate of rows visited per run of the loop */
+	double estimated_rows;
+	/** Table or index the loop steps through */
+	std::string name;
+	/** The loop's `EXPLAIN QUERY PLAN` text */
+	std::string explain;
+	/** The `select` the loop belongs to, matches `EXPLAIN QUERY PLAN` ids */
+	int select_id;
+
+	/** Rows visited per run, to be compared with `estimated_rows` */
+	double rows_per_loop() const {
+		return (loops ? static_cast<double>(rows_visited) / loops : 0.0);
+	}
+};
+
 /**
  * A sql statement
  *
@@ -238,6 +262,34 @@ public:
 	 */
 	void clear_bindings();
 
+	/**
+	 * Non-throwing variants of `bind()` and `clear_bindings()`.
+	 *
+	 * Instead of throwing an exception these return the sqlite result code,
+	 * `OK` on success. They only take parameter indexes, since looking up
+	 * a parameter name can fail as well.
+	 *
+	 *     int rv = stmt.try_bind(0, 123);
+	 *     if (rv != sqxx::OK) {
+	 *        ...
+	 *     }
+	 */
+	int try_bind(int idx);
+
+	template<typename T>
+	if_selected_type<T, int, int, int64_t, double>
+	try_bind(int idx, T value);
+
+	template<typename T>
+	if_selected_type<T, int, const char*>
+	try_bind(int idx, T value, bool copy=true);
+
+	template<typename T>
+	if_selected_type<T, int, std::string, blob>
+	try_bind(int idx, const T &value, bool copy=true);
+
+	int try_clear_bindings();
+
 
 	// Result columns
 
@@ -337,7 +389,46 @@ public:
 	 *
 	 * Wraps [`sqlite3_step()`](http://www.sqlite.org/c3ref/step.html)
 	 */
-	void step();
+	void step() {
+		int rv = try_step();
+		if (rv != ROW && rv != DONE)
+			throw static_error(rv);
+	}
+
+	/**
+	 * Non-throwing variant of `step()`.
+	 *
+	 * Returns the result code of `sqlite3_step()`: `ROW` if a result row is
+	 * available, `DONE` if the statement completed, and an error code
+	 * otherwise. This avoids the cost of exceptions in loops where errors
+	 * like `BUSY` or `CONSTRAINT` are expected and handled locally:
+	 *
+	 *     int rv;
+	 *     while ((rv = stmt.try_step()) == sqxx::ROW) {
+	 *        ...
+	 *     }
+	 *     if (rv != sqxx::DONE) {
+	 *        ...
+	 *     }
+	 *
+	 * Wraps [`sqlite3_step()`](http://www.sqlite.org/c3ref/step.html)
+	 */
+	int try_step();
+
+	/**
+	 * Like `step()`, but waits instead of failing with `SQLITE_LOCKED` when
+	 * another connection to the same shared cache holds a conflicting lock.
+	 *
+	 * The statement is reset and stepped again once the blocking connection
+	 * finished its transaction, so this should be used for the first step
+	 * of a statement. If waiting would deadlock, the `SQLITE_LOCKED` error
+	 * is thrown.
+	 *
+	 * Uses `connection::wait_for_unlock()`, time spent waiting is counted in
+	 * `connection::unlock_stats()`. Throws an error with code `SQLITE_MISUSE`
+	 * if sqxx wasn't compiled with `SQLITE_ENABLE_UNLOCK_NOTIFY`.
+	 */
+	void step_blocking();
 
 	/** Execute a statement */
 	void run();
@@ -356,7 +447,14 @@ public:
 	 *
 	 * Wraps ['sqlite3_reset()'](http://www.sqlite.org/c3ref/reset.html).
 	 */
-	void reset();
+	void reset() { try_reset(); }
+
+	/**
+	 * Like `reset()`, but returns the result code of `sqlite3_reset()`.
+	 *
+	 * If the last `step()` failed, this is the code of that error.
+	 */
+	int try_reset();
 
 	// Result row access
 
@@ -409,6 +507,23 @@ public:
 	int status_autoindex(bool reset=false);
 	int status_vm_step(bool reset=false);
 
+	/**
+	 * Per-loop statistics of the statement's query plan, in the order of
+	 * `EXPLAIN QUERY PLAN`. Counts accumulate over all executions until
+	 * `scan_stats_reset()`.
+	 *
+	 * Wraps [`sqlite3_stmt_scanstatus()`](http://www.sqlite.org/c3ref/stmt_scanstatus.html),
+	 * which is only available if sqlite was compiled with
+	 * `SQLITE_ENABLE_STMT_SCANSTATUS`. sqxx needs to be compiled with the same
+	 * define, otherwise these functions throw.
+	 */
+	std::vector<scan_stat> scan_stats() const;
+
+	/**
+	 * Wraps [`sqlite3_stmt_scanstatus_reset()`](http://www.sqlite.org/c3ref/stmt_scanstatus_reset.html)
+	 */
+	void scan_stats_reset();
+
 	/**
 	 * Determines if the prepared statement writes to the database.
 	 *
@@ -8,28 +8,91 @@
 #error "Don't include statement.impl.hpp directly, include statement.hpp instead"
 #endif
 
+#if defined(SQXX_HEADER_ONLY)
+#include "statement.inline.hpp"
+#endif
+
 namespace sqxx {
 
+#if !defined(SQXX_HEADER_ONLY)
+
+template<>
+int statement::try_bind<int>(int idx, int value);
+template<>
+int statement::try_bind<int64_t>(int idx, int64_t value);
+template<>
+int statement::try_bind<double>(int idx, double value);
+template<>
+int statement::try_bind<const char*>(int idx, const char* value, bool copy);
+template<>
+int statement::try_bind<std::string>(int idx, const std::string &value, bool copy);
+template<>
+int statement::try_bind<blob>(int idx, const blob &value, bool copy);
+
+/** Wraps [`sqlite3_column_int()`](http://www.sqlite.org/c3ref/column_blob.html) */
+template<>
+int statement::val<int>(int idx) const;
+
+/** Wraps [`sqlite3_column_int64()`](http://www.sqlite.org/c3ref/column_blob.html) */
+template<>
+int64_t statement::val<int64_t>(int idx) const;
+
+/** Wraps [`sqlite3_column_double()`](http://www.sqlite.org/c3ref/column_blob.html) */
+template<>
+double statement::val<double>(int idx) const;
+
+/** Wraps [`sqlite3_column_text()`](http://www.sqlite.org/c3ref/column_blob.html) */
+template<>
+const char* statement::val<const char*>(int idx) const;
+
+/** Wraps [`sqlite3_column_text()`](http://www.sqlite.org/c3ref/column_blob.html) */
+template<>
+std::string statement::val<std::string>(int idx) const;
+
+/** Wraps [`sqlite3_column_blob()`](http://www.sqlite.org/c3ref/column_blob.html) */
+template<>
+blob statement::val<blob>(int idx) const;
+
+#endif
+
+inline void statement::bind(int idx) {
+	int rv = try_bind(idx);
+	if (rv != OK)
+		throw static_error(rv);
+}
+
 /** Set a parameter to an int value
  *
  * sqlite3_bind_int()
  */
 template<>
-void statement::bind<int>(int idx, int value);
+inline void statement::bind<int>(int idx, int value) {
+	int rv = try_bind<int>(idx, value);
+	if (rv != OK)
+		throw static_error(rv);
+}
 
 /** Set a parameter to an int64_t value
  *
  * sqlite3_bind_int64()
  */
 template<>
-void statement::bind<int64_t>(int idx, int64_t value);
+inline void statement::bind<int64_t>(int idx, int64_t value) {
+	int rv = try_bind<int64_t>(idx, value);
+	if (rv != OK)
+		throw static_error(rv);
+}
 
 /** Set a parameter to a double value
  *
  * sqlite3_bind_double()
  */
 template<>
-void statement::bind<double>(int idx, double value);
+inline void statement::bind<double>(int idx, double value) {
+	int rv = try_bind<double>(idx, value);
+	if (rv != OK)
+		throw static_error(rv);
+}
 
 /** Set a parameter to a const char* value.
  *
@@ -42,10 +105,18 @@ void statement::bind<double>(int idx, double value);
  * sqlite3_bind_text()
  */
 template<>
-void statement::bind<const char*>(int idx, const char* value, bool copy);
+inline void statement::bind<const char*>(int idx, const char* value, bool copy) {
+	int rv = try_bind<const char*>(idx, value, copy);
+	if (rv != OK)
+		throw static_error(rv);
+}
 
 template<>
-void statement::bind<std::string>(int idx, const std::string &value, bool copy);
+inline void statement::bind<std::string>(int idx, const std::string &value, bool copy) {
+	int rv = try_bind<std::string>(idx, value, copy);
+	if (rv != OK)
+		throw static_error(rv);
+}
 
 /** Set a parameter to a blob.
  *
@@ -56,32 +127,18 @@ void statement::bind<std::string>(int idx, const std::string &value, bool copy);
  * sqlite3_bind_zeroblob()
  */
 template<>
-void statement::bind<blob>(int idx, const blob &value, bool copy);
-
-
-/** Wraps [`sqlite3_column_int()`](http://www.sqlite.org/c3ref/column_blob.html) */
-template<>
-int statement::val<int>(int idx) const;
-
-/** Wraps [`sqlite3_column_int64()`](http://www.sqlite.org/c3ref/column_blob.html) */
-template<>
-int64_t statement::val<int64_t>(int idx) const;
-
-/** Wraps [`sqlite3_column_double()`](http://www.sqlite.org/c3ref/column_blob.html) */
-template<>
-double statement::val<double>(int idx) const;
-
-/** Wraps [`sqlite3_column_text()`](http://www.sqlite.org/c3ref/column_blob.html) */
-template<>
-const char* statement::val<const char*>(int idx) const;
+inline void statement::bind<blob>(int idx, const blob &value, bool copy) {
+	int rv = try_bind<blob>(idx, value, copy);
+	if (rv != OK)
+		throw static_error(rv);
+}
 
-/** Wraps [`sqlite3_column_text()`](http://www.sqlite.org/c3ref/column_blob.html) */
-template<>
-std::string statement::val<std::string>(int idx) const;
+inline void statement::clear_bindings() {
+	int rv = try_clear_bindings();
+	if (rv != OK)
+		throw static_error(rv);
+}
 
-/** Wraps [`sqlite3_column_blob()`](http://www.sqlite.org/c3ref/column_blob.html) */
-template<>
-blob statement::val<blob>(int idx) const;
 
 template<typename T>
 if_sqxx_db_type<T, T> statement::val(const char *name) const {
@@ -0,0 +1,130 @@
+
+// Wrappers of statement that are called for every row or column.
+//
+// Compiled into the library by statement.cpp, or, if SQXX_HEADER_ONLY is
+// defined, included by statement.hpp so that they can be inlined.
+
+#if !defined(SQXX_STATEMENT_INLINE_HPP_INCLUDED)
+#define SQXX_STATEMENT_INLINE_HPP_INCLUDED
+
+#if !defined(SQXX_STATEMENT_HPP_INCLUDED)
+#error "Don't include statement.inline.hpp directly, include statement.hpp instead"
+#endif
+
+#include <sqlite3.h>
+#include <cstring>
+
+namespace sqxx {
+
+template<>
+SQXX_INLINE int statement::try_bind<int>(int idx, int value) {
+	return sqlite3_bind_int(handle, idx+1, value);
+}
+
+template<>
+SQXX_INLINE int statement::try_bind<int64_t>(int idx, int64_t value) {
+	return sqlite3_bind_int64(handle, idx+1, value);
+}
+
+template<>
+SQXX_INLINE int statement::try_bind<double>(int idx, double value) {
+	return sqlite3_bind_double(handle, idx+1, value);
+}
+
+template<>
+SQXX_INLINE int statement::try_bind<const char*>(int idx, const char *value, bool copy) {
+	if (value) {
+		return
+#if SQLITE_VERSION_NUMBER >= 3008007
+			sqlite3_bind_text64(handle, idx+1, value, std::strlen(value), (copy ? SQLITE_TRANSIENT : SQLITE_STATIC), SQLITE_UTF8);
+#else
+			sqlite3_bind_text(handle, idx+1, value, -1, (copy ? SQLITE_TRANSIENT : SQLITE_STATIC));
+#endif
+	}
+	else {
+		return try_bind(idx);
+	}
+}
+
+template<>
+SQXX_INLINE int statement::try_bind<std::string>(int idx, const std::string &value, bool copy) {
+	return
+#if SQLITE_VERSION_NUMBER >= 3008007
+		sqlite3_bind_text64(handle, idx+1, value.c_str(), value.length(), (copy ? SQLITE_TRANSIENT : SQLITE_STATIC), SQLITE_UTF8);
+#else
+		sqlite3_bind_text(handle, idx+1, value.c_str(), value.length(), (copy ? SQLITE_TRANSIENT : SQLITE_STATIC));
+#endif
+}
+
+template<>
+SQXX_INLINE int statement::try_bind<blob>(int idx, const blob &value, bool copy) {
+	if (value.data) {
+		return
+#if SQLITE_VERSION_NUMBER >= 3008007
+			sqlite3_bind_blob64(handle, idx+1, value.data, value.length, (copy ? SQLITE_TRANSIENT : SQLITE_STATIC));
+#else
+			sqlite3_bind_blob(handle, idx+1, value.data, value.length, (copy ? SQLITE_TRANSIENT : SQLITE_STATIC));
+#endif
+	}
+	else {
+		return
+#if SQLITE_VERSION_NUMBER >= 3008011
+			sqlite3_bind_zeroblob64(handle, idx+1, value.length);
+#else
+			sqlite3_bind_zeroblob(handle, idx+1, value.length);
+#endif
+	}
+}
+
+template<>
+SQXX_INLINE int statement::val<int>(int idx) const {
+	return sqlite3_column_int(handle, idx);
+}
+
+template<>
+SQXX_INLINE int64_t statement::val<int64_t>(int idx) const {
+	return sqlite3_column_int64(handle, idx);
+}
+
+template<>
+SQXX_INLINE double statement::val<double>(int idx) const {
+	return sqlite3_column_double(handle, idx);
+}
+
+template<>
+SQXX_INLINE const char* statement::val<const char*>(int idx) const {
+	const unsigned char *text = sqlite3_column_text(handle, idx);
+	return reinterpret_cast<const char*>(text);
+}
+
+template<>
+SQXX_INLINE std::string statement::val<std::string>(int idx) const {
+	// Correct order to call functions according to http://www.sqlite.org/c3ref/column_blob.html
+	const unsigned char* text = sqlite3_column_text(handle, idx);
+	int bytes = sqlite3_column_bytes(handle, idx);
+	return std::string(reinterpret_cast<const char*>(text), bytes);
+}
+
+template<>
+SQXX_INLINE blob statement::val<blob>(int idx) const {
+	// Correct order to call functions according to http://www.sqlite.org/c3ref/column_blob.html
+	const void *data = sqlite3_column_blob(handle, idx);
+	int bytes = sqlite3_column_bytes(handle, idx);
+	return blob(data, bytes);
+}
+
+SQXX_INLINE int statement::try_step() {
+	int rv = sqlite3_step(handle);
+	if (rv == SQLITE_ROW) {
+		completed = false;
+	}
+	else if (rv == SQLITE_DONE) {
+		completed = true;
+	}
+	return rv;
+}
+
+} // namespace sqxx
+
+#endif // SQXX_STATEMENT_INLINE_HPP_INCLUDED
+
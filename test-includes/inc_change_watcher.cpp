@@ -0,0 +1,2 @@
+
+#include <change_watcher.hpp>
@@ -0,0 +1,2 @@
+
+#include <checkpoint_scheduler.hpp>
@@ -0,0 +1,2 @@
+
+#include <huge_buffer.hpp>
@@ -0,0 +1,2 @@
+
+#include <malloc_pool.hpp>
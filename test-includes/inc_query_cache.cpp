@@ -0,0 +1,2 @@
+
+#include <query_cache.hpp>
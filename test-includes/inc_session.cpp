@@ -0,0 +1,2 @@
+
+#include <session.hpp>
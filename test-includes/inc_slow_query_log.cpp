@@ -0,0 +1,2 @@
+
+#include <slow_query_log.hpp>
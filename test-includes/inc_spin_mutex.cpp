@@ -0,0 +1,2 @@
+
+#include <spin_mutex.hpp>
@@ -0,0 +1,2 @@
+
+#include <tuning.hpp>
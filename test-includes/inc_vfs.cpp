@@ -0,0 +1,3 @@
+
+#include <vfs.hpp>
+
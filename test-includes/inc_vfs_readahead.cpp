@@ -0,0 +1,2 @@
+
+#include <vfs_readahead.hpp>
@@ -0,0 +1,3 @@
+
+#include <vfs_uring.hpp>
+
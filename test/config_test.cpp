@@ -0,0 +1,267 @@
+
+#include "sqxx.hpp"
+#include "config.hpp"
+#include "global.hpp"
+#include "huge_buffer.hpp"
+#include "malloc_pool.hpp"
+#include "pcache.hpp"
+#include "spin_mutex.hpp"
+
+#include "setup.hpp"
+
+#include <boost/test/unit_test.hpp>
+#include <sqlite3.h>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// Runs a small workload in several threads, each with its own connection
+void run_threads(int nthreads) {
+	std::vector<std::thread> threads;
+	for (int t = 0; t < nthreads; ++t) {
+		threads.emplace_back([] {
+			sqxx::connection conn(":memory:");
+			conn.exec("create table items (id integer primary key, v text)");
+			for (int i = 0; i < 200; ++i) {
+				conn.query("insert into items (v) values (hex(randomblob(" + std::to_string(i % 50 + 1) + ")))");
+			}
+			conn.exec("delete from items where id % 2 = 0");
+		});
+	}
+	for (auto &t : threads) {
+		t.join();
+	}
+}
+
+} // anonymous namespace
+
+BOOST_AUTO_TEST_SUITE(sqxx_config)
+
+BOOST_AUTO_TEST_CASE(config_needs_shutdown) {
+	sqlite3_mem_methods methods;
+	sqxx::initialize();
+	BOOST_CHECK_THROW(sqxx::config_getmalloc(&methods), sqxx::error);
+}
+
+BOOST_AUTO_TEST_CASE(malloc_pool) {
+	sqlite3_mem_methods previous;
+	sqxx::shutdown();
+	sqxx::config_getmalloc(&previous);
+	sqxx::config_malloc_pool();
+	sqxx::initialize();
+
+	run_threads(4);
+	{
+		sqxx::connection conn(":memory:");
+		BOOST_CHECK_EQUAL(conn.query("select length(randomblob(100000))").val<int>(0), 100000);
+	}
+
+	sqxx::malloc_pool_statistics stats = sqxx::malloc_pool_stats();
+	uint64_t allocations = 0, cache_hits = 0, frees = 0;
+	for (auto &cs : stats.classes) {
+		allocations += cs.allocations;
+		cache_hits += cs.cache_hits;
+		frees += cs.frees;
+		BOOST_CHECK(cs.cache_hits <= cs.allocations);
+	}
+	BOOST_CHECK(allocations > 0);
+	BOOST_CHECK(cache_hits > allocations / 2);
+	BOOST_CHECK(frees > 0);
+	BOOST_CHECK(stats.large_allocations > 0);
+
+	sqxx::shutdown();
+	sqxx::config_malloc(&previous);
+	sqxx::initialize();
+}
+
+BOOST_AUTO_TEST_CASE(shared_pcache) {
+	sqlite3_pcache_methods2 previous;
+	sqxx::pcache_options opts;
+	opts.budget = 512 * 1024;
+	opts.huge_pages = true;
+	sqxx::shutdown();
+	sqxx::config_getpcache2(&previous);
+	sqxx::config_shared_pcache(opts);
+	sqxx::initialize();
+
+	{
+		tmpdb file;
+		sqxx::connection writer(file.filename, sqxx::OPEN_READWRITE|sqxx::OPEN_CREATE);
+		sqxx::connection reader(file.filename);
+		writer.exec("pragma cache_size = 10000");
+		reader.exec("pragma cache_size = 10000");
+		writer.exec("create table items (id integer primary key, v blob)");
+		writer.exec("begin");
+		for (int i = 0; i < 2000; ++i) {
+			writer.exec("insert into items (v) values (randomblob(1000))");
+		}
+		writer.exec("commit");
+		for (int i = 0; i < 100; ++i) {
+			BOOST_CHECK_EQUAL(reader.query("select length(v) from items where id = 7").val<int>(0), 1000);
+		}
+		BOOST_CHECK_EQUAL(reader.query("select count(*) from items where length(v) = 1000").val<int>(0), 2000);
+		BOOST_CHECK_EQUAL(reader.query("pragma integrity_check").val<std::string>(0), "ok");
+
+		// A cache at its own limit replaces its own pages
+		sqxx::connection small(file.filename);
+		small.exec("pragma cache_size = 20");
+		BOOST_CHECK_EQUAL(small.query("select count(*) from items where length(v) = 1000").val<int>(0), 2000);
+
+		sqxx::pcache_statistics stats = sqxx::shared_pcache_stats();
+		BOOST_CHECK(stats.used <= opts.budget);
+		BOOST_CHECK(stats.reserved >= stats.used);
+		uint64_t hits = 0, evictions = 0;
+		int purgeable = 0;
+		int limited = 0;
+		for (auto &is : stats.instances) {
+			if (is.max_pages == 20) {
+				++limited;
+				BOOST_CHECK(is.pages <= 20);
+				BOOST_CHECK(is.evictions > 0);
+			}
+			hits += is.hits;
+			evictions += is.evictions;
+			purgeable += is.purgeable;
+			BOOST_CHECK(is.hit_ratio() >= 0.0 && is.hit_ratio() <= 1.0);
+		}
+		BOOST_CHECK(purgeable >= 2);
+		BOOST_CHECK_EQUAL(limited, 1);
+		BOOST_CHECK(hits > 0);
+		BOOST_CHECK(evictions > 0);
+
+		// Pages used repeatedly survive a scan much larger than the budget
+		sqxx::connection hot(file.filename);
+		hot.exec("pragma cache_size = 5000");
+		auto lookup = hot.prepare("select length(v) from items where id = ?");
+		auto lookup_all = [&] {
+			for (int id : {7, 500, 1000, 1500}) {
+				lookup.bind(0, id);
+				lookup.run();
+				BOOST_CHECK_EQUAL(lookup.val<int>(0), 1000);
+				lookup.reset();
+			}
+		};
+		auto hot_stats = [] {
+			for (auto &is : sqxx::shared_pcache_stats().instances) {
+				if (is.max_pages == 5000)
+					return is;
+			}
+			BOOST_FAIL("no cache for the hot connection");
+			return sqxx::pcache_instance_stats();
+		};
+		for (int i = 0; i < 3; ++i) {
+			lookup_all();
+		}
+		sqxx::pcache_instance_stats warm = hot_stats();
+		BOOST_CHECK_EQUAL(hot.query("select count(*) from items where length(v) = 1000").val<int>(0), 2000);
+		sqxx::pcache_instance_stats scanned = hot_stats();
+		BOOST_CHECK(scanned.misses - warm.misses > opts.budget / 4096);
+		BOOST_CHECK(scanned.pages < scanned.misses - warm.misses);
+		lookup_all();
+		sqxx::pcache_instance_stats after = hot_stats();
+		BOOST_CHECK_EQUAL(after.misses, scanned.misses);
+		BOOST_CHECK(after.hits > scanned.hits);
+	}
+
+	sqxx::shutdown();
+	sqxx::config_pcache2(&previous);
+	sqxx::initialize();
+}
+
+BOOST_AUTO_TEST_CASE(spin_mutex) {
+	if (!sqxx::threadsafe())
+		return;
+	sqlite3_mutex_methods previous;
+	sqxx::shutdown();
+	sqxx::config_getmutex(&previous);
+	sqxx::config_spin_mutex();
+	sqxx::initialize();
+	sqxx::spin_mutex_reset_stats();
+
+	run_threads(4);
+	{
+		// Threads sharing a connection contend for its mutex
+		sqxx::connection conn(":memory:", sqxx::OPEN_READWRITE|sqxx::OPEN_FULLMUTEX);
+		conn.exec("create table items (id integer primary key, v integer)");
+		std::vector<std::thread> threads;
+		for (int t = 0; t < 4; ++t) {
+			threads.emplace_back([&conn] {
+				for (int i = 0; i < 500; ++i) {
+					conn.exec("insert into items (v) values (1)");
+				}
+			});
+		}
+		for (auto &t : threads) {
+			t.join();
+		}
+		BOOST_CHECK_EQUAL(conn.query("select count(*) from items").val<int>(0), 2000);
+	}
+
+	std::vector<sqxx::mutex_class_stats> stats = sqxx::spin_mutex_stats();
+	uint64_t acquisitions = 0;
+	for (auto &s : stats) {
+		acquisitions += s.acquisitions;
+		BOOST_CHECK(s.contended <= s.acquisitions);
+		if (std::string(s.name) == "recursive")
+			BOOST_CHECK(s.acquisitions >= 2000);
+	}
+	BOOST_CHECK(acquisitions > 0);
+
+	sqxx::shutdown();
+	sqxx::config_mutex(&previous);
+	sqxx::initialize();
+}
+
+BOOST_AUTO_TEST_CASE(huge_buffer) {
+	sqxx::huge_buffer buf(100000);
+	BOOST_REQUIRE(buf.data() != nullptr);
+	BOOST_CHECK(buf.size() >= 100000);
+	BOOST_CHECK(buf.kind_of_pages() != sqxx::huge_buffer::backing::none);
+	static_cast<char*>(buf.data())[99999] = 1;
+
+	sqxx::huge_buffer moved(std::move(buf));
+	BOOST_CHECK(buf.data() == nullptr);
+	BOOST_CHECK_EQUAL(static_cast<char*>(moved.data())[99999], 1);
+
+	sqxx::huge_buffer normal(4096, false);
+	BOOST_CHECK(normal.kind_of_pages() == sqxx::huge_buffer::backing::normal);
+}
+
+BOOST_AUTO_TEST_CASE(pagecache_huge) {
+	sqxx::shutdown();
+	sqxx::huge_buffer pagecache = sqxx::config_pagecache_huge(4096, 50, 2);
+	sqxx::initialize();
+	{
+		tmpdb file;
+		sqxx::connection conn(file.filename, sqxx::OPEN_READWRITE|sqxx::OPEN_CREATE);
+		conn.exec("create table items (id integer primary key, v blob)");
+		conn.exec("insert into items (v) values (randomblob(10000))");
+		BOOST_CHECK(sqxx::status_pagecache_used().current > 0);
+	}
+	sqxx::shutdown();
+	sqxx::config_pagecache(nullptr, 0, 0);
+	sqxx::initialize();
+}
+
+BOOST_AUTO_TEST_CASE(lookaside_arena) {
+	sqxx::lookaside_arena arena(2, 512, 64);
+	sqxx::connection c1(":memory:");
+	sqxx::connection c2(":memory:");
+	sqxx::connection c3(":memory:");
+	int p1 = arena.config(c1);
+	int p2 = arena.config(c2);
+	BOOST_CHECK(p1 != p2);
+	BOOST_CHECK_THROW(arena.config(c3), sqxx::error);
+
+	c1.exec("create table items (id integer primary key, v text)");
+	c1.exec("insert into items (v) values ('abc')");
+	if (!sqxx::compileoption_used("OMIT_LOOKASIDE"))
+		BOOST_CHECK(c1.status_lookaside_used().highwater > 0);
+
+	c2.close();
+	arena.release(p2);
+	BOOST_CHECK_EQUAL(arena.config(c3), p2);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
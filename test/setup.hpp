@@ -3,6 +3,10 @@
 #define SQXX_TEST_SETUP_HPP_INCLUDED
 
 #include "sqxx.hpp"
+#include <cstdio>
+#include <string>
+#include <stdlib.h>
+#include <unistd.h>
 
 struct db {
 	sqxx::connection conn;
@@ -21,6 +25,23 @@ struct tab : db {
 	}
 };
 
+// A database file in a temporary location, removed again in the end
+struct tmpdb {
+	std::string filename;
+	tmpdb() {
+		char name[] = "/tmp/sqxx_test_XXXXXX";
+		int fd = mkstemp(name);
+		if (fd >= 0)
+			close(fd);
+		filename = name;
+	}
+	~tmpdb() {
+		for (const char *suffix : {"", "-wal", "-shm", "-journal"}) {
+			std::remove((filename + suffix).c_str());
+		}
+	}
+};
+
 
 #endif // SQXX_TEST_SETUP_HPP_INCLUDED
 
@@ -2,11 +2,29 @@
 // (c) 2013 Stephan Hohe
 
 #include "sqxx.hpp"
+#include "change_stream.hpp"
+#include "change_watcher.hpp"
+#include "checkpoint_scheduler.hpp"
 #include "column.hpp"
+#include "metrics.hpp"
+#include "profiler.hpp"
+#include "query_cache.hpp"
+#include "session.hpp"
+#include "slow_query_log.hpp"
+#include "tuning.hpp"
 
 #include "setup.hpp"
 
+#include <sqlite3.h>
 #include <boost/test/unit_test.hpp>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <thread>
 
 BOOST_AUTO_TEST_SUITE(sqxx_cn)
 
@@ -19,6 +37,55 @@ BOOST_AUTO_TEST_CASE(database) {
 	ctx.conn.status(0);
 }
 
+namespace {
+
+long file_size(const std::string &filename) {
+	std::FILE *f = std::fopen(filename.c_str(), "rb");
+	if (!f)
+		return -1;
+	std::fseek(f, 0, SEEK_END);
+	long size = std::ftell(f);
+	std::fclose(f);
+	return size;
+}
+
+} // anonymous namespace
+
+BOOST_AUTO_TEST_CASE(file_control) {
+	tmpdb file;
+	sqxx::growth_policy growth;
+	growth.chunk_size = 256 * 1024;
+	growth.preallocate = 1024 * 1024;
+	{
+		sqxx::connection conn;
+		// Database is still empty, nothing preallocated
+		conn.open(file.filename, sqxx::OPEN_READWRITE, nullptr, growth);
+		BOOST_CHECK_EQUAL(file_size(file.filename), 0);
+		conn.exec("create table items (id integer primary key, v blob)");
+		conn.exec("insert into items (v) values (randomblob(1000))");
+		// Preallocation isn't applied later either, only the chunk size
+		BOOST_CHECK_EQUAL(file_size(file.filename), 256 * 1024);
+		// Once the database has content it is
+		conn.set_growth_policy(growth);
+		BOOST_CHECK_EQUAL(file_size(file.filename), 1024 * 1024);
+
+		BOOST_CHECK_EQUAL(conn.file_control_persist_wal(), false);
+		BOOST_CHECK_EQUAL(conn.file_control_persist_wal(1), true);
+		BOOST_CHECK_EQUAL(conn.file_control_persist_wal(), true);
+		BOOST_CHECK_THROW(conn.file_control_chunk_size(4096, "nosuchdb"), sqxx::error);
+		BOOST_CHECK_THROW(conn.file_control("main", 12345, nullptr), sqxx::error);
+	}
+
+	sqxx::connection conn;
+	growth.preallocate = 1280 * 1024;
+	conn.open(file.filename, sqxx::OPEN_READWRITE, nullptr, growth);
+	BOOST_CHECK_EQUAL(file_size(file.filename), 1280 * 1024);
+	conn.file_control_size_hint(1536 * 1024);
+	BOOST_CHECK_EQUAL(file_size(file.filename), 1536 * 1024);
+	BOOST_CHECK_EQUAL(conn.query("pragma integrity_check").val<std::string>(0), "ok");
+	BOOST_CHECK_EQUAL(conn.query("select count(*) from items").val<int>(0), 1);
+}
+
 BOOST_AUTO_TEST_CASE(table) {
 	tab ctx;
 }
@@ -123,6 +190,42 @@ BOOST_AUTO_TEST_CASE(statement_param_bind) {
 	BOOST_CHECK(st.done());
 }
 
+BOOST_AUTO_TEST_CASE(statement_try_step) {
+	tab ctx;
+	ctx.conn.exec("create table uniq (k integer unique)");
+	sqxx::statement st = ctx.conn.prepare("insert into uniq (k) values (?)");
+	BOOST_CHECK_EQUAL(st.try_bind(1, 1), sqxx::RANGE);
+	BOOST_CHECK_EQUAL(st.try_bind(0, 1), sqxx::OK);
+	BOOST_CHECK_EQUAL(st.try_step(), sqxx::DONE);
+	BOOST_CHECK(st.done());
+	st.reset();
+	BOOST_CHECK_EQUAL(sqxx::primary_code(st.try_step()), sqxx::CONSTRAINT);
+	BOOST_CHECK_EQUAL(sqxx::primary_code(st.try_reset()), sqxx::CONSTRAINT);
+	BOOST_CHECK_EQUAL(st.try_bind(0, std::string("x")), sqxx::OK);
+	BOOST_CHECK_EQUAL(st.try_step(), sqxx::DONE);
+	st.reset();
+	BOOST_CHECK_EQUAL(st.try_clear_bindings(), sqxx::OK);
+}
+
+BOOST_AUTO_TEST_CASE(statement_scan_stats) {
+	tab ctx;
+	sqxx::statement st = ctx.conn.prepare("select count(*) from items a, items b where a.v < b.v");
+#if defined(SQLITE_ENABLE_STMT_SCANSTATUS)
+	st.run();
+	std::vector<sqxx::scan_stat> stats = st.scan_stats();
+	BOOST_REQUIRE_EQUAL(stats.size(), 2);
+	BOOST_CHECK_EQUAL(stats[0].name, "items");
+	BOOST_CHECK_EQUAL(stats[0].loops, 1);
+	BOOST_CHECK_EQUAL(stats[0].rows_visited, 3);
+	BOOST_CHECK_EQUAL(stats[1].rows_visited, 9);
+	BOOST_CHECK(!stats[1].explain.empty());
+	st.scan_stats_reset();
+	BOOST_CHECK_EQUAL(st.scan_stats()[0].loops, 0);
+#else
+	BOOST_CHECK_THROW(st.scan_stats(), sqxx::error);
+#endif
+}
+
 BOOST_AUTO_TEST_CASE(commit_handler) {
 	tab ctx;
 	bool called = false;
@@ -157,6 +260,90 @@ BOOST_AUTO_TEST_CASE(update_handler) {
 	BOOST_CHECK(called);
 }
 
+int static_commits = 0;
+int static_updates = 0;
+int static_progress = 0;
+int count_commit() { ++static_commits; return 0; }
+void count_update(int, const char*, const char*, int64_t) { ++static_updates; }
+bool count_progress() { ++static_progress; return false; }
+
+BOOST_AUTO_TEST_CASE(hook_overloads) {
+	tab ctx;
+
+	// Functions as template parameters
+	ctx.conn.set_commit_handler<int (), count_commit>();
+	ctx.conn.set_update_handler<void (int, const char*, const char*, int64_t), count_update>();
+	ctx.conn.set_progress_handler<bool (), count_progress>(1);
+	ctx.conn.query("update items set v = 111 where id = 1");
+	BOOST_CHECK_EQUAL(static_commits, 1);
+	BOOST_CHECK_EQUAL(static_updates, 1);
+	BOOST_CHECK(static_progress > 0);
+
+	// The connection owns a copy of a callable object until the hook is
+	// replaced or removed
+	auto token = std::make_shared<int>(0);
+	ctx.conn.set_update_handler([token](int, const char*, const char*, int64_t) { ++*token; });
+	BOOST_CHECK_EQUAL(token.use_count(), 2);
+	ctx.conn.query("update items set v = 112 where id = 1");
+	BOOST_CHECK_EQUAL(*token, 1);
+	BOOST_CHECK_EQUAL(static_updates, 1);
+
+	// std::function objects are still stored as they are
+	int counted = 0;
+	sqxx::connection::update_handler_t fun = [&](int, const char*, const char*, int64_t) { ++counted; };
+	ctx.conn.set_update_handler(fun);
+	BOOST_CHECK_EQUAL(token.use_count(), 1);
+	ctx.conn.query("update items set v = 113 where id = 1");
+	BOOST_CHECK_EQUAL(counted, 1);
+	BOOST_CHECK_EQUAL(*token, 1);
+
+	ctx.conn.set_progress_handler(1, [] { return true; });
+	BOOST_CHECK_THROW(ctx.conn.query("update items set v = 114 where id = 1"), sqxx::error);
+
+	int commits = static_commits;
+	ctx.conn.set_progress_handler();
+	ctx.conn.set_update_handler();
+	ctx.conn.set_commit_handler();
+	ctx.conn.query("update items set v = 115 where id = 1");
+	BOOST_CHECK_EQUAL(static_commits, commits);
+	BOOST_CHECK_EQUAL(counted, 1);
+}
+
+BOOST_AUTO_TEST_CASE(preupdate_handler) {
+	tab ctx;
+#if defined(SQLITE_ENABLE_PREUPDATE_HOOK)
+	int calls = 0;
+	ctx.conn.set_preupdate_handler([&](const sqxx::preupdate &change) {
+		++calls;
+		BOOST_CHECK_EQUAL(change.op, SQLITE_UPDATE);
+		BOOST_CHECK_EQUAL(change.table, "items");
+		BOOST_CHECK_EQUAL(change.old_rowid, 1);
+		BOOST_CHECK_EQUAL(change.count(), 2);
+		BOOST_CHECK_EQUAL(change.depth(), 0);
+		BOOST_CHECK_EQUAL(change.old_value(1).val<int>(), 11);
+		BOOST_CHECK_EQUAL(change.new_value(1).val<int>(), 111);
+	});
+	ctx.conn.exec("update items set v = 111 where id = 1");
+	BOOST_CHECK_EQUAL(calls, 1);
+
+	// Tables without rowid are reported as well
+	ctx.conn.set_preupdate_handler();
+	ctx.conn.exec("create table kv (k text primary key, v text) without rowid");
+	ctx.conn.exec("insert into kv values ('a', 'x')");
+	calls = 0;
+	ctx.conn.set_preupdate_handler([&](const sqxx::preupdate &change) {
+		++calls;
+		BOOST_CHECK_EQUAL(change.op, SQLITE_DELETE);
+		BOOST_CHECK_EQUAL(change.old_value(0).val<std::string>(), "a");
+		BOOST_CHECK_THROW(change.new_value(0), sqxx::error);
+	});
+	ctx.conn.exec("delete from kv where k = 'a'");
+	BOOST_CHECK_EQUAL(calls, 1);
+#else
+	BOOST_CHECK_THROW(ctx.conn.set_preupdate_handler([](const sqxx::preupdate&) {}), sqxx::error);
+#endif
+}
+
 BOOST_AUTO_TEST_CASE(trace_handler) {
 	tab ctx;
 	bool called = false;
@@ -181,6 +368,682 @@ BOOST_AUTO_TEST_CASE(profile_handler) {
 	BOOST_CHECK(called);
 }
 
+BOOST_AUTO_TEST_CASE(profiler) {
+	tab ctx;
+	sqxx::profiler prof;
+	std::vector<std::string> traced;
+	ctx.conn.set_trace_handler([&](const char *q) {
+		traced.push_back(q);
+	});
+	ctx.conn.set_profiler(prof);
+	for (int i = 1; i <= 3; ++i) {
+		sqxx::statement st = ctx.conn.prepare("select v from items where id >= ?");
+		st.bind(0, i);
+		st.run();
+		for (auto j : st) {
+			sqxx::unused(j);
+		}
+	}
+	ctx.conn.exec("update items set v = 5 where id = 1");
+	ctx.conn.exec("update items set v = 6 where id = 2");
+	ctx.conn.set_profiler();
+
+	BOOST_CHECK_EQUAL(traced.size(), 5);
+	BOOST_CHECK_EQUAL(traced[0], "select v from items where id >= 1");
+
+	std::vector<sqxx::statement_profile> top = prof.top_by_total(10);
+	BOOST_REQUIRE_EQUAL(top.size(), 2);
+	for (const sqxx::statement_profile &s : top) {
+		if (s.sql == "select v from items where id >= ?") {
+			BOOST_CHECK_EQUAL(s.count, 3);
+			BOOST_CHECK_EQUAL(s.rows, 3 + 2 + 1);
+		}
+		else {
+			BOOST_CHECK_EQUAL(s.sql, "update items set v = ? where id = ?");
+			BOOST_CHECK_EQUAL(s.count, 2);
+			BOOST_CHECK_EQUAL(s.rows, 0);
+		}
+		BOOST_CHECK(s.vm_steps > 0);
+		BOOST_CHECK(s.p50_ns <= s.p99_ns);
+		BOOST_CHECK(s.p99_ns <= s.max_ns);
+	}
+
+	prof.reset();
+	BOOST_CHECK(prof.snapshot().empty());
+
+	// Entries can be looked up once and recorded in directly
+	sqxx::profiler::entry *e = prof.lookup("select 1 + 1");
+	BOOST_CHECK_EQUAL(prof.lookup("select 2 + 3"), e);
+	prof.record(e, 1000, 1, 4);
+	BOOST_REQUIRE_EQUAL(prof.snapshot().size(), 1);
+	BOOST_CHECK_EQUAL(prof.snapshot()[0].sql, "select ? + ?");
+	BOOST_CHECK_EQUAL(prof.snapshot()[0].count, 1);
+	prof.reset();
+
+	// Entries cached for a statement are dropped when it is destroyed, even
+	// if the next statement gets the same handle
+	ctx.conn.set_profiler(prof);
+	{
+		sqxx::statement st = ctx.conn.prepare("select count(*) from items");
+		for (int i = 0; i < 2; ++i) {
+			st.run();
+			st.reset();
+		}
+	}
+	{
+		sqxx::statement st = ctx.conn.prepare("select count(*) from types");
+		st.run();
+		st.reset();
+	}
+	ctx.conn.set_profiler();
+	for (const sqxx::statement_profile &s : prof.snapshot()) {
+		BOOST_CHECK_EQUAL(s.count, (s.sql == "select count(*) from items" ? 2 : 1));
+	}
+	BOOST_CHECK_EQUAL(prof.snapshot().size(), 2);
+	prof.reset();
+
+	BOOST_CHECK_EQUAL(sqxx::profiler::normalize("select  'it''s',\n x'0a', 1.5e3 from t2  -- c"),
+			"select ?, ?, ? from t2");
+
+	sqxx::latency_histogram hist;
+	for (uint64_t ns = 1; ns <= 1000; ++ns) {
+		hist.record(ns * 1000);
+	}
+	BOOST_CHECK_EQUAL(hist.count(), 1000);
+	BOOST_CHECK_CLOSE(static_cast<double>(hist.percentile(0.5)), 500000.0, 7.0);
+	BOOST_CHECK_CLOSE(static_cast<double>(hist.percentile(0.99)), 990000.0, 7.0);
+}
+
+BOOST_AUTO_TEST_CASE(slow_query_log) {
+	tmpdb file;
+	sqxx::connection conn(file.filename, sqxx::OPEN_READWRITE|sqxx::OPEN_CREATE);
+	conn.exec("create table items (id integer, v integer)");
+	conn.exec("insert into items (id, v) values (1, 11), (2, 22), (3, 33)");
+	conn.exec("create table other (id integer, w integer)");
+	conn.exec("insert into other (id, w) values (1, 1), (2, 2), (3, 3)");
+	std::vector<sqxx::slow_query> logged;
+	sqxx::slow_query_options opts;
+	opts.threshold = std::chrono::nanoseconds(0);
+	opts.max_per_second = 2;
+	sqxx::slow_query_log slow([&](const sqxx::slow_query &q) { logged.push_back(q); }, opts);
+	conn.set_slow_query_log(slow);
+
+	sqxx::statement st = conn.prepare("select i.v, o.w from items i join other o on o.w = i.id where i.v > ?");
+	st.bind(0, 0);
+	st.run();
+	for (auto j : st) {
+		sqxx::unused(j);
+	}
+	st.reset();
+	conn.exec("select count(*) from items");
+	conn.exec("select count(*) from other");
+	conn.set_slow_query_log();
+	slow.flush();
+
+	BOOST_CHECK_EQUAL(slow.logged(), 2);
+	BOOST_CHECK_EQUAL(slow.dropped(), 1);
+	BOOST_REQUIRE_EQUAL(logged.size(), 2);
+	const sqxx::slow_query &q = logged[0];
+	BOOST_CHECK_EQUAL(q.sql, "select i.v, o.w from items i join other o on o.w = i.id where i.v > 0");
+	BOOST_CHECK(q.full_scan());
+	BOOST_CHECK(q.automatic_index());
+	BOOST_CHECK(q.vm_steps > 0);
+	BOOST_CHECK(!q.plan.empty());
+	BOOST_CHECK(q.format().find("[AUTOMATIC INDEX]") != std::string::npos);
+	// Only the statements themselves were traced, no EXPLAIN
+	BOOST_CHECK_EQUAL(logged[1].sql, "select count(*) from items");
+
+	// In-memory databases can't be explained from another connection
+	tab mem;
+	sqxx::slow_query_log mem_slow([&](const sqxx::slow_query &q) { logged.push_back(q); }, opts);
+	mem.conn.set_slow_query_log(mem_slow);
+	mem.conn.exec("select count(*) from items");
+	mem.conn.set_slow_query_log();
+	mem_slow.flush();
+	BOOST_REQUIRE_EQUAL(logged.size(), 3);
+	BOOST_CHECK(logged[2].database.empty());
+	BOOST_CHECK(logged[2].plan.empty());
+	BOOST_CHECK(logged[2].vm_steps > 0);
+}
+
+BOOST_AUTO_TEST_CASE(metrics) {
+	tab ctx;
+	sqxx::profiler prof;
+	ctx.conn.set_profiler(prof);
+	sqxx::metrics m;
+	m.add(ctx.conn, "test \"db\"");
+	m.add(prof, "p");
+	m.sample();
+	ctx.conn.exec("select count(*) from items");
+	m.sample();
+	ctx.conn.set_profiler();
+	m.remove(prof);
+	m.remove(ctx.conn);
+
+	std::string text = m.render();
+	BOOST_CHECK(text.find("# TYPE sqlite_memory_used_bytes gauge\n") != std::string::npos);
+	BOOST_CHECK(text.find("sqlite_connection_cache_hits_total{connection=\"test \\\"db\\\"\"} ") != std::string::npos);
+	BOOST_CHECK(text.find("sqlite_connection_cache_hit_ratio{") != std::string::npos);
+	BOOST_CHECK(text.find("sqlite_connection_cache_hits_per_second{") != std::string::npos);
+	BOOST_CHECK(text.find("sqlite_statement_executions_total{profiler=\"p\",sql=\"select count(*) from items\"} 1\n") != std::string::npos);
+	BOOST_CHECK(text.find("# TYPE sqlite_statement_latency_seconds summary\n") != std::string::npos);
+	BOOST_CHECK(text.find("sqlite_statement_latency_seconds{profiler=\"p\",sql=\"select count(*) from items\",quantile=\"0.5\"} ") != std::string::npos);
+	BOOST_CHECK(text.find("sqlite_statement_latency_seconds_sum{profiler=\"p\",sql=\"select count(*) from items\"} ") != std::string::npos);
+	BOOST_CHECK(text.find("sqlite_statement_latency_seconds_count{profiler=\"p\",sql=\"select count(*) from items\"} 1\n") != std::string::npos);
+
+	tmpdb file;
+	m.write(file.filename);
+	std::ifstream in(file.filename.c_str());
+	std::stringstream written;
+	written << in.rdbuf();
+	BOOST_CHECK_EQUAL(written.str(), text);
+
+	tmpdb scheduled;
+	m.start(std::chrono::milliseconds(5), scheduled.filename);
+	std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	m.stop();
+	BOOST_CHECK(file_size(scheduled.filename) > 0);
+}
+
+BOOST_AUTO_TEST_CASE(checkpoint_scheduler) {
+	tmpdb file;
+	sqxx::connection writer;
+	writer.open(file.filename);
+	writer.busy_timeout(1000);
+	writer.exec("pragma journal_mode=wal");
+	writer.exec("create table t (x integer)");
+
+	sqxx::checkpoint_options opts;
+	opts.passive_frames = 5;
+	opts.restart_frames = 20;
+	opts.truncate_frames = 40;
+	opts.busy_timeout = std::chrono::milliseconds(10);
+	sqxx::checkpoint_scheduler sched(file.filename, opts);
+	sched.attach(writer);
+
+	for (int i = 0; i < 10; ++i)
+		writer.exec("insert into t values (1)");
+	sched.flush();
+	sqxx::checkpoint_stats stats = sched.stats();
+	BOOST_CHECK(stats.passive >= 1);
+	BOOST_CHECK_EQUAL(stats.truncate, 0);
+
+	{
+		// An open read transaction keeps the WAL from being reset
+		sqxx::connection reader;
+		reader.open(file.filename);
+		reader.exec("begin");
+		sqxx::statement st = reader.prepare("select count(*) from t");
+		st.run();
+		for (int i = 0; i < 50; ++i)
+			writer.exec("insert into t values (2)");
+		sched.request();
+		sched.flush();
+		stats = sched.stats();
+		BOOST_CHECK(stats.wal_frames >= opts.truncate_frames);
+		BOOST_CHECK(stats.wal_bytes > 0);
+		BOOST_CHECK(stats.busy >= 1);
+	}
+
+	sched.request();
+	sched.flush();
+	stats = sched.stats();
+	BOOST_CHECK_EQUAL(stats.truncate, 1);
+	BOOST_CHECK_EQUAL(stats.wal_frames, 0);
+	BOOST_CHECK_EQUAL(file_size(file.filename + "-wal"), 0);
+	BOOST_CHECK(stats.max_duration_ns > 0);
+
+	sqxx::metrics m;
+	m.add(sched, "main");
+	m.sample();
+	std::string text = m.render();
+	BOOST_CHECK(text.find("sqlite_checkpoints_total{checkpointer=\"main\",mode=\"truncate\"} 1\n") != std::string::npos);
+	BOOST_CHECK(text.find("sqlite_wal_bytes{checkpointer=\"main\"} 0\n") != std::string::npos);
+	m.remove(sched);
+
+	sched.detach(writer);
+}
+
+BOOST_AUTO_TEST_CASE(pragmas) {
+	tmpdb file;
+	sqxx::connection conn;
+	conn.open(file.filename);
+	BOOST_CHECK_EQUAL(conn.journal_mode(), sqxx::JOURNAL_DELETE);
+	conn.journal_mode(sqxx::JOURNAL_WAL);
+	BOOST_CHECK_EQUAL(conn.journal_mode(), sqxx::JOURNAL_WAL);
+	conn.synchronous(sqxx::SYNC_NORMAL);
+	BOOST_CHECK_EQUAL(conn.synchronous(), sqxx::SYNC_NORMAL);
+	conn.cache_size(-4096);
+	BOOST_CHECK_EQUAL(conn.cache_size(), -4096);
+	conn.temp_store(sqxx::TEMP_STORE_MEMORY);
+	BOOST_CHECK_EQUAL(conn.temp_store(), sqxx::TEMP_STORE_MEMORY);
+	conn.busy_timeout(250);
+	BOOST_CHECK_EQUAL(conn.busy_timeout(), 250);
+	conn.wal_autocheckpoint(500);
+	BOOST_CHECK_EQUAL(conn.wal_autocheckpoint(), 500);
+	BOOST_CHECK_EQUAL(conn.mmap_size(conn.mmap_size()), conn.mmap_size());
+	BOOST_CHECK(conn.page_size() > 0);
+	BOOST_CHECK_EQUAL(conn.locking_mode(), sqxx::LOCKING_NORMAL);
+
+	db mem;
+	BOOST_CHECK_THROW(mem.conn.journal_mode(sqxx::JOURNAL_WAL), sqxx::error);
+}
+
+BOOST_AUTO_TEST_CASE(tuning) {
+	tmpdb file;
+	sqxx::connection conn;
+	conn.open(file.filename);
+	conn.journal_mode(sqxx::JOURNAL_WAL);
+	conn.exec("create table t (x integer)");
+
+	BOOST_CHECK_THROW(sqxx::tuning::preset("unknown"), sqxx::error);
+	for (const std::string &name : sqxx::tuning::presets())
+		sqxx::tuning::preset(name);
+
+	sqxx::tuning previous = sqxx::tuning::preset("bulk-load").apply(conn);
+	BOOST_CHECK_EQUAL(conn.journal_mode(), sqxx::JOURNAL_MEMORY);
+	BOOST_CHECK_EQUAL(conn.locking_mode(), sqxx::LOCKING_EXCLUSIVE);
+	BOOST_CHECK_EQUAL(conn.synchronous(), sqxx::SYNC_OFF);
+	conn.exec("insert into t values (1)");
+	previous.apply(conn);
+	BOOST_CHECK_EQUAL(conn.journal_mode(), sqxx::JOURNAL_WAL);
+	BOOST_CHECK_EQUAL(conn.locking_mode(), sqxx::LOCKING_NORMAL);
+
+	// Other connections can use the database again
+	sqxx::connection other;
+	other.open(file.filename);
+	other.exec("insert into t values (2)");
+
+	{
+		sqxx::scoped_tuning scope(conn, "read-only-analytics");
+		BOOST_CHECK_EQUAL(conn.temp_store(), sqxx::TEMP_STORE_MEMORY);
+		BOOST_CHECK_EQUAL(conn.cache_size(), -256 * 1024);
+	}
+	BOOST_CHECK_EQUAL(conn.temp_store(), sqxx::TEMP_STORE_DEFAULT);
+	BOOST_CHECK_EQUAL(conn.cache_size(), -2000);
+
+	// A failing setting restores the ones applied before
+	sqxx::tuning t;
+	t.locking_mode = sqxx::LOCKING_EXCLUSIVE;
+	t.journal_mode = sqxx::JOURNAL_DELETE;
+	conn.exec("begin");
+	BOOST_CHECK_THROW(t.apply(conn), sqxx::error);
+	conn.exec("commit");
+	BOOST_CHECK_EQUAL(conn.journal_mode(), sqxx::JOURNAL_WAL);
+	BOOST_CHECK_EQUAL(conn.locking_mode(), sqxx::LOCKING_NORMAL);
+
+	// Entering WAL mode with an exclusive lock can be undone
+	other.close();
+	conn.journal_mode(sqxx::JOURNAL_DELETE);
+	sqxx::tuning wal;
+	wal.locking_mode = sqxx::LOCKING_EXCLUSIVE;
+	wal.journal_mode = sqxx::JOURNAL_WAL;
+	previous = wal.apply(conn);
+	BOOST_CHECK_EQUAL(conn.journal_mode(), sqxx::JOURNAL_WAL);
+	BOOST_CHECK_EQUAL(conn.locking_mode(), sqxx::LOCKING_EXCLUSIVE);
+	conn.exec("insert into t values (3)");
+	previous.apply(conn);
+	BOOST_CHECK_EQUAL(conn.journal_mode(), sqxx::JOURNAL_DELETE);
+	BOOST_CHECK_EQUAL(conn.locking_mode(), sqxx::LOCKING_NORMAL);
+	other.open(file.filename);
+	other.exec("insert into t values (4)");
+}
+
+BOOST_AUTO_TEST_CASE(query_cache) {
+	tmpdb file;
+	sqxx::connection conn;
+	conn.open(file.filename);
+	conn.exec("create table items (id integer primary key, name text)");
+	conn.exec("create table other (x integer)");
+	conn.exec("insert into items (name) values ('a'), ('b'), (null)");
+
+	std::vector<std::string> tables = conn.read_tables("select name from items join other on id = x");
+	std::sort(tables.begin(), tables.end());
+	BOOST_CHECK(tables == (std::vector<std::string>{"items", "other"}));
+	{
+		std::vector<std::string> prepared_tables;
+		sqxx::statement counted = conn.prepare("select count(*) from other", prepared_tables);
+		counted.run();
+		BOOST_CHECK_EQUAL(counted.val<int>(0), 0);
+		BOOST_CHECK(prepared_tables == std::vector<std::string>{"other"});
+	}
+
+	sqxx::query_cache cache(conn);
+	const char *sql = "select id, name from items where id >= ? order by id";
+	auto rows = cache.query(sql, 1);
+	BOOST_CHECK_EQUAL(rows->row_count(), 3);
+	BOOST_CHECK_EQUAL(rows->col_count(), 2);
+	BOOST_CHECK_EQUAL(rows->col_name(1), "name");
+	BOOST_CHECK_EQUAL(rows->val<std::string>(1, 1), "b");
+	BOOST_CHECK(rows->null(2, 1));
+	BOOST_CHECK(cache.query(sql, 1) == rows);
+	BOOST_CHECK(cache.query(sql, 2) != rows);
+	cache.query("select count(*) from other");
+	sqxx::query_cache_stats st = cache.stats();
+	BOOST_CHECK_EQUAL(st.hits, 1);
+	BOOST_CHECK_EQUAL(st.misses, 3);
+	BOOST_CHECK_EQUAL(st.entries, 3);
+
+	// Writes only drop the results of the changed table
+	conn.exec("insert into items (name) values ('c')");
+	BOOST_CHECK_EQUAL(cache.stats().entries, 1);
+	BOOST_CHECK_EQUAL(cache.query(sql, 1)->row_count(), 4);
+	cache.query("select count(*) from other");
+	BOOST_CHECK_EQUAL(cache.stats().hits, 2);
+
+	// Writes of other connections drop everything
+	{
+		sqxx::connection other;
+		other.open(file.filename);
+		other.exec("insert into other values (1)");
+	}
+	BOOST_CHECK_EQUAL(cache.query("select count(*) from other")->val<int>(0, 0), 1);
+	BOOST_CHECK_EQUAL(cache.stats().hits, 2);
+
+	// Not cached in transactions
+	conn.exec("begin");
+	cache.query("select count(*) from items");
+	conn.exec("commit");
+	BOOST_CHECK_EQUAL(cache.stats().uncached, 1);
+
+	BOOST_CHECK_THROW(cache.query("delete from items"), sqxx::error);
+	BOOST_CHECK_EQUAL(conn.total_changes(), 4);
+
+	// Least recently used results are evicted
+	sqxx::connection conn2;
+	conn2.open(file.filename);
+	sqxx::query_cache_options opts;
+	opts.max_bytes = 2000;
+	opts.max_entry_bytes = 2000;
+	sqxx::query_cache small(conn2, opts);
+	for (int i = 0; i < 20; ++i)
+		small.query(sql, i);
+	st = small.stats();
+	BOOST_CHECK(st.evictions > 0);
+	BOOST_CHECK(st.bytes <= opts.max_bytes);
+	BOOST_CHECK_EQUAL(st.entries + st.evictions, 20);
+}
+
+BOOST_AUTO_TEST_CASE(change_stream) {
+	db ctx;
+	ctx.conn.exec("create table t (x integer)");
+	sqxx::change_stream_options opts;
+	opts.capacity = 100;
+	sqxx::change_stream changes(ctx.conn, opts);
+	BOOST_CHECK_EQUAL(changes.stats().capacity, 128);
+
+	ctx.conn.exec("begin");
+	ctx.conn.exec("insert into t values (1)");
+	ctx.conn.exec("update t set x = 2");
+	BOOST_CHECK_EQUAL(changes.size(), 0);
+	ctx.conn.exec("commit");
+	std::vector<sqxx::change_event> events = changes.drain(10);
+	BOOST_REQUIRE_EQUAL(events.size(), 2);
+	BOOST_CHECK_EQUAL(events[0].op, SQLITE_INSERT);
+	BOOST_CHECK_EQUAL(events[1].op, SQLITE_UPDATE);
+	BOOST_CHECK_EQUAL(events[1].table, "t");
+	BOOST_CHECK_EQUAL(events[1].db, "main");
+	BOOST_CHECK_EQUAL(events[1].rowid, 1);
+	BOOST_CHECK_EQUAL(events[1].transaction, 1);
+
+	ctx.conn.exec("begin");
+	ctx.conn.exec("delete from t where x = 2");
+	ctx.conn.exec("rollback");
+	BOOST_CHECK_EQUAL(changes.size(), 0);
+
+	// Events that don't fit are dropped
+	ctx.conn.exec("with recursive n(i) as (select 1 union all select i + 1 from n where i < 200) "
+			"insert into t select i from n");
+	sqxx::change_stream_stats st = changes.stats();
+	BOOST_CHECK_EQUAL(st.size, 128);
+	BOOST_CHECK_EQUAL(st.high_water, 128);
+	BOOST_CHECK_EQUAL(st.dropped, 72);
+	BOOST_CHECK_EQUAL(st.discarded, 1);
+	BOOST_CHECK_EQUAL(st.commits, 2);
+	BOOST_CHECK_EQUAL(st.rollbacks, 1);
+
+	// Several consumers
+	std::atomic<size_t> total(0);
+	std::vector<std::thread> consumers;
+	for (int i = 0; i < 4; ++i) {
+		consumers.emplace_back([&] {
+			sqxx::change_event batch[16];
+			size_t n;
+			while ((n = changes.drain(batch, 16)) > 0)
+				total += n;
+		});
+	}
+	for (std::thread &t : consumers)
+		t.join();
+	BOOST_CHECK_EQUAL(total, 128);
+	BOOST_CHECK_EQUAL(changes.stats().consumed, 130);
+}
+
+BOOST_AUTO_TEST_CASE(change_watcher) {
+	tmpdb file;
+	sqxx::connection conn;
+	conn.open(file.filename);
+	conn.journal_mode(sqxx::JOURNAL_WAL);
+	conn.exec("create table t (x integer)");
+
+	std::mutex mutex;
+	std::condition_variable cond;
+	int polled = 0, notified = 0;
+	auto wait_for = [&](int &count) {
+		std::unique_lock<std::mutex> lock(mutex);
+		return cond.wait_for(lock, std::chrono::seconds(10), [&] { return count > 0; });
+	};
+
+	sqxx::change_watcher_options polling;
+	polling.interval = std::chrono::milliseconds(10);
+	polling.use_inotify = false;
+	sqxx::change_watcher poller(file.filename, polling);
+	BOOST_CHECK(!poller.inotify());
+	BOOST_CHECK(!poller.check());
+	poller.set_change_handler([&] {
+		std::lock_guard<std::mutex> lock(mutex);
+		++polled;
+		cond.notify_all();
+	});
+
+	// Only inotify can detect the change in time
+	sqxx::change_watcher_options events;
+	events.interval = std::chrono::hours(1);
+	sqxx::change_watcher watcher(file.filename, events);
+	watcher.set_change_handler([&] {
+		std::lock_guard<std::mutex> lock(mutex);
+		++notified;
+		cond.notify_all();
+	});
+
+	conn.exec("insert into t values (1)");
+	BOOST_CHECK(wait_for(polled));
+	if (watcher.inotify()) {
+		BOOST_CHECK(wait_for(notified));
+		BOOST_CHECK(watcher.stats().events > 0);
+	}
+	poller.set_change_handler();
+	sqxx::change_watcher_stats st = poller.stats();
+	BOOST_CHECK(st.checks > 0);
+	BOOST_CHECK(st.changes >= 1);
+	BOOST_CHECK_EQUAL(st.failed, 0);
+}
+
+BOOST_AUTO_TEST_CASE(session) {
+	tmpdb edge_file, central_file;
+	sqxx::connection edge, central;
+	edge.open(edge_file.filename);
+	central.open(central_file.filename);
+	for (sqxx::connection *c : {&edge, &central}) {
+		c->exec("create table items (id integer primary key, name text)");
+		c->exec("insert into items values (1, 'a'), (2, 'b')");
+	}
+#if defined(SQLITE_ENABLE_SESSION) && defined(SQLITE_ENABLE_PREUPDATE_HOOK)
+	// Sessions and preupdate handlers can't share the preupdate hook
+	edge.set_preupdate_handler([](const sqxx::preupdate&) {});
+	BOOST_CHECK_THROW(sqxx::session{edge}, sqxx::error);
+	edge.set_preupdate_handler();
+
+	sqxx::session s(edge);
+	BOOST_CHECK_THROW(edge.set_preupdate_handler([](const sqxx::preupdate&) {}), sqxx::error);
+	edge.set_preupdate_handler();
+	s.attach();
+	BOOST_CHECK(s.empty());
+	edge.exec("insert into items values (3, 'c')");
+	edge.exec("update items set name = 'x' where id = 1");
+	central.exec("insert into items values (3, 'other')");
+
+	sqxx::changeset cs = s.changes();
+	BOOST_CHECK(!cs.empty());
+	int conflicts = 0;
+	sqxx::apply_changeset(central, cs, [&](const sqxx::changeset_conflict &c) {
+		++conflicts;
+		BOOST_CHECK_EQUAL(c.type, sqxx::CHANGESET_CONFLICT);
+		BOOST_CHECK_EQUAL(c.table(), "items");
+		BOOST_CHECK_EQUAL(c.op(), SQLITE_INSERT);
+		BOOST_CHECK_EQUAL(c.conflict_value(1).val<std::string>(), "other");
+		BOOST_CHECK_EQUAL(c.new_value(1).val<std::string>(), "c");
+		return sqxx::CHANGESET_REPLACE;
+	});
+	BOOST_CHECK_EQUAL(conflicts, 1);
+	sqxx::statement names = central.prepare("select group_concat(name) from items");
+	names.run();
+	BOOST_CHECK_EQUAL(names.val<std::string>(0), "x,b,c");
+
+	// Without handler conflicts abort the whole changeset
+	BOOST_CHECK_THROW(sqxx::apply_changeset(central, cs), sqxx::error);
+
+	// Streamed through a buffer in small pieces
+	std::string stream;
+	s.changes([&](const void *data, int n) { stream.append(static_cast<const char*>(data), n); });
+	BOOST_CHECK_EQUAL(stream.size(), cs.size());
+	size_t pos = 0;
+	auto input = [&](void *data, int n) {
+		int len = static_cast<int>(std::min<size_t>(std::min(n, 7), stream.size() - pos));
+		std::memcpy(data, stream.data() + pos, len);
+		pos += len;
+		return len;
+	};
+	auto items = [](sqxx::connection &c) {
+		sqxx::statement st = c.prepare("select group_concat(name) from items");
+		st.run();
+		return st.val<std::string>(0);
+	};
+	auto fresh = [](sqxx::connection &c) {
+		c.open(":memory:");
+		c.exec("create table items (id integer primary key, name text)");
+		c.exec("insert into items values (1, 'a'), (2, 'b')");
+	};
+	sqxx::connection copy;
+	fresh(copy);
+	sqxx::apply_changeset(copy, input);
+	BOOST_CHECK_EQUAL(items(copy), "x,b,c");
+
+	// Later changes combined with the earlier ones
+	sqxx::session later(edge);
+	later.attach("items");
+	edge.exec("delete from items where id = 2");
+	sqxx::changegroup group;
+	group.add(cs);
+	group.add(later.changes());
+	sqxx::changeset combined = group.output();
+	sqxx::connection copy2;
+	fresh(copy2);
+	sqxx::apply_changeset(copy2, combined);
+	BOOST_CHECK_EQUAL(items(copy2), "x,c");
+	sqxx::apply_changeset(copy2, combined.invert());
+	BOOST_CHECK_EQUAL(items(copy2), "a,b");
+
+	// Exceptions of stream functions are passed on
+	BOOST_CHECK_THROW(s.changes([](const void*, int) { throw std::runtime_error("full"); }), std::runtime_error);
+
+	// If the filter throws, changes to tables applied before are undone
+	sqxx::connection src, dst;
+	for (sqxx::connection *c : {&src, &dst}) {
+		c->open(":memory:");
+		c->exec("create table t1 (id integer primary key)");
+		c->exec("create table t2 (id integer primary key)");
+	}
+	sqxx::session both(src);
+	both.attach();
+	src.exec("insert into t1 values (1)");
+	src.exec("insert into t2 values (1)");
+	BOOST_CHECK_THROW(sqxx::apply_changeset(dst, both.changes(), sqxx::conflict_handler_t(),
+			[](const char *table) -> bool {
+				if (std::strcmp(table, "t2") == 0)
+					throw std::runtime_error("filter");
+				return true;
+			}), std::runtime_error);
+	sqxx::statement t1 = dst.prepare("select count(*) from t1");
+	t1.run();
+	BOOST_CHECK_EQUAL(t1.val<int>(0), 0);
+#else
+	BOOST_CHECK_THROW(sqxx::session s(edge), sqxx::error);
+#endif
+}
+
+BOOST_AUTO_TEST_CASE(unlock_notify) {
+	const char *uri = "file:sqxx_unlock_test?mode=memory&cache=shared";
+	int flags = sqxx::OPEN_URI | sqxx::OPEN_READWRITE | sqxx::OPEN_CREATE | sqxx::OPEN_SHAREDCACHE;
+	sqxx::connection writer, reader;
+	writer.open(uri, flags);
+	reader.open(uri, flags);
+	writer.exec("create table t (x integer)");
+	writer.exec("begin");
+	writer.exec("insert into t values (1)");
+
+	sqxx::statement st = reader.prepare("select count(*) from t");
+	BOOST_CHECK_EQUAL(sqxx::primary_code(st.try_step()), sqxx::LOCKED);
+	st.reset();
+
+#if defined(SQLITE_ENABLE_UNLOCK_NOTIFY)
+	// The handler is called once the blocking transaction finishes
+	bool notified = false;
+	reader.set_unlock_handler([&] { notified = true; });
+	BOOST_CHECK(!notified);
+	writer.exec("commit");
+	BOOST_CHECK(notified);
+
+	writer.exec("begin");
+	writer.exec("insert into t values (2)");
+
+	// The committer waits until the first step of step_blocking() failed,
+	// which the profile handler reports. If the commit then happens before
+	// the reader registered its notification, sqlite calls it right away,
+	// so the reader waits exactly once either way.
+	std::mutex mutex;
+	std::condition_variable cond;
+	bool failed = false;
+	reader.set_profile_handler([&](const char*, uint64_t) {
+		std::lock_guard<std::mutex> lock(mutex);
+		failed = true;
+		cond.notify_all();
+	});
+	std::thread committer([&] {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			cond.wait(lock, [&] { return failed; });
+		}
+		writer.exec("commit");
+	});
+	st.step_blocking();
+	committer.join();
+	reader.set_profile_handler();
+	BOOST_CHECK_EQUAL(st.val<int>(0), 2);
+
+	sqxx::unlock_stats stats = reader.unlock_stats();
+	BOOST_CHECK_EQUAL(stats.waits, 1);
+	BOOST_CHECK_EQUAL(stats.deadlocks, 0);
+	BOOST_CHECK(stats.wait_ns > 0);
+	BOOST_CHECK_EQUAL(stats.max_wait_ns, stats.wait_ns);
+#else
+	BOOST_CHECK_THROW(reader.set_unlock_handler([] {}), sqxx::error);
+	BOOST_CHECK_THROW(reader.wait_for_unlock(), sqxx::error);
+	BOOST_CHECK_THROW(st.step_blocking(), sqxx::error);
+	writer.exec("commit");
+#endif
+}
+
 BOOST_AUTO_TEST_CASE(authorize_handler) {
 	tab ctx;
 	bool called = false;
@@ -0,0 +1,166 @@
+
+#include "sqxx.hpp"
+#include "vfs.hpp"
+#include "vfs_direct.hpp"
+#include "vfs_readahead.hpp"
+#include "vfs_uring.hpp"
+
+#include "setup.hpp"
+
+#include <boost/test/unit_test.hpp>
+
+namespace {
+
+// Writes and modifies rows through `vfs`, checks that a second connection
+// using the default VFS sees committed data and that the file is intact when
+// read back. A `page_size` of 0 keeps sqlite's default.
+void check_roundtrip(const char *vfs, const char *journal_mode, const char *synchronous = "full",
+		int page_size = 0) {
+	tmpdb file;
+	{
+		sqxx::connection conn(file.filename, sqxx::OPEN_READWRITE|sqxx::OPEN_CREATE, vfs);
+		sqxx::connection reader(file.filename);
+		if (page_size)
+			conn.exec("pragma page_size = " + std::to_string(page_size));
+		conn.exec(std::string("pragma journal_mode = ") + journal_mode);
+		conn.exec(std::string("pragma synchronous = ") + synchronous);
+		conn.exec("create table items (id integer primary key, v blob)");
+		conn.exec("create index items_v on items (v)");
+
+		for (int tx = 0; tx < 10; ++tx) {
+			conn.exec("begin");
+			auto st = conn.prepare("insert into items (v) values (randomblob(1000))");
+			for (int i = 0; i < 50; ++i) {
+				st.run();
+				st.reset();
+			}
+			conn.exec("commit");
+			BOOST_CHECK_EQUAL(reader.query("select count(*) from items").val<int>(0), (tx+1) * 50);
+		}
+		conn.exec("update items set v = randomblob(500) where id % 3 = 0");
+		conn.exec("delete from items where id % 7 = 0");
+		BOOST_CHECK_EQUAL(conn.query("select count(*) from items").val<int>(0), 500 - 500/7);
+		BOOST_CHECK_EQUAL(reader.query("select count(*) from items").val<int>(0), 500 - 500/7);
+	}
+
+	sqxx::connection check(file.filename);
+	BOOST_CHECK_EQUAL(check.query("pragma integrity_check").val<std::string>(0), "ok");
+	BOOST_CHECK_EQUAL(check.query("select count(*) from items").val<int>(0), 500 - 500/7);
+}
+
+} // anonymous namespace
+
+BOOST_AUTO_TEST_SUITE(sqxx_vfs)
+
+BOOST_AUTO_TEST_CASE(vfs_find) {
+	BOOST_CHECK(sqxx::vfs_find() != nullptr);
+	BOOST_CHECK(sqxx::vfs_find("sqxx-no-such-vfs") == nullptr);
+}
+
+BOOST_AUTO_TEST_CASE(vfs_uring) {
+	sqxx::vfs_uring_options opts;
+	// Small enough to also exercise flushes between syncs
+	opts.max_pending = 64 * 1024;
+	opts.readahead = 256 * 1024;
+	sqxx::vfs_uring_register("sqxx-test-uring", false, opts);
+	BOOST_CHECK(sqxx::vfs_find("sqxx-test-uring") != nullptr);
+	BOOST_CHECK_THROW(sqxx::vfs_uring_register("sqxx-test-uring"), sqxx::error);
+
+	check_roundtrip("sqxx-test-uring", "wal");
+	// Without syncs on commit the frames have to be written before the
+	// wal-index refers to them
+	check_roundtrip("sqxx-test-uring", "wal", "normal");
+	check_roundtrip("sqxx-test-uring", "delete");
+
+	sqxx::vfs_uring_unregister("sqxx-test-uring");
+	BOOST_CHECK(sqxx::vfs_find("sqxx-test-uring") == nullptr);
+}
+
+BOOST_AUTO_TEST_CASE(vfs_direct) {
+	sqxx::vfs_direct_options opts;
+	opts.pool_buffers = 2;
+	sqxx::vfs_direct_register("sqxx-test-direct", false, opts);
+	BOOST_CHECK(sqxx::vfs_find("sqxx-test-direct") != nullptr);
+	BOOST_CHECK_THROW(sqxx::vfs_direct_register("sqxx-test-direct"), sqxx::error);
+
+	check_roundtrip("sqxx-test-direct", "wal");
+	check_roundtrip("sqxx-test-direct", "delete");
+	// Pages smaller than the alignment go through bounce buffers
+	check_roundtrip("sqxx-test-direct", "delete", "full", 1024);
+
+	sqxx::vfs_direct_unregister("sqxx-test-direct");
+	BOOST_CHECK(sqxx::vfs_find("sqxx-test-direct") == nullptr);
+
+	opts.alignment = 1000;
+	BOOST_CHECK_THROW(sqxx::vfs_direct_register("sqxx-test-direct", false, opts), sqxx::error);
+}
+
+BOOST_AUTO_TEST_CASE(vfs_readahead) {
+	sqxx::vfs_readahead_options opts;
+	opts.window = 64 * 1024;
+	opts.trigger = 1;
+	sqxx::vfs_readahead_register("sqxx-test-readahead", false, opts);
+	BOOST_CHECK(sqxx::vfs_find("sqxx-test-readahead") != nullptr);
+
+	check_roundtrip("sqxx-test-readahead", "wal");
+	check_roundtrip("sqxx-test-readahead", "delete");
+
+	sqxx::vfs_readahead_unregister("sqxx-test-readahead");
+	BOOST_CHECK(sqxx::vfs_find("sqxx-test-readahead") == nullptr);
+	BOOST_CHECK_THROW(sqxx::vfs_readahead_stats("sqxx-test-readahead"), sqxx::error);
+}
+
+BOOST_AUTO_TEST_CASE(vfs_readahead_pattern) {
+	sqxx::vfs_readahead_options opts;
+	opts.window = 256 * 1024;
+	sqxx::vfs_readahead_register("sqxx-test-readahead", false, opts);
+
+	const int rows = 5000;
+	tmpdb file;
+	{
+		sqxx::connection conn(file.filename, sqxx::OPEN_READWRITE|sqxx::OPEN_CREATE);
+		conn.exec("create table items (id integer primary key, v blob)");
+		conn.exec("begin");
+		auto st = conn.prepare("insert into items (v) values (randomblob(1000))");
+		for (int i = 0; i < rows; ++i) {
+			st.run();
+			st.reset();
+		}
+		conn.exec("commit");
+	}
+
+	// Point lookups jump backwards through the file, which never looks like
+	// a sequential scan
+	sqxx::vfs_readahead_statistics before = sqxx::vfs_readahead_stats("sqxx-test-readahead");
+	{
+		sqxx::connection conn(file.filename, sqxx::OPEN_READONLY, "sqxx-test-readahead");
+		auto st = conn.prepare("select length(v) from items where id = ?");
+		for (int id = rows; id > 0; id -= rows / 50) {
+			st.bind(0, id);
+			st.run();
+			BOOST_CHECK_EQUAL(st.val<int>(0), 1000);
+			st.reset();
+		}
+	}
+	sqxx::vfs_readahead_statistics lookups = sqxx::vfs_readahead_stats("sqxx-test-readahead");
+#if defined(__unix__)
+	BOOST_CHECK(lookups.reads > before.reads);
+#endif
+	BOOST_CHECK_EQUAL(lookups.readaheads, before.readaheads);
+
+	// A full table scan reads the leaf pages in order
+	{
+		sqxx::connection conn(file.filename, sqxx::OPEN_READONLY, "sqxx-test-readahead");
+		BOOST_CHECK_EQUAL(conn.query("select sum(length(v)) from items").val<int>(0), rows * 1000);
+	}
+	sqxx::vfs_readahead_statistics scan = sqxx::vfs_readahead_stats("sqxx-test-readahead");
+#if defined(__unix__)
+	BOOST_CHECK(scan.sequential_reads - lookups.sequential_reads > rows / 8);
+	BOOST_CHECK(scan.readaheads > lookups.readaheads);
+	BOOST_CHECK(scan.readahead_bytes - lookups.readahead_bytes >= opts.window);
+#endif
+
+	sqxx::vfs_readahead_unregister("sqxx-test-readahead");
+}
+
+BOOST_AUTO_TEST_SUITE_END()
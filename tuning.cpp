@@ -0,0 +1,168 @@
+
+#include "tuning.hpp"
+#include "error.hpp"
+#include <sqlite3.h>
+
+namespace sqxx {
+
+namespace {
+
+const int64_t mib = 1024 * 1024;
+
+// Negative cache sizes are in KiB
+int64_t cache_mib(int64_t n) {
+	return -n * 1024;
+}
+
+} // anonymous namespace
+
+tuning tuning::preset(const std::string &name) {
+	tuning t;
+	if (name == "oltp-wal") {
+		t.locking_mode = LOCKING_NORMAL;
+		t.journal_mode = JOURNAL_WAL;
+		t.synchronous = SYNC_NORMAL;
+		t.cache_size = cache_mib(64);
+		t.mmap_size = 256 * mib;
+		t.temp_store = TEMP_STORE_MEMORY;
+		t.busy_timeout = 5000;
+	}
+	else if (name == "bulk-load") {
+		t.locking_mode = LOCKING_EXCLUSIVE;
+		t.journal_mode = JOURNAL_MEMORY;
+		t.synchronous = SYNC_OFF;
+		t.cache_size = cache_mib(256);
+		t.temp_store = TEMP_STORE_MEMORY;
+	}
+	else if (name == "read-only-analytics") {
+		t.cache_size = cache_mib(256);
+		t.mmap_size = 1024 * mib;
+		t.temp_store = TEMP_STORE_MEMORY;
+		t.busy_timeout = 5000;
+	}
+	else {
+		throw error(SQLITE_ERROR, "unknown tuning preset: " + name);
+	}
+	return t;
+}
+
+std::vector<std::string> tuning::presets() {
+	return {"oltp-wal", "bulk-load", "read-only-analytics"};
+}
+
+tuning tuning::current(connection &conn) const {
+	tuning t;
+	if (locking_mode)
+		t.locking_mode = conn.locking_mode();
+	if (journal_mode)
+		t.journal_mode = conn.journal_mode();
+	if (synchronous)
+		t.synchronous = conn.synchronous();
+	if (cache_size)
+		t.cache_size = conn.cache_size();
+	if (mmap_size)
+		t.mmap_size = conn.mmap_size();
+	if (temp_store)
+		t.temp_store = conn.temp_store();
+	if (wal_autocheckpoint)
+		t.wal_autocheckpoint = conn.wal_autocheckpoint();
+	if (busy_timeout)
+		t.busy_timeout = conn.busy_timeout();
+	return t;
+}
+
+tuning tuning::apply(connection &conn) const {
+	tuning previous = current(conn);
+	// Previous values of the settings applied so far
+	tuning applied;
+	try {
+		// A database in WAL mode that is locked exclusively can't return to
+		// normal locking before leaving WAL mode. So when leaving WAL mode
+		// the journal mode goes first, otherwise the locking mode does, so
+		// that entering WAL mode with an exclusive lock doesn't need shared
+		// memory.
+		bool leaving_wal = journal_mode && journal_mode.value != JOURNAL_WAL &&
+				previous.journal_mode.value == JOURNAL_WAL;
+		if (journal_mode && leaving_wal) {
+			conn.journal_mode(journal_mode.value);
+			applied.journal_mode = previous.journal_mode.value;
+		}
+		if (locking_mode) {
+			conn.locking_mode(locking_mode.value);
+			applied.locking_mode = previous.locking_mode.value;
+			// An exclusive lock is only released with the next access of
+			// the database
+			if (locking_mode.value == LOCKING_NORMAL && previous.locking_mode.value != LOCKING_NORMAL)
+				conn.exec("pragma schema_version");
+		}
+		if (journal_mode && !leaving_wal) {
+			conn.journal_mode(journal_mode.value);
+			applied.journal_mode = previous.journal_mode.value;
+		}
+		if (synchronous) {
+			conn.synchronous(synchronous.value);
+			applied.synchronous = previous.synchronous.value;
+		}
+		if (cache_size) {
+			conn.cache_size(cache_size.value);
+			applied.cache_size = previous.cache_size.value;
+		}
+		if (mmap_size) {
+			conn.mmap_size(mmap_size.value);
+			applied.mmap_size = previous.mmap_size.value;
+		}
+		if (temp_store) {
+			conn.temp_store(temp_store.value);
+			applied.temp_store = previous.temp_store.value;
+		}
+		if (wal_autocheckpoint) {
+			conn.wal_autocheckpoint(wal_autocheckpoint.value);
+			applied.wal_autocheckpoint = previous.wal_autocheckpoint.value;
+		}
+		if (busy_timeout) {
+			conn.busy_timeout(busy_timeout.value);
+			applied.busy_timeout = previous.busy_timeout.value;
+		}
+	}
+	catch (...) {
+		try {
+			applied.apply(conn);
+		}
+		catch (...) {
+			// Report the original error
+		}
+		throw;
+	}
+	return previous;
+}
+
+
+// ---------------------------------------------------------------------------
+// scoped_tuning
+
+scoped_tuning::scoped_tuning(connection &conn_arg, const tuning &t)
+	: conn(conn_arg), previous(t.apply(conn_arg)), active(true) {
+}
+
+scoped_tuning::scoped_tuning(connection &conn_arg, const std::string &preset)
+	: scoped_tuning(conn_arg, tuning::preset(preset)) {
+}
+
+scoped_tuning::~scoped_tuning() {
+	try {
+		restore();
+	}
+	catch (...) {
+		handle_callback_exception("scoped_tuning destructor");
+	}
+}
+
+void scoped_tuning::restore() {
+	if (active) {
+		active = false;
+		previous.apply(conn);
+	}
+}
+
+} // namespace sqxx
+
@@ -0,0 +1,106 @@
+
+#if !defined(SQXX_TUNING_HPP_INCLUDED)
+#define SQXX_TUNING_HPP_INCLUDED
+
+#include "connection.hpp"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace sqxx {
+
+/** A setting of a `tuning`, only applied if it was assigned a value */
+template<typename T>
+struct tuning_value {
+	bool set = false;
+	T value = T();
+
+	tuning_value& operator=(T value_arg) {
+		set = true;
+		value = value_arg;
+		return *this;
+	}
+	explicit operator bool() const { return set; }
+};
+
+/**
+ * A set of pragma settings that are applied to a connection together.
+ *
+ * Settings that were not assigned are left unchanged. `apply()` returns the
+ * previous values of the changed settings, so they can be restored later:
+ *
+ *     sqxx::tuning previous = sqxx::tuning::preset("bulk-load").apply(conn);
+ *     // ... insert lots of data
+ *     previous.apply(conn);
+ *
+ * `scoped_tuning` does the same for a scope, so that the settings are also
+ * restored when an exception is thrown.
+ */
+struct tuning {
+	tuning_value<journal_mode_t> journal_mode;
+	tuning_value<synchronous_t> synchronous;
+	tuning_value<int64_t> cache_size;
+	tuning_value<int64_t> mmap_size;
+	tuning_value<temp_store_t> temp_store;
+	tuning_value<locking_mode_t> locking_mode;
+	tuning_value<int> wal_autocheckpoint;
+	tuning_value<int> busy_timeout;
+
+	/**
+	 * Named presets:
+	 *
+	 * - `"oltp-wal"`: Many short transactions with concurrent readers. WAL
+	 *   with `SYNC_NORMAL`, a 64 MiB cache, 256 MiB memory mapping and a
+	 *   5 second busy timeout.
+	 * - `"bulk-load"`: Loading lots of data with no other connections. An
+	 *   exclusive lock, in-memory journal, no syncs and a 256 MiB cache. A
+	 *   crash during the load can corrupt the database.
+	 * - `"read-only-analytics"`: Large scans and sorts. A 256 MiB cache,
+	 *   1 GiB memory mapping and temporary tables in memory.
+	 *
+	 * Throws an error for unknown names.
+	 */
+	static tuning preset(const std::string &name);
+	/** Names of the available presets */
+	static std::vector<std::string> presets();
+
+	/** The current values on `conn` of all settings assigned in this tuning */
+	tuning current(connection &conn) const;
+
+	/**
+	 * Applies the assigned settings to `conn` and returns their previous
+	 * values. Must not be called within a transaction.
+	 *
+	 * If applying a setting fails, the ones applied before are restored
+	 * and the error is rethrown.
+	 */
+	tuning apply(connection &conn) const;
+};
+
+/** Applies a tuning and restores the previous settings at the end of the scope */
+class scoped_tuning {
+private:
+	connection &conn;
+	tuning previous;
+	bool active;
+
+public:
+	scoped_tuning(connection &conn, const tuning &t);
+	scoped_tuning(connection &conn, const std::string &preset);
+	/**
+	 * Restores the previous settings if `restore()` wasn't called. Errors
+	 * are reported to the callback exception handler (see error.hpp).
+	 */
+	~scoped_tuning();
+
+	scoped_tuning(const scoped_tuning&) = delete;
+	scoped_tuning& operator=(const scoped_tuning&) = delete;
+
+	/** Restore the previous settings now, throws on errors */
+	void restore();
+};
+
+} // namespace sqxx
+
+#endif // SQXX_TUNING_HPP_INCLUDED
+
@@ -6,7 +6,11 @@
 
 #include "datatypes.hpp"
 
+#if defined(SQXX_HEADER_ONLY)
+#include <sqlite3.h>
+#else
 typedef struct Mem sqlite3_value;
+#endif
 
 namespace sqxx {
 
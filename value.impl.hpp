@@ -8,6 +8,10 @@
 #error "Don't include value.impl.hpp directly, include value.hpp instead"
 #endif
 
+#if defined(SQXX_HEADER_ONLY)
+#include "value.inline.hpp"
+#else
+
 namespace sqxx {
 
 /** sqlite3_value_int() */
@@ -34,5 +38,7 @@ blob value::val<blob>() const;
 
 } // namespace sqxx
 
+#endif
+
 #endif // SQXX_VALUE_IMPL_HPP_INCLUDED
 
@@ -0,0 +1,58 @@
+
+// Typed access to a value, called for every argument of a SQL function.
+//
+// Compiled into the library by value.cpp, or, if SQXX_HEADER_ONLY is
+// defined, included by value.hpp so that it can be inlined.
+
+#if !defined(SQXX_VALUE_INLINE_HPP_INCLUDED)
+#define SQXX_VALUE_INLINE_HPP_INCLUDED
+
+#if !defined(SQXX_VALUE_HPP_INCLUDED)
+#error "Don't include value.inline.hpp directly, include value.hpp instead"
+#endif
+
+#include <sqlite3.h>
+
+namespace sqxx {
+
+template<>
+SQXX_INLINE int value::val<int>() const {
+	return sqlite3_value_int(handle);
+}
+
+template<>
+SQXX_INLINE int64_t value::val<int64_t>() const {
+	return sqlite3_value_int64(handle);
+}
+
+template<>
+SQXX_INLINE double value::val<double>() const {
+	return sqlite3_value_double(handle);
+}
+
+template<>
+SQXX_INLINE const char* value::val<const char*>() const {
+	const unsigned char *text = sqlite3_value_text(handle);
+	return reinterpret_cast<const char*>(text);
+}
+
+template<>
+SQXX_INLINE std::string value::val<std::string>() const {
+	// Correct order to call functions according to http://www.sqlite.org/c3ref/column_blob.html
+	const unsigned char *text = sqlite3_value_text(handle);
+	int bytes = sqlite3_value_bytes(handle);
+	return std::string(reinterpret_cast<const char*>(text), bytes);
+}
+
+template<>
+SQXX_INLINE blob value::val<blob>() const {
+	// Correct order to call functions according to http://www.sqlite.org/c3ref/column_blob.html
+	const void *data = sqlite3_value_blob(handle);
+	int len = sqlite3_value_bytes(handle);
+	return blob(data, len);
+}
+
+} // namespace sqxx
+
+#endif // SQXX_VALUE_INLINE_HPP_INCLUDED
+
@@ -0,0 +1,28 @@
+
+#include "vfs.hpp"
+#include "error.hpp"
+#include <sqlite3.h>
+
+namespace sqxx {
+
+sqlite3_vfs* vfs_find(const char *name) {
+	return sqlite3_vfs_find(name);
+}
+
+sqlite3_vfs* vfs_find(const std::string &name) {
+	return vfs_find(name.c_str());
+}
+
+void vfs_register(sqlite3_vfs *vfs, bool makedefault) {
+	int rv = sqlite3_vfs_register(vfs, makedefault);
+	if (rv != SQLITE_OK)
+		throw static_error(rv);
+}
+
+void vfs_unregister(sqlite3_vfs *vfs) {
+	int rv = sqlite3_vfs_unregister(vfs);
+	if (rv != SQLITE_OK)
+		throw static_error(rv);
+}
+
+} // namespace sqxx
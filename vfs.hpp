@@ -0,0 +1,40 @@
+
+#if !defined(SQXX_VFS_HPP_INCLUDED)
+#define SQXX_VFS_HPP_INCLUDED
+
+#include <string>
+
+struct sqlite3_vfs;
+
+namespace sqxx {
+
+/**
+ * Find a registered virtual file system by name.
+ *
+ * Without a name (or with `nullptr`) the default VFS is returned. Returns
+ * `nullptr` if no VFS with the given name is registered.
+ *
+ * Wraps [`sqlite3_vfs_find()`](http://www.sqlite.org/c3ref/vfs_find.html)
+ */
+sqlite3_vfs* vfs_find(const char *name = nullptr);
+sqlite3_vfs* vfs_find(const std::string &name);
+
+/**
+ * Register a virtual file system.
+ *
+ * The `sqlite3_vfs` object has to stay alive until it is unregistered again.
+ *
+ * Wraps [`sqlite3_vfs_register()`](http://www.sqlite.org/c3ref/vfs_find.html)
+ */
+void vfs_register(sqlite3_vfs *vfs, bool makedefault = false);
+
+/**
+ * Unregister a virtual file system.
+ *
+ * Wraps [`sqlite3_vfs_unregister()`](http://www.sqlite.org/c3ref/vfs_find.html)
+ */
+void vfs_unregister(sqlite3_vfs *vfs);
+
+} // namespace sqxx
+
+#endif // SQXX_VFS_HPP_INCLUDED
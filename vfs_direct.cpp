@@ -0,0 +1,342 @@
+
+#include "vfs_direct.hpp"
+#include "vfs_shim.hpp"
+#include "error.hpp"
+#include "datatypes.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+
+#if defined(__linux__)
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace sqxx {
+namespace detail {
+
+// Aligned buffers for direct I/O, shared by all files of a VFS. Idle
+// buffers are kept for reuse, up to a limit.
+class aligned_pool {
+private:
+	size_t alignment;
+	size_t max_idle;
+	std::mutex mutex;
+	std::multimap<size_t, void*> idle;
+
+public:
+	aligned_pool(size_t alignment_arg, size_t max_idle_arg)
+		: alignment(alignment_arg), max_idle(max_idle_arg) {
+	}
+	~aligned_pool();
+
+	aligned_pool(const aligned_pool&) = delete;
+	aligned_pool& operator=(const aligned_pool&) = delete;
+
+	// Returns nullptr if no memory is available
+	void* get(size_t size);
+	void put(void *buf, size_t size);
+};
+
+aligned_pool::~aligned_pool() {
+	for (auto &b : idle) {
+		std::free(b.second);
+	}
+}
+
+void* aligned_pool::get(size_t size) {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		auto it = idle.find(size);
+		if (it != idle.end()) {
+			void *buf = it->second;
+			idle.erase(it);
+			return buf;
+		}
+	}
+	void *buf = nullptr;
+	if (posix_memalign(&buf, alignment, size) != 0)
+		return nullptr;
+	return buf;
+}
+
+void aligned_pool::put(void *buf, size_t size) {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (idle.size() < max_idle) {
+			idle.emplace(size, buf);
+			return;
+		}
+	}
+	std::free(buf);
+}
+
+// A buffer borrowed from the pool for the duration of one I/O operation
+class pooled_buffer {
+private:
+	aligned_pool &pool;
+	size_t size;
+public:
+	char *data;
+
+	pooled_buffer(aligned_pool &pool_arg, size_t size_arg)
+		: pool(pool_arg), size(size_arg), data(static_cast<char*>(pool.get(size))) {
+	}
+	~pooled_buffer() {
+		if (data)
+			pool.put(data, size);
+	}
+	pooled_buffer(const pooled_buffer&) = delete;
+	pooled_buffer& operator=(const pooled_buffer&) = delete;
+};
+
+struct direct_vfs : shim_vfs {
+	vfs_direct_options opts;
+	aligned_pool pool;
+
+	explicit direct_vfs(const vfs_direct_options &opts_arg)
+		: opts(opts_arg), pool(opts.alignment, opts.pool_buffers) {
+	}
+};
+
+struct direct_file {
+	shim_file shim;
+	int fd;
+};
+
+inline direct_file* direct_file_of(sqlite3_file *f) {
+	return reinterpret_cast<direct_file*>(f);
+}
+
+inline direct_vfs* direct_vfs_of(sqlite3_file *f) {
+	return static_cast<direct_vfs*>(direct_file_of(f)->shim.shim);
+}
+
+#if defined(__linux__)
+
+// Reads up to `len` bytes, stopping early only at the end of the file.
+// Returns the number of bytes read or -1.
+ssize_t direct_pread(int fd, char *buf, size_t len, off_t ofs, size_t alignment) {
+	size_t done = 0;
+	while (done < len) {
+		ssize_t n = pread(fd, buf + done, len - done, ofs + done);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		done += n;
+		// A partial block means end of file
+		if (n == 0 || done % alignment != 0)
+			break;
+	}
+	return static_cast<ssize_t>(done);
+}
+
+bool direct_pwrite(int fd, const char *buf, size_t len, off_t ofs, size_t alignment) {
+	size_t done = 0;
+	while (done < len) {
+		ssize_t n = pwrite(fd, buf + done, len - done, ofs + done);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+		done += n;
+		if (n == 0 || done % alignment != 0)
+			return (done == len);
+	}
+	return true;
+}
+
+#endif // __linux__
+
+} // namespace detail
+} // namespace sqxx
+
+#if defined(__linux__)
+
+using sqxx::detail::direct_file_of;
+using sqxx::detail::direct_vfs_of;
+
+namespace {
+
+inline bool is_aligned(const void *buf, int amt, sqlite3_int64 ofs, size_t alignment) {
+	return (reinterpret_cast<uintptr_t>(buf) % alignment == 0 &&
+			static_cast<size_t>(amt) % alignment == 0 &&
+			static_cast<uint64_t>(ofs) % alignment == 0);
+}
+
+} // anonymous namespace
+
+extern "C"
+int sqxx_direct_close(sqlite3_file *f) {
+	// The unix VFS might keep the descriptor around and reuse it for a later
+	// open of the same file, which should get buffered I/O again.
+	int fd = direct_file_of(f)->fd;
+	int fl = fcntl(fd, F_GETFL);
+	if (fl != -1)
+		fcntl(fd, F_SETFL, fl & ~O_DIRECT);
+	return sqxx_shim_close(f);
+}
+
+extern "C"
+int sqxx_direct_read(sqlite3_file *f, void *buf, int amt, sqlite3_int64 ofs) {
+	int fd = direct_file_of(f)->fd;
+	sqxx::detail::direct_vfs *v = direct_vfs_of(f);
+	size_t al = v->opts.alignment;
+	char *out = static_cast<char*>(buf);
+
+	size_t have;
+	if (is_aligned(buf, amt, ofs, al)) {
+		ssize_t n = sqxx::detail::direct_pread(fd, out, amt, ofs, al);
+		if (n < 0)
+			return SQLITE_IOERR_READ;
+		have = n;
+	}
+	else {
+		sqlite3_int64 start = ofs / al * al;
+		size_t skip = ofs - start;
+		size_t span = (skip + amt + al - 1) / al * al;
+		sqxx::detail::pooled_buffer bounce(v->pool, span);
+		if (!bounce.data)
+			return SQLITE_IOERR_NOMEM;
+		ssize_t n = sqxx::detail::direct_pread(fd, bounce.data, span, start, al);
+		if (n < 0)
+			return SQLITE_IOERR_READ;
+		have = (static_cast<size_t>(n) > skip ? std::min(static_cast<size_t>(amt), n - skip) : 0);
+		std::memcpy(out, bounce.data + skip, have);
+	}
+
+	if (have < static_cast<size_t>(amt)) {
+		std::memset(out + have, 0, amt - have);
+		return SQLITE_IOERR_SHORT_READ;
+	}
+	return SQLITE_OK;
+}
+
+extern "C"
+int sqxx_direct_write(sqlite3_file *f, const void *buf, int amt, sqlite3_int64 ofs) {
+	int fd = direct_file_of(f)->fd;
+	sqxx::detail::direct_vfs *v = direct_vfs_of(f);
+	size_t al = v->opts.alignment;
+
+	if (is_aligned(buf, amt, ofs, al)) {
+		if (!sqxx::detail::direct_pwrite(fd, static_cast<const char*>(buf), amt, ofs, al))
+			return SQLITE_IOERR_WRITE;
+		return SQLITE_OK;
+	}
+
+	// Read-modify-write of the surrounding blocks
+	struct stat st;
+	if (fstat(fd, &st) != 0)
+		return SQLITE_IOERR_FSTAT;
+	sqlite3_int64 start = ofs / al * al;
+	size_t skip = ofs - start;
+	size_t span = (skip + amt + al - 1) / al * al;
+	sqxx::detail::pooled_buffer bounce(v->pool, span);
+	if (!bounce.data)
+		return SQLITE_IOERR_NOMEM;
+	size_t have = 0;
+	if (start < st.st_size) {
+		ssize_t n = sqxx::detail::direct_pread(fd, bounce.data, span, start, al);
+		if (n < 0)
+			return SQLITE_IOERR_WRITE;
+		have = n;
+	}
+	std::memset(bounce.data + have, 0, span - have);
+	std::memcpy(bounce.data + skip, buf, amt);
+	if (!sqxx::detail::direct_pwrite(fd, bounce.data, span, start, al))
+		return SQLITE_IOERR_WRITE;
+
+	// Writing whole blocks might have extended the file too far
+	sqlite3_int64 end = std::max<sqlite3_int64>(st.st_size, ofs + amt);
+	if (start + static_cast<sqlite3_int64>(span) > end && ftruncate(fd, end) != 0)
+		return SQLITE_IOERR_WRITE;
+	return SQLITE_OK;
+}
+
+extern "C"
+int sqxx_direct_file_control(sqlite3_file *f, int op, void *arg) {
+	switch (op) {
+	case SQLITE_FCNTL_MMAP_SIZE:
+		// Memory mapping would go through the page cache again
+		if (arg)
+			*static_cast<sqlite3_int64*>(arg) = 0;
+		return SQLITE_OK;
+	case SQLITE_FCNTL_SIZE_HINT: {
+		// The unix VFS might extend the file by writing single bytes, which
+		// doesn't work with direct I/O. Reserve the space without changing
+		// the file size instead.
+		sqlite3_int64 hint = *static_cast<sqlite3_int64*>(arg);
+		if (hint > 0)
+			fallocate(direct_file_of(f)->fd, FALLOC_FL_KEEP_SIZE, 0, hint);
+		return SQLITE_OK;
+	}
+	default:
+		return sqxx_shim_file_control(f, op, arg);
+	}
+}
+
+extern "C"
+int sqxx_direct_fetch(sqlite3_file *f, sqlite3_int64 ofs, int amt, void **pp) {
+	sqxx::unused(f);
+	sqxx::unused(ofs);
+	sqxx::unused(amt);
+	*pp = nullptr;
+	return SQLITE_OK;
+}
+
+#endif // __linux__
+
+extern "C"
+int sqxx_direct_open(sqlite3_vfs *vfs, const char *name, sqlite3_file *f, int flags, int *outflags) {
+	sqxx::detail::direct_file *file = reinterpret_cast<sqxx::detail::direct_file*>(f);
+	file->fd = -1;
+	int rv = sqxx::detail::shim_open(vfs, name, &file->shim, flags, outflags);
+	if (rv != SQLITE_OK || !(flags & SQLITE_OPEN_MAIN_DB))
+		return rv;
+
+#if defined(__linux__)
+	int fd = sqxx::detail::shim_unix_fd(&file->shim, name);
+	if (fd < 0)
+		return rv;
+	int fl = fcntl(fd, F_GETFL);
+	if (fl == -1 || fcntl(fd, F_SETFL, fl | O_DIRECT) != 0)
+		return rv;
+	file->fd = fd;
+
+	sqlite3_io_methods &m = file->shim.methods;
+	m.xClose = sqxx_direct_close;
+	m.xRead = sqxx_direct_read;
+	m.xWrite = sqxx_direct_write;
+	m.xFileControl = sqxx_direct_file_control;
+	if (m.iVersion >= 3) {
+		m.xFetch = sqxx_direct_fetch;
+	}
+#endif
+	return rv;
+}
+
+
+namespace sqxx {
+
+void vfs_direct_register(const char *name, bool makedefault, const vfs_direct_options &opts,
+		const char *base) {
+	vfs_direct_options o = opts;
+	if (o.alignment == 0 || (o.alignment & (o.alignment - 1)) != 0)
+		throw error(SQLITE_MISUSE, "direct I/O alignment must be a power of two");
+	std::unique_ptr<detail::direct_vfs> shim(new detail::direct_vfs(o));
+	detail::shim_register(std::move(shim), name, base, sizeof(detail::direct_file),
+			sqxx_direct_open, makedefault);
+}
+
+void vfs_direct_unregister(const char *name) {
+	detail::shim_unregister(name);
+}
+
+} // namespace sqxx
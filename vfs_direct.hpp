@@ -0,0 +1,55 @@
+
+#if !defined(SQXX_VFS_DIRECT_HPP_INCLUDED)
+#define SQXX_VFS_DIRECT_HPP_INCLUDED
+
+#include <cstddef>
+
+namespace sqxx {
+
+/** Tuning parameters for `vfs_direct_register()` */
+struct vfs_direct_options {
+	/** Required alignment of offsets, sizes and buffers for direct I/O */
+	size_t alignment = 4096;
+	/** Maximum number of idle buffers kept for reuse in the buffer pool */
+	size_t pool_buffers = 32;
+};
+
+/**
+ * Register a VFS that accesses the main database file with `O_DIRECT` (Linux only).
+ *
+ * The VFS is a shim on top of the VFS `base` (the default VFS if `base` is
+ * `nullptr`), which must be one of sqlite's builtin "unix" VFSes. The main
+ * database file bypasses the kernel page cache, so that pages are cached
+ * only once, in sqlite's page cache. Journals and the write-ahead log still
+ * use buffered I/O.
+ *
+ * Reads and writes that don't satisfy the alignment requirements of direct
+ * I/O (for example when sqlite reads the database header) go through
+ * aligned bounce buffers, which are taken from a pool shared by all files of
+ * the VFS. Memory mapped I/O is disabled for the database file.
+ *
+ * Since the kernel doesn't cache the file anymore, this should be combined
+ * with a larger page cache, for example with `pragma cache_size`:
+ *
+ *     sqxx::vfs_direct_register();
+ *     sqxx::connection conn("big.db", sqxx::OPEN_READWRITE, "sqxx-direct");
+ *     conn.cache_size(-1048576); // 1 GiB
+ *
+ * If the file system doesn't support `O_DIRECT`, the file is accessed like
+ * with the underlying VFS.
+ *
+ * Throws if a VFS with the same name was already registered by sqxx.
+ */
+void vfs_direct_register(const char *name = "sqxx-direct", bool makedefault = false,
+		const vfs_direct_options &opts = vfs_direct_options(), const char *base = nullptr);
+
+/**
+ * Unregister a VFS registered by `vfs_direct_register()`.
+ *
+ * No database connections using the VFS may be open anymore.
+ */
+void vfs_direct_unregister(const char *name = "sqxx-direct");
+
+} // namespace sqxx
+
+#endif // SQXX_VFS_DIRECT_HPP_INCLUDED
@@ -0,0 +1,153 @@
+
+#include "vfs_readahead.hpp"
+#include "vfs_shim.hpp"
+#include "error.hpp"
+#include <algorithm>
+#include <atomic>
+#include <string>
+
+#if defined(__unix__)
+#include <fcntl.h>
+#if defined(POSIX_FADV_WILLNEED)
+#define SQXX_HAVE_FADVISE 1
+#endif
+#endif
+
+namespace sqxx {
+namespace detail {
+
+struct readahead_vfs : shim_vfs {
+	vfs_readahead_options opts;
+	// Files of several connections update these concurrently
+	std::atomic<uint64_t> reads{0};
+	std::atomic<uint64_t> sequential_reads{0};
+	std::atomic<uint64_t> readaheads{0};
+	std::atomic<uint64_t> readahead_bytes{0};
+
+	explicit readahead_vfs(const vfs_readahead_options &opts_arg) : opts(opts_arg) {
+	}
+};
+
+// sqlite doesn't use a file from several threads at once, so the access
+// pattern state needs no locking.
+struct readahead_file {
+	shim_file shim;
+	int fd;
+	// End of the previous read
+	sqlite3_int64 last_end;
+	// Number of consecutive sequential reads
+	unsigned run;
+	// End of the range already requested from the kernel
+	sqlite3_int64 advised_end;
+};
+
+inline readahead_file* readahead_file_of(sqlite3_file *f) {
+	return reinterpret_cast<readahead_file*>(f);
+}
+
+#if defined(SQXX_HAVE_FADVISE)
+
+// Records a read of `amt` bytes at `ofs` and requests more data from the
+// kernel if the reads look sequential.
+void readahead_access(sqlite3_file *f, sqlite3_int64 ofs, int amt) {
+	readahead_file *file = readahead_file_of(f);
+	readahead_vfs *vfs = static_cast<readahead_vfs*>(file->shim.shim);
+	const vfs_readahead_options &opts = vfs->opts;
+	sqlite3_int64 end = ofs + amt;
+
+	vfs->reads.fetch_add(1, std::memory_order_relaxed);
+	if (ofs >= file->last_end && ofs - file->last_end <= static_cast<sqlite3_int64>(opts.max_gap)) {
+		++file->run;
+		vfs->sequential_reads.fetch_add(1, std::memory_order_relaxed);
+	}
+	else {
+		file->run = 0;
+		file->advised_end = 0;
+	}
+	file->last_end = end;
+	if (file->run < opts.trigger)
+		return;
+
+	// Keep at least half a window ahead of the reader
+	sqlite3_int64 window = opts.window;
+	if (file->advised_end - end >= window / 2)
+		return;
+	sqlite3_int64 start = std::max(file->advised_end, end);
+	posix_fadvise(file->fd, start, end + window - start, POSIX_FADV_WILLNEED);
+	file->advised_end = end + window;
+	vfs->readaheads.fetch_add(1, std::memory_order_relaxed);
+	vfs->readahead_bytes.fetch_add(static_cast<uint64_t>(end + window - start), std::memory_order_relaxed);
+}
+
+#endif // SQXX_HAVE_FADVISE
+
+} // namespace detail
+} // namespace sqxx
+
+#if defined(SQXX_HAVE_FADVISE)
+
+extern "C"
+int sqxx_readahead_read(sqlite3_file *f, void *buf, int amt, sqlite3_int64 ofs) {
+	sqxx::detail::readahead_access(f, ofs, amt);
+	return sqxx_shim_read(f, buf, amt, ofs);
+}
+
+extern "C"
+int sqxx_readahead_fetch(sqlite3_file *f, sqlite3_int64 ofs, int amt, void **pp) {
+	sqxx::detail::readahead_access(f, ofs, amt);
+	return sqxx_shim_fetch(f, ofs, amt, pp);
+}
+
+#endif // SQXX_HAVE_FADVISE
+
+extern "C"
+int sqxx_readahead_open(sqlite3_vfs *vfs, const char *name, sqlite3_file *f, int flags, int *outflags) {
+	sqxx::detail::readahead_file *file = sqxx::detail::readahead_file_of(f);
+	file->fd = -1;
+	file->last_end = 0;
+	file->run = 0;
+	file->advised_end = 0;
+	int rv = sqxx::detail::shim_open(vfs, name, &file->shim, flags, outflags);
+	if (rv != SQLITE_OK || !(flags & SQLITE_OPEN_MAIN_DB))
+		return rv;
+
+#if defined(SQXX_HAVE_FADVISE)
+	file->fd = sqxx::detail::shim_unix_fd(&file->shim, name);
+	if (file->fd < 0)
+		return rv;
+	sqlite3_io_methods &m = file->shim.methods;
+	m.xRead = sqxx_readahead_read;
+	if (m.iVersion >= 3) {
+		m.xFetch = sqxx_readahead_fetch;
+	}
+#endif
+	return rv;
+}
+
+
+namespace sqxx {
+
+void vfs_readahead_register(const char *name, bool makedefault, const vfs_readahead_options &opts,
+		const char *base) {
+	std::unique_ptr<detail::readahead_vfs> shim(new detail::readahead_vfs(opts));
+	detail::shim_register(std::move(shim), name, base, sizeof(detail::readahead_file),
+			sqxx_readahead_open, makedefault);
+}
+
+void vfs_readahead_unregister(const char *name) {
+	detail::shim_unregister(name);
+}
+
+vfs_readahead_statistics vfs_readahead_stats(const char *name) {
+	detail::readahead_vfs *vfs = dynamic_cast<detail::readahead_vfs*>(detail::shim_find(name));
+	if (!vfs)
+		throw error(SQLITE_MISUSE, std::string("not a readahead vfs: ") + name);
+	vfs_readahead_statistics st;
+	st.reads = vfs->reads.load(std::memory_order_relaxed);
+	st.sequential_reads = vfs->sequential_reads.load(std::memory_order_relaxed);
+	st.readaheads = vfs->readaheads.load(std::memory_order_relaxed);
+	st.readahead_bytes = vfs->readahead_bytes.load(std::memory_order_relaxed);
+	return st;
+}
+
+} // namespace sqxx
@@ -0,0 +1,74 @@
+
+#if !defined(SQXX_VFS_READAHEAD_HPP_INCLUDED)
+#define SQXX_VFS_READAHEAD_HPP_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+
+namespace sqxx {
+
+/** Tuning parameters for `vfs_readahead_register()` */
+struct vfs_readahead_options {
+	/** Amount of data (in bytes) requested ahead of a sequential reader */
+	size_t window = 2 * 1024 * 1024;
+	/** Number of consecutive sequential reads before readahead starts */
+	unsigned trigger = 4;
+	/**
+	 * Largest forward jump (in bytes) between two reads that still counts
+	 * as sequential, since b-tree pages of a table are rarely perfectly
+	 * contiguous.
+	 */
+	size_t max_gap = 64 * 1024;
+};
+
+/** Statistics of a VFS registered by `vfs_readahead_register()` */
+struct vfs_readahead_statistics {
+	/** Reads of main database files */
+	uint64_t reads;
+	/** Reads that continued a forward run of reads */
+	uint64_t sequential_reads;
+	/** Readahead requests passed to the kernel */
+	uint64_t readaheads;
+	/** Bytes requested by those */
+	uint64_t readahead_bytes;
+};
+
+/**
+ * Register a VFS that reads ahead of sequential scans (Linux and other
+ * systems with `posix_fadvise()`).
+ *
+ * The VFS is a shim on top of the VFS `base` (the default VFS if `base` is
+ * `nullptr`), which must be one of sqlite's builtin "unix" VFSes. For each
+ * open main database file it watches the offsets of page reads. Once reads
+ * move forward through the file, as in full table scans or backups, it asks
+ * the kernel with `POSIX_FADV_WILLNEED` to load the next `window` bytes in
+ * the background. Any read that doesn't continue the pattern resets it, so
+ * random access isn't affected.
+ *
+ *     sqxx::vfs_readahead_register();
+ *     sqxx::connection conn("reports.db", sqxx::OPEN_READONLY, "sqxx-readahead");
+ *
+ * Throws if a VFS with the same name was already registered by sqxx.
+ */
+void vfs_readahead_register(const char *name = "sqxx-readahead", bool makedefault = false,
+		const vfs_readahead_options &opts = vfs_readahead_options(), const char *base = nullptr);
+
+/**
+ * Unregister a VFS registered by `vfs_readahead_register()`.
+ *
+ * No database connections using the VFS may be open anymore.
+ */
+void vfs_readahead_unregister(const char *name = "sqxx-readahead");
+
+/**
+ * Statistics of the VFS registered as `name` by `vfs_readahead_register()`,
+ * summed over all files opened with it.
+ *
+ * Without `posix_fadvise()` reads are passed through unobserved and all
+ * counters stay `0`.
+ */
+vfs_readahead_statistics vfs_readahead_stats(const char *name = "sqxx-readahead");
+
+} // namespace sqxx
+
+#endif // SQXX_VFS_READAHEAD_HPP_INCLUDED
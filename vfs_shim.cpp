@@ -0,0 +1,382 @@
+
+#include "vfs_shim.hpp"
+#include "datatypes.hpp"
+#include "error.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <map>
+#include <mutex>
+
+#if defined(__unix__)
+#include <sys/stat.h>
+#endif
+
+using sqxx::detail::shim_file;
+using sqxx::detail::shim_of;
+
+namespace {
+
+inline sqlite3_file* real_file(sqlite3_file *f) {
+	return reinterpret_cast<shim_file*>(f)->real;
+}
+
+inline sqlite3_vfs* real_vfs(sqlite3_vfs *vfs) {
+	return shim_of(vfs)->real;
+}
+
+} // anonymous namespace
+
+
+// ---------------------------------------------------------------------------
+// Forwarding VFS methods
+
+extern "C"
+int sqxx_shim_vfs_delete(sqlite3_vfs *vfs, const char *name, int syncdir) {
+	sqlite3_vfs *r = real_vfs(vfs);
+	return r->xDelete(r, name, syncdir);
+}
+
+extern "C"
+int sqxx_shim_vfs_access(sqlite3_vfs *vfs, const char *name, int flags, int *out) {
+	sqlite3_vfs *r = real_vfs(vfs);
+	return r->xAccess(r, name, flags, out);
+}
+
+extern "C"
+int sqxx_shim_vfs_full_pathname(sqlite3_vfs *vfs, const char *name, int n, char *out) {
+	sqlite3_vfs *r = real_vfs(vfs);
+	return r->xFullPathname(r, name, n, out);
+}
+
+extern "C"
+void* sqxx_shim_vfs_dlopen(sqlite3_vfs *vfs, const char *name) {
+	sqlite3_vfs *r = real_vfs(vfs);
+	return r->xDlOpen(r, name);
+}
+
+extern "C"
+void sqxx_shim_vfs_dlerror(sqlite3_vfs *vfs, int n, char *msg) {
+	sqlite3_vfs *r = real_vfs(vfs);
+	r->xDlError(r, n, msg);
+}
+
+extern "C"
+void (*sqxx_shim_vfs_dlsym(sqlite3_vfs *vfs, void *handle, const char *sym))(void) {
+	sqlite3_vfs *r = real_vfs(vfs);
+	return r->xDlSym(r, handle, sym);
+}
+
+extern "C"
+void sqxx_shim_vfs_dlclose(sqlite3_vfs *vfs, void *handle) {
+	sqlite3_vfs *r = real_vfs(vfs);
+	r->xDlClose(r, handle);
+}
+
+extern "C"
+int sqxx_shim_vfs_randomness(sqlite3_vfs *vfs, int n, char *out) {
+	sqlite3_vfs *r = real_vfs(vfs);
+	return r->xRandomness(r, n, out);
+}
+
+extern "C"
+int sqxx_shim_vfs_sleep(sqlite3_vfs *vfs, int usec) {
+	sqlite3_vfs *r = real_vfs(vfs);
+	return r->xSleep(r, usec);
+}
+
+extern "C"
+int sqxx_shim_vfs_current_time(sqlite3_vfs *vfs, double *out) {
+	sqlite3_vfs *r = real_vfs(vfs);
+	return r->xCurrentTime(r, out);
+}
+
+extern "C"
+int sqxx_shim_vfs_get_last_error(sqlite3_vfs *vfs, int n, char *out) {
+	sqlite3_vfs *r = real_vfs(vfs);
+	return r->xGetLastError(r, n, out);
+}
+
+extern "C"
+int sqxx_shim_vfs_current_time_int64(sqlite3_vfs *vfs, sqlite3_int64 *out) {
+	sqlite3_vfs *r = real_vfs(vfs);
+	return r->xCurrentTimeInt64(r, out);
+}
+
+extern "C"
+int sqxx_shim_vfs_set_system_call(sqlite3_vfs *vfs, const char *name, sqlite3_syscall_ptr fn) {
+	sqlite3_vfs *r = real_vfs(vfs);
+	return r->xSetSystemCall(r, name, fn);
+}
+
+extern "C"
+sqlite3_syscall_ptr sqxx_shim_vfs_get_system_call(sqlite3_vfs *vfs, const char *name) {
+	sqlite3_vfs *r = real_vfs(vfs);
+	return r->xGetSystemCall(r, name);
+}
+
+extern "C"
+const char* sqxx_shim_vfs_next_system_call(sqlite3_vfs *vfs, const char *name) {
+	sqlite3_vfs *r = real_vfs(vfs);
+	return r->xNextSystemCall(r, name);
+}
+
+
+// ---------------------------------------------------------------------------
+// Forwarding file methods
+
+extern "C"
+int sqxx_shim_close(sqlite3_file *f) {
+	sqlite3_file *r = real_file(f);
+	return r->pMethods->xClose(r);
+}
+
+extern "C"
+int sqxx_shim_read(sqlite3_file *f, void *buf, int amt, sqlite3_int64 ofs) {
+	sqlite3_file *r = real_file(f);
+	return r->pMethods->xRead(r, buf, amt, ofs);
+}
+
+extern "C"
+int sqxx_shim_write(sqlite3_file *f, const void *buf, int amt, sqlite3_int64 ofs) {
+	sqlite3_file *r = real_file(f);
+	return r->pMethods->xWrite(r, buf, amt, ofs);
+}
+
+extern "C"
+int sqxx_shim_truncate(sqlite3_file *f, sqlite3_int64 size) {
+	sqlite3_file *r = real_file(f);
+	return r->pMethods->xTruncate(r, size);
+}
+
+extern "C"
+int sqxx_shim_sync(sqlite3_file *f, int flags) {
+	sqlite3_file *r = real_file(f);
+	return r->pMethods->xSync(r, flags);
+}
+
+extern "C"
+int sqxx_shim_file_size(sqlite3_file *f, sqlite3_int64 *size) {
+	sqlite3_file *r = real_file(f);
+	return r->pMethods->xFileSize(r, size);
+}
+
+extern "C"
+int sqxx_shim_lock(sqlite3_file *f, int lock) {
+	sqlite3_file *r = real_file(f);
+	return r->pMethods->xLock(r, lock);
+}
+
+extern "C"
+int sqxx_shim_unlock(sqlite3_file *f, int lock) {
+	sqlite3_file *r = real_file(f);
+	return r->pMethods->xUnlock(r, lock);
+}
+
+extern "C"
+int sqxx_shim_check_reserved_lock(sqlite3_file *f, int *out) {
+	sqlite3_file *r = real_file(f);
+	return r->pMethods->xCheckReservedLock(r, out);
+}
+
+extern "C"
+int sqxx_shim_file_control(sqlite3_file *f, int op, void *arg) {
+	sqlite3_file *r = real_file(f);
+	return r->pMethods->xFileControl(r, op, arg);
+}
+
+extern "C"
+int sqxx_shim_sector_size(sqlite3_file *f) {
+	sqlite3_file *r = real_file(f);
+	return r->pMethods->xSectorSize(r);
+}
+
+extern "C"
+int sqxx_shim_device_characteristics(sqlite3_file *f) {
+	sqlite3_file *r = real_file(f);
+	return r->pMethods->xDeviceCharacteristics(r);
+}
+
+extern "C"
+int sqxx_shim_shm_map(sqlite3_file *f, int pg, int pgsz, int extend, void volatile **pp) {
+	sqlite3_file *r = real_file(f);
+	return r->pMethods->xShmMap(r, pg, pgsz, extend, pp);
+}
+
+extern "C"
+int sqxx_shim_shm_lock(sqlite3_file *f, int ofs, int n, int flags) {
+	sqlite3_file *r = real_file(f);
+	return r->pMethods->xShmLock(r, ofs, n, flags);
+}
+
+extern "C"
+void sqxx_shim_shm_barrier(sqlite3_file *f) {
+	sqlite3_file *r = real_file(f);
+	r->pMethods->xShmBarrier(r);
+}
+
+extern "C"
+int sqxx_shim_shm_unmap(sqlite3_file *f, int deleteflag) {
+	sqlite3_file *r = real_file(f);
+	return r->pMethods->xShmUnmap(r, deleteflag);
+}
+
+extern "C"
+int sqxx_shim_fetch(sqlite3_file *f, sqlite3_int64 ofs, int amt, void **pp) {
+	sqlite3_file *r = real_file(f);
+	return r->pMethods->xFetch(r, ofs, amt, pp);
+}
+
+extern "C"
+int sqxx_shim_unfetch(sqlite3_file *f, sqlite3_int64 ofs, void *p) {
+	sqlite3_file *r = real_file(f);
+	return r->pMethods->xUnfetch(r, ofs, p);
+}
+
+
+namespace sqxx {
+namespace detail {
+
+namespace {
+	std::mutex shim_registry_mutex;
+	std::map<std::string, std::unique_ptr<shim_vfs>> shim_registry;
+}
+
+void shim_register(std::unique_ptr<shim_vfs> shim, const char *name, const char *base,
+		size_t file_size, int (*open)(sqlite3_vfs*, const char*, sqlite3_file*, int, int*),
+		bool makedefault) {
+	sqlite3_vfs *real = sqlite3_vfs_find(base);
+	if (!real)
+		throw error(SQLITE_ERROR, std::string("no such vfs: ") + (base ? base : "(default)"));
+
+	std::lock_guard<std::mutex> lock(shim_registry_mutex);
+	if (shim_registry.count(name))
+		throw error(SQLITE_MISUSE, std::string("vfs already registered: ") + name);
+
+	// Keep the underlying file suitably aligned
+	const size_t align = alignof(std::max_align_t);
+	shim->real_offset = static_cast<int>((file_size + align - 1) / align * align);
+	shim->real = real;
+	shim->name = name;
+
+	sqlite3_vfs &v = shim->vfs;
+	std::memset(&v, 0, sizeof(v));
+	v.iVersion = std::min(real->iVersion, 3);
+	v.szOsFile = shim->real_offset + real->szOsFile;
+	v.mxPathname = real->mxPathname;
+	v.zName = shim->name.c_str();
+	v.pAppData = shim.get();
+	v.xOpen = open;
+	v.xDelete = sqxx_shim_vfs_delete;
+	v.xAccess = sqxx_shim_vfs_access;
+	v.xFullPathname = sqxx_shim_vfs_full_pathname;
+	v.xDlOpen = sqxx_shim_vfs_dlopen;
+	v.xDlError = sqxx_shim_vfs_dlerror;
+	v.xDlSym = sqxx_shim_vfs_dlsym;
+	v.xDlClose = sqxx_shim_vfs_dlclose;
+	v.xRandomness = sqxx_shim_vfs_randomness;
+	v.xSleep = sqxx_shim_vfs_sleep;
+	v.xCurrentTime = sqxx_shim_vfs_current_time;
+	v.xGetLastError = sqxx_shim_vfs_get_last_error;
+	if (v.iVersion >= 2 && real->xCurrentTimeInt64) {
+		v.xCurrentTimeInt64 = sqxx_shim_vfs_current_time_int64;
+	}
+	if (v.iVersion >= 3 && real->xSetSystemCall) {
+		v.xSetSystemCall = sqxx_shim_vfs_set_system_call;
+		v.xGetSystemCall = sqxx_shim_vfs_get_system_call;
+		v.xNextSystemCall = sqxx_shim_vfs_next_system_call;
+	}
+
+	int rv = sqlite3_vfs_register(&v, makedefault);
+	if (rv != SQLITE_OK)
+		throw static_error(rv);
+	shim_registry[name] = std::move(shim);
+}
+
+void shim_unregister(const char *name) {
+	std::lock_guard<std::mutex> lock(shim_registry_mutex);
+	auto it = shim_registry.find(name);
+	if (it == shim_registry.end())
+		throw error(SQLITE_MISUSE, std::string("vfs not registered: ") + name);
+	int rv = sqlite3_vfs_unregister(&it->second->vfs);
+	if (rv != SQLITE_OK)
+		throw static_error(rv);
+	shim_registry.erase(it);
+}
+
+shim_vfs* shim_find(const char *name) {
+	std::lock_guard<std::mutex> lock(shim_registry_mutex);
+	auto it = shim_registry.find(name);
+	return (it == shim_registry.end() ? nullptr : it->second.get());
+}
+
+int shim_open(sqlite3_vfs *vfs, const char *name, shim_file *file, int flags, int *outflags) {
+	shim_vfs *shim = shim_of(vfs);
+	file->base.pMethods = nullptr;
+	file->shim = shim;
+	file->real = reinterpret_cast<sqlite3_file*>(reinterpret_cast<char*>(file) + shim->real_offset);
+	file->real->pMethods = nullptr;
+
+	int rv = shim->real->xOpen(shim->real, name, file->real, flags, outflags);
+	const sqlite3_io_methods *rm = file->real->pMethods;
+	if (!rm)
+		return rv;
+
+	sqlite3_io_methods &m = file->methods;
+	std::memset(&m, 0, sizeof(m));
+	m.iVersion = std::min(rm->iVersion, 3);
+	m.xClose = sqxx_shim_close;
+	m.xRead = sqxx_shim_read;
+	m.xWrite = sqxx_shim_write;
+	m.xTruncate = sqxx_shim_truncate;
+	m.xSync = sqxx_shim_sync;
+	m.xFileSize = sqxx_shim_file_size;
+	m.xLock = sqxx_shim_lock;
+	m.xUnlock = sqxx_shim_unlock;
+	m.xCheckReservedLock = sqxx_shim_check_reserved_lock;
+	m.xFileControl = sqxx_shim_file_control;
+	m.xSectorSize = sqxx_shim_sector_size;
+	m.xDeviceCharacteristics = sqxx_shim_device_characteristics;
+	if (m.iVersion >= 2) {
+		m.xShmMap = sqxx_shim_shm_map;
+		m.xShmLock = sqxx_shim_shm_lock;
+		m.xShmBarrier = sqxx_shim_shm_barrier;
+		m.xShmUnmap = sqxx_shim_shm_unmap;
+	}
+	if (m.iVersion >= 3) {
+		m.xFetch = sqxx_shim_fetch;
+		m.xUnfetch = sqxx_shim_unfetch;
+	}
+	file->base.pMethods = &m;
+	return rv;
+}
+
+int shim_unix_fd(const shim_file *file, const char *path) {
+#if defined(__unix__)
+	if (!path || !file->real->pMethods || std::strncmp(file->shim->real->zName, "unix", 4) != 0)
+		return -1;
+
+	// Leading members of `struct unixFile` in os_unix.c
+	struct unix_file_head {
+		const sqlite3_io_methods *methods;
+		sqlite3_vfs *vfs;
+		void *inode;
+		int fd;
+	};
+	int fd = reinterpret_cast<const unix_file_head*>(file->real)->fd;
+
+	struct stat fst, pst;
+	if (fd < 0 || fstat(fd, &fst) != 0 || stat(path, &pst) != 0)
+		return -1;
+	if (fst.st_dev != pst.st_dev || fst.st_ino != pst.st_ino)
+		return -1;
+	return fd;
+#else
+	unused(file);
+	unused(path);
+	return -1;
+#endif
+}
+
+} // namespace detail
+} // namespace sqxx
@@ -0,0 +1,119 @@
+
+// Internal helpers for the VFS shims provided by sqxx (vfs_*.cpp). Not part
+// of the public interface, includes <sqlite3.h>.
+
+#if !defined(SQXX_VFS_SHIM_HPP_INCLUDED)
+#define SQXX_VFS_SHIM_HPP_INCLUDED
+
+#include <sqlite3.h>
+#include <memory>
+#include <string>
+
+namespace sqxx {
+namespace detail {
+
+/**
+ * Common part of the VFS shims provided by sqxx.
+ *
+ * A shim forwards everything to an underlying VFS (usually "unix") and only
+ * replaces the file operations it is interested in. `vfs.pAppData` points
+ * back to the `shim_vfs` object. Concrete shims derive from this to store
+ * their options.
+ */
+struct shim_vfs {
+	sqlite3_vfs vfs;
+	sqlite3_vfs *real;
+	std::string name;
+	// Offset of the underlying file in the memory sqlite allocates per file
+	int real_offset;
+
+	virtual ~shim_vfs() = default;
+};
+
+/**
+ * A file opened through a shim.
+ *
+ * Concrete shims embed this as the first member of their file struct. The
+ * file of the underlying VFS lives in the same allocation, behind the shim's
+ * file struct. `methods` initially forwards every call to the underlying
+ * file, shims override the entries they need to.
+ */
+struct shim_file {
+	sqlite3_file base;
+	sqlite3_file *real;
+	shim_vfs *shim;
+	sqlite3_io_methods methods;
+};
+
+/**
+ * Registers `shim` under `name` on top of the VFS `base` (the default VFS
+ * if `base` is null). `file_size` is the size of the shim's file struct,
+ * `open` its `xOpen` implementation, which usually calls `shim_open()`.
+ *
+ * Ownership of `shim` is kept in a global registry until `shim_unregister()`.
+ */
+void shim_register(std::unique_ptr<shim_vfs> shim, const char *name, const char *base,
+		size_t file_size, int (*open)(sqlite3_vfs*, const char*, sqlite3_file*, int, int*),
+		bool makedefault);
+
+/** Unregisters and destroys a shim registered by `shim_register()`. */
+void shim_unregister(const char *name);
+
+/**
+ * The shim registered by `shim_register()` under `name`, null if there is
+ * none. It stays valid until it is unregistered.
+ */
+shim_vfs* shim_find(const char *name);
+
+/** The shim object a `sqlite3_vfs` registered by `shim_register()` belongs to */
+inline shim_vfs* shim_of(sqlite3_vfs *vfs) {
+	return reinterpret_cast<shim_vfs*>(vfs->pAppData);
+}
+
+/**
+ * Opens the underlying file for a shim file and sets up forwarding methods.
+ *
+ * If the underlying VFS set up a file (even on failure), `file->base.pMethods`
+ * points to `file->methods` afterwards, otherwise it is null and `xClose`
+ * won't be called.
+ */
+int shim_open(sqlite3_vfs *vfs, const char *name, shim_file *file, int flags, int *outflags);
+
+/**
+ * The file descriptor of the underlying file, if the underlying VFS is one
+ * of the builtin "unix" VFSes. Returns -1 if it can't be determined.
+ *
+ * This relies on the layout of sqlite's `unixFile` struct, which starts with
+ * the methods, the VFS, the inode info and then the descriptor. The result
+ * is verified against `path` so that a different layout is detected and
+ * leads to -1 instead of a wrong descriptor.
+ */
+int shim_unix_fd(const shim_file *file, const char *path);
+
+} // namespace detail
+} // namespace sqxx
+
+// Forwarding file methods, to be called by shims that override a method but
+// still want to call through to the underlying file.
+extern "C" {
+int sqxx_shim_close(sqlite3_file *f);
+int sqxx_shim_read(sqlite3_file *f, void *buf, int amt, sqlite3_int64 ofs);
+int sqxx_shim_write(sqlite3_file *f, const void *buf, int amt, sqlite3_int64 ofs);
+int sqxx_shim_truncate(sqlite3_file *f, sqlite3_int64 size);
+int sqxx_shim_sync(sqlite3_file *f, int flags);
+int sqxx_shim_file_size(sqlite3_file *f, sqlite3_int64 *size);
+int sqxx_shim_lock(sqlite3_file *f, int lock);
+int sqxx_shim_unlock(sqlite3_file *f, int lock);
+int sqxx_shim_check_reserved_lock(sqlite3_file *f, int *out);
+int sqxx_shim_file_control(sqlite3_file *f, int op, void *arg);
+int sqxx_shim_sector_size(sqlite3_file *f);
+int sqxx_shim_device_characteristics(sqlite3_file *f);
+int sqxx_shim_shm_map(sqlite3_file *f, int pg, int pgsz, int extend, void volatile **pp);
+int sqxx_shim_shm_lock(sqlite3_file *f, int ofs, int n, int flags);
+void sqxx_shim_shm_barrier(sqlite3_file *f);
+int sqxx_shim_shm_unmap(sqlite3_file *f, int deleteflag);
+int sqxx_shim_fetch(sqlite3_file *f, sqlite3_int64 ofs, int amt, void **pp);
+int sqxx_shim_unfetch(sqlite3_file *f, sqlite3_int64 ofs, void *p);
+}
+
+#endif // SQXX_VFS_SHIM_HPP_INCLUDED
@@ -0,0 +1,706 @@
+
+#include "vfs_uring.hpp"
+#include "vfs_shim.hpp"
+#include "error.hpp"
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define SQXX_HAVE_IO_URING 1
+#endif
+#endif
+
+#if defined(SQXX_HAVE_IO_URING)
+#include <linux/io_uring.h>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+namespace sqxx {
+namespace detail {
+
+struct uring_file;
+
+struct uring_vfs : shim_vfs {
+	vfs_uring_options opts;
+
+	// Batched main database files by the name sqlite opened them with, so
+	// that the write-ahead log opened later by the same connection can be
+	// linked to them. sqlite passes the main database's name to xOpen for the
+	// log as well, as prefix of the same allocation, so the pointer
+	// identifies the connection's database file.
+	std::mutex mutex;
+	std::map<const char*, uring_file*> main_files;
+};
+
+#if defined(SQXX_HAVE_IO_URING)
+
+// A minimal io_uring instance, set up with the raw system calls so that
+// there is no dependency on liburing.
+class uring {
+private:
+	int fd = -1;
+	unsigned entries = 0;
+
+	void *sq_map = MAP_FAILED;
+	size_t sq_map_len = 0;
+	void *cq_map = MAP_FAILED;
+	size_t cq_map_len = 0;
+	io_uring_sqe *sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+	size_t sqes_len = 0;
+
+	unsigned *sq_tail;
+	unsigned *sq_mask;
+	unsigned *sq_array;
+	unsigned *cq_head;
+	unsigned *cq_tail;
+	unsigned *cq_mask;
+	io_uring_cqe *cqes;
+
+	// Entries prepared with get_sqe(), but not yet submitted
+	unsigned sq_local_tail = 0;
+	unsigned unsubmitted = 0;
+
+public:
+	uring() = default;
+	~uring();
+
+	uring(const uring&) = delete;
+	uring& operator=(const uring&) = delete;
+
+	bool setup(unsigned depth);
+	unsigned size() const { return entries; }
+
+	// Returns a cleared submission queue entry, nullptr if the queue is full
+	io_uring_sqe* get_sqe();
+	// Submits prepared entries and waits for at least `wait_nr` completions.
+	// Returns a negative errno on failure.
+	int submit(unsigned wait_nr);
+	bool pop_cqe(io_uring_cqe &cqe);
+};
+
+uring::~uring() {
+	if (sqes != MAP_FAILED)
+		munmap(sqes, sqes_len);
+	if (cq_map != MAP_FAILED && cq_map != sq_map)
+		munmap(cq_map, cq_map_len);
+	if (sq_map != MAP_FAILED)
+		munmap(sq_map, sq_map_len);
+	if (fd >= 0)
+		close(fd);
+}
+
+bool uring::setup(unsigned depth) {
+	io_uring_params p;
+	std::memset(&p, 0, sizeof(p));
+	fd = static_cast<int>(syscall(__NR_io_uring_setup, depth, &p));
+	if (fd < 0)
+		return false;
+
+	sq_map_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	cq_map_len = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+	bool single = (p.features & IORING_FEAT_SINGLE_MMAP);
+	if (single)
+		sq_map_len = cq_map_len = std::max(sq_map_len, cq_map_len);
+
+	sq_map = mmap(nullptr, sq_map_len, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+	if (sq_map == MAP_FAILED)
+		return false;
+	if (single) {
+		cq_map = sq_map;
+	}
+	else {
+		cq_map = mmap(nullptr, cq_map_len, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+		if (cq_map == MAP_FAILED)
+			return false;
+	}
+	sqes_len = p.sq_entries * sizeof(io_uring_sqe);
+	void *s = mmap(nullptr, sqes_len, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, fd, IORING_OFF_SQES);
+	if (s == MAP_FAILED)
+		return false;
+	sqes = static_cast<io_uring_sqe*>(s);
+
+	char *sq = static_cast<char*>(sq_map);
+	char *cq = static_cast<char*>(cq_map);
+	sq_tail = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+	sq_mask = reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+	sq_array = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+	cq_head = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+	cq_tail = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+	cq_mask = reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+	cqes = reinterpret_cast<io_uring_cqe*>(cq + p.cq_off.cqes);
+
+	entries = p.sq_entries;
+	sq_local_tail = *sq_tail;
+	return true;
+}
+
+io_uring_sqe* uring::get_sqe() {
+	if (unsubmitted >= entries)
+		return nullptr;
+	unsigned idx = sq_local_tail & *sq_mask;
+	io_uring_sqe *sqe = &sqes[idx];
+	std::memset(sqe, 0, sizeof(*sqe));
+	sq_array[idx] = idx;
+	++sq_local_tail;
+	++unsubmitted;
+	return sqe;
+}
+
+int uring::submit(unsigned wait_nr) {
+	__atomic_store_n(sq_tail, sq_local_tail, __ATOMIC_RELEASE);
+	unsigned flags = (wait_nr ? IORING_ENTER_GETEVENTS : 0);
+	for (;;) {
+		long rv = syscall(__NR_io_uring_enter, fd, unsubmitted, wait_nr, flags, nullptr, 0);
+		if (rv >= 0) {
+			unsubmitted -= std::min(unsubmitted, static_cast<unsigned>(rv));
+			if (!unsubmitted || !wait_nr)
+				return 0;
+			// Not everything consumed yet, continue submitting
+		}
+		else if (errno != EINTR) {
+			return -errno;
+		}
+	}
+}
+
+bool uring::pop_cqe(io_uring_cqe &cqe) {
+	unsigned head = *cq_head;
+	if (head == __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE))
+		return false;
+	cqe = cqes[head & *cq_mask];
+	__atomic_store_n(cq_head, head + 1, __ATOMIC_RELEASE);
+	return true;
+}
+
+bool write_all(int fd, const char *buf, size_t len, off_t ofs) {
+	while (len) {
+		ssize_t n = pwrite(fd, buf, len, ofs);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+		buf += n;
+		len -= n;
+		ofs += n;
+	}
+	return true;
+}
+
+// Collects writes to one file and submits them in batches.
+//
+// Pending writes are kept ordered by offset. Writes that overlap a pending
+// write other than by replacing it exactly cause a flush first, so the
+// writes of one batch never overlap and can complete in any order.
+class uring_writer {
+private:
+	struct pending_write {
+		size_t pos;
+		int len;
+	};
+
+	// A run of adjacent pending writes, submitted as one vectored write
+	struct run {
+		sqlite3_int64 ofs;
+		size_t first_iov;
+		size_t iovcnt;
+		size_t bytes;
+	};
+
+	static const uint64_t readahead_tag = ~uint64_t(0);
+	// Upper bound for iovecs in one vectored write, well below IOV_MAX
+	static const size_t max_run_iovs = 256;
+
+	int fd;
+	uring ring;
+	std::map<sqlite3_int64, pending_write> pending;
+	std::vector<char> data;
+	size_t max_pending;
+	// Deferred error from a flush that couldn't report it
+	int failed = SQLITE_OK;
+	// Set if the ring failed. Everything is written synchronously afterwards
+	// and buffers that might still be referenced by the kernel are retired
+	// until the file is closed.
+	bool broken = false;
+	std::vector<std::vector<char>> retired_data;
+	std::vector<std::vector<iovec>> retired_iov;
+
+	size_t readahead;
+	sqlite3_int64 last_read_end = -1;
+	sqlite3_int64 readahead_end = 0;
+	unsigned readahead_inflight = 0;
+
+	void reap_readahead();
+	bool write_run_sync(const run &r, const std::vector<iovec> &iov, size_t skip);
+
+public:
+	uring_writer(int fd_arg, size_t max_pending_arg, size_t readahead_arg)
+		: fd(fd_arg), max_pending(max_pending_arg), readahead(readahead_arg) {
+	}
+
+	bool setup(unsigned depth) { return ring.setup(depth); }
+
+	bool overlaps(sqlite3_int64 ofs, int amt) const;
+	int write(const void *buf, int amt, sqlite3_int64 ofs);
+	int flush();
+	// Flush, but report errors only with the next flush
+	void flush_deferred();
+	void advise_read(sqlite3_int64 ofs, int amt);
+};
+
+bool uring_writer::overlaps(sqlite3_int64 ofs, int amt) const {
+	if (pending.empty())
+		return false;
+	auto it = pending.lower_bound(ofs + amt);
+	if (it == pending.begin())
+		return false;
+	--it;
+	return (it->first + it->second.len > ofs);
+}
+
+int uring_writer::write(const void *buf, int amt, sqlite3_int64 ofs) {
+	auto it = pending.find(ofs);
+	if (it != pending.end() && it->second.len == amt) {
+		// Same region written again, just replace the data
+		std::memcpy(data.data() + it->second.pos, buf, amt);
+		return SQLITE_OK;
+	}
+	if (overlaps(ofs, amt)) {
+		int rv = flush();
+		if (rv != SQLITE_OK)
+			return rv;
+	}
+
+	const char *p = static_cast<const char*>(buf);
+	pending[ofs] = pending_write{data.size(), amt};
+	data.insert(data.end(), p, p + amt);
+
+	if (data.size() >= max_pending)
+		return flush();
+	return SQLITE_OK;
+}
+
+bool uring_writer::write_run_sync(const run &r, const std::vector<iovec> &iov, size_t skip) {
+	sqlite3_int64 ofs = r.ofs;
+	for (size_t i = r.first_iov; i < r.first_iov + r.iovcnt; ++i) {
+		const char *base = static_cast<const char*>(iov[i].iov_base);
+		size_t len = iov[i].iov_len;
+		if (skip >= len) {
+			skip -= len;
+		}
+		else {
+			if (!write_all(fd, base + skip, len - skip, ofs + skip))
+				return false;
+			skip = 0;
+		}
+		ofs += len;
+	}
+	return true;
+}
+
+int uring_writer::flush() {
+	if (pending.empty()) {
+		int rv = failed;
+		failed = SQLITE_OK;
+		return rv;
+	}
+
+	std::vector<iovec> iov;
+	std::vector<run> runs;
+	iov.reserve(pending.size());
+	for (const auto &p : pending) {
+		iovec v;
+		v.iov_base = data.data() + p.second.pos;
+		v.iov_len = p.second.len;
+		if (!runs.empty() && runs.back().ofs + static_cast<sqlite3_int64>(runs.back().bytes) == p.first &&
+				runs.back().iovcnt < max_run_iovs) {
+			runs.back().iovcnt++;
+			runs.back().bytes += v.iov_len;
+		}
+		else {
+			runs.push_back(run{p.first, iov.size(), 1, v.iov_len});
+		}
+		iov.push_back(v);
+	}
+
+	bool ok = true;
+	size_t next = 0, done = 0, inflight = 0;
+	while (!broken && done < runs.size()) {
+		while (next < runs.size() && inflight + readahead_inflight < ring.size()) {
+			io_uring_sqe *sqe = ring.get_sqe();
+			if (!sqe)
+				break;
+			const run &r = runs[next];
+			sqe->opcode = IORING_OP_WRITEV;
+			sqe->fd = fd;
+			sqe->addr = reinterpret_cast<uint64_t>(&iov[r.first_iov]);
+			sqe->len = static_cast<uint32_t>(r.iovcnt);
+			sqe->off = r.ofs;
+			sqe->user_data = next;
+			++next;
+			++inflight;
+		}
+		if (ring.submit(1) < 0) {
+			broken = true;
+			break;
+		}
+		io_uring_cqe cqe;
+		while (ring.pop_cqe(cqe)) {
+			if (cqe.user_data == readahead_tag) {
+				--readahead_inflight;
+				continue;
+			}
+			--inflight;
+			++done;
+			const run &r = runs[cqe.user_data];
+			if (cqe.res < 0) {
+				ok = false;
+			}
+			else if (static_cast<size_t>(cqe.res) < r.bytes) {
+				ok = write_run_sync(r, iov, cqe.res) && ok;
+			}
+		}
+	}
+
+	if (broken) {
+		// Write everything synchronously. Writes that might still be in
+		// flight write the same data, their buffers are kept alive.
+		ok = true;
+		readahead = 0;
+		for (const run &r : runs) {
+			ok = write_run_sync(r, iov, 0) && ok;
+		}
+		retired_data.push_back(std::move(data));
+		retired_iov.push_back(std::move(iov));
+		data = std::vector<char>();
+	}
+
+	pending.clear();
+	data.clear();
+	int rv = failed;
+	failed = SQLITE_OK;
+	if (!ok)
+		rv = SQLITE_IOERR_WRITE;
+	return rv;
+}
+
+void uring_writer::flush_deferred() {
+	int rv = flush();
+	if (rv != SQLITE_OK)
+		failed = rv;
+}
+
+void uring_writer::reap_readahead() {
+	io_uring_cqe cqe;
+	while (readahead_inflight && ring.pop_cqe(cqe)) {
+		--readahead_inflight;
+		if (cqe.res == -EINVAL || cqe.res == -EOPNOTSUPP) {
+			// Kernel doesn't support IORING_OP_FADVISE
+			readahead = 0;
+		}
+	}
+}
+
+void uring_writer::advise_read(sqlite3_int64 ofs, int amt) {
+	if (!readahead || broken)
+		return;
+	bool sequential = (ofs == last_read_end);
+	last_read_end = ofs + amt;
+	if (!sequential)
+		return;
+
+	reap_readahead();
+	sqlite3_int64 want_end = last_read_end + static_cast<sqlite3_int64>(readahead);
+	if (want_end - readahead_end < static_cast<sqlite3_int64>(readahead / 2) ||
+			readahead_inflight >= ring.size() / 2)
+		return;
+	sqlite3_int64 start = std::max(last_read_end, readahead_end);
+	io_uring_sqe *sqe = ring.get_sqe();
+	if (!sqe)
+		return;
+	sqe->opcode = IORING_OP_FADVISE;
+	sqe->fd = fd;
+	sqe->off = start;
+	sqe->len = static_cast<uint32_t>(want_end - start);
+	sqe->fadvise_advice = POSIX_FADV_WILLNEED;
+	sqe->user_data = readahead_tag;
+	// Once prepared the entry is submitted eventually, even if this fails
+	++readahead_inflight;
+	readahead_end = want_end;
+	ring.submit(0);
+}
+
+#else // SQXX_HAVE_IO_URING
+
+// Never instantiated without io_uring, files are passed through unchanged
+class uring_writer {
+public:
+	bool overlaps(sqlite3_int64, int) const { return false; }
+	int write(const void*, int, sqlite3_int64) { return SQLITE_IOERR_WRITE; }
+	int flush() { return SQLITE_OK; }
+	void flush_deferred() {}
+	void advise_read(sqlite3_int64, int) {}
+};
+
+#endif // SQXX_HAVE_IO_URING
+
+struct uring_file {
+	shim_file shim;
+	// null for files that are passed through unchanged
+	uring_writer *writer;
+	// Name the file was registered under in `uring_vfs::main_files`
+	const char *name;
+	// The write-ahead log of a main database file and the other way around,
+	// if both are batched. Both files belong to the same connection, so only
+	// the connection's thread uses the link.
+	uring_file *linked;
+};
+
+inline uring_writer* writer_of(sqlite3_file *f) {
+	return reinterpret_cast<uring_file*>(f)->writer;
+}
+
+inline uring_vfs* vfs_of(uring_file *file) {
+	return static_cast<uring_vfs*>(file->shim.shim);
+}
+
+// Flushes the writes to a main database file and to its write-ahead log.
+//
+// sqlite only calls the wal-index methods on the main database file, but
+// the frames the wal-index refers to are in the log.
+inline int flush_with_wal(sqlite3_file *f) {
+	uring_file *file = reinterpret_cast<uring_file*>(f);
+	int rv = file->writer->flush();
+	if (file->linked) {
+		int wrv = file->linked->writer->flush();
+		if (rv == SQLITE_OK)
+			rv = wrv;
+	}
+	return rv;
+}
+
+inline void unlink_file(uring_file *file) {
+	uring_vfs *vfs = vfs_of(file);
+	std::lock_guard<std::mutex> lock(vfs->mutex);
+	if (file->name)
+		vfs->main_files.erase(file->name);
+	if (file->linked)
+		file->linked->linked = nullptr;
+	file->linked = nullptr;
+}
+
+} // namespace detail
+} // namespace sqxx
+
+using sqxx::detail::writer_of;
+using sqxx::detail::flush_with_wal;
+
+extern "C"
+int sqxx_uring_close(sqlite3_file *f) {
+	sqxx::detail::uring_file *file = reinterpret_cast<sqxx::detail::uring_file*>(f);
+	sqxx::detail::unlink_file(file);
+	int rv = file->writer->flush();
+	delete file->writer;
+	file->writer = nullptr;
+	int crv = sqxx_shim_close(f);
+	return (rv != SQLITE_OK ? rv : crv);
+}
+
+extern "C"
+int sqxx_uring_read(sqlite3_file *f, void *buf, int amt, sqlite3_int64 ofs) {
+	sqxx::detail::uring_writer *w = writer_of(f);
+	if (w->overlaps(ofs, amt)) {
+		int rv = w->flush();
+		if (rv != SQLITE_OK)
+			return SQLITE_IOERR_READ;
+	}
+	w->advise_read(ofs, amt);
+	return sqxx_shim_read(f, buf, amt, ofs);
+}
+
+extern "C"
+int sqxx_uring_write(sqlite3_file *f, const void *buf, int amt, sqlite3_int64 ofs) {
+	return writer_of(f)->write(buf, amt, ofs);
+}
+
+extern "C"
+int sqxx_uring_truncate(sqlite3_file *f, sqlite3_int64 size) {
+	int rv = writer_of(f)->flush();
+	if (rv != SQLITE_OK)
+		return rv;
+	return sqxx_shim_truncate(f, size);
+}
+
+extern "C"
+int sqxx_uring_sync(sqlite3_file *f, int flags) {
+	int rv = writer_of(f)->flush();
+	if (rv != SQLITE_OK)
+		return rv;
+	return sqxx_shim_sync(f, flags);
+}
+
+extern "C"
+int sqxx_uring_file_size(sqlite3_file *f, sqlite3_int64 *size) {
+	int rv = writer_of(f)->flush();
+	if (rv != SQLITE_OK)
+		return rv;
+	return sqxx_shim_file_size(f, size);
+}
+
+extern "C"
+int sqxx_uring_unlock(sqlite3_file *f, int lock) {
+	// Other processes must see the data once the lock is released
+	int rv = writer_of(f)->flush();
+	if (rv != SQLITE_OK)
+		return rv;
+	return sqxx_shim_unlock(f, lock);
+}
+
+extern "C"
+int sqxx_uring_file_control(sqlite3_file *f, int op, void *arg) {
+	int rv = writer_of(f)->flush();
+	if (rv != SQLITE_OK)
+		return rv;
+	return sqxx_shim_file_control(f, op, arg);
+}
+
+extern "C"
+int sqxx_uring_shm_lock(sqlite3_file *f, int ofs, int n, int flags) {
+	int rv = flush_with_wal(f);
+	if (rv != SQLITE_OK)
+		return rv;
+	return sqxx_shim_shm_lock(f, ofs, n, flags);
+}
+
+extern "C"
+void sqxx_uring_shm_barrier(sqlite3_file *f) {
+	// The wal-index is published to other connections after a barrier, the
+	// frames it refers to have to be written by then. Errors are reported
+	// by the next sync.
+	sqxx::detail::uring_file *file = reinterpret_cast<sqxx::detail::uring_file*>(f);
+	file->writer->flush_deferred();
+	if (file->linked)
+		file->linked->writer->flush_deferred();
+	sqxx_shim_shm_barrier(f);
+}
+
+extern "C"
+int sqxx_uring_fetch(sqlite3_file *f, sqlite3_int64 ofs, int amt, void **pp) {
+	sqxx::detail::uring_writer *w = writer_of(f);
+	if (w->overlaps(ofs, amt)) {
+		int rv = w->flush();
+		if (rv != SQLITE_OK)
+			return rv;
+	}
+	return sqxx_shim_fetch(f, ofs, amt, pp);
+}
+
+extern "C"
+int sqxx_uring_open(sqlite3_vfs *vfs, const char *name, sqlite3_file *f, int flags, int *outflags) {
+	sqxx::detail::uring_file *file = reinterpret_cast<sqxx::detail::uring_file*>(f);
+	file->writer = nullptr;
+	file->name = nullptr;
+	file->linked = nullptr;
+	int rv = sqxx::detail::shim_open(vfs, name, &file->shim, flags, outflags);
+	if (rv != SQLITE_OK || !(flags & (SQLITE_OPEN_MAIN_DB|SQLITE_OPEN_WAL)))
+		return rv;
+
+#if defined(SQXX_HAVE_IO_URING)
+	int fd = sqxx::detail::shim_unix_fd(&file->shim, name);
+	if (fd < 0)
+		return rv;
+
+	sqxx::detail::uring_vfs *uvfs = sqxx::detail::vfs_of(file);
+	const sqxx::vfs_uring_options &opts = uvfs->opts;
+	size_t readahead = ((flags & SQLITE_OPEN_MAIN_DB) ? opts.readahead : 0);
+	std::unique_ptr<sqxx::detail::uring_writer> w;
+	try {
+		w.reset(new sqxx::detail::uring_writer(fd, opts.max_pending, readahead));
+	}
+	catch (const std::bad_alloc&) {
+		return rv;
+	}
+	if (!w->setup(opts.queue_depth))
+		return rv;
+
+	try {
+		std::lock_guard<std::mutex> lock(uvfs->mutex);
+		if (flags & SQLITE_OPEN_MAIN_DB) {
+			if (uvfs->main_files.emplace(name, file).second)
+				file->name = name;
+		}
+		else {
+			// Only batch the log if the wal-index operations of its main
+			// database file flush it
+			auto it = uvfs->main_files.find(sqlite3_filename_database(name));
+			if (it == uvfs->main_files.end() || it->second->linked)
+				return rv;
+			file->linked = it->second;
+			it->second->linked = file;
+		}
+	}
+	catch (const std::bad_alloc&) {
+		return rv;
+	}
+	file->writer = w.release();
+
+	sqlite3_io_methods &m = file->shim.methods;
+	m.xClose = sqxx_uring_close;
+	m.xRead = sqxx_uring_read;
+	m.xWrite = sqxx_uring_write;
+	m.xTruncate = sqxx_uring_truncate;
+	m.xSync = sqxx_uring_sync;
+	m.xFileSize = sqxx_uring_file_size;
+	m.xUnlock = sqxx_uring_unlock;
+	m.xFileControl = sqxx_uring_file_control;
+	if (m.iVersion >= 2) {
+		m.xShmLock = sqxx_uring_shm_lock;
+		m.xShmBarrier = sqxx_uring_shm_barrier;
+	}
+	if (m.iVersion >= 3) {
+		m.xFetch = sqxx_uring_fetch;
+	}
+#endif
+	return rv;
+}
+
+
+namespace sqxx {
+
+bool vfs_uring_available() {
+#if defined(SQXX_HAVE_IO_URING)
+	static const bool available = []() {
+		detail::uring ring;
+		return ring.setup(1);
+	}();
+	return available;
+#else
+	return false;
+#endif
+}
+
+void vfs_uring_register(const char *name, bool makedefault, const vfs_uring_options &opts,
+		const char *base) {
+	std::unique_ptr<detail::uring_vfs> shim(new detail::uring_vfs);
+	shim->opts = opts;
+	if (shim->opts.queue_depth == 0)
+		shim->opts.queue_depth = 1;
+	detail::shim_register(std::move(shim), name, base, sizeof(detail::uring_file),
+			sqxx_uring_open, makedefault);
+}
+
+void vfs_uring_unregister(const char *name) {
+	detail::shim_unregister(name);
+}
+
+} // namespace sqxx
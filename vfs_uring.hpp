@@ -0,0 +1,64 @@
+
+#if !defined(SQXX_VFS_URING_HPP_INCLUDED)
+#define SQXX_VFS_URING_HPP_INCLUDED
+
+#include <cstddef>
+
+namespace sqxx {
+
+/** Tuning parameters for `vfs_uring_register()` */
+struct vfs_uring_options {
+	/** Submission queue size of the ring used for each batched file */
+	unsigned queue_depth = 64;
+	/** Amount of buffered writes (in bytes) after which they are submitted even without a sync */
+	size_t max_pending = 16 * 1024 * 1024;
+	/**
+	 * Window (in bytes) that is requested from the kernel ahead of sequential
+	 * reads of the main database file. `0` disables readahead.
+	 */
+	size_t readahead = 0;
+};
+
+/**
+ * Determine if io_uring can be used on this system.
+ *
+ * Returns `false` if sqxx was built without io_uring support or if the
+ * kernel doesn't provide it (or forbids its use).
+ */
+bool vfs_uring_available();
+
+/**
+ * Register a VFS that batches writes with io_uring (Linux only).
+ *
+ * The VFS is a shim on top of the VFS `base` (the default VFS if `base` is
+ * `nullptr`), which must be one of sqlite's builtin "unix" VFSes for the
+ * batching to be used. Writes to the main database file and to the
+ * write-ahead log are collected in memory and submitted as one batch of
+ * vectored writes when sqlite syncs the file, releases a lock or needs
+ * the data for some other reason. This lets checkpoints and transactions
+ * that touch many scattered pages use the parallelism of the device instead of
+ * issuing one blocking `pwrite()` per page. Optionally readahead is submitted
+ * asynchronously for sequential reads.
+ *
+ * If io_uring isn't available, the VFS is registered anyway and behaves
+ * exactly like the underlying VFS, so that databases can be opened with
+ * it unconditionally.
+ *
+ *     sqxx::vfs_uring_register();
+ *     sqxx::connection conn("data.db", sqxx::OPEN_READWRITE|sqxx::OPEN_CREATE, "sqxx-uring");
+ *
+ * Throws if a VFS with the same name was already registered by sqxx.
+ */
+void vfs_uring_register(const char *name = "sqxx-uring", bool makedefault = false,
+		const vfs_uring_options &opts = vfs_uring_options(), const char *base = nullptr);
+
+/**
+ * Unregister a VFS registered by `vfs_uring_register()`.
+ *
+ * No database connections using the VFS may be open anymore.
+ */
+void vfs_uring_unregister(const char *name = "sqxx-uring");
+
+} // namespace sqxx
+
+#endif // SQXX_VFS_URING_HPP_INCLUDED